@@ -0,0 +1,80 @@
+/*
+ * aead.cpp: Sealing batches of small AEAD records, one at a time vs. the batch interface, and one large record
+ *           on several threads.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20/aead.hpp>
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+    constexpr size_t NUM_RECORDS = 64;
+    constexpr size_t AAD_SIZE    = 13;
+}  // namespace
+
+BENCHMARK ("aead: seal 64 records, single vs. batch") {
+    const std::string          key {"0123456789abcdef0123456789abcdef"};
+    const std::vector<uint8_t> aad (AAD_SIZE, 0x17);
+    for (size_t size : {64u, 256u, 576u, 1024u}) {
+        bench::section (fmt::format ("{} B records", size));
+        std::vector<std::vector<uint8_t>> plain (NUM_RECORDS, std::vector<uint8_t> (size, 0x5A));
+        std::vector<std::vector<uint8_t>> cipher (NUM_RECORDS, std::vector<uint8_t> (size));
+        std::vector<ChaCha::AEAD::Record> records (NUM_RECORDS);
+        for (size_t i = 0; i < NUM_RECORDS; ++i) {
+            const std::array<uint8_t, 12> nonce {static_cast<uint8_t> (i), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+            auto &r    = records[i];
+            r.state    = ChaCha::RFC7539::State {key.data (), key.size (), nonce.data (), nonce.size ()};
+            r.aad      = aad.data ();
+            r.aad_size = aad.size ();
+            r.in       = plain[i].data ();
+            r.out      = cipher[i].data ();
+            r.size     = size;
+        }
+        bench::report (bench::measure ("single", NUM_RECORDS * size, [&] () {
+            for (auto &r : records) {
+                r.tag = ChaCha::AEAD::seal (r.state, r.out, r.in, r.size, r.aad, r.aad_size);
+            }
+            bench::do_not_optimize (records.data ());
+        }));
+        bench::report (bench::measure ("batch", NUM_RECORDS * size, [&] () {
+            ChaCha::AEAD::seal (records.data (), records.size ());
+            bench::do_not_optimize (records.data ());
+        }));
+    }
+}
+
+BENCHMARK ("aead: seal one 64 MiB record over threads") {
+    const std::string             key {"0123456789abcdef0123456789abcdef"};
+    const std::array<uint8_t, 12> nonce {};
+    const std::vector<uint8_t>    aad (AAD_SIZE, 0x17);
+    const ChaCha::RFC7539::State  state {key.data (), key.size (), nonce.data (), nonce.size ()};
+    std::vector<uint8_t>          plain (64 * 1024 * 1024, 0x5A);
+    std::vector<uint8_t>          cipher (plain.size ());
+    size_t const                  hw = std::max<size_t> (std::thread::hardware_concurrency (), 1);
+
+    bench::report (bench::measure ("Poly1305", plain.size (), [&] () {
+        bench::do_not_optimize (ChaCha::Poly1305::authenticate (key.data (), plain.data (), plain.size ()));
+    }));
+    bench::report (bench::measure ("seal", plain.size (), [&] () {
+        bench::do_not_optimize (ChaCha::AEAD::seal (state, cipher.data (), plain.data (), plain.size (), aad.data (), aad.size ()));
+    }));
+    for (size_t threads = 1; threads <= std::max<size_t> (hw, 4); threads *= 2) {
+        bench::section (fmt::format ("{} threads", threads));
+        bench::report (bench::measure ("Poly1305::authenticate_parallel", plain.size (), [&] () {
+            bench::do_not_optimize (ChaCha::Poly1305::authenticate_parallel (key.data (), plain.data (), plain.size (), threads));
+        }));
+        bench::report (bench::measure ("parallel_seal", plain.size (), [&] () {
+            auto const &tag = ChaCha::AEAD::parallel_seal (state, cipher.data (), plain.data (), plain.size (), aad.data (), aad.size (), threads);
+            bench::do_not_optimize (tag);
+        }));
+    }
+}
@@ -0,0 +1,50 @@
+/*
+ * apply.cpp: Every `ChaCha::apply` overload on every kernel, for reading next to the performance counters.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/tuning.hpp>
+
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+BENCHMARK ("apply: overloads per kernel") {
+    using ChaCha::Tuning::Backend;
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+
+    ChaCha::DJB::State state {key.data (), key.size (), 0};
+    for (size_t size : {4096u, 256u * 1024u}) {
+        std::vector<uint8_t> in (size + 64, 0x5A);
+        std::vector<uint8_t> out (size + 64);
+        for (auto b : {Backend::SCALAR, Backend::SSE2, Backend::SSSE3, Backend::AVX2, Backend::AVX512}) {
+            if (! ChaCha::Tuning::available (b)) {
+                continue;
+            }
+            ChaCha::Tuning::ThreadOverride pin {b};
+            bench::section (fmt::format ("{}, {} KiB", ChaCha::Tuning::to_string (b), size / 1024));
+            bench::report (bench::measure ("apply (out, in)", size, [&] () {
+                state.setSequence (0);
+                ChaCha::apply (state, out.data (), in.data (), size);
+                bench::do_not_optimize (out.data ());
+            }));
+            bench::report (bench::measure ("apply (in place)", size, [&] () {
+                state.setSequence (0);
+                ChaCha::apply (state, out.data (), size);
+                bench::do_not_optimize (out.data ());
+            }));
+            bench::report (bench::measure ("apply (out, in, offset)", size, [&] () {
+                ChaCha::apply (state, out.data (), in.data (), size, 64);
+                bench::do_not_optimize (out.data ());
+            }));
+            bench::report (bench::measure ("apply (out, in, unaligned offset)", size, [&] () {
+                ChaCha::apply (state, out.data (), in.data (), size, 13);
+                bench::do_not_optimize (out.data ());
+            }));
+        }
+    }
+}
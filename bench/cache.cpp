@@ -0,0 +1,56 @@
+/*
+ * cache.cpp: Small overlapping random-access reads with and without a `BlockCache`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20/block-cache.hpp>
+#include <chacha20/state-rfc7539.hpp>
+
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+    constexpr size_t NUM_READS = 1024;
+}  // namespace
+
+BENCHMARK ("cache: 8-48 B reads at random offsets") {
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+    const std::string nonce {"0123456789ab"};
+    for (size_t region : {4096u, 65536u, 1048576u}) {
+        bench::section (fmt::format ("{} KiB region", region / 1024));
+        std::vector<uint8_t>                   data (region, 0x5A);
+        std::vector<std::pair<size_t, size_t>> reads;
+        std::mt19937                           rng {1234};
+        std::uniform_int_distribution<size_t>  size_dist {8, 48};
+        size_t                                 bytes = 0;
+        for (size_t i = 0; i < NUM_READS; ++i) {
+            auto size = size_dist (rng);
+            reads.emplace_back (std::uniform_int_distribution<size_t> {0, region - size} (rng), size);
+            bytes += size;
+        }
+        std::vector<uint8_t>   buf (64);
+        ChaCha::RFC7539::State S {key.data (), key.size (), nonce.data (), nonce.size ()};
+        ChaCha::BlockCache     cache {4096};
+
+        bench::report (bench::measure ("uncached", bytes, [&] () {
+            for (auto const &r : reads) {
+                ChaCha::apply (S, buf.data (), data.data () + r.first, r.second, r.first);
+            }
+            bench::do_not_optimize (buf.data ());
+        }));
+        bench::report (bench::measure ("cached", bytes, [&] () {
+            for (auto const &r : reads) {
+                ChaCha::apply (cache, S, buf.data (), data.data () + r.first, r.second, r.first);
+            }
+            bench::do_not_optimize (buf.data ());
+        }));
+        auto stats = cache.statistics ();
+        fmt::print ("  hit rate {:.1f}% ({} evictions)\n", 100.0 * stats.hits / (stats.hits + stats.misses), stats.evictions);
+    }
+}
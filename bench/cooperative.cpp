@@ -0,0 +1,85 @@
+/*
+ * cooperative.cpp: Latency of small requests served while a large encryption is in progress.
+ *
+ * A single-threaded reactor is simulated: small requests (1 KiB) arrive on a fixed schedule and are
+ * served as soon as the loop gets control back, while one large buffer is encrypted either in one call
+ * or in slices with `ChaCha::apply_cooperatively`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20/cooperative.hpp>
+#include <chacha20/state-rfc7539.hpp>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+    constexpr size_t LARGE_SIZE = 64u * 1024u * 1024u;
+    constexpr size_t SMALL_SIZE = 1024u;
+
+    struct Outcome {
+        std::vector<double> latencies; /* microseconds */
+        double              large_seconds = 0;
+    };
+
+    Outcome run_reactor (size_t budget, std::chrono::nanoseconds interval, size_t num_requests) {
+        const std::string      key {"0123456789abcdef0123456789abcdef"};
+        ChaCha::RFC7539::State large_state {key.data (), key.size ()};
+        ChaCha::RFC7539::State small_state {key.data (), key.size ()};
+
+        std::vector<uint8_t> large (LARGE_SIZE, 0x5A);
+        std::vector<uint8_t> small (SMALL_SIZE, 0xA5);
+
+        Outcome result;
+        result.latencies.reserve (num_requests);
+
+        auto task  = ChaCha::apply_cooperatively (large_state, large.data (), large.size (), budget);
+        auto start = bench::clock_t::now ();
+        auto large_done = start;
+        size_t next = 0;
+        while (next < num_requests || ! task.done ()) {
+            auto now = bench::clock_t::now ();
+            while (next < num_requests && start + next * interval <= now) {
+                ChaCha::apply (small_state, small.data (), small.size ());
+                auto finished = bench::clock_t::now ();
+                result.latencies.push_back (std::chrono::duration<double, std::micro> (finished - (start + next * interval)).count ());
+                ++next;
+            }
+            if (! task.done ()) {
+                if (! task.resume ()) {
+                    large_done = bench::clock_t::now ();
+                }
+            }
+        }
+        bench::do_not_optimize (large.data ());
+        bench::do_not_optimize (small.data ());
+        result.large_seconds = std::chrono::duration<double> (large_done - start).count ();
+        return result;
+    }
+}  // namespace
+
+BENCHMARK ("cooperative: small request latency during a 64 MiB apply") {
+    // Size the request stream to the duration of the unsliced encryption.
+    auto const blocking = run_reactor (std::numeric_limits<size_t>::max (), std::chrono::microseconds (50), 1);
+    auto const interval = std::chrono::microseconds (50);
+    auto const count    = static_cast<size_t> (blocking.large_seconds * 1.25 / 50e-6) + 1;
+
+    fmt::print ("  {} requests of {} B, one every {} us\n", count, SMALL_SIZE, interval.count ());
+    fmt::print ("  {:<16} {:>10} {:>10} {:>10} {:>10} {:>12}\n", "slice", "p50 us", "p99 us", "p99.9 us", "max us", "large ms");
+    for (size_t budget : {std::numeric_limits<size_t>::max (), size_t {1024 * 1024}, size_t {256 * 1024}, size_t {64 * 1024}, size_t {16 * 1024}}) {
+        auto r     = run_reactor (budget, interval, count);
+        auto label = budget == std::numeric_limits<size_t>::max () ? std::string {"unsliced"} : fmt::format ("{} KiB", budget / 1024);
+        fmt::print ("  {:<16} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>12.2f}\n",
+                    label,
+                    bench::percentile (r.latencies, 50),
+                    bench::percentile (r.latencies, 99),
+                    bench::percentile (r.latencies, 99.9),
+                    bench::percentile (r.latencies, 100),
+                    1e3 * r.large_seconds);
+    }
+}
@@ -0,0 +1,44 @@
+/*
+ * fields.cpp: Encrypting one 16-byte field of each 128-byte record, per field vs. `apply_fields`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/fields.hpp>
+
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+BENCHMARK ("fields: 16-byte field of 1M 128-byte records") {
+    constexpr size_t RECORDS = 1024 * 1024;
+    constexpr size_t STRIDE  = 128;
+    constexpr size_t FIELD   = 16;
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+
+    std::vector<uint8_t> table (RECORDS * STRIDE, 0x5A);
+    std::vector<uint8_t> bulk (RECORDS * FIELD, 0x5A);
+    ChaCha::RecordLayout layout {STRIDE, {{32, FIELD}}};
+
+    // Throughput is of the selected bytes (16 MiB).
+    bench::report (bench::measure ("apply per field", RECORDS * FIELD, [&] () {
+        ChaCha::DJB::State state {key.data (), key.size (), 0};
+        for (size_t r = 0; r < RECORDS; ++r) {
+            ChaCha::apply (state, table.data () + r * STRIDE + 32, FIELD);
+        }
+        bench::do_not_optimize (table.data ());
+    }));
+    bench::report (bench::measure ("apply_fields", RECORDS * FIELD, [&] () {
+        ChaCha::DJB::State state {key.data (), key.size (), 0};
+        ChaCha::apply_fields (state, table.data (), RECORDS, layout);
+        bench::do_not_optimize (table.data ());
+    }));
+    bench::report (bench::measure ("apply on the gathered bytes", RECORDS * FIELD, [&] () {
+        ChaCha::DJB::State state {key.data (), key.size (), 0};
+        ChaCha::apply (state, bulk.data (), bulk.size ());
+        bench::do_not_optimize (bulk.data ());
+    }));
+}
@@ -0,0 +1,129 @@
+/*
+ * harness.hpp: Minimal benchmark harness.
+ *
+ * Measurements carry the hardware counters of the measuring thread where Linux lets us read them (perf.cpp);
+ * elsewhere they are wall-clock only.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+    using clock_t = std::chrono::steady_clock;
+
+    /// @brief Registered benchmark.
+    struct Benchmark {
+        std::string           name;
+        std::function<void ()> fn;
+    };
+
+    std::vector<Benchmark> &registry ();
+
+    /// @brief Registers a benchmark at static initialization time.
+    struct Register {
+        Register (std::string name, std::function<void ()> fn) { registry ().push_back ({std::move (name), std::move (fn)}); }
+    };
+
+    /// @brief Performance counter totals over a measurement (NaN: not available on this host).
+    struct Counters {
+        double cycles        = std::numeric_limits<double>::quiet_NaN ();
+        double instructions  = std::numeric_limits<double>::quiet_NaN ();
+        double l1d_misses    = std::numeric_limits<double>::quiet_NaN ();
+        double llc_misses    = std::numeric_limits<double>::quiet_NaN ();
+        double branch_misses = std::numeric_limits<double>::quiet_NaN ();
+        double task_clock_ns = std::numeric_limits<double>::quiet_NaN (); /* CPU time */
+
+        std::vector<std::pair<std::string, double>> extra; /* `BENCH_PERF_EVENTS` */
+
+        /// @brief `true` if the hardware counters could be read (`false` in most containers and VMs).
+        [[nodiscard]] bool available () const;
+    };
+
+    /// @brief Starts counting on the calling thread (`BENCH_PERF=0` disables the counters).
+    void counters_start ();
+
+    /// @brief The counts since `counters_start`.
+    Counters counters_stop ();
+
+    /// @brief The events being counted, or why there are none.
+    std::string counters_status ();
+
+    /// @brief Result of a throughput measurement.
+    struct Measurement {
+        std::string label;
+        size_t      bytes      = 0; /* bytes processed per iteration */
+        size_t      iterations = 0;
+        double      seconds    = 0;
+        Counters    counters   = {}; /* over all the iterations */
+
+        [[nodiscard]] double bytesPerSecond () const { return seconds <= 0 ? 0 : static_cast<double> (bytes * iterations) / seconds; }
+        [[nodiscard]] double nsPerIteration () const { return iterations == 0 ? 0 : 1e9 * seconds / static_cast<double> (iterations); }
+    };
+
+    /// @brief Minimum measuring time per measurement (seconds), `BENCH_MIN_TIME` overrides.
+    double min_time ();
+
+    /// @brief Calls `fn` repeatedly for at least `min_time ()` seconds.
+    template<typename Fn_>
+    Measurement measure (std::string label, size_t bytes, Fn_ &&fn) {
+        Measurement m {std::move (label), bytes, 0, 0, {}};
+        // Warm up (and calibrate the batch size).
+        size_t batch = 1;
+        {
+            auto start = clock_t::now ();
+            fn ();
+            auto dt = std::chrono::duration<double> (clock_t::now () - start).count ();
+            if (0 < dt) {
+                batch = std::clamp<size_t> (static_cast<size_t> (min_time () / 20 / dt), 1, 1u << 20u);
+            }
+        }
+        counters_start ();
+        auto start = clock_t::now ();
+        do {
+            for (size_t i = 0; i < batch; ++i) {
+                fn ();
+            }
+            m.iterations += batch;
+            m.seconds = std::chrono::duration<double> (clock_t::now () - start).count ();
+        } while (m.seconds < min_time ());
+        m.counters = counters_stop ();
+        return m;
+    }
+
+    /// @brief Prints a measurement as a table row (with the counters per byte, when available).
+    void report (const Measurement &m);
+
+    /// @brief Prints a section header.
+    void section (const std::string &title);
+
+    /// @brief `p`th percentile (0 <= p <= 100) of `samples` (sorts `samples`).
+    double percentile (std::vector<double> &samples, double p);
+
+    /// @brief Keeps the compiler from discarding `value`.
+    template<typename T_>
+    void do_not_optimize (T_ const &value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile ("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void *sink;
+        sink = &value;
+#endif
+    }
+}  // namespace bench
+
+#define BENCH_CONCAT_(a_, b_) a_##b_
+#define BENCH_CONCAT(a_, b_)  BENCH_CONCAT_ (a_, b_)
+#define BENCHMARK(name_)                                                                         \
+    static void                   BENCH_CONCAT (bench_fn_, __LINE__) ();                         \
+    static const bench::Register BENCH_CONCAT (bench_reg_, __LINE__) {name_, &BENCH_CONCAT (bench_fn_, __LINE__)}; \
+    static void                   BENCH_CONCAT (bench_fn_, __LINE__) ()
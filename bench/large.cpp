@@ -0,0 +1,80 @@
+/*
+ * large.cpp: `ChaCha::apply` throughput against buffer size, across the L2 / LLC / DRAM boundaries,
+ *            with and without the large-buffer path (prefetch + non-temporal stores).
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/tuning.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include <fmt/format.h>
+
+namespace {
+    /// @brief Largest buffer to measure (`BENCH_LARGE_MAX` overrides, in MiB).
+    size_t max_size () {
+        if (auto const *s = ::getenv ("BENCH_LARGE_MAX"); s != nullptr) {
+            return std::strtoull (s, nullptr, 10) * 1024 * 1024;
+        }
+        return 1024 * 1024 * 1024;
+    }
+
+    /// @brief Page-aligned, pre-faulted buffer.
+    struct Buffer {
+        std::unique_ptr<uint8_t[]> storage;
+        uint8_t *                  data;
+
+        explicit Buffer (size_t size) : storage {new uint8_t[size + 4096]} {
+            data = storage.get () + (4096 - reinterpret_cast<uintptr_t> (storage.get ()) % 4096) % 4096;
+            for (size_t i = 0; i < size; i += 4096) {
+                data[i] = static_cast<uint8_t> (i);
+            }
+        }
+    };
+}  // namespace
+
+BENCHMARK ("large: GB/s against buffer size") {
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+
+    auto const &saved  = ChaCha::Tuning::current_plan ();
+    auto        cached = saved;
+    auto        large  = saved;
+    cached.large_min_size = ChaCha::Tuning::NEVER;
+    large.large_min_size  = 0;
+    ::printf ("large-buffer path by default from %zu bytes, prefetching %zu bytes ahead\n", saved.large_min_size, saved.prefetch_distance);
+
+    size_t const       limit = max_size ();
+    Buffer             src {limit};
+    Buffer             dst {limit};
+    ChaCha::DJB::State state {key.data (), key.size (), 0};
+    auto               run = [&] (const std::string &label, size_t size, uint8_t *out) {
+        return bench::measure (label, size, [&] () {
+            state.setSequence (0);
+            ChaCha::apply (state, out, src.data, size);
+            bench::do_not_optimize (out);
+        });
+    };
+    for (size_t size = 256 * 1024; size <= limit; size *= 4) {
+        bench::section (fmt::format ("{} KiB", size / 1024));
+        ChaCha::Tuning::install (cached);
+        bench::report (run ("cached stores", size, dst.data));
+        bench::report (run ("cached stores, in place", size, src.data));
+        ChaCha::Tuning::install (large);
+        bench::report (run ("large-buffer path", size, dst.data));
+        bench::report (run ("large-buffer path, in place", size, src.data));
+    }
+
+    bench::section (fmt::format ("prefetch distance, {} KiB", limit / 1024));
+    for (size_t distance : {0, 256, 1024, 4096, 16384}) {
+        large.prefetch_distance = distance;
+        ChaCha::Tuning::install (large);
+        bench::report (run (fmt::format ("{} bytes ahead", distance), limit, dst.data));
+    }
+    ChaCha::Tuning::install (saved);
+}
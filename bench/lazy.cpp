@@ -0,0 +1,69 @@
+/*
+ * lazy.cpp: Sparse reads of an encrypted file, decrypted up front vs. mapped with `LazyMapping`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/lazy-mapping.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+    constexpr size_t FILE_SIZE = 256u * 1024u * 1024u;
+    constexpr size_t PAGE_SIZE = 4096;
+}  // namespace
+
+BENCHMARK ("lazy: sparse reads of a 256 MiB encrypted file") {
+    if (! ChaCha::LazyMapping::supported ()) {
+        fmt::print ("  userfaultfd is not available\n");
+        return;
+    }
+    const std::string  key {"0123456789abcdef0123456789abcdef"};
+    ChaCha::DJB::State state {key.data (), key.size (), 0};
+
+    const std::string path {"bench-chacha20-lazy.bin"};
+    {
+        std::vector<uint8_t> buf (FILE_SIZE, 0x5A);
+        auto                 S = state;
+        ChaCha::apply (S, buf.data (), buf.size ());
+        std::ofstream out {path, std::ios::binary};
+        out.write (reinterpret_cast<const char *> (buf.data ()), static_cast<std::streamsize> (buf.size ()));
+    }
+    std::vector<uint8_t> plain (FILE_SIZE);
+    for (size_t permille : {1u, 10u, 100u}) {
+        bench::section (fmt::format ("{:.1f}% of the pages", static_cast<double> (permille) / 10));
+        std::mt19937_64     gen {1};
+        std::vector<size_t> pages (FILE_SIZE / PAGE_SIZE * permille / 1000);
+        for (auto &p : pages) {
+            p = std::uniform_int_distribution<size_t> {0, FILE_SIZE / PAGE_SIZE - 1}(gen);
+        }
+        bench::report (bench::measure ("read + apply (whole file)", FILE_SIZE, [&] () {
+            std::ifstream in {path, std::ios::binary};
+            in.read (reinterpret_cast<char *> (plain.data ()), static_cast<std::streamsize> (plain.size ()));
+            auto S = state;
+            ChaCha::apply (S, plain.data (), plain.size ());
+            uint64_t sum = 0;
+            for (auto p : pages) {
+                sum += plain[p * PAGE_SIZE];
+            }
+            bench::do_not_optimize (sum);
+        }));
+        bench::report (bench::measure ("LazyMapping", FILE_SIZE, [&] () {
+            ChaCha::LazyMapping m {path, state};
+            uint64_t            sum = 0;
+            for (auto p : pages) {
+                sum += m.data ()[p * PAGE_SIZE];
+            }
+            bench::do_not_optimize (sum);
+        }));
+    }
+    std::remove (path.c_str ());
+}
@@ -0,0 +1,108 @@
+/*
+ * main.cpp: Benchmark driver.
+ *
+ * Usage: bench-chacha20 [--list] [FILTER...]
+ *   Runs every benchmark whose name contains one of FILTERs (all of them when omitted).
+ *
+ * Environment:
+ *   BENCH_MIN_TIME     Minimum measuring time per row (seconds)
+ *   BENCH_PERF=0       Wall-clock only (no performance counters)
+ *   BENCH_PERF_EVENTS  Extra raw events as `name=rUUEE,...` (e.g. execution port or frequency licence events)
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+#include <fmt/format.h>
+
+namespace bench {
+    std::vector<Benchmark> &registry () {
+        static std::vector<Benchmark> benchmarks;
+        return benchmarks;
+    }
+
+    double min_time () {
+        static const double value = [] () {
+            if (auto const *s = std::getenv ("BENCH_MIN_TIME")) {
+                return std::max (0.001, std::atof (s));
+            }
+            return 0.25;
+        }();
+        return value;
+    }
+
+    namespace {
+        std::string cell (double value, int width, int precision) {
+            if (std::isnan (value)) {
+                return fmt::format ("{:>{}}", "-", width);
+            }
+            return fmt::format ("{:>{}.{}f}", value, width, precision);
+        }
+    }  // namespace
+
+    void report (const Measurement &m) {
+        fmt::print ("  {:<40} {:>10} B {:>12.1f} ns {:>9.3f} GB/s", m.label, m.bytes, m.nsPerIteration (), m.bytesPerSecond () / 1e9);
+        auto const &c = m.counters;
+        if (c.available ()) {
+            auto const bytes = static_cast<double> (m.bytes * m.iterations);
+            auto const kib   = bytes / 1024;
+            fmt::print (" {} c/B {} IPC {} GHz {} L1d/KiB {} LLC/KiB {} br/KiB", cell (c.cycles / bytes, 7, 3),
+                        cell (c.instructions / c.cycles, 5, 2), cell (c.cycles / c.task_clock_ns, 5, 2), cell (c.l1d_misses / kib, 7, 2),
+                        cell (c.llc_misses / kib, 7, 3), cell (c.branch_misses / kib, 6, 3));
+            for (auto const &[name, value] : c.extra) {
+                fmt::print (" {} {}/KiB", cell (value / kib, 8, 2), name);
+            }
+        }
+        fmt::print ("\n");
+    }
+
+    void section (const std::string &title) { fmt::print ("\n{}\n", title); }
+
+    double percentile (std::vector<double> &samples, double p) {
+        if (samples.empty ()) {
+            return 0;
+        }
+        std::sort (samples.begin (), samples.end ());
+        auto idx = static_cast<size_t> (p / 100.0 * static_cast<double> (samples.size () - 1) + 0.5);
+        return samples[std::min (idx, samples.size () - 1)];
+    }
+}  // namespace bench
+
+int main (int argc, char **argv) {
+    std::vector<std::string> filters;
+    bool                     list = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg {argv[i]};
+        if (arg == "--list") {
+            list = true;
+        }
+        else {
+            filters.push_back (std::move (arg));
+        }
+    }
+    auto selected = [&filters] (const std::string &name) {
+        if (filters.empty ()) {
+            return true;
+        }
+        return std::any_of (filters.begin (), filters.end (), [&name] (auto const &f) { return name.find (f) != std::string::npos; });
+    };
+    if (! list) {
+        fmt::print ("counters: {}\n", bench::counters_status ());
+    }
+    for (auto const &b : bench::registry ()) {
+        if (! selected (b.name)) {
+            continue;
+        }
+        if (list) {
+            fmt::print ("{}\n", b.name);
+            continue;
+        }
+        bench::section (b.name);
+        b.fn ();
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * perf.cpp: Hardware performance counters of the calling thread (Linux `perf_event_open`).
+ *
+ * Every event is opened on its own (not as a group), so that a host lacking some of them (VMs rarely expose
+ * the cache events) still reports the others; the kernel multiplexes them when they outnumber the PMU
+ * counters, and the values are scaled by enabled / running time.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#ifdef __linux__
+#    include <linux/perf_event.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
+
+namespace bench {
+    namespace {
+        constexpr double NA = std::numeric_limits<double>::quiet_NaN ();
+
+        /// @brief Events reported for every measurement, in the order of the `Counters` fields.
+        enum Fixed : size_t { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, TASK_CLOCK, NUM_FIXED };
+
+#ifdef __linux__
+        struct Event {
+            std::string name;
+            int         fd = -1;
+        };
+
+        /// @brief Raw counter value and enabled / running times.
+        struct Sample {
+            uint64_t value   = 0;
+            uint64_t enabled = 0;
+            uint64_t running = 0;
+        };
+
+        uint64_t cache_event (uint64_t cache, uint64_t op, uint64_t result) { return cache | (op << 8u) | (result << 16u); }
+
+        int open_event (uint32_t type, uint64_t config) {
+            perf_event_attr attr {};
+            attr.size           = sizeof (attr);
+            attr.type           = type;
+            attr.config         = config;
+            attr.exclude_kernel = 1; /* works with perf_event_paranoid <= 2 */
+            attr.exclude_hv     = 1;
+            attr.inherit        = 1; /* threads spawned by the measured code count as well */
+            attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            return static_cast<int> (::syscall (SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        }
+
+        /// @brief The counters of one thread (opened on first use, enabled all the time).
+        class Session {
+            std::vector<Event>  events_;
+            std::vector<Sample> start_;
+            std::string         status_;
+
+        public:
+            Session () {
+                if (auto const *s = std::getenv ("BENCH_PERF"); s != nullptr && std::string {s} == "0") {
+                    status_ = "disabled (BENCH_PERF=0)";
+                    return;
+                }
+                events_.resize (NUM_FIXED);
+                events_[CYCLES]        = {"cycles", open_event (PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES)};
+                auto const err         = errno;
+                events_[INSTRUCTIONS]  = {"instructions", open_event (PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS)};
+                events_[L1D_MISSES]    = {"L1d misses",
+                                       open_event (PERF_TYPE_HW_CACHE,
+                                                   cache_event (PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                                                                PERF_COUNT_HW_CACHE_RESULT_MISS))};
+                events_[LLC_MISSES]    = {"LLC misses",
+                                       open_event (PERF_TYPE_HW_CACHE,
+                                                   cache_event (PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                                                                PERF_COUNT_HW_CACHE_RESULT_MISS))};
+                events_[BRANCH_MISSES] = {"branch misses", open_event (PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES)};
+                events_[TASK_CLOCK]    = {"task clock", open_event (PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK)};
+                // Model specific events, e.g. `BENCH_PERF_EVENTS=p0=r01a1,p1=r02a1` (execution port dispatch on Skylake).
+                if (auto const *s = std::getenv ("BENCH_PERF_EVENTS")) {
+                    std::string spec {s};
+                    size_t      pos = 0;
+                    while (pos < spec.size ()) {
+                        auto end = spec.find (',', pos);
+                        if (end == std::string::npos) {
+                            end = spec.size ();
+                        }
+                        auto const item = spec.substr (pos, end - pos);
+                        auto const eq   = item.find ('=');
+                        auto const name = eq == std::string::npos ? item : item.substr (0, eq);
+                        auto const code = eq == std::string::npos ? item : item.substr (eq + 1);
+                        if (! code.empty () && code[0] == 'r') {
+                            events_.push_back ({name, open_event (PERF_TYPE_RAW, std::strtoull (code.c_str () + 1, nullptr, 16))});
+                        }
+                        pos = end + 1;
+                    }
+                }
+                start_.resize (events_.size ());
+
+                std::string opened;
+                for (auto const &e : events_) {
+                    if (0 <= e.fd) {
+                        opened += (opened.empty () ? "" : ", ") + e.name;
+                    }
+                }
+                if (events_[CYCLES].fd < 0) {
+                    status_ = fmt::format ("no hardware counters ({}), {}", std::strerror (err), opened.empty () ? "wall-clock only" : opened);
+                }
+                else {
+                    status_ = opened;
+                }
+            }
+
+            ~Session () {
+                for (auto const &e : events_) {
+                    if (0 <= e.fd) {
+                        ::close (e.fd);
+                    }
+                }
+            }
+
+            Session (const Session &) = delete;
+            Session &operator= (const Session &) = delete;
+
+            [[nodiscard]] const std::string &status () const { return status_; }
+
+            void start () {
+                for (size_t i = 0; i < events_.size (); ++i) {
+                    start_[i] = read (events_[i]);
+                }
+            }
+
+            Counters stop () const {
+                std::vector<double> values (events_.size (), NA);
+                for (size_t i = 0; i < events_.size (); ++i) {
+                    if (events_[i].fd < 0) {
+                        continue;
+                    }
+                    auto const s       = read (events_[i]);
+                    auto const running = s.running - start_[i].running;
+                    if (running == 0) {
+                        continue; /* never scheduled on the PMU */
+                    }
+                    auto const scale = static_cast<double> (s.enabled - start_[i].enabled) / static_cast<double> (running);
+                    values[i]        = scale * static_cast<double> (s.value - start_[i].value);
+                }
+                Counters result;
+                if (NUM_FIXED <= values.size ()) {
+                    result.cycles        = values[CYCLES];
+                    result.instructions  = values[INSTRUCTIONS];
+                    result.l1d_misses    = values[L1D_MISSES];
+                    result.llc_misses    = values[LLC_MISSES];
+                    result.branch_misses = values[BRANCH_MISSES];
+                    result.task_clock_ns = values[TASK_CLOCK];
+                }
+                for (size_t i = NUM_FIXED; i < values.size (); ++i) {
+                    result.extra.emplace_back (events_[i].name, values[i]);
+                }
+                return result;
+            }
+
+        private:
+            static Sample read (const Event &e) {
+                Sample s;
+                if (0 <= e.fd && ::read (e.fd, &s, sizeof (s)) != static_cast<ssize_t> (sizeof (s))) {
+                    s = Sample {};
+                }
+                return s;
+            }
+        };
+#else
+        class Session {
+        public:
+            [[nodiscard]] std::string status () const { return "not supported on this platform, wall-clock only"; }
+            void                      start () {}
+            [[nodiscard]] Counters    stop () const { return {}; }
+        };
+#endif
+
+        Session &session () {
+            thread_local Session s;
+            return s;
+        }
+    }  // namespace
+
+    bool Counters::available () const { return ! std::isnan (cycles); }
+
+    void counters_start () { session ().start (); }
+
+    Counters counters_stop () { return session ().stop (); }
+
+    std::string counters_status () { return session ().status (); }
+}  // namespace bench
@@ -0,0 +1,148 @@
+/*
+ * policy.cpp: Kernel selection policies under a mixed workload.
+ *
+ * A crypto thread encrypts a packet-sized traffic mix with occasional bulk transfers while a scalar task
+ * (hash-table updates) runs interleaved on the same thread, or concurrently on another one.  Reports both
+ * the crypto throughput and the throughput of the scalar task, which is what wide kernels used on small
+ * messages cost (frequency licence, warm-up).
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/tuning.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+    using ChaCha::Tuning::Backend;
+
+    /// @brief Packet sizes: mostly 64 .. 1500 bytes, one 64 KiB transfer in 32 messages.
+    std::vector<size_t> traffic (size_t count) {
+        std::mt19937_64                       gen {1};
+        std::uniform_int_distribution<size_t> small {64, 1500};
+        std::vector<size_t>                   result (count);
+        for (size_t i = 0; i < count; ++i) {
+            result[i] = i % 32 == 31 ? 64 * 1024 : small (gen);
+        }
+        return result;
+    }
+
+    /// @brief The scalar task: `n` updates of an open-addressing table.
+    struct ScalarTask {
+        std::vector<uint64_t> table = std::vector<uint64_t> (1u << 14u);
+        uint64_t              x     = 0x9E3779B97F4A7C15ull;
+
+        void run (size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                x ^= x << 13u;
+                x ^= x >> 7u;
+                x ^= x << 17u;
+                auto &slot = table[(x * 0xBF58476D1CE4E5B9ull) >> 50u];
+                slot += x | 1u;
+            }
+            bench::do_not_optimize (table.data ());
+        }
+    };
+
+    struct Policy {
+        std::string            label;
+        std::optional<Backend> pinned;
+        size_t                 avx512_engage;
+    };
+
+    void print (const std::string &label, double crypto_bps, double scalar_ops) {
+        fmt::print ("  {:<40} {:>9.3f} GB/s {:>10.1f} Mop/s (scalar)\n", label, crypto_bps / 1e9, scalar_ops / 1e6);
+    }
+}  // namespace
+
+BENCHMARK ("policy: mixed workload") {
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+    constexpr size_t  WORK_PER_MESSAGE = 2000;
+
+    auto const &saved    = ChaCha::Tuning::current_plan ();
+    auto const &messages = traffic (4096);
+    size_t      total    = 0;
+    for (auto s : messages) {
+        total += s;
+    }
+    std::vector<uint8_t> buf (64 * 1024, 0x5A);
+
+    std::vector<Policy> policies {{"pinned ssse3", Backend::SSSE3, 0},
+                                  {"pinned avx2", Backend::AVX2, 0},
+                                  {"pinned avx512", Backend::AVX512, 0},
+                                  {"by size only", std::nullopt, 0},
+                                  {"by size and rate", std::nullopt, saved.avx512_engage}};
+    if (saved.avx512_engage == 0) {
+        policies.back ().avx512_engage = ChaCha::Tuning::Plan {}.avx512_engage;
+    }
+
+    for (auto const &p : policies) {
+        if (p.pinned && ! ChaCha::Tuning::available (*p.pinned)) {
+            continue;
+        }
+        auto plan          = saved;
+        plan.avx512_engage = p.avx512_engage;
+        ChaCha::Tuning::install (plan);
+
+        ChaCha::DJB::State state {key.data (), key.size (), 0};
+        ScalarTask         task;
+
+        bench::section (p.label);
+        {
+            std::optional<ChaCha::Tuning::ThreadOverride> pin;
+            if (p.pinned) {
+                pin.emplace (*p.pinned);
+            }
+            // Interleaved: one message, then a slice of the scalar task.
+            auto const &m = bench::measure ("", total, [&] () {
+                for (auto size : messages) {
+                    ChaCha::apply (state, buf.data (), size);
+                    task.run (WORK_PER_MESSAGE);
+                }
+                bench::do_not_optimize (buf.data ());
+            });
+            auto const ops = static_cast<double> (WORK_PER_MESSAGE * messages.size () * m.iterations) / m.seconds;
+            print ("interleaved", m.bytesPerSecond (), ops);
+        }
+        {
+            // Co-running: the scalar task on its own thread for as long as the crypto thread runs.
+            std::atomic<bool>   stop {false};
+            std::atomic<size_t> done {0};
+            std::thread         other {[&] () {
+                ScalarTask t;
+                while (! stop.load (std::memory_order_relaxed)) {
+                    t.run (WORK_PER_MESSAGE);
+                    done.fetch_add (WORK_PER_MESSAGE, std::memory_order_relaxed);
+                }
+            }};
+            auto const start = bench::clock_t::now ();
+            {
+                std::optional<ChaCha::Tuning::ThreadOverride> pin;
+                if (p.pinned) {
+                    pin.emplace (*p.pinned);
+                }
+                auto const &m = bench::measure ("", total, [&] () {
+                    for (auto size : messages) {
+                        ChaCha::apply (state, buf.data (), size);
+                    }
+                    bench::do_not_optimize (buf.data ());
+                });
+                stop.store (true);
+                other.join ();
+                auto const seconds = std::chrono::duration<double> (bench::clock_t::now () - start).count ();
+                print ("co-running", m.bytesPerSecond (), static_cast<double> (done.load ()) / seconds);
+            }
+        }
+    }
+    ChaCha::Tuning::install (saved);
+}
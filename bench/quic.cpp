@@ -0,0 +1,51 @@
+/*
+ * quic.cpp: QUIC header-protection masks, a state and `create_mask` per packet vs. `HeaderProtection::masks`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/header-protection.hpp>
+#include <chacha20/state-rfc7539.hpp>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+BENCHMARK ("quic: header-protection masks") {
+    const std::string            key {"0123456789abcdef0123456789abcdef"};
+    const ChaCha::RFC7539::State K {key.data (), key.size ()};
+
+    std::mt19937                                    gen {1};
+    std::vector<ChaCha::HeaderProtection::sample_t> samples (1024);
+    for (auto &s : samples) {
+        for (auto &b : s) {
+            b = static_cast<uint8_t> (gen ());
+        }
+    }
+    std::vector<ChaCha::HeaderProtection::mask_t> masks (samples.size ());
+    for (size_t batch : {1u, 4u, 8u, 16u, 64u, 1024u}) {
+        bench::section (fmt::format ("{} packets per call", batch));
+        // Throughput is counted in masks (5 bytes each).
+        size_t const bytes = 5 * samples.size ();
+        bench::report (bench::measure ("state + create_mask per packet", bytes, [&] () {
+            for (size_t i = 0; i < samples.size (); ++i) {
+                ChaCha::RFC7539::State S {key.data (), key.size (), samples[i].data () + 4, 12};
+                S.setSequence (ChaCha::detail::le32 (samples[i].data ()));
+                auto const &block = ChaCha::detail::create_mask (S.state ());
+                std::copy_n (block.begin (), 5, masks[i].begin ());
+            }
+            bench::do_not_optimize (masks.data ());
+        }));
+        bench::report (bench::measure ("HeaderProtection::masks", bytes, [&] () {
+            for (size_t i = 0; i < samples.size (); i += batch) {
+                ChaCha::HeaderProtection::masks (K, &samples[i], batch, &masks[i]);
+            }
+            bench::do_not_optimize (masks.data ());
+        }));
+    }
+}
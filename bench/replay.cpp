@@ -0,0 +1,380 @@
+/*
+ * replay.cpp: Replays operation traces (packet mixes, re-keying, seeks, large transfers) against the library.
+ *
+ * A trace is a text file, one operation per line (`#` starts a comment):
+ *   cipher djb|rfc7539|xsalsa20  State type of the operations that follow the line (default: rfc7539)
+ *   key SIZE                     Sets a new key of SIZE bytes
+ *   nonce                        Sets a new nonce (the IV for `djb`), from block 0
+ *   apply SIZE                   `apply` of SIZE bytes, continuing the stream
+ *   seek OFFSET SIZE             `apply` of SIZE bytes from OFFSET
+ *   seal SIZE AAD                `AEAD::seal` of SIZE bytes with AAD bytes of associated data (rfc7539)
+ * Any operation may end with `*COUNT` to repeat it.
+ *
+ * Every trace is replayed as a whole (aggregate throughput, with the counters when available), then once
+ * per pass with each operation timed, for the throughput and latency percentiles of each operation.  The
+ * cost of reading the clock is measured and taken off the latencies.
+ *
+ * The bundled traces are synthetic, generated at build time from fixed seeds by trace-gen.cpp:
+ *   vpn.trace      tunnel packets: a nonce per packet, mostly full-MTU and ACK-sized, re-keyed every 1000 packets
+ *   storage.trace  4 KiB and 512 B sector reads at random offsets, a nonce per file, some 256 KiB - 1 MiB transfers
+ *   rpc.trace      short sessions: a key per session, 64 B - 16 KiB requests and responses, a few 256 KiB bodies
+ *
+ * Environment:
+ *   BENCH_TRACES  Traces to replay instead of the bundled ones (paths separated by `:`)
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/aead.hpp>
+#include <chacha20/state-rfc7539.hpp>
+#include <chacha20/state-salsa20.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fmt/format.h>
+
+#ifndef BENCH_TRACE_DIR
+#    define BENCH_TRACE_DIR "traces"
+#endif
+
+namespace {
+    enum class Kind : size_t {
+        KEY,
+        NONCE,
+        APPLY,
+        SEEK,
+        SEAL,
+    };
+
+    constexpr size_t      NUM_KINDS             = 5;
+    constexpr const char *KIND_NAMES[NUM_KINDS] = {"key", "nonce", "apply", "seek", "seal"};
+
+    enum class Cipher {
+        DJB,
+        RFC7539,
+        XSALSA20,
+    };
+
+    struct Op {
+        Kind   kind;
+        size_t size;
+        size_t arg; /* `key`: key size, `seek`: offset, `seal`: AAD size */
+    };
+
+    /// @brief A run of operations on one cipher.
+    struct Segment {
+        Cipher          cipher;
+        std::vector<Op> ops;
+    };
+
+    struct Trace {
+        std::string          name;
+        std::vector<Segment> segments;
+        size_t               num_ops  = 0;
+        size_t               bytes    = 0; /* per replay */
+        size_t               max_size = 0;
+        size_t               max_aad  = 0;
+    };
+
+    const char *cipher_name (Cipher c) {
+        switch (c) {
+        case Cipher::DJB:
+            return "djb";
+        case Cipher::RFC7539:
+            return "rfc7539";
+        default:
+            return "xsalsa20";
+        }
+    }
+
+    /// @throws std::runtime_error on a malformed line
+    Trace load (const std::string &path) {
+        std::ifstream in {path};
+        if (! in) {
+            throw std::runtime_error {fmt::format ("{}: cannot open", path)};
+        }
+        Trace t;
+        t.name = path.substr (path.find_last_of ('/') + 1);
+        t.segments.push_back ({Cipher::RFC7539, {}});
+
+        std::string line;
+        for (size_t lineno = 1; std::getline (in, line); ++lineno) {
+            auto fail = [&] (const std::string &what) {
+                return std::runtime_error {fmt::format ("{}:{}: {}", path, lineno, what)};
+            };
+            std::istringstream       fields {line.substr (0, line.find ('#'))};
+            std::vector<std::string> words;
+            for (std::string w; fields >> w;) {
+                words.push_back (w);
+            }
+            if (words.empty ()) {
+                continue;
+            }
+            size_t repeat = 1;
+            if (1 < words.size () && words.back ()[0] == '*') {
+                repeat = std::strtoull (words.back ().c_str () + 1, nullptr, 10);
+                words.pop_back ();
+            }
+            std::vector<size_t> args;
+            for (size_t i = 1; i < words.size (); ++i) {
+                char *end = nullptr;
+                args.push_back (std::strtoull (words[i].c_str (), &end, 10));
+                if (*end != 0 && words[0] != "cipher") {
+                    throw fail (fmt::format ("bad number `{}`", words[i]));
+                }
+            }
+            auto expect = [&] (size_t n) {
+                if (args.size () != n) {
+                    throw fail (fmt::format ("`{}` takes {} argument(s)", words[0], n));
+                }
+            };
+            auto &seg = t.segments.back ();
+            Op    op {};
+            if (words[0] == "cipher") {
+                expect (1);
+                Cipher c = words[1] == "djb" ? Cipher::DJB : words[1] == "rfc7539" ? Cipher::RFC7539 : Cipher::XSALSA20;
+                if (words[1] != cipher_name (c)) {
+                    throw fail (fmt::format ("unknown cipher `{}`", words[1]));
+                }
+                if (seg.ops.empty ()) {
+                    seg.cipher = c;
+                }
+                else {
+                    t.segments.push_back ({c, {}});
+                }
+                continue;
+            }
+            if (words[0] == "key") {
+                expect (1);
+                op = {Kind::KEY, 0, args[0]};
+            }
+            else if (words[0] == "nonce") {
+                expect (0);
+                op = {Kind::NONCE, 0, 0};
+            }
+            else if (words[0] == "apply") {
+                expect (1);
+                op = {Kind::APPLY, args[0], 0};
+            }
+            else if (words[0] == "seek") {
+                expect (2);
+                op = {Kind::SEEK, args[1], args[0]};
+            }
+            else if (words[0] == "seal") {
+                expect (2);
+                if (seg.cipher != Cipher::RFC7539) {
+                    throw fail ("`seal` needs `cipher rfc7539`");
+                }
+                op = {Kind::SEAL, args[0], args[1]};
+                t.max_aad = std::max (t.max_aad, op.arg);
+            }
+            else {
+                throw fail (fmt::format ("unknown operation `{}`", words[0]));
+            }
+            t.max_size = std::max (t.max_size, op.size);
+            t.bytes += repeat * op.size;
+            t.num_ops += repeat;
+            seg.ops.insert (seg.ops.end (), repeat, op);
+        }
+        return t;
+    }
+
+    /// @brief Runs the operations of one cipher on a state of type `State_`.
+    template<typename State_>
+    class Replayer {
+        State_                  state_;
+        std::array<uint8_t, 32> key_ {};
+        std::array<uint8_t, 24> nonce_ {};
+        size_t                  key_size_ = 32;
+        uint64_t                counter_  = 0;
+        std::vector<uint8_t> &  buf_;
+        const uint8_t *         aad_;
+
+    public:
+        Replayer (std::vector<uint8_t> &buf, const uint8_t *aad)
+                : buf_ {buf}
+                , aad_ {aad} {
+            rekey ();
+        }
+
+        void run (const Op &op) {
+            switch (op.kind) {
+            case Kind::KEY:
+                key_size_ = std::min (op.arg, key_.size ());
+                for (size_t i = 0; i < 8; ++i) {
+                    key_[i] = static_cast<uint8_t> (++counter_ >> (8 * i));
+                }
+                rekey ();
+                break;
+            case Kind::NONCE:
+                ++counter_;
+                for (size_t i = 0; i < 8; ++i) {
+                    nonce_[4 + i] = static_cast<uint8_t> (counter_ >> (8 * i));
+                }
+                if constexpr (std::is_same_v<State_, ChaCha::DJB::State>) {
+                    state_.setInitialVector (counter_);
+                }
+                else if constexpr (std::is_same_v<State_, ChaCha::RFC7539::State>) {
+                    state_.setNonce (nonce_.data (), 12);
+                }
+                else {
+                    rekey ();
+                }
+                break;
+            case Kind::APPLY:
+                ChaCha::apply (state_, buf_.data (), op.size);
+                break;
+            case Kind::SEEK:
+                ChaCha::apply (state_, buf_.data (), op.size, op.arg);
+                break;
+            case Kind::SEAL:
+                if constexpr (std::is_same_v<State_, ChaCha::RFC7539::State>) {
+                    auto const tag = ChaCha::AEAD::seal (state_, buf_.data (), buf_.data (), op.size, aad_, op.arg);
+                    bench::do_not_optimize (tag);
+                }
+                break;
+            }
+            bench::do_not_optimize (buf_.data ());
+        }
+
+    private:
+        void rekey () {
+            if constexpr (std::is_same_v<State_, ChaCha::DJB::State>) {
+                state_ = ChaCha::DJB::State {key_.data (), key_size_, counter_};
+            }
+            else if constexpr (std::is_same_v<State_, ChaCha::RFC7539::State>) {
+                state_ = ChaCha::RFC7539::State {key_.data (), key_size_, nonce_.data (), 12};
+            }
+            else {
+                state_ = State_ {key_.data (), key_size_, nonce_.data (), nonce_.size ()};
+            }
+        }
+    };
+
+    /// @brief Calls `fn (replayer, op)` for every operation of `t`, in order.
+    template<typename Fn_>
+    void for_each_op (const Trace &t, std::vector<uint8_t> &buf, const uint8_t *aad, Fn_ &&fn) {
+        for (auto const &seg : t.segments) {
+            auto replay = [&] (auto &&r) {
+                for (auto const &op : seg.ops) {
+                    fn (r, op);
+                }
+            };
+            switch (seg.cipher) {
+            case Cipher::DJB:
+                replay (Replayer<ChaCha::DJB::State> {buf, aad});
+                break;
+            case Cipher::RFC7539:
+                replay (Replayer<ChaCha::RFC7539::State> {buf, aad});
+                break;
+            case Cipher::XSALSA20:
+                replay (Replayer<ChaCha::XSalsa20::State> {buf, aad});
+                break;
+            }
+        }
+    }
+
+    /// @brief Shortest interval between two reads of the clock (ns).
+    double clock_overhead () {
+        double result = std::numeric_limits<double>::max ();
+        for (int i = 0; i < 1000; ++i) {
+            auto const t0 = bench::clock_t::now ();
+            auto const t1 = bench::clock_t::now ();
+            result        = std::min (result, std::chrono::duration<double, std::nano> (t1 - t0).count ());
+        }
+        return result;
+    }
+
+    std::vector<std::string> trace_paths () {
+        std::vector<std::string> result;
+        if (auto const *s = std::getenv ("BENCH_TRACES"); s != nullptr) {
+            std::istringstream in {s};
+            for (std::string p; std::getline (in, p, ':');) {
+                if (! p.empty ()) {
+                    result.push_back (p);
+                }
+            }
+            return result;
+        }
+        for (auto const *name : {"vpn.trace", "storage.trace", "rpc.trace"}) {
+            result.push_back (fmt::format ("{}/{}", BENCH_TRACE_DIR, name));
+        }
+        return result;
+    }
+}  // namespace
+
+BENCHMARK ("replay: operation traces") {
+    auto const overhead = clock_overhead ();
+    for (auto const &path : trace_paths ()) {
+        Trace t;
+        try {
+            t = load (path);
+        }
+        catch (const std::exception &e) {
+            fmt::print ("  {}\n", e.what ());
+            continue;
+        }
+        std::string ciphers;
+        for (auto const &seg : t.segments) {
+            if (ciphers.find (cipher_name (seg.cipher)) == std::string::npos) {
+                ciphers += (ciphers.empty () ? "" : ", ") + std::string {cipher_name (seg.cipher)};
+            }
+        }
+        bench::section (fmt::format ("{}: {} ops, {:.2f} MiB per replay ({})", t.name, t.num_ops, static_cast<double> (t.bytes) / (1024 * 1024), ciphers));
+
+        std::vector<uint8_t>       buf (std::max<size_t> (t.max_size, 1), 0x5A);
+        std::vector<uint8_t> const aad (std::max<size_t> (t.max_aad, 1), 0x17);
+        bench::report (bench::measure ("replay", t.bytes, [&] () {
+            for_each_op (t, buf, aad.data (), [] (auto &r, const Op &op) { r.run (op); });
+        }));
+
+        std::array<std::vector<double>, NUM_KINDS> latencies;
+        std::array<size_t, NUM_KINDS>              bytes {};
+        size_t                                     passes = 0;
+        auto const                                 start  = bench::clock_t::now ();
+        do {
+            ++passes;
+            for_each_op (t, buf, aad.data (), [&] (auto &r, const Op &op) {
+                auto const t0 = bench::clock_t::now ();
+                r.run (op);
+                auto const t1 = bench::clock_t::now ();
+                auto const k  = static_cast<size_t> (op.kind);
+                latencies[k].push_back (std::max (0.0, std::chrono::duration<double, std::nano> (t1 - t0).count () - overhead));
+                bytes[k] += op.size;
+            });
+        } while (std::chrono::duration<double> (bench::clock_t::now () - start).count () < bench::min_time ());
+
+        fmt::print ("  {:<8} {:>10} {:>9} {:>10} {:>10} {:>10} {:>10}\n", "op", "per replay", "GB/s", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns");
+        for (size_t k = 0; k < NUM_KINDS; ++k) {
+            auto &samples = latencies[k];
+            if (samples.empty ()) {
+                continue;
+            }
+            double total = 0;
+            for (auto v : samples) {
+                total += v;
+            }
+            auto const rate = bytes[k] == 0 || total <= 0 ? std::string {"-"} : fmt::format ("{:.3f}", static_cast<double> (bytes[k]) / total);
+            fmt::print ("  {:<8} {:>10} {:>9} {:>10.0f} {:>10.0f} {:>10.0f} {:>10.0f}\n",
+                        KIND_NAMES[k],
+                        samples.size () / passes,
+                        rate,
+                        bench::percentile (samples, 50),
+                        bench::percentile (samples, 90),
+                        bench::percentile (samples, 99),
+                        bench::percentile (samples, 99.9));
+        }
+    }
+}
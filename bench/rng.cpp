@@ -0,0 +1,125 @@
+/*
+ * rng.cpp: `ChaCha::CounterRNG` against Philox4x32-10 and std::mt19937_64 at equal output volume.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20/rng.hpp>
+
+#include <array>
+#include <random>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+    constexpr size_t NUM_OUTPUTS = 4096; /* 64-bit outputs per iteration */
+
+    /// @brief Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+    class Philox4x32 {
+        std::array<uint32_t, 4> ctr_;
+        std::array<uint32_t, 2> key_;
+        std::array<uint32_t, 4> out_;
+        size_t                  used_;
+
+    public:
+        using result_type = uint64_t;
+
+        explicit Philox4x32 (uint64_t seed)
+                : ctr_ {}
+                , key_ {static_cast<uint32_t> (seed), static_cast<uint32_t> (seed >> 32u)}
+                , out_ {}
+                , used_ {4} {}
+
+        result_type operator() () {
+            if (used_ == 4) {
+                round10 ();
+                used_ = 0;
+            }
+            auto v = static_cast<uint64_t> (out_[used_]) | (static_cast<uint64_t> (out_[used_ + 1]) << 32u);
+            used_ += 2;
+            return v;
+        }
+
+    private:
+        void round10 () {
+            auto x = ctr_;
+            auto k = key_;
+            for (int i = 0; i < 10; ++i) {
+                uint64_t p0 = static_cast<uint64_t> (0xD2511F53u) * x[0];
+                uint64_t p1 = static_cast<uint64_t> (0xCD9E8D57u) * x[2];
+                x[0]        = static_cast<uint32_t> (p1 >> 32u) ^ x[1] ^ k[0];
+                x[2]        = static_cast<uint32_t> (p0 >> 32u) ^ x[3] ^ k[1];
+                x[1]        = static_cast<uint32_t> (p1);
+                x[3]        = static_cast<uint32_t> (p0);
+                k[0] += 0x9E3779B9u;
+                k[1] += 0xBB67AE85u;
+            }
+            out_ = x;
+            for (auto &c : ctr_) {
+                if (++c != 0) {
+                    break;
+                }
+            }
+        }
+    };
+
+    template<typename Rng_>
+    bench::Measurement draw (const char *label, Rng_ &rng, std::vector<uint64_t> &out) {
+        return bench::measure (label, out.size () * sizeof (uint64_t), [&] () {
+            for (auto &v : out) {
+                v = rng ();
+            }
+            bench::do_not_optimize (out.data ());
+        });
+    }
+}  // namespace
+
+BENCHMARK ("rng: CounterRNG vs. Philox4x32-10 vs. mt19937_64") {
+    std::vector<uint64_t> words (NUM_OUTPUTS);
+    std::vector<double>   doubles (NUM_OUTPUTS);
+    std::vector<float>    floats (2 * NUM_OUTPUTS);
+    std::vector<uint32_t> ints (2 * NUM_OUTPUTS);
+
+    ChaCha::CounterRNG rng {0x0123456789ABCDEFu};
+    Philox4x32         philox {0x0123456789ABCDEFu};
+    std::mt19937_64    mt {0x0123456789ABCDEFu};
+
+    bench::section (fmt::format ("{} x 64-bit per iteration", NUM_OUTPUTS));
+    bench::report (draw ("mt19937_64 operator()", mt, words));
+    bench::report (draw ("Philox4x32-10 operator()", philox, words));
+    bench::report (draw ("CounterRNG operator()", rng, words));
+    bench::report (bench::measure ("CounterRNG generate", words.size () * sizeof (uint64_t), [&] () {
+        rng.generate (words.data (), words.size () * sizeof (uint64_t));
+        bench::do_not_optimize (words.data ());
+    }));
+
+    bench::section ("conversions (same output volume)");
+    bench::report (bench::measure ("mt19937_64 uniform double", doubles.size () * sizeof (double), [&] () {
+        std::uniform_real_distribution<double> dist;
+        for (auto &v : doubles) {
+            v = dist (mt);
+        }
+        bench::do_not_optimize (doubles.data ());
+    }));
+    bench::report (bench::measure ("CounterRNG uniform double", doubles.size () * sizeof (double), [&] () {
+        rng.uniform (doubles.data (), doubles.size ());
+        bench::do_not_optimize (doubles.data ());
+    }));
+    bench::report (bench::measure ("CounterRNG uniform float", floats.size () * sizeof (float), [&] () {
+        rng.uniform (floats.data (), floats.size ());
+        bench::do_not_optimize (floats.data ());
+    }));
+    bench::report (bench::measure ("mt19937_64 bounded [0, 1000)", ints.size () * sizeof (uint32_t), [&] () {
+        std::uniform_int_distribution<uint32_t> dist {0, 999};
+        for (auto &v : ints) {
+            v = dist (mt);
+        }
+        bench::do_not_optimize (ints.data ());
+    }));
+    bench::report (bench::measure ("CounterRNG bounded [0, 1000)", ints.size () * sizeof (uint32_t), [&] () {
+        rng.bounded (ints.data (), ints.size (), 1000);
+        bench::do_not_optimize (ints.data ());
+    }));
+}
@@ -0,0 +1,41 @@
+/*
+ * salsa20.cpp: Salsa20 / XSalsa20 against ChaCha20 through the same `ChaCha::apply`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/state-salsa20.hpp>
+
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+    template<typename State_>
+    bench::Measurement run (const std::string &label, State_ &state, std::vector<uint8_t> &buf) {
+        return bench::measure (label, buf.size (), [&] () {
+            state.setSequence (0);
+            ChaCha::apply (state, buf.data (), buf.size ());
+            bench::do_not_optimize (buf.data ());
+        });
+    }
+}  // namespace
+
+BENCHMARK ("salsa20: ChaCha20 vs. Salsa20 vs. XSalsa20") {
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+    const std::string nonce {"0123456789abcdef01234567"};
+
+    ChaCha::DJB::State      chacha {key.data (), key.size (), 0};
+    ChaCha::Salsa20::State  salsa {key.data (), key.size (), nonce.data (), 8};
+    ChaCha::XSalsa20::State xsalsa {key.data (), key.size (), nonce.data (), nonce.size ()};
+    for (size_t size : {64u, 512u, 4096u, 65536u}) {
+        bench::section (fmt::format ("{} B", size));
+        std::vector<uint8_t> buf (size, 0x5A);
+        bench::report (run ("ChaCha20 (DJB)", chacha, buf));
+        bench::report (run ("Salsa20", salsa, buf));
+        bench::report (run ("XSalsa20", xsalsa, buf));
+    }
+}
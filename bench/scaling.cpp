@@ -0,0 +1,459 @@
+/*
+ * scaling.cpp: Throughput over 1 .. N threads, with private states and with the shared structures.
+ *
+ * Every row runs the same per-thread work on `threads` threads at once (a crew started once per row and
+ * placed by the policy below) and prints:
+ *   - the aggregate throughput,
+ *   - the efficiency: aggregate / (threads x the 1-thread throughput of the same sweep),
+ *   - for the out-of-cache sweep, the throughput as a share of `memcpy` by the same threads on the same
+ *     buffers (near 100%: ChaCha is bound by the memory system, not by the cores).
+ * An efficiency falling well short of 100% while the copy share stays low points at a shared cache,
+ * a lock or false sharing rather than at memory bandwidth.
+ *
+ * Placement (Linux; elsewhere only `none`):
+ *   none     left to the scheduler (may exceed the CPU count with `BENCH_THREADS`)
+ *   compact  one thread per physical core, filling a package before the next one
+ *   scatter  one thread per physical core, round-robin over the packages
+ *   smt      every hardware thread of a core before the next core
+ * A pinned sweep stops at the number of CPUs its policy can use.
+ *
+ * Environment:
+ *   BENCH_THREADS  Largest thread count (default: the CPUs this process may run on, at most 128)
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/block-cache.hpp>
+#include <chacha20/parallel.hpp>
+#include <chacha20/rng.hpp>
+#include <chacha20/shared-stream.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <fmt/format.h>
+
+#if defined(__linux__)
+#    include <pthread.h>
+#    include <sched.h>
+#endif
+
+namespace {
+    constexpr size_t WORK = 256 * 1024; /* bytes per thread and round (at least one message) */
+
+    const std::string KEY {"0123456789abcdef0123456789abcdef"};
+
+    /// @brief A CPU this process may run on.
+    struct Cpu {
+        int id;
+        int package;
+        int core; /* within the package */
+        int smt;  /* index among the hardware threads of the core */
+    };
+
+    std::vector<Cpu> allowed_cpus () {
+        std::vector<Cpu> result;
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO (&set);
+        if (::sched_getaffinity (0, sizeof (set), &set) != 0) {
+            return result;
+        }
+        auto read_int = [] (const std::string &path, int fallback) {
+            std::ifstream in {path};
+            int           value = fallback;
+            return (in >> value) ? value : fallback;
+        };
+        for (int i = 0; i < CPU_SETSIZE; ++i) {
+            if (! CPU_ISSET (i, &set)) {
+                continue;
+            }
+            auto const dir = fmt::format ("/sys/devices/system/cpu/cpu{}/topology/", i);
+            Cpu        cpu {i, read_int (dir + "physical_package_id", 0), read_int (dir + "core_id", i), 0};
+            for (auto const &c : result) {
+                if (c.package == cpu.package && c.core == cpu.core) {
+                    ++cpu.smt;
+                }
+            }
+            result.push_back (cpu);
+        }
+#endif
+        return result;
+    }
+
+    /// @brief Named CPU order; thread `i` runs on `cpus[i]` (unpinned if `cpus` is empty).
+    struct Placement {
+        std::string      name;
+        std::vector<int> cpus;
+    };
+
+    std::vector<Placement> placements () {
+        std::vector<Placement> result {{"none", {}}};
+        auto                   cpus = allowed_cpus ();
+        if (cpus.empty ()) {
+            return result;
+        }
+        std::sort (cpus.begin (), cpus.end (), [] (const Cpu &a, const Cpu &b) {
+            return std::tie (a.package, a.core, a.smt) < std::tie (b.package, b.core, b.smt);
+        });
+        Placement                       compact {"compact", {}};
+        Placement                       scatter {"scatter", {}};
+        Placement                       smt {"smt", {}};
+        std::map<int, std::vector<int>> packages;
+        for (auto const &c : cpus) {
+            smt.cpus.push_back (c.id);
+            if (c.smt == 0) {
+                compact.cpus.push_back (c.id);
+                packages[c.package].push_back (c.id);
+            }
+        }
+        for (size_t i = 0; scatter.cpus.size () < compact.cpus.size (); ++i) {
+            for (auto const &p : packages) {
+                if (i < p.second.size ()) {
+                    scatter.cpus.push_back (p.second[i]);
+                }
+            }
+        }
+        result.push_back (std::move (compact));
+        result.push_back (std::move (scatter));
+        result.push_back (std::move (smt));
+        return result;
+    }
+
+    size_t max_threads () {
+        if (auto const *s = std::getenv ("BENCH_THREADS"); s != nullptr) {
+            return std::max<size_t> (std::strtoull (s, nullptr, 10), 1);
+        }
+        auto const n = allowed_cpus ().size ();
+        return std::clamp<size_t> (n == 0 ? std::thread::hardware_concurrency () : n, 1, 128);
+    }
+
+    /// @brief 1, 2, 4, ... and `limit`.
+    std::vector<size_t> thread_counts (size_t limit) {
+        std::vector<size_t> result;
+        for (size_t n = 1; n < limit; n *= 2) {
+            result.push_back (n);
+        }
+        result.push_back (limit);
+        return result;
+    }
+
+    /// @brief Threads started once and run in lockstep rounds.
+    class Crew {
+        using task_t = std::function<void (size_t)>;
+
+        std::vector<std::thread> threads_;
+        std::mutex               mutex_;
+        std::condition_variable  start_;
+        std::condition_variable  done_;
+        const task_t *           task_    = nullptr;
+        uint64_t                 round_   = 0;
+        size_t                   running_ = 0;
+        bool                     stop_    = false;
+
+    public:
+        Crew (size_t size, const std::vector<int> &cpus) {
+            for (size_t i = 0; i < size; ++i) {
+                threads_.emplace_back ([this, i, cpu = i < cpus.size () ? cpus[i] : -1] () { work (i, cpu); });
+            }
+        }
+
+        ~Crew () {
+            {
+                std::lock_guard<std::mutex> lock {mutex_};
+                stop_ = true;
+            }
+            start_.notify_all ();
+            for (auto &t : threads_) {
+                t.join ();
+            }
+        }
+
+        Crew (const Crew &) = delete;
+        Crew &operator= (const Crew &) = delete;
+
+        /// @brief Runs `task (i)` on thread `i` of the crew, for all of them; returns when all are done.
+        void run (const task_t &task) {
+            std::unique_lock<std::mutex> lock {mutex_};
+            task_    = &task;
+            running_ = threads_.size ();
+            ++round_;
+            start_.notify_all ();
+            done_.wait (lock, [this] () { return running_ == 0; });
+        }
+
+    private:
+        void work (size_t index, int cpu) {
+#if defined(__linux__)
+            if (0 <= cpu) {
+                cpu_set_t set;
+                CPU_ZERO (&set);
+                CPU_SET (cpu, &set);
+                ::pthread_setaffinity_np (::pthread_self (), sizeof (set), &set);
+            }
+#else
+            static_cast<void> (cpu);
+#endif
+            uint64_t seen = 0;
+            while (true) {
+                const task_t *task;
+                {
+                    std::unique_lock<std::mutex> lock {mutex_};
+                    start_.wait (lock, [&] () { return stop_ || round_ != seen; });
+                    if (stop_) {
+                        return;
+                    }
+                    seen = round_;
+                    task = task_;
+                }
+                (*task) (index);
+                std::lock_guard<std::mutex> lock {mutex_};
+                if (--running_ == 0) {
+                    done_.notify_one ();
+                }
+            }
+        }
+    };
+
+    /// @brief Per-thread task of one row, and optionally the `memcpy` of the same buffers.
+    struct Work {
+        std::function<void (size_t)> task;
+        std::function<void (size_t)> copy;
+    };
+
+    /// @brief Measures `make (crew, threads)` on 1 .. `limit` threads placed by `cpus`, a row per thread count.
+    /// @param bytes Bytes per thread and round
+    void sweep (size_t limit, const std::vector<int> &cpus, size_t bytes, const std::function<Work (Crew &, size_t)> &make) {
+        double base = 0;
+        for (auto threads : thread_counts (limit)) {
+            Crew       crew {threads, cpus};
+            auto const work  = make (crew, threads);
+            auto const total = threads * bytes;
+            auto const m     = bench::measure ("", total, [&] () { crew.run (work.task); });
+            auto const rate  = m.bytesPerSecond ();
+            if (threads == 1) {
+                base = rate;
+            }
+            fmt::print ("  {:>4} threads {:>9.3f} GB/s {:>6.1f}% eff", threads, rate / 1e9, 100 * rate / (static_cast<double> (threads) * base));
+            if (work.copy) {
+                auto const c = bench::measure ("", total, [&] () { crew.run (work.copy); });
+                fmt::print (" {:>9.3f} GB/s copy {:>6.1f}% of copy", c.bytesPerSecond () / 1e9, 100 * rate / c.bytesPerSecond ());
+            }
+            fmt::print ("\n");
+        }
+    }
+
+    /// @brief A private state and buffers per thread (one cache line apart, allocated by their thread).
+    struct alignas (64) Lane {
+        ChaCha::DJB::State   state;
+        std::vector<uint8_t> in;
+        std::vector<uint8_t> out;
+    };
+
+    std::vector<Lane> make_lanes (Crew &crew, size_t threads, size_t size) {
+        std::vector<Lane> lanes;
+        lanes.reserve (threads);
+        for (size_t i = 0; i < threads; ++i) {
+            lanes.push_back (Lane {ChaCha::DJB::State {KEY.data (), KEY.size (), i}, {}, {}});
+        }
+        // First touch on the thread that uses them (their NUMA node).
+        crew.run ([&] (size_t i) {
+            lanes[i].in.assign (size, 0x5A);
+            lanes[i].out.assign (size, 0);
+        });
+        return lanes;
+    }
+}  // namespace
+
+BENCHMARK ("scaling: private states over threads and placements") {
+    auto const limit = max_threads ();
+    for (size_t size : {64u, 1500u, 16384u, 4u * 1024u * 1024u}) {
+        auto const reps = std::max<size_t> (WORK / size, 1);
+        for (auto const &p : placements ()) {
+            auto const n = p.cpus.empty () ? limit : std::min (limit, p.cpus.size ());
+            bench::section (fmt::format ("{} B messages, placement {}", size, p.name));
+            std::vector<Lane> lanes;
+            sweep (n, p.cpus, reps * size, [&] (Crew &crew, size_t threads) {
+                lanes = make_lanes (crew, threads, size);
+                Work work;
+                work.task = [&lanes, reps] (size_t i) {
+                    auto &l = lanes[i];
+                    for (size_t r = 0; r < reps; ++r) {
+                        ChaCha::apply (l.state, l.out.data (), l.in.data (), l.in.size ());
+                    }
+                    bench::do_not_optimize (l.out.data ());
+                };
+                if (WORK <= size) {
+                    work.copy = [&lanes] (size_t i) {
+                        ::memcpy (lanes[i].out.data (), lanes[i].in.data (), lanes[i].in.size ());
+                        bench::do_not_optimize (lanes[i].out.data ());
+                    };
+                }
+                return work;
+            });
+        }
+    }
+}
+
+BENCHMARK ("scaling: shared structures over threads") {
+    auto const limit = max_threads ();
+    auto const all   = placements ();
+    // Compact when it has a core for every thread, unpinned otherwise.
+    auto const cpus = (1 < all.size () && limit <= all[1].cpus.size ()) ? all[1].cpus : std::vector<int> {};
+
+    constexpr size_t MESSAGE = 64;
+    constexpr size_t RECORDS = WORK / 64 / MESSAGE; /* messages per thread and round */
+
+    bench::section ("64 B messages, state per thread, padded to a cache line");
+    std::vector<Lane> lanes;
+    sweep (limit, cpus, RECORDS * MESSAGE, [&] (Crew &crew, size_t threads) {
+        lanes = make_lanes (crew, threads, MESSAGE);
+        return Work {[&] (size_t i) {
+                         for (size_t r = 0; r < RECORDS; ++r) {
+                             ChaCha::apply (lanes[i].state, lanes[i].in.data (), MESSAGE);
+                         }
+                         bench::do_not_optimize (lanes[i].in.data ());
+                     },
+                     {}};
+    });
+
+    bench::section ("64 B messages, states packed across cache lines (false sharing)");
+    constexpr size_t                   STRIDE = sizeof (ChaCha::DJB::State);
+    std::unique_ptr<uint8_t[]>         arena;
+    std::vector<ChaCha::DJB::State *>  packed;
+    std::vector<std::vector<uint8_t>>  bufs;
+    sweep (limit, cpus, RECORDS * MESSAGE, [&] (Crew &, size_t threads) {
+        // Half a line off: every line holds parts of two neighbouring states.
+        arena.reset (new uint8_t[threads * STRIDE + 128]);
+        auto *base = arena.get () + (64 - reinterpret_cast<uintptr_t> (arena.get ()) % 64) + 32;
+        packed.clear ();
+        for (size_t i = 0; i < threads; ++i) {
+            packed.push_back (new (base + i * STRIDE) ChaCha::DJB::State {KEY.data (), KEY.size (), i});
+        }
+        bufs.assign (threads, std::vector<uint8_t> (MESSAGE, 0x5A));
+        return Work {[&] (size_t i) {
+                         for (size_t r = 0; r < RECORDS; ++r) {
+                             ChaCha::apply (*packed[i], bufs[i].data (), MESSAGE);
+                         }
+                         bench::do_not_optimize (bufs[i].data ());
+                     },
+                     {}};
+    });
+
+    bench::section ("64 B records appended to one SharedStream");
+    std::unique_ptr<ChaCha::SharedStream<ChaCha::DJB::State>> stream;
+    sweep (limit, cpus, RECORDS * MESSAGE, [&] (Crew &, size_t threads) {
+        stream = std::make_unique<ChaCha::SharedStream<ChaCha::DJB::State>> (ChaCha::DJB::State {KEY.data (), KEY.size (), 0});
+        bufs.assign (threads, std::vector<uint8_t> (MESSAGE, 0x5A));
+        return Work {[&] (size_t i) {
+                         for (size_t r = 0; r < RECORDS; ++r) {
+                             stream->append (bufs[i].data (), bufs[i].data (), MESSAGE);
+                         }
+                         bench::do_not_optimize (bufs[i].data ());
+                     },
+                     {}};
+    });
+
+    bench::section ("4 KiB draws, CounterRNG per thread");
+    constexpr size_t                DRAW = 4096;
+    std::vector<ChaCha::CounterRNG> rngs;
+    sweep (limit, cpus, WORK, [&] (Crew &, size_t threads) {
+        rngs.clear ();
+        for (size_t i = 0; i < threads; ++i) {
+            rngs.emplace_back (0x0123456789ABCDEFu, i);
+        }
+        bufs.assign (threads, std::vector<uint8_t> (DRAW));
+        return Work {[&] (size_t i) {
+                         for (size_t r = 0; r < WORK / DRAW; ++r) {
+                             rngs[i].generate (bufs[i].data (), DRAW);
+                         }
+                         bench::do_not_optimize (bufs[i].data ());
+                     },
+                     {}};
+    });
+
+    bench::section ("4 KiB draws, one CounterRNG behind a mutex");
+    std::mutex mutex;
+    sweep (limit, cpus, WORK, [&] (Crew &, size_t threads) {
+        rngs.assign (1, ChaCha::CounterRNG {0x0123456789ABCDEFu});
+        bufs.assign (threads, std::vector<uint8_t> (DRAW));
+        return Work {[&] (size_t i) {
+                         for (size_t r = 0; r < WORK / DRAW; ++r) {
+                             std::lock_guard<std::mutex> lock {mutex};
+                             rngs[0].generate (bufs[i].data (), DRAW);
+                         }
+                         bench::do_not_optimize (bufs[i].data ());
+                     },
+                     {}};
+    });
+
+    bench::section ("8-48 B reads at random offsets of 1 MiB, one BlockCache");
+    constexpr size_t                                    REGION = 1024 * 1024;
+    constexpr size_t                                    READS  = 4096;
+    std::vector<uint8_t>                                data (REGION, 0x5A);
+    std::vector<std::vector<std::pair<size_t, size_t>>> reads;
+    std::unique_ptr<ChaCha::BlockCache>                 cache;
+    size_t                                              read_bytes = 0;
+    {
+        std::mt19937                          rng {1234};
+        std::uniform_int_distribution<size_t> size_dist {8, 48};
+        reads.resize (limit);
+        for (auto &r : reads) {
+            for (size_t i = 0; i < READS; ++i) {
+                auto const size = size_dist (rng);
+                r.emplace_back (std::uniform_int_distribution<size_t> {0, REGION - size} (rng), size);
+            }
+        }
+        for (auto const &r : reads[0]) {
+            read_bytes += r.second;
+        }
+    }
+    sweep (limit, cpus, read_bytes, [&] (Crew &, size_t threads) {
+        cache = std::make_unique<ChaCha::BlockCache> (4096);
+        lanes.clear ();
+        for (size_t i = 0; i < threads; ++i) {
+            lanes.push_back (Lane {ChaCha::DJB::State {KEY.data (), KEY.size (), 0}, {}, std::vector<uint8_t> (64)});
+        }
+        return Work {[&] (size_t i) {
+                         for (auto const &r : reads[i]) {
+                             ChaCha::apply (*cache, lanes[i].state, lanes[i].out.data (), data.data () + r.first, r.second, r.first);
+                         }
+                         bench::do_not_optimize (lanes[i].out.data ());
+                     },
+                     {}};
+    });
+
+    bench::section ("16 MiB message, parallel_apply (threads per call)");
+    {
+        std::vector<uint8_t> msg (16 * 1024 * 1024, 0x5A);
+        ChaCha::DJB::State   state {KEY.data (), KEY.size (), 0};
+        double               base = 0;
+        for (auto threads : thread_counts (limit)) {
+            auto const m = bench::measure ("", msg.size (), [&] () {
+                ChaCha::parallel_apply (state, msg.data (), msg.size (), threads);
+                bench::do_not_optimize (msg.data ());
+            });
+            auto const rate = m.bytesPerSecond ();
+            if (threads == 1) {
+                base = rate;
+            }
+            fmt::print ("  {:>4} threads {:>9.3f} GB/s {:>6.1f}% eff\n", threads, rate / 1e9, 100 * rate / (static_cast<double> (threads) * base));
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * sector.cpp: Batches of random 4 KiB sectors, one by one vs. `SectorCipher` batches vs. `BlockStore` I/O.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/block-store.hpp>
+#include <chacha20/sector.hpp>
+#include <chacha20/state-rfc7539.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+    constexpr size_t SECTOR_SIZE = 4096;
+    constexpr size_t BATCH       = 1024; /* 4 MiB per batch */
+    constexpr size_t VOLUME      = 64u * 1024u; /* sectors (256 MiB) */
+}  // namespace
+
+BENCHMARK ("sector: batches of 1024 random 4 KiB sectors") {
+    const std::string            key {"0123456789abcdef0123456789abcdef"};
+    const std::string            nonce {"0123456789ab"};
+    const ChaCha::RFC7539::State state {key.data (), key.size (), nonce.data (), nonce.size ()};
+    const ChaCha::SectorCipher   cipher {state, SECTOR_SIZE};
+    size_t const                 hw = std::max<size_t> (std::thread::hardware_concurrency (), 1);
+
+    std::mt19937_64                   gen {1};
+    std::vector<uint8_t>              data (BATCH * SECTOR_SIZE, 0x5A);
+    std::vector<ChaCha::SectorBuffer> batch (BATCH);
+    for (size_t i = 0; i < BATCH; ++i) {
+        batch[i] = ChaCha::SectorBuffer {std::uniform_int_distribution<uint64_t> {0, VOLUME - 1}(gen), &data[i * SECTOR_SIZE]};
+    }
+
+    bench::section ("encryption only");
+    bench::report (bench::measure ("apply at offset, sector by sector", data.size (), [&] () {
+        for (auto const &s : batch) {
+            auto S = state;
+            ChaCha::apply (S, s.data, s.data, SECTOR_SIZE, s.number * SECTOR_SIZE);
+        }
+        bench::do_not_optimize (data.data ());
+    }));
+    for (size_t threads = 1; threads <= std::max<size_t> (hw, 4); threads *= 2) {
+        bench::report (bench::measure (fmt::format ("SectorCipher batch, {} threads", threads), data.size (), [&] () {
+            cipher.apply (batch.data (), batch.size (), threads);
+            bench::do_not_optimize (data.data ());
+        }));
+    }
+
+    bench::section ("BlockStore (256 MiB file, page cache)");
+    const std::string path {"bench-chacha20-sector.bin"};
+    {
+        ChaCha::BlockStore store {path, cipher, VOLUME};
+        // Sorted batches of a sequential scan coalesce into one system call each.
+        std::vector<ChaCha::SectorBuffer> sequential (BATCH);
+        for (size_t i = 0; i < BATCH; ++i) {
+            sequential[i] = ChaCha::SectorBuffer {i, &data[i * SECTOR_SIZE]};
+        }
+        std::vector<ChaCha::ConstSectorBuffer> writes (BATCH);
+        std::transform (batch.begin (), batch.end (), writes.begin (), [] (auto const &s) { return ChaCha::ConstSectorBuffer {s.number, s.data}; });
+        bench::report (bench::measure ("write, random", data.size (), [&] () { store.write (writes.data (), writes.size ()); }));
+        bench::report (bench::measure ("read, random", data.size (), [&] () { store.read (batch.data (), batch.size ()); }));
+        bench::report (bench::measure ("read, sequential", data.size (), [&] () { store.read (sequential.data (), sequential.size ()); }));
+    }
+    std::remove (path.c_str ());
+}
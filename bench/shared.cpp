@@ -0,0 +1,64 @@
+/*
+ * shared.cpp: Writers appending records to one stream, serialised on a mutex vs. `SharedStream`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/shared-stream.hpp>
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+    constexpr size_t RECORDS = 4096; /* per writer and iteration */
+
+    /// @brief Runs `fn (writer, record)` for `RECORDS` records on each of `writers` threads.
+    template<typename Fn_>
+    void run_writers (size_t writers, Fn_ &&fn) {
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < writers; ++t) {
+            threads.emplace_back ([&fn, t] () {
+                for (size_t i = 0; i < RECORDS; ++i) {
+                    fn (t, i);
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join ();
+        }
+    }
+}  // namespace
+
+BENCHMARK ("shared: concurrent writers on one stream") {
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+
+    for (size_t record : {64u, 250u, 1500u}) {
+        for (size_t writers : {1u, 2u, 4u}) {
+            bench::section (fmt::format ("{} B records, {} writers", record, writers));
+            std::vector<std::vector<uint8_t>> bufs (writers, std::vector<uint8_t> (record, 0x5A));
+            auto const                        total = record * RECORDS * writers;
+            bench::report (bench::measure ("mutex + DJB::State", total, [&] () {
+                ChaCha::DJB::State state {key.data (), key.size (), 0};
+                std::mutex         mutex;
+                size_t             position = 0;
+                run_writers (writers, [&] (size_t t, size_t) {
+                    std::lock_guard<std::mutex> lock {mutex};
+                    ChaCha::apply (state, bufs[t].data (), record, position);
+                    position += record;
+                });
+                bench::do_not_optimize (bufs.data ());
+            }));
+            bench::report (bench::measure ("SharedStream", total, [&] () {
+                ChaCha::SharedStream<ChaCha::DJB::State> stream {ChaCha::DJB::State {key.data (), key.size (), 0}};
+                run_writers (writers, [&] (size_t t, size_t) { stream.append (bufs[t].data (), bufs[t].data (), record); });
+                bench::do_not_optimize (bufs.data ());
+            }));
+        }
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ * small.cpp: Per-call cost of `ChaCha::apply` on short messages.
+ *
+ * Built twice: into bench-chacha20 (kernels behind the library's dispatch) and into
+ * bench-chacha20-header-only (`CHACHA20_HEADER_ONLY`, kernels inlined into the caller).
+ * Run both to see the call overhead saved on 16-256 byte messages.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/state-rfc7539.hpp>
+
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+#ifdef CHACHA20_HEADER_ONLY
+    const char *const MODE = "header-only";
+#else
+    const char *const MODE = "library";
+#endif
+}  // namespace
+
+BENCHMARK ("short messages: apply on 16-256 bytes") {
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+    const std::string nonce {"0123456789ab"};
+    bench::section (fmt::format ("{} kernels", MODE));
+    for (size_t size : {16u, 32u, 64u, 100u, 128u, 192u, 256u}) {
+        ChaCha::RFC7539::State S {key.data (), key.size (), nonce.data (), nonce.size ()};
+        ChaCha::DJB::State     D {key.data (), key.size (), 0};
+        std::vector<uint8_t>   buf (size, 0x5A);
+        bench::report (bench::measure (fmt::format ("RFC7539 {} B", size), size, [&] () {
+            S.setSequence (1);
+            ChaCha::apply (S, buf.data (), buf.size ());
+            bench::do_not_optimize (buf.data ());
+        }));
+        bench::report (bench::measure (fmt::format ("DJB {} B", size), size, [&] () {
+            D.setSequence (0);
+            ChaCha::apply (D, buf.data (), buf.size ());
+            bench::do_not_optimize (buf.data ());
+        }));
+    }
+}
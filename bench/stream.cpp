@@ -0,0 +1,50 @@
+/*
+ * stream.cpp: Chunked AEAD stream throughput, tiled (keystream and MAC per 4 KiB) vs. two passes per chunk.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20/secretstream.hpp>
+
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+    constexpr size_t TOTAL_SIZE = 16u * 1024u * 1024u;
+}  // namespace
+
+BENCHMARK ("stream: seal 16 MiB in chunks") {
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+    const std::string nonce {"0123456789ab"};
+
+    std::vector<uint8_t> plain (TOTAL_SIZE, 0x5A);
+    for (size_t chunk : {size_t {16 * 1024}, size_t {256 * 1024}, size_t {1024 * 1024}, size_t {4 * 1024 * 1024}}) {
+        bench::section (fmt::format ("{} KiB chunks", chunk / 1024));
+        std::vector<uint8_t> out (chunk + ChaCha::AEAD::STREAM_OVERHEAD);
+        bench::report (bench::measure ("apply only", TOTAL_SIZE, [&] () {
+            ChaCha::RFC7539::State S {key.data (), key.size (), nonce.data (), nonce.size ()};
+            for (size_t off = 0; off < TOTAL_SIZE; off += chunk) {
+                ChaCha::apply (S, out.data (), plain.data () + off, chunk);
+            }
+            bench::do_not_optimize (out.data ());
+        }));
+        bench::report (bench::measure ("AEAD::seal (2 passes)", TOTAL_SIZE, [&] () {
+            ChaCha::RFC7539::State S {key.data (), key.size (), nonce.data (), nonce.size ()};
+            for (size_t off = 0; off < TOTAL_SIZE; off += chunk) {
+                auto tag = ChaCha::AEAD::seal (S, out.data (), plain.data () + off, chunk, nullptr, 0);
+                bench::do_not_optimize (tag);
+            }
+            bench::do_not_optimize (out.data ());
+        }));
+        bench::report (bench::measure ("StreamSealer (tiled)", TOTAL_SIZE, [&] () {
+            ChaCha::AEAD::StreamSealer sealer {key.data (), key.size (), nonce.data (), nonce.size ()};
+            for (size_t off = 0; off < TOTAL_SIZE; off += chunk) {
+                sealer.seal (out.data (), plain.data () + off, chunk);
+            }
+            bench::do_not_optimize (out.data ());
+        }));
+    }
+}
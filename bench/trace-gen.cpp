@@ -0,0 +1,128 @@
+/*
+ * trace-gen.cpp: Generates the bundled traces of replay.cpp from fixed seeds.
+ *
+ *   bench-chacha20-trace-gen DIR   writes DIR/vpn.trace, DIR/storage.trace and DIR/rpc.trace
+ *
+ * The build runs it to produce the traces next to the benchmark.  Only raw `std::mt19937_64` draws are used
+ * (its sequence is fixed by the standard, unlike the one of `std::*_distribution`), so every build replays
+ * the same mixes.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <utility>
+
+#include <fmt/format.h>
+
+namespace {
+    constexpr uint64_t VPN_SEED     = 1;
+    constexpr uint64_t STORAGE_SEED = 2;
+    constexpr uint64_t RPC_SEED     = 3;
+
+    constexpr uint64_t KiB = 1024;
+    constexpr uint64_t MiB = 1024 * KiB;
+    constexpr uint64_t GiB = 1024 * MiB;
+
+    class Random {
+    private:
+        std::mt19937_64 gen_;
+
+    public:
+        explicit Random (uint64_t seed) : gen_ {seed} {}
+
+        /// @brief Uniform in [lo, hi].
+        uint64_t between (uint64_t lo, uint64_t hi) { return lo + gen_ () % (hi - lo + 1); }
+
+        /// @brief Uniform in [0, 1).
+        double real () { return static_cast<double> (gen_ () >> 11u) * (1.0 / 9007199254740992.0); }
+
+        /// @brief Log-normal with the given median (Box-Muller).
+        double lognormal (double median, double sigma) {
+            auto const u = 1.0 - real ();
+            auto const v = real ();
+            return median * std::exp (sigma * std::sqrt (-2.0 * std::log (u)) * std::cos (6.283185307179586 * v));
+        }
+    };
+
+    void vpn (std::ofstream &out) {
+        Random r {VPN_SEED};
+        out << "# vpn.trace: synthetic tunnel traffic (3000 packets).\n"
+               "#\n"
+               "# Every packet gets a fresh nonce and is sealed with a 16-byte header as associated data.  Sizes: 45% full\n"
+               "# MTU (1420 B), 35% ACK-sized (40 - 100 B), 20% uniform in 100 - 1400 B.  The session is re-keyed every 1000\n"
+               "# packets.\n"
+               "cipher rfc7539\n"
+               "key 32\n";
+        for (int i = 0; i < 3000; ++i) {
+            if (0 < i && i % 1000 == 0) {
+                out << "key 32\n";
+            }
+            auto const p    = r.between (0, 99);
+            auto const size = p < 45 ? 1420 : p < 80 ? r.between (40, 100) : r.between (100, 1400);
+            out << fmt::format ("nonce\nseal {} 16\n", size);
+        }
+    }
+
+    void storage (std::ofstream &out) {
+        Random r {STORAGE_SEED};
+        out << "# storage.trace: synthetic encrypted volume traffic (3000 requests on a 1 GiB volume).\n"
+               "#\n"
+               "# 70% 4 KiB and 25% 512 B sector reads at random aligned offsets, 5% sequential transfers of 256 KiB -\n"
+               "# 1 MiB; a new nonce (file) every 200 requests.\n"
+               "cipher djb\n"
+               "key 32\n"
+               "nonce\n";
+        for (int i = 0; i < 3000; ++i) {
+            if (0 < i && i % 200 == 0) {
+                out << "nonce\n";
+            }
+            auto const p    = r.between (0, 99);
+            auto const size = p < 70 ? 4 * KiB : p < 95 ? 512 : (256 * KiB) << r.between (0, 2);
+            out << fmt::format ("seek {} {}\n", r.between (0, (GiB - size) / size) * size, size);
+        }
+    }
+
+    void rpc (std::ofstream &out) {
+        Random r {RPC_SEED};
+        out << "# rpc.trace: synthetic RPC traffic (about 3000 messages).\n"
+               "#\n"
+               "# Short sessions (1 - 20 calls, a key each); every request and response is sealed under a fresh nonce with\n"
+               "# 16 - 64 B of associated data.  Body sizes are log-normal (median 665 B) clamped to 64 B - 16 KiB; 1% are\n"
+               "# 256 KiB.\n"
+               "cipher rfc7539\n";
+        auto body = [&r] () -> uint64_t {
+            if (r.between (0, 99) == 0) {
+                return 256 * KiB;
+            }
+            return static_cast<uint64_t> (std::fmin (std::fmax (r.lognormal (665, 1.0), 64), 16 * KiB));
+        };
+        for (int messages = 0; messages < 3000;) {
+            out << "key 32\n";
+            for (auto calls = r.between (1, 20); 0 < calls; --calls, messages += 2) {
+                out << fmt::format ("nonce\nseal {} {}\n", body (), 16 << r.between (0, 2));
+                out << fmt::format ("nonce\nseal {} {}\n", body (), 16 << r.between (0, 2));
+            }
+        }
+    }
+}  // namespace
+
+int main (int argc, char **argv) {
+    if (argc != 2) {
+        fmt::print (stderr, "usage: bench-chacha20-trace-gen DIR\n");
+        return 2;
+    }
+    const std::string dir {argv[1]};
+    for (auto [name, fn] : {std::pair {"vpn.trace", &vpn}, std::pair {"storage.trace", &storage}, std::pair {"rpc.trace", &rpc}}) {
+        std::ofstream out {dir + "/" + name};
+        fn (out);
+        if (! out.flush ()) {
+            fmt::print (stderr, "bench-chacha20-trace-gen: cannot write {}/{}\n", dir, name);
+            return 1;
+        }
+    }
+    return 0;
+}
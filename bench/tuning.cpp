@@ -0,0 +1,63 @@
+/*
+ * tuning.cpp: `ChaCha::apply` per kernel and with the default / autotuned plans.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "harness.hpp"
+
+#include <chacha20.hpp>
+#include <chacha20/parallel.hpp>
+#include <chacha20/tuning.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+    using ChaCha::Tuning::Backend;
+
+    bench::Measurement run (const std::string &label, ChaCha::DJB::State &state, std::vector<uint8_t> &buf) {
+        return bench::measure (label, buf.size (), [&] () {
+            state.setSequence (0);
+            ChaCha::apply (state, buf.data (), buf.size ());
+            bench::do_not_optimize (buf.data ());
+        });
+    }
+}  // namespace
+
+BENCHMARK ("tuning: kernels and plans") {
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+
+    auto const &saved = ChaCha::Tuning::current_plan ();
+    auto const &tuned = ChaCha::Tuning::autotune (false);
+    ::printf ("host: %s\n", ChaCha::Tuning::host_signature ().c_str ());
+    ::printf ("%s", ChaCha::Tuning::describe (tuned).c_str ());
+
+    ChaCha::DJB::State state {key.data (), key.size (), 0};
+    for (size_t size : {64u, 256u, 512u, 1024u, 4096u, 65536u}) {
+        bench::section (fmt::format ("{} B", size));
+        std::vector<uint8_t> buf (size, 0x5A);
+        for (auto b : {Backend::SCALAR, Backend::SSE2, Backend::SSSE3, Backend::AVX2, Backend::AVX512}) {
+            if (ChaCha::Tuning::available (b)) {
+                ChaCha::Tuning::ThreadOverride pin {b};
+                bench::report (run (ChaCha::Tuning::to_string (b), state, buf));
+            }
+        }
+        ChaCha::Tuning::install (ChaCha::Tuning::default_plan ());
+        bench::report (run ("default plan", state, buf));
+        ChaCha::Tuning::install (tuned);
+        bench::report (run ("autotuned plan", state, buf));
+    }
+
+    bench::section ("parallel_apply, 16 MiB");
+    std::vector<uint8_t> large (16 * 1024 * 1024, 0x5A);
+    bench::report (run ("apply", state, large));
+    bench::report (bench::measure ("parallel_apply", large.size (), [&] () {
+        state.setSequence (0);
+        ChaCha::parallel_apply (state, large.data (), large.size ());
+        bench::do_not_optimize (large.data ());
+    }));
+    ChaCha::Tuning::install (saved);
+}
@@ -0,0 +1,559 @@
+/*
+ * relay.cpp: Encrypted TCP relay (reference for driving the library at line rate).
+ *
+ *   loadgen --(plain)--> relay --(ChaCha20)--> server
+ *   loadgen <-(plain)--- relay <-(ChaCha20)--- server
+ *
+ * - `server`  : decrypts the byte stream in the receive buffer, re-encrypts it in place and echoes it back.
+ * - `relay`   : client side tunnel endpoint; encrypts what `loadgen` sends and decrypts the replies.
+ * - `loadgen` : sends time-stamped fixed size messages through the relay and measures the round trips.
+ * - `bench`   : runs all of the above in one process over loopback and prints a summary.
+ *
+ * Since ChaCha20 is a stream cipher and the keystream offset simply follows the byte count, the pumps need no
+ * framing: every received chunk is transformed in place with the offset overload of `ChaCha::apply` and sent
+ * as is.  A TCP `recv` of a large buffer already batches many messages into one system call, and `send` can use
+ * `MSG_ZEROCOPY` (`--zerocopy`), in which case receive buffers are recycled only after the kernel reports the
+ * transmission completed.  Every pump thread is pinned to its own core.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include <chacha20.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#ifndef SO_ZEROCOPY
+#    define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#    define MSG_ZEROCOPY 0x4000000
+#endif
+
+namespace {
+    using clock_t = std::chrono::steady_clock;
+
+    constexpr size_t NUM_BUFFERS = 8;
+
+    struct Options {
+        std::string host     = "127.0.0.1";
+        uint16_t    port     = 0;
+        uint16_t    upstream = 0;
+        size_t      msg_size = 1024;
+        size_t      buf_size = 256 * 1024;
+        size_t      window   = 64;
+        size_t      conns    = 1;
+        double      seconds  = 3;
+        bool        zerocopy = false;
+        bool        crypto   = true;
+        std::string key      = "0123456789abcdef0123456789abcdef";
+    };
+
+    /// @brief Counters shared by the pumps.
+    struct Stats {
+        std::atomic<uint64_t> bytes {0};
+        std::atomic<uint64_t> crypto_ns {0};
+        std::atomic<uint64_t> busy_ns {0};
+
+        void print (const char *who) const {
+            auto b = bytes.load ();
+            auto c = crypto_ns.load ();
+            auto t = busy_ns.load ();
+            fmt::print ("{:<8} {:>12} bytes, crypto {:8.3f} s of {:8.3f} s in the pumps ({:5.1f}%)\n",
+                        who,
+                        b,
+                        1e-9 * static_cast<double> (c),
+                        1e-9 * static_cast<double> (t),
+                        t == 0 ? 0.0 : 100.0 * static_cast<double> (c) / static_cast<double> (t));
+        }
+    };
+
+    [[noreturn]] void fail (const char *what, int err = errno) { throw std::runtime_error (fmt::format ("{}: {}", what, std::strerror (err))); }
+
+    /// @brief Runs `body` and logs what it throws: the threads serving one connection must not take the process down.
+    /// @return `false` if `body` failed
+    template<typename F_>
+    bool guarded (const char *who, F_ &&body) {
+        try {
+            body ();
+            return true;
+        }
+        catch (const std::exception &e) {
+            fmt::print (stderr, "chacha20-relay: {}: {}\n", who, e.what ());
+            return false;
+        }
+    }
+
+    uint64_t elapsed_ns (clock_t::time_point since) {
+        return static_cast<uint64_t> (std::chrono::duration_cast<std::chrono::nanoseconds> (clock_t::now () - since).count ());
+    }
+
+    /// @brief Pins the calling thread to the next core (round robin).
+    void pin_to_next_core () {
+        static std::atomic<unsigned> next {0};
+        auto const                   n    = std::max (1u, std::thread::hardware_concurrency ());
+        auto const                   core = next.fetch_add (1) % n;
+        cpu_set_t                    set;
+        CPU_ZERO (&set);
+        CPU_SET (core, &set);
+        pthread_setaffinity_np (pthread_self (), sizeof (set), &set);
+    }
+
+    void tune (int fd) {
+        int one = 1;
+        setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+    }
+
+    int listen_on (const Options &opt, uint16_t port) {
+        int fd = socket (AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            fail ("socket");
+        }
+        int one = 1;
+        setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_port   = htons (port);
+        inet_pton (AF_INET, opt.host.c_str (), &addr.sin_addr);
+        if (bind (fd, reinterpret_cast<sockaddr *> (&addr), sizeof (addr)) < 0) {
+            fail ("bind");
+        }
+        if (listen (fd, 128) < 0) {
+            fail ("listen");
+        }
+        return fd;
+    }
+
+    uint16_t local_port (int fd) {
+        sockaddr_in addr {};
+        socklen_t   len = sizeof (addr);
+        getsockname (fd, reinterpret_cast<sockaddr *> (&addr), &len);
+        return ntohs (addr.sin_port);
+    }
+
+    int connect_to (const Options &opt, uint16_t port) {
+        int fd = socket (AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            fail ("socket");
+        }
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_port   = htons (port);
+        inet_pton (AF_INET, opt.host.c_str (), &addr.sin_addr);
+        if (connect (fd, reinterpret_cast<sockaddr *> (&addr), sizeof (addr)) < 0) {
+            int err = errno;
+            close (fd);
+            fail ("connect", err);
+        }
+        tune (fd);
+        return fd;
+    }
+
+    bool recv_exact (int fd, void *data, size_t size) {
+        auto *p = static_cast<uint8_t *> (data);
+        while (0 < size) {
+            auto n = recv (fd, p, size, 0);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            p += n;
+            size -= static_cast<size_t> (n);
+        }
+        return true;
+    }
+
+    /// @brief `send` with optional `MSG_ZEROCOPY` completion tracking.
+    class Sender {
+    private:
+        int      fd_;
+        bool     zerocopy_;
+        uint32_t issued_    = 0; /* # of zerocopy sends issued */
+        uint32_t completed_ = 0; /* # of zerocopy sends the kernel is done with */
+
+        void reap (bool block) {
+            pollfd p {fd_, 0, 0};
+            if (poll (&p, 1, block ? 100 : 0) <= 0) {
+                return;
+            }
+            for (;;) {
+                char    control[128];
+                msghdr  msg {};
+                msg.msg_control    = control;
+                msg.msg_controllen = sizeof (control);
+                if (recvmsg (fd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                    return;
+                }
+                for (auto *cm = CMSG_FIRSTHDR (&msg); cm != nullptr; cm = CMSG_NXTHDR (&msg, cm)) {
+                    auto const *err = reinterpret_cast<const sock_extended_err *> (CMSG_DATA (cm));
+                    if (err->ee_errno == 0 && err->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                        completed_ = std::max (completed_, err->ee_data + 1);
+                    }
+                }
+            }
+        }
+
+    public:
+        Sender (int fd, bool zerocopy) : fd_ {fd}, zerocopy_ {zerocopy} {
+            int one = 1;
+            if (zerocopy_ && setsockopt (fd_, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof (one)) < 0) {
+                zerocopy_ = false;
+            }
+        }
+
+        /// @brief Sends everything.
+        /// @return The ticket to pass to `wait` before reusing the buffer
+        uint32_t send_all (const uint8_t *p, size_t size) {
+            while (0 < size) {
+                auto n = ::send (fd_, p, size, MSG_NOSIGNAL | (zerocopy_ ? MSG_ZEROCOPY : 0));
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno == ENOBUFS && zerocopy_) {
+                        reap (true);
+                        continue;
+                    }
+                    fail ("send");
+                }
+                if (zerocopy_) {
+                    ++issued_;
+                }
+                p += n;
+                size -= static_cast<size_t> (n);
+            }
+            return issued_;
+        }
+
+        /// @brief Waits until the kernel no longer references the buffer sent with `ticket`.
+        void wait (uint32_t ticket) {
+            while (zerocopy_ && completed_ < ticket) {
+                reap (true);
+            }
+        }
+    };
+
+    /// @brief Receives from `from`, applies the transforms in place and sends to `to`.
+    /// @param decrypt Keystream removed from the incoming bytes (if any)
+    /// @param encrypt Keystream added to the outgoing bytes (if any)
+    void pump (const Options &opt, int from, int to, std::optional<ChaCha::DJB::State> decrypt, std::optional<ChaCha::DJB::State> encrypt, Stats &stats) {
+        pin_to_next_core ();
+        Sender                             sender {to, opt.zerocopy};
+        std::vector<std::vector<uint8_t>> buffers (NUM_BUFFERS, std::vector<uint8_t> (opt.buf_size));
+        std::vector<uint32_t>             tickets (NUM_BUFFERS, 0);
+        uint64_t                          offset = 0;
+        for (size_t i = 0;; i = (i + 1) % NUM_BUFFERS) {
+            auto &buf = buffers[i];
+            sender.wait (tickets[i]);
+            auto n = recv (from, buf.data (), buf.size (), 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            auto start = clock_t::now ();
+            auto size  = static_cast<size_t> (n);
+            if (decrypt) {
+                ChaCha::apply (*decrypt, buf.data (), size, offset);
+            }
+            if (encrypt) {
+                ChaCha::apply (*encrypt, buf.data (), size, offset);
+            }
+            auto crypto = elapsed_ns (start);
+            tickets[i]  = sender.send_all (buf.data (), size);
+            offset += size;
+            stats.bytes += size;
+            stats.crypto_ns += crypto;
+            stats.busy_ns += elapsed_ns (start);
+        }
+        shutdown (to, SHUT_WR);
+    }
+
+    ChaCha::DJB::State make_state (const Options &opt, uint64_t conn, uint64_t direction) {
+        return ChaCha::DJB::State {opt.key.data (), opt.key.size (), (conn << 1u) | direction};
+    }
+
+    std::optional<ChaCha::DJB::State> maybe (const Options &opt, ChaCha::DJB::State s) {
+        if (opt.crypto) {
+            return s;
+        }
+        return std::nullopt;
+    }
+
+    /// @brief Accepts encrypted connections, echoes the decrypted stream back encrypted with the reverse keystream.
+    void run_server (const Options &opt, int lfd, Stats &stats) {
+        for (;;) {
+            int fd = accept (lfd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fail ("accept");
+            }
+            tune (fd);
+            std::thread {[&opt, &stats, fd] () {
+                guarded ("server", [&] () {
+                    uint64_t conn = 0;
+                    if (recv_exact (fd, &conn, sizeof (conn))) {
+                        pump (opt, fd, fd, maybe (opt, make_state (opt, conn, 0)), maybe (opt, make_state (opt, conn, 1)), stats);
+                    }
+                });
+                close (fd);
+            }}.detach ();
+        }
+    }
+
+    /// @brief Accepts plain connections and tunnels them to the server.
+    void run_relay (const Options &opt, int lfd, Stats &stats) {
+        std::atomic<uint64_t> next_conn {1};
+        for (;;) {
+            int fd = accept (lfd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fail ("accept");
+            }
+            tune (fd);
+            uint64_t conn = next_conn++;
+            std::thread {[&opt, &stats, fd, conn] () {
+                int  up      = -1;
+                // A failed direction wakes up the other one, blocked in `recv`.
+                auto hang_up = [&fd, &up] () {
+                    shutdown (fd, SHUT_RDWR);
+                    shutdown (up, SHUT_RDWR);
+                };
+                guarded ("relay", [&] () {
+                    up = connect_to (opt, opt.upstream);
+                    if (send (up, &conn, sizeof (conn), MSG_NOSIGNAL) != sizeof (conn)) {
+                        fail ("send");
+                    }
+                    std::thread down {[&] () {
+                        if (! guarded ("relay", [&] () { pump (opt, up, fd, maybe (opt, make_state (opt, conn, 1)), std::nullopt, stats); })) {
+                            hang_up ();
+                        }
+                    }};
+                    if (! guarded ("relay", [&] () { pump (opt, fd, up, std::nullopt, maybe (opt, make_state (opt, conn, 0)), stats); })) {
+                        hang_up ();
+                    }
+                    down.join ();
+                });
+                close (fd);
+                if (0 <= up) {
+                    close (up);
+                }
+            }}.detach ();
+        }
+    }
+
+    /// @brief Round trip measurements of one connection.
+    struct LoadResult {
+        uint64_t            messages = 0;
+        uint64_t            corrupted = 0;
+        std::vector<double> latencies; /* microseconds */
+    };
+
+    LoadResult run_connection (const Options &opt, uint16_t port) {
+        int                   fd = connect_to (opt, port);
+        std::atomic<size_t>   outstanding {0};
+        std::atomic<bool>     stop {false};
+        LoadResult            result;
+        auto const            epoch = clock_t::now ();
+
+        std::thread sender {[&] () {
+            pin_to_next_core ();
+            Sender               s {fd, false};
+            std::vector<uint8_t> msg (std::max<size_t> (opt.msg_size, sizeof (uint64_t)), 0x42);
+            auto                 ok = guarded ("loadgen", [&] () {
+                while (! stop.load (std::memory_order_relaxed)) {
+                    if (opt.window <= outstanding.load (std::memory_order_acquire)) {
+                        std::this_thread::yield ();
+                        continue;
+                    }
+                    uint64_t stamp = elapsed_ns (epoch);
+                    std::memcpy (msg.data (), &stamp, sizeof (stamp));
+                    outstanding.fetch_add (1, std::memory_order_release);
+                    s.send_all (msg.data (), msg.size ());
+                }
+            });
+            shutdown (fd, ok ? SHUT_WR : SHUT_RDWR);
+        }};
+        std::thread receiver {[&] () {
+            pin_to_next_core ();
+            std::vector<uint8_t> msg (std::max<size_t> (opt.msg_size, sizeof (uint64_t)));
+            while (recv_exact (fd, msg.data (), msg.size ())) {
+                uint64_t stamp;
+                std::memcpy (&stamp, msg.data (), sizeof (stamp));
+                result.latencies.push_back (1e-3 * static_cast<double> (elapsed_ns (epoch) - stamp));
+                result.messages += 1;
+                if (std::any_of (msg.begin () + sizeof (stamp), msg.end (), [] (uint8_t v) { return v != 0x42; })) {
+                    result.corrupted += 1;
+                }
+                outstanding.fetch_sub (1, std::memory_order_release);
+            }
+        }};
+        std::this_thread::sleep_for (std::chrono::duration<double> (opt.seconds));
+        stop = true;
+        sender.join ();
+        receiver.join ();
+        close (fd);
+        return result;
+    }
+
+    void run_loadgen (const Options &opt, uint16_t port) {
+        std::vector<LoadResult>  results (opt.conns);
+        std::vector<std::thread> threads;
+        auto                     start = clock_t::now ();
+        for (size_t i = 0; i < opt.conns; ++i) {
+            threads.emplace_back ([&opt, &results, port, i] () { guarded ("loadgen", [&] () { results[i] = run_connection (opt, port); }); });
+        }
+        for (auto &t : threads) {
+            t.join ();
+        }
+        auto                seconds = std::chrono::duration<double> (clock_t::now () - start).count ();
+        uint64_t            msgs    = 0;
+        uint64_t            bad     = 0;
+        std::vector<double> all;
+        for (auto &r : results) {
+            msgs += r.messages;
+            bad += r.corrupted;
+            all.insert (all.end (), r.latencies.begin (), r.latencies.end ());
+        }
+        std::sort (all.begin (), all.end ());
+        auto pct = [&all] (double p) { return all.empty () ? 0.0 : all[std::min (all.size () - 1, static_cast<size_t> (p / 100 * all.size ()))]; };
+        auto bits = 8.0 * static_cast<double> (msgs * opt.msg_size);
+        fmt::print ("loadgen  {} conns x {} B messages (window {}): {} round trips in {:.2f} s\n", opt.conns, opt.msg_size, opt.window, msgs, seconds);
+        fmt::print ("loadgen  {:.3f} Gbit/s each way, latency us p50 {:.1f} p99 {:.1f} p99.9 {:.1f} max {:.1f}\n",
+                    bits / seconds / 1e9,
+                    pct (50),
+                    pct (99),
+                    pct (99.9),
+                    pct (100));
+        if (0 < bad) {
+            fmt::print ("loadgen  {} corrupted round trips\n", bad);
+        }
+    }
+
+    void usage () {
+        fmt::print (stderr,
+                    "usage: chacha20-relay server  --port P [options]\n"
+                    "       chacha20-relay relay   --port P --upstream P [options]\n"
+                    "       chacha20-relay loadgen --port P [options]\n"
+                    "       chacha20-relay bench   [options]\n"
+                    "options: --host ADDR --size BYTES --buffer BYTES --window N --connections N --seconds S --zerocopy --no-crypto\n");
+        std::exit (2);
+    }
+
+    Options parse (int argc, char **argv, int first) {
+        Options opt;
+        for (int i = first; i < argc; ++i) {
+            std::string arg {argv[i]};
+            auto        value = [&] () -> std::string {
+                if (argc <= i + 1) {
+                    usage ();
+                }
+                return argv[++i];
+            };
+            if (arg == "--host") {
+                opt.host = value ();
+            }
+            else if (arg == "--port") {
+                opt.port = static_cast<uint16_t> (std::stoul (value ()));
+            }
+            else if (arg == "--upstream") {
+                opt.upstream = static_cast<uint16_t> (std::stoul (value ()));
+            }
+            else if (arg == "--size") {
+                opt.msg_size = std::stoul (value ());
+            }
+            else if (arg == "--buffer") {
+                opt.buf_size = std::stoul (value ());
+            }
+            else if (arg == "--window") {
+                opt.window = std::max<size_t> (1, std::stoul (value ()));
+            }
+            else if (arg == "--connections") {
+                opt.conns = std::max<size_t> (1, std::stoul (value ()));
+            }
+            else if (arg == "--seconds") {
+                opt.seconds = std::stod (value ());
+            }
+            else if (arg == "--zerocopy") {
+                opt.zerocopy = true;
+            }
+            else if (arg == "--no-crypto") {
+                opt.crypto = false;
+            }
+            else {
+                usage ();
+            }
+        }
+        return opt;
+    }
+}  // namespace
+
+int main (int argc, char **argv) {
+    if (argc < 2) {
+        usage ();
+    }
+    std::string mode {argv[1]};
+    auto        opt = parse (argc, argv, 2);
+    try {
+        Stats stats;
+        if (mode == "server") {
+            run_server (opt, listen_on (opt, opt.port), stats);
+        }
+        else if (mode == "relay") {
+            run_relay (opt, listen_on (opt, opt.port), stats);
+        }
+        else if (mode == "loadgen") {
+            run_loadgen (opt, opt.port);
+        }
+        else if (mode == "bench") {
+            Stats server_stats;
+            Stats relay_stats;
+            int   sfd = listen_on (opt, 0);
+            opt.upstream = local_port (sfd);
+            int rfd      = listen_on (opt, 0);
+            std::thread {[&opt, &server_stats, sfd] () { guarded ("server", [&] () { run_server (opt, sfd, server_stats); }); }}.detach ();
+            std::thread {[&opt, &relay_stats, rfd] () { guarded ("relay", [&] () { run_relay (opt, rfd, relay_stats); }); }}.detach ();
+            run_loadgen (opt, local_port (rfd));
+            // Let the pumps drain before reading the counters.
+            std::this_thread::sleep_for (std::chrono::milliseconds (200));
+            server_stats.print ("server");
+            relay_stats.print ("relay");
+        }
+        else {
+            usage ();
+        }
+    }
+    catch (const std::exception &e) {
+        fmt::print (stderr, "chacha20-relay: {}\n", e.what ());
+        return 1;
+    }
+    return 0;
+}
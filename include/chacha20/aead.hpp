@@ -0,0 +1,229 @@
+/*
+ * aead.hpp: ChaCha20-Poly1305 AEAD (RFC 8439), single and batched.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "apply.hpp"
+#include "parallel.hpp"
+#include "poly1305.hpp"
+#include "state-rfc7539.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ChaCha::AEAD {
+    using tag_t = Poly1305::tag_t;
+
+    /// @brief A record of the batch interface.
+    ///
+    /// The key and the nonce come from `state` (its sequence is ignored: block 0 keys Poly1305 and the payload
+    /// starts from block 1).
+    struct Record {
+        RFC7539::State state;
+        const void *   aad;
+        size_t         aad_size;
+        const void *   in;
+        void *         out; /* may be equal to `in` */
+        size_t         size;
+        tag_t          tag;       /* `seal`: output, `open`: expected */
+        bool           authentic; /* `open`: output */
+    };
+
+    namespace detail {
+        /// @brief Encodes the trailing length block of the AEAD construction.
+        inline std::array<uint8_t, 16> lengths (size_t aad_size, size_t size) {
+            std::array<uint8_t, 16> result;
+            for (size_t i = 0; i < 8; ++i) {
+                result[i + 0] = static_cast<uint8_t> (static_cast<uint64_t> (aad_size) >> (8 * i));
+                result[i + 8] = static_cast<uint8_t> (static_cast<uint64_t> (size) >> (8 * i));
+            }
+            return result;
+        }
+
+        inline tag_t compute_tag (const uint8_t *key, const void *aad, size_t aad_size, const void *ciphertext, size_t size) {
+            auto len = lengths (aad_size, size);
+            return Poly1305 {key}.update (aad, aad_size).pad ().update (ciphertext, size).pad ().update (len.data (), len.size ()).finish ();
+        }
+
+        inline tag_t
+        compute_tag_parallel (const uint8_t *key, const void *aad, size_t aad_size, const void *ciphertext, size_t size, size_t threads) {
+            auto len = lengths (aad_size, size);
+            return Poly1305 {key}
+                    .update (aad, aad_size)
+                    .pad ()
+                    .update_parallel (ciphertext, size, threads)
+                    .pad ()
+                    .update (len.data (), len.size ())
+                    .finish ();
+        }
+
+        inline ChaCha::detail::mask_t block0 (const RFC7539::State &state) {
+            auto s = state.state ();
+            s[12]  = 0;
+            return ChaCha::detail::create_mask (s);
+        }
+
+        /// @brief Runs the batch through the multi-state keystream and the multi-buffer Poly1305.
+        ///
+        /// The one-time keys and the payload keystream of the short records (up to `SHORT_BLOCKS` blocks) share one
+        /// `create_masks` call, so the blocks of different records go through the rounds side by side.  Longer payloads
+        /// are already wide enough for `apply` and take it record by record.
+        /// @param encrypt `true` to seal, `false` to open
+        inline size_t process (Record *records, size_t count, bool encrypt) {
+            constexpr size_t BATCH        = 16;
+            constexpr size_t SHORT_BLOCKS = 4;
+            constexpr size_t MAX_BLOCKS   = BATCH * (1 + SHORT_BLOCKS);
+
+            std::array<std::array<uint32_t, 16>, MAX_BLOCKS>  states;
+            std::array<uint8_t, 64 * MAX_BLOCKS>              masks;
+            std::array<size_t, BATCH>                         first; /* index of the record's block 0 in `states` */
+            std::array<std::array<uint8_t, 16>, BATCH>        lens;
+            std::array<ChaCha::detail::poly1305_job_t, BATCH> jobs;
+            std::array<tag_t, BATCH>                          tags;
+
+            auto is_short = [] (const Record &r) { return r.size <= 64 * SHORT_BLOCKS; };
+            auto crypt    = [&] (size_t i) {
+                auto &r = records[i];
+                if (is_short (r)) {
+                    auto const *mask = &masks[64 * (first[i] + 1)];
+                    auto const *src  = static_cast<const uint8_t *> (r.in);
+                    auto *      dst  = static_cast<uint8_t *> (r.out);
+                    for (size_t k = 0; k < r.size; ++k) {
+                        dst[k] = src[k] ^ mask[k];
+                    }
+                }
+                else {
+                    RFC7539::State s {r.state};
+                    s.setSequence (1);
+                    apply (s, r.out, r.in, r.size);
+                }
+            };
+
+            size_t authentic = 0;
+            while (0 < count) {
+                auto   n      = std::min (count, BATCH);
+                size_t blocks = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    auto const &r = records[i];
+                    auto        m = is_short (r) ? 1 + (r.size + 63) / 64 : 1;
+                    first[i]      = blocks;
+                    for (size_t k = 0; k < m; ++k) {
+                        states[blocks + k]     = r.state.state ();
+                        states[blocks + k][12] = static_cast<uint32_t> (k);
+                    }
+                    blocks += m;
+                }
+                // One-time keys and short payloads of the whole batch in one go.
+                ChaCha::detail::create_masks (states.data (), blocks, masks.data ());
+                if (encrypt) {
+                    for (size_t i = 0; i < n; ++i) {
+                        crypt (i);
+                    }
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    auto &r              = records[i];
+                    auto &job            = jobs[i];
+                    lens[i]              = lengths (r.aad_size, r.size);
+                    job.key              = &masks[64 * first[i]];
+                    job.segments[0].data = static_cast<const uint8_t *> (r.aad);
+                    job.segments[0].size = r.aad_size;
+                    job.segments[1].data = static_cast<const uint8_t *> (encrypt ? r.out : r.in);
+                    job.segments[1].size = r.size;
+                    job.segments[2].data = lens[i].data ();
+                    job.segments[2].size = lens[i].size ();
+                    job.num_segments     = 3;
+                    job.pad              = true;
+                    job.tag              = encrypt ? r.tag.data () : tags[i].data ();
+                }
+                ChaCha::detail::poly1305_many (jobs.data (), n);
+                if (! encrypt) {
+                    for (size_t i = 0; i < n; ++i) {
+                        auto &r     = records[i];
+                        r.authentic = Poly1305::verify (r.tag.data (), tags[i].data ());
+                        if (r.authentic) {
+                            crypt (i);
+                            ++authentic;
+                        }
+                    }
+                }
+                std::fill (masks.begin (), masks.begin () + 64 * blocks, 0);
+                records += n;
+                count -= n;
+            }
+            return authentic;
+        }
+    }  // namespace detail
+
+    /// @brief Encrypts `in` into `out` and returns the tag over `aad` and the ciphertext.
+    inline tag_t seal (const RFC7539::State &state, void *out, const void *in, size_t size, const void *aad, size_t aad_size) {
+        auto           key = detail::block0 (state);
+        RFC7539::State s {state};
+        s.setSequence (1);
+        apply (s, out, in, size);
+        auto tag = detail::compute_tag (key.data (), aad, aad_size, out, size);
+        key.fill (0);
+        return tag;
+    }
+
+    /// @brief Verifies `tag` and decrypts `in` into `out`.
+    /// @return `false` if the tag does not match (`out` is left untouched)
+    [[nodiscard]] inline bool
+    open (const RFC7539::State &state, void *out, const void *in, size_t size, const void *aad, size_t aad_size, const void *tag) {
+        auto key      = detail::block0 (state);
+        auto expected = detail::compute_tag (key.data (), aad, aad_size, in, size);
+        key.fill (0);
+        if (! Poly1305::verify (expected.data (), tag)) {
+            return false;
+        }
+        RFC7539::State s {state};
+        s.setSequence (1);
+        apply (s, out, in, size);
+        return true;
+    }
+
+    /// @brief `seal` of one large message, with the keystream and the MAC each split over up to `threads` threads.
+    /// @param threads # of threads (`0`: hardware concurrency)
+    inline tag_t
+    parallel_seal (const RFC7539::State &state, void *out, const void *in, size_t size, const void *aad, size_t aad_size, size_t threads = 0) {
+        auto           key = detail::block0 (state);
+        RFC7539::State s {state};
+        s.setSequence (1);
+        parallel_apply (s, out, in, size, threads);
+        auto tag = detail::compute_tag_parallel (key.data (), aad, aad_size, out, size, threads);
+        key.fill (0);
+        return tag;
+    }
+
+    /// @brief `open` of one large message, with the MAC and the keystream each split over up to `threads` threads.
+    [[nodiscard]] inline bool parallel_open (const RFC7539::State &state,
+                                             void *                out,
+                                             const void *          in,
+                                             size_t                size,
+                                             const void *          aad,
+                                             size_t                aad_size,
+                                             const void *          tag,
+                                             size_t                threads = 0) {
+        auto key      = detail::block0 (state);
+        auto expected = detail::compute_tag_parallel (key.data (), aad, aad_size, in, size, threads);
+        key.fill (0);
+        if (! Poly1305::verify (expected.data (), tag)) {
+            return false;
+        }
+        RFC7539::State s {state};
+        s.setSequence (1);
+        parallel_apply (s, out, in, size, threads);
+        return true;
+    }
+
+    /// @brief Seals `count` records at once.
+    inline void seal (Record *records, size_t count) { detail::process (records, count, true); }
+
+    /// @brief Opens `count` records at once (only the authentic ones are decrypted).
+    /// @return # of authentic records
+    inline size_t open (Record *records, size_t count) { return detail::process (records, count, false); }
+}  // namespace ChaCha::AEAD
@@ -5,6 +5,7 @@
 
 #include "detail.hpp"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstddef>
 #include <array>
@@ -26,21 +27,15 @@ namespace ChaCha {
         auto *out = static_cast<uint8_t *> (result);
         auto *in  = static_cast<const uint8_t *> (msg);
 
+        // Whole blocks go through the multi-block kernel.
         size_t cnt = msg_size / std::tuple_size<detail::mask_t>::value;
-        for (size_t i = 0; i < cnt; ++i) {
-            auto const &mask = detail::create_mask (state.state ());
-            state.incrementSequence ();
-
-            for (size_t j = 0; j < mask.size (); ++j) {
-                out[j] = in[j] ^ mask[j];
-            }
-            out += mask.size ();
-            in += mask.size ();
-        }
+        detail::apply_blocks (state, out, in, cnt);
+        out += cnt * std::tuple_size<detail::mask_t>::value;
+        in += cnt * std::tuple_size<detail::mask_t>::value;
 
         size_t remain = msg_size - (cnt * std::tuple_size<detail::mask_t>::value);
         if (0 < remain) {
-            auto const &mask = detail::create_mask (state.state ());
+            auto const &mask = detail::create_mask (state);
             state.incrementSequence ();
 
             for (size_t i = 0; i < remain; ++i) {
@@ -56,31 +51,7 @@ namespace ChaCha {
     /// @param msg_size
     template<typename State_>
     void apply (State_ &state, void *msg, size_t msg_size) {
-        if (msg == nullptr || msg_size == 0) {
-            return;
-        }
-        auto *m = static_cast<uint8_t *> (msg);
-
-        size_t cnt = msg_size / std::tuple_size<detail::mask_t>::value;
-        for (size_t i = 0; i < cnt; ++i) {
-            auto const &mask = detail::create_mask (state.state ());
-            state.incrementSequence ();
-
-            for (size_t j = 0; j < mask.size (); ++j) {
-                m[j] ^= mask[j];
-            }
-            m += mask.size ();
-        }
-
-        size_t remain = msg_size - (cnt * std::tuple_size<detail::mask_t>::value);
-        if (0 < remain) {
-            auto const &mask = detail::create_mask (state.state ());
-            state.incrementSequence ();
-
-            for (size_t i = 0; i < remain; ++i) {
-                m[i] ^= mask[i];
-            }
-        }
+        apply (state, msg, msg, msg_size);
     }
 
     /// @brief Applies ChaCha20.
@@ -90,23 +61,41 @@ namespace ChaCha {
     /// @param msg
     /// @param msg_size
     /// @param offset
+    /// @remarks On return, the sequence of `state` points the block containing `offset + msg_size`.
     template<typename State_>
     void apply (State_ &state, void *result, const void *msg, size_t msg_size, size_t offset) {
+        constexpr size_t BLOCK_SIZE = std::tuple_size<detail::mask_t>::value;
+
         auto out = static_cast<uint8_t *> (result);
         auto in  = static_cast<const uint8_t *> (msg);
-        auto end = in + msg_size;
 
         state.setSequence (detail::offset_to_sequence (offset));
 
-        auto mask = detail::create_mask (state.state ());
-
-        auto i = static_cast<size_t> (offset % mask.size ());
-        while (in < end) {
-            *out++ = *in++ ^ mask[i++];
-            if (mask.size () <= i) {
+        auto skip = static_cast<size_t> (offset % BLOCK_SIZE);
+        if (0 < skip && 0 < msg_size) {
+            auto const &mask = detail::create_mask (state);
+            auto        n    = std::min (BLOCK_SIZE - skip, msg_size);
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = in[i] ^ mask[skip + i];
+            }
+            if (skip + n == BLOCK_SIZE) {
                 state.incrementSequence ();
-                mask = detail::create_mask (state.state ());
-                i    = 0;
+            }
+            out += n;
+            in += n;
+            msg_size -= n;
+        }
+
+        size_t cnt = msg_size / BLOCK_SIZE;
+        detail::apply_blocks (state, out, in, cnt);
+        out += cnt * BLOCK_SIZE;
+        in += cnt * BLOCK_SIZE;
+
+        size_t remain = msg_size - (cnt * BLOCK_SIZE);
+        if (0 < remain) {
+            auto const &mask = detail::create_mask (state);
+            for (size_t i = 0; i < remain; ++i) {
+                out[i] = in[i] ^ mask[i];
             }
         }
     }
@@ -119,21 +108,6 @@ namespace ChaCha {
     /// @param offset
     template<typename State_>
     void apply (State_ &state, void *msg, size_t msg_size, size_t offset) {
-        auto *m   = static_cast<uint8_t *> (msg);
-        auto *end = m + msg_size;
-
-        state.setSequence (detail::offset_to_sequence (offset));
-
-        auto mask = create_mask (state.state ());
-
-        auto i = static_cast<size_t> (offset % mask.size ());
-        while (m < end) {
-            *m++ ^= mask[i++];
-            if (mask.size () <= i) {
-                state.incrementSequence ();
-                mask = detail::create_mask (state.state ());
-                i    = 0;
-            }
-        }
+        apply (state, msg, msg, msg_size, offset);
     }
 }  // namespace ChaCha
@@ -0,0 +1,204 @@
+/*
+ * block-cache.hpp: Bounded keystream block cache for small random-access reads.
+ *
+ * Small reads at arbitrary offsets (`apply (state, ..., offset)`) compute a whole keystream block for a
+ * few bytes, and overlapping reads compute the same block again.  `BlockCache` keeps recently used
+ * blocks, keyed by the block function and the complete state of the block (key, nonce and block counter),
+ * so it can be shared by any number of states and never returns a block of another key.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "apply.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace ChaCha {
+    /// @brief Sharded, set-associative cache of keystream blocks (thread safe).
+    ///
+    /// - Each shard has its own lock; a block is assigned to a shard by the hash of its state.
+    /// - Within a shard, a block can go to one of `WAYS` slots; the least recently used one is evicted.
+    /// - Evicted slots (and all of them on `clear ()` and destruction) are wiped, as they hold the
+    ///   key as well as the keystream.
+    class BlockCache {
+    public:
+        static constexpr size_t BLOCK_SIZE = std::tuple_size<detail::mask_t>::value;
+        static constexpr size_t WAYS       = 4;
+        /// @brief Reads spanning more blocks than this bypass the cache (the multi-block kernels win).
+        static constexpr size_t MAX_CACHED_RUN = 4;
+
+        struct Statistics {
+            uint64_t hits      = 0;
+            uint64_t misses    = 0;
+            uint64_t evictions = 0;
+        };
+
+    private:
+        using state_t = std::array<uint32_t, 16>;
+
+        struct Entry {
+            state_t        state;
+            detail::mask_t mask;
+            uint64_t       stamp; /* last use (0: empty) */
+            detail::core_t core;
+        };
+
+        struct alignas (64) Shard {
+            std::mutex               mutex_;
+            std::unique_ptr<Entry[]> entries_;
+            uint64_t                 tick_ = 0;
+            Statistics               stats_;
+        };
+
+        size_t                   num_shards_; /* a power of 2 */
+        size_t                   num_sets_;   /* sets per shard */
+        std::unique_ptr<Shard[]> shards_;
+
+    public:
+        /// @param capacity # of blocks to keep (rounded up to a multiple of `shards * WAYS`)
+        /// @param shards # of independently locked shards (rounded up to a power of 2)
+        explicit BlockCache (size_t capacity = 1024, size_t shards = 8)
+                : num_shards_ {1}
+                , num_sets_ {1} {
+            while (num_shards_ < shards) {
+                num_shards_ *= 2;
+            }
+            num_sets_ = std::max<size_t> (1, (capacity + num_shards_ * WAYS - 1) / (num_shards_ * WAYS));
+            shards_   = std::make_unique<Shard[]> (num_shards_);
+            for (size_t i = 0; i < num_shards_; ++i) {
+                shards_[i].entries_ = std::make_unique<Entry[]> (num_sets_ * WAYS);
+            }
+        }
+
+        ~BlockCache () { clear (); }
+
+        BlockCache (const BlockCache &) = delete;
+        BlockCache &operator= (const BlockCache &) = delete;
+
+        [[nodiscard]] size_t capacity () const { return num_shards_ * num_sets_ * WAYS; }
+
+        /// @brief The keystream block at the current sequence of `state` (computed and inserted on a miss).
+        template<typename State_>
+        void get (const State_ &src, detail::mask_t &mask) {
+            constexpr auto core  = detail::core_v<State_>;
+            auto const &   state = src.state ();
+            auto           h     = hash (state, core);
+            auto &shard = shards_[h & (num_shards_ - 1)];
+            auto *set   = &shard.entries_[(h >> 32u) % num_sets_ * WAYS];
+            {
+                std::lock_guard<std::mutex> lock {shard.mutex_};
+                for (size_t i = 0; i < WAYS; ++i) {
+                    auto &e = set[i];
+                    if (e.stamp != 0 && e.core == core && e.state == state) {
+                        e.stamp = ++shard.tick_;
+                        mask    = e.mask;
+                        ++shard.stats_.hits;
+                        return;
+                    }
+                }
+                ++shard.stats_.misses;
+            }
+            // Computed without holding the lock.
+            mask = detail::create_mask (src);
+
+            std::lock_guard<std::mutex> lock {shard.mutex_};
+            Entry *                     victim = &set[0];
+            for (size_t i = 0; i < WAYS; ++i) {
+                auto &e = set[i];
+                if (e.stamp != 0 && e.core == core && e.state == state) {
+                    return; /* inserted by another thread meanwhile */
+                }
+                if (e.stamp < victim->stamp) {
+                    victim = &e;
+                }
+            }
+            if (victim->stamp != 0) {
+                ++shard.stats_.evictions;
+                detail::secure_wipe (victim, sizeof (*victim));
+            }
+            victim->state = state;
+            victim->mask  = mask;
+            victim->stamp = ++shard.tick_;
+            victim->core  = core;
+        }
+
+        /// @brief Sum of the counters of all the shards.
+        [[nodiscard]] Statistics statistics () const {
+            Statistics result;
+            for (size_t i = 0; i < num_shards_; ++i) {
+                auto &                      shard = shards_[i];
+                std::lock_guard<std::mutex> lock {shard.mutex_};
+                result.hits += shard.stats_.hits;
+                result.misses += shard.stats_.misses;
+                result.evictions += shard.stats_.evictions;
+            }
+            return result;
+        }
+
+        /// @brief Wipes all the blocks (the counters are kept).
+        void clear () {
+            for (size_t i = 0; i < num_shards_; ++i) {
+                auto &                      shard = shards_[i];
+                std::lock_guard<std::mutex> lock {shard.mutex_};
+                detail::secure_wipe (shard.entries_.get (), num_sets_ * WAYS * sizeof (Entry));
+            }
+        }
+
+    private:
+        static uint64_t hash (const state_t &state, detail::core_t core) {
+            uint64_t h = static_cast<uint64_t> (core);
+            for (size_t i = 0; i < state.size (); i += 2) {
+                h = (h ^ (static_cast<uint64_t> (state[i]) | (static_cast<uint64_t> (state[i + 1]) << 32u))) * 0x9E3779B97F4A7C15u;
+                h ^= h >> 29u;
+            }
+            return h;
+        }
+    };
+
+    /// @brief Applies ChaCha20 from `offset`, taking short runs of blocks from `cache`.
+    /// @remarks Same as `apply (state, result, msg, msg_size, offset)` otherwise.
+    template<typename State_>
+    void apply (BlockCache &cache, State_ &state, void *result, const void *msg, size_t msg_size, size_t offset) {
+        constexpr size_t BLOCK_SIZE = BlockCache::BLOCK_SIZE;
+
+        auto out = static_cast<uint8_t *> (result);
+        auto in  = static_cast<const uint8_t *> (msg);
+
+        state.setSequence (detail::offset_to_sequence (offset));
+
+        detail::mask_t mask;
+        auto           skip = static_cast<size_t> (offset % BLOCK_SIZE);
+        auto           cnt  = (skip + msg_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if (BlockCache::MAX_CACHED_RUN < cnt) {
+            apply (state, result, msg, msg_size, offset);
+            return;
+        }
+        while (0 < msg_size) {
+            cache.get (state, mask);
+            auto n = std::min (BLOCK_SIZE - skip, msg_size);
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = in[i] ^ mask[skip + i];
+            }
+            if (skip + n == BLOCK_SIZE) {
+                state.incrementSequence ();
+            }
+            out += n;
+            in += n;
+            msg_size -= n;
+            skip = 0;
+        }
+        mask.fill (0);
+    }
+
+    /// @brief Applies ChaCha20 from `offset` (in place), taking short runs of blocks from `cache`.
+    template<typename State_>
+    void apply (BlockCache &cache, State_ &state, void *msg, size_t msg_size, size_t offset) {
+        apply (cache, state, msg, msg, msg_size, offset);
+    }
+}  // namespace ChaCha
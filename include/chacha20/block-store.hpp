@@ -0,0 +1,59 @@
+/*
+ * block-store.hpp: A file of encrypted sectors, read and written in batches.
+ *
+ * Meant for trying `SectorCipher` against block-device style I/O locally: a batch is sorted by sector number,
+ * runs of adjacent sectors become one `preadv` / `pwritev`, and the sectors of the batch are decrypted
+ * (or encrypted, in a scratch buffer: the caller's plaintext is left alone) on up to `threads` threads.
+ *
+ * The file is created (or extended) to `sectors * sector_size` bytes; sectors never written read back as the
+ * keystream (zeros decrypted).  Linux only: elsewhere the constructor throws (`ENOSYS`).
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "sector.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ChaCha {
+    /// @brief File-backed store of encrypted sectors (one batch at a time: a store is not shared between threads).
+    class BlockStore {
+        SectorCipher         cipher_;
+        int                  fd_;
+        uint64_t             sectors_;
+        std::vector<uint8_t> scratch_; /* ciphertext of a `write` batch */
+
+    public:
+        /// @brief Opens (or creates) the store at `path` with room for `sectors` sectors.
+        /// @throws std::invalid_argument if `cipher` cannot address `sectors` sectors
+        /// @throws std::system_error if the file cannot be opened or sized
+        BlockStore (const std::string &path, const SectorCipher &cipher, uint64_t sectors);
+
+        ~BlockStore ();
+        BlockStore (BlockStore &&) noexcept;
+        BlockStore &operator= (BlockStore &&) noexcept;
+        BlockStore (const BlockStore &) = delete;
+        BlockStore &operator= (const BlockStore &) = delete;
+
+        [[nodiscard]] uint64_t sectors () const { return sectors_; }
+
+        [[nodiscard]] size_t sector_size () const { return cipher_.sector_size (); }
+
+        /// @brief Reads and decrypts `count` sectors into their buffers.
+        /// @throws std::out_of_range if a sector number is not below `sectors ()`
+        /// @throws std::system_error on an I/O error
+        void read (const SectorBuffer *sectors, size_t count, size_t threads = 0);
+
+        /// @brief Encrypts and writes `count` sectors (a sector given twice: the last one wins).
+        /// @throws std::out_of_range if a sector number is not below `sectors ()`
+        /// @throws std::system_error on an I/O error
+        void write (const ConstSectorBuffer *sectors, size_t count, size_t threads = 0);
+
+        /// @brief Flushes the written sectors to the device (`fdatasync`).
+        void sync ();
+    };
+}  // namespace ChaCha
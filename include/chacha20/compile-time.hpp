@@ -0,0 +1,91 @@
+/*
+ * compile-time.hpp: ChaCha20 / Salsa20 in constant expressions.
+ *
+ * `apply_constexpr` and `keystream` run the portable kernel (kernel/scalar.hpp, kernel/salsa20.hpp) one block
+ * at a time; its block constructors are `constexpr`, so data under a fixed key and nonce can be embedded already
+ * encrypted (or its keystream precomputed) with nothing left to do at startup.  The states are `constexpr` when
+ * their key and nonce are given as byte pointers (`const void *` cannot be read in a constant expression).
+ *
+ * These are ordinary, slow functions at run time: `ChaCha::apply` keeps using the SIMD kernels.  Compilers
+ * bound the work of a constant evaluation; sizeable tables may need `-fconstexpr-ops-limit` (GCC) or
+ * `-fconstexpr-steps` (Clang) raised.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "detail.hpp"
+#include "kernel/salsa20.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ChaCha {
+    namespace detail {
+        /// @brief HSalsa20 of `key` and the first 16 bytes of `nonce` (the XSalsa20 subkey), in constant expressions as well.
+        constexpr std::array<uint8_t, 32> hsalsa20_constexpr (const std::array<uint8_t, 32> &key, const std::array<uint8_t, 24> &nonce) {
+            std::array<uint8_t, 32> result {};
+            kernel::hsalsa20_scalar (key.data (), nonce.data (), result.data ());
+            return result;
+        }
+
+        /// @brief The keystream block at the current sequence of `state`, as words.
+        template<typename State_>
+        constexpr std::array<uint32_t, 16> block_words (const State_ &state) {
+            std::array<uint32_t, 16> result {};
+            if constexpr (core_v<State_> == core_t::SALSA20) {
+                kernel::SalsaBlocks<1> const x {state.state ()};
+                for (size_t i = 0; i < result.size (); ++i) {
+                    result[i] = x.word (i);
+                }
+            }
+            else {
+                kernel::Blocks<1> const x {state.state (), false};
+                for (size_t i = 0; i < result.size (); ++i) {
+                    result[i] = x.word (i);
+                }
+            }
+            return result;
+        }
+    }  // namespace detail
+
+    /// @brief `ChaCha::apply (state, result, msg, msg_size)` usable in constant expressions.
+    /// @remarks Leaves the sequence of `state` where `apply` does.
+    template<typename State_, typename Out_, typename In_, typename = detail::enable_if_byte_t<Out_>, typename = detail::enable_if_byte_t<In_>>
+    constexpr void apply_constexpr (State_ &state, Out_ *result, const In_ *msg, size_t msg_size) {
+        constexpr size_t BLOCK_SIZE = std::tuple_size<detail::mask_t>::value;
+
+        for (size_t off = 0; off < msg_size; off += BLOCK_SIZE) {
+            auto const x = detail::block_words (state);
+            auto const n = std::min (BLOCK_SIZE, msg_size - off);
+            for (size_t i = 0; i < n; ++i) {
+                auto const k    = static_cast<uint8_t> (x[i / 4] >> (8 * (i % 4)));
+                result[off + i] = static_cast<Out_> (static_cast<uint8_t> (msg[off + i]) ^ k);
+            }
+            state.incrementSequence ();
+        }
+    }
+
+    /// @brief `msg` with the keystream from the current sequence of `state` applied.
+    template<typename State_, size_t N_>
+    constexpr std::array<uint8_t, N_> apply_constexpr (const State_ &state, const std::array<uint8_t, N_> &msg) {
+        State_                  S {state};
+        std::array<uint8_t, N_> result {};
+        apply_constexpr (S, result.data (), msg.data (), N_);
+        return result;
+    }
+
+    /// @brief `N_` bytes of keystream from the current sequence of `state`.
+    template<size_t N_, typename State_>
+    constexpr std::array<uint8_t, N_> keystream (const State_ &state) {
+        return apply_constexpr (state, std::array<uint8_t, N_> {});
+    }
+
+    /// @brief The characters of a string literal (without the terminating NUL) as bytes.
+    template<size_t N_>
+    constexpr std::array<uint8_t, N_ - 1> literal_bytes (const char (&s)[N_]) {
+        return detail::padded<N_ - 1> (s, N_ - 1);
+    }
+}  // namespace ChaCha
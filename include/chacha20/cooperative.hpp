@@ -0,0 +1,171 @@
+/*
+ * cooperative.hpp: Sliced (coroutine based) ChaCha20 application.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "apply.hpp"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#    include <coroutine>
+#    include <exception>
+#    include <utility>
+
+#    define CHACHA20_HAVE_COROUTINES 1
+
+namespace ChaCha {
+
+    /// @brief Lazily started task returned by `apply_cooperatively`.
+    ///
+    /// The task can be driven in two ways:
+    /// - Step by step: `resume ()` processes one slice and returns `true` while slices remain.
+    ///   Suitable for reactors that keep a run queue of resumable jobs (io_uring completion loops etc.).
+    /// - Awaited from another coroutine: `co_await task;`.  The `yield` awaitable given to
+    ///   `apply_cooperatively` is `co_await`ed between slices and should reschedule the current
+    ///   coroutine (e.g. `asio::post (executor, asio::use_awaitable)`).
+    class [[nodiscard]] CooperativeTask {
+    public:
+        struct promise_type {
+            std::coroutine_handle<> continuation_;
+            std::exception_ptr      error_;
+
+            CooperativeTask get_return_object () { return CooperativeTask {handle_t::from_promise (*this)}; }
+
+            std::suspend_always initial_suspend () noexcept { return {}; }
+
+            auto final_suspend () noexcept {
+                struct Awaiter {
+                    bool await_ready () noexcept { return false; }
+
+                    std::coroutine_handle<> await_suspend (std::coroutine_handle<promise_type> h) noexcept {
+                        if (auto c = h.promise ().continuation_) {
+                            return c;
+                        }
+                        return std::noop_coroutine ();
+                    }
+
+                    void await_resume () noexcept {}
+                };
+                return Awaiter {};
+            }
+
+            void return_void () {}
+
+            void unhandled_exception () { error_ = std::current_exception (); }
+        };
+
+    private:
+        using handle_t = std::coroutine_handle<promise_type>;
+        handle_t handle_;
+
+        explicit CooperativeTask (handle_t h) : handle_ {h} {}
+
+        void rethrow_if_failed () const {
+            if (handle_ && handle_.promise ().error_) {
+                std::rethrow_exception (handle_.promise ().error_);
+            }
+        }
+
+    public:
+        ~CooperativeTask () {
+            if (handle_) {
+                handle_.destroy ();
+            }
+        }
+
+        CooperativeTask (const CooperativeTask &) = delete;
+
+        CooperativeTask (CooperativeTask &&src) noexcept : handle_ {std::exchange (src.handle_, {})} {}
+
+        CooperativeTask &operator= (const CooperativeTask &) = delete;
+
+        CooperativeTask &operator= (CooperativeTask &&src) noexcept {
+            if (this != &src) {
+                if (handle_) {
+                    handle_.destroy ();
+                }
+                handle_ = std::exchange (src.handle_, {});
+            }
+            return *this;
+        }
+
+        /// @brief `true` if every slice has been processed.
+        [[nodiscard]] bool done () const { return ! handle_ || handle_.done (); }
+
+        /// @brief Processes the next slice.
+        /// @return `true` if more slices remain
+        bool resume () {
+            if (! done ()) {
+                handle_.resume ();
+            }
+            rethrow_if_failed ();
+            return ! done ();
+        }
+
+        /// @brief Processes every remaining slice.
+        void run () {
+            while (resume ()) {
+                /* NO-OP */
+            }
+        }
+
+        bool await_ready () const noexcept { return done (); }
+
+        std::coroutine_handle<> await_suspend (std::coroutine_handle<> awaiting) noexcept {
+            handle_.promise ().continuation_ = awaiting;
+            return handle_;
+        }
+
+        void await_resume () const { rethrow_if_failed (); }
+    };
+
+    /// @brief Applies ChaCha20 in slices of at most `budget` bytes, suspending between slices.
+    /// @tparam State_ The state type
+    /// @tparam Yield_ Nullary callable returning the awaitable to suspend on between slices
+    /// @param state ChaCha20 state (must outlive the task)
+    /// @param result Output (must outlive the task)
+    /// @param msg Input (must outlive the task)
+    /// @param msg_size # of bytes
+    /// @param budget Slice size (rounded down to a multiple of the block size, 1 block at least)
+    /// @param yield Suspension point
+    /// @remarks Every slice except the last one is a whole number of blocks, so the sequence of `state`
+    ///          points the block of the next unprocessed byte whenever the task is suspended.
+    template<typename State_, typename Yield_>
+    CooperativeTask apply_cooperatively (State_ &state, void *result, const void *msg, size_t msg_size, size_t budget, Yield_ yield) {
+        constexpr size_t BLOCK_SIZE = std::tuple_size<detail::mask_t>::value;
+
+        auto *out = static_cast<uint8_t *> (result);
+        auto *in  = static_cast<const uint8_t *> (msg);
+        budget    = std::max (BLOCK_SIZE, budget - (budget % BLOCK_SIZE));
+        while (0 < msg_size) {
+            auto n = std::min (budget, msg_size);
+            apply (state, out, in, n);
+            out += n;
+            in += n;
+            msg_size -= n;
+            if (0 < msg_size) {
+                co_await yield ();
+            }
+        }
+    }
+
+    /// @brief Applies ChaCha20 in slices of at most `budget` bytes, returning to the caller of `resume ()` between slices.
+    template<typename State_>
+    CooperativeTask apply_cooperatively (State_ &state, void *result, const void *msg, size_t msg_size, size_t budget) {
+        return apply_cooperatively (state, result, msg, msg_size, budget, [] () { return std::suspend_always {}; });
+    }
+
+    /// @brief Applies ChaCha20 in slices (in place).
+    template<typename State_, typename Yield_>
+    CooperativeTask apply_cooperatively (State_ &state, void *msg, size_t msg_size, size_t budget, Yield_ yield) {
+        return apply_cooperatively (state, msg, msg, msg_size, budget, std::move (yield));
+    }
+
+    /// @brief Applies ChaCha20 in slices (in place).
+    template<typename State_>
+    CooperativeTask apply_cooperatively (State_ &state, void *msg, size_t msg_size, size_t budget) {
+        return apply_cooperatively (state, msg, msg, msg_size, budget);
+    }
+}  // namespace ChaCha
+#endif /* __cpp_impl_coroutine */
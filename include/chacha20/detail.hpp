@@ -5,15 +5,171 @@
 #pragma once
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#if defined(TARGET_LITTLE_ENDIAN) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_M_X64) || defined(_M_IX86)
+#    define CHACHA20_LITTLE_ENDIAN 1
+#endif
+
+/* With `CHACHA20_HEADER_ONLY`, the kernels are defined in the headers (see kernel/inline.hpp) so that they can be
+ * inlined into (and specialized for) the caller, and no library is needed for the ChaCha20 core.
+ *
+ * The header-only entry points live in an inline namespace named after the instruction set chosen from the caller's
+ * flags, so that translation units built with different `-m` flags (and the library, which exports the same
+ * functions without the namespace) never share a definition.  The inline templates calling them (`ChaCha::apply`,
+ * ...) are still merged by the linker, though: do not mix the header-only and the library configurations in one
+ * binary, and build the header-only translation units of a binary with the same instruction-set flags. */
+#ifdef CHACHA20_HEADER_ONLY
+#    define CHACHA20_API inline
+#    if defined(__AVX512F__)
+#        define CHACHA20_API_NAMESPACE header_only_avx512
+#    elif defined(__AVX2__)
+#        define CHACHA20_API_NAMESPACE header_only_avx2
+#    elif defined(__SSSE3__) && (defined(__SSE2__) || defined(_M_X64))
+#        define CHACHA20_API_NAMESPACE header_only_ssse3
+#    elif defined(__SSE2__) || defined(_M_X64)
+#        define CHACHA20_API_NAMESPACE header_only_sse2
+#    else
+#        define CHACHA20_API_NAMESPACE header_only_scalar
+#    endif
+#    define CHACHA20_API_BEGIN inline namespace CHACHA20_API_NAMESPACE {
+#    define CHACHA20_API_END }
+#else
+#    define CHACHA20_API
+#    define CHACHA20_API_BEGIN
+#    define CHACHA20_API_END
+#endif
 
 namespace ChaCha::detail {
     using mask_t = std::array<uint8_t, 64>;
     constexpr size_t offset_to_sequence (size_t offset) { return offset / std::tuple_size<mask_t>::value; }
+
+    CHACHA20_API_BEGIN
+    // NOLINTNEXTLINE: cppcoreguidelines-avoid-magic-numbers
+    CHACHA20_API mask_t create_mask (const std::array<uint32_t, 16> &state);
+
+    /// @brief XORs `count` consecutive keystream blocks into `in` and stores them to `out`.
+    /// @param state The state for the first block (the state itself is not modified)
+    /// @param wide_sequence `true` if the block counter spans `state[12]` and `state[13]` (DJB), `false` if it is `state[12]` only (RFC7539)
+    /// @param out Output (may be equal to `in`)
+    /// @param in Input
+    /// @param count # of 64-byte blocks
     // NOLINTNEXTLINE: cppcoreguidelines-avoid-magic-numbers
-    mask_t create_mask (const std::array<uint32_t, 16> &state);
+    CHACHA20_API void apply_blocks (const std::array<uint32_t, 16> &state, bool wide_sequence, void *out, const void *in, size_t count);
+
+    /// @brief Computes one keystream block for each of `count` independent states.
+    /// @param states The states (not modified)
+    /// @param count # of states
+    /// @param out Output (`64 * count` bytes, block `i` belongs to `states[i]`)
+    CHACHA20_API void create_masks (const std::array<uint32_t, 16> *states, size_t count, void *out);
+
+    /// @brief Computes the first 5 bytes of one block for each of `count` 16-byte samples, the sample taking the place of
+    ///        words 12 .. 15 (counter and nonce) of `state` (QUIC header protection).
+    /// @param state Words 0 .. 11 (constants and key) are used
+    /// @param samples `16 * count` bytes
+    /// @param out Output (`5 * count` bytes)
+    CHACHA20_API void header_protection_masks (const std::array<uint32_t, 16> &state, const void *samples, size_t count, void *out);
+
+    /// @brief Salsa20 counterpart of `create_mask`.
+    CHACHA20_API mask_t salsa20_create_mask (const std::array<uint32_t, 16> &state);
+
+    /// @brief Salsa20 counterpart of `apply_blocks` (the block counter is always 64-bit, in `state[8]` and `state[9]`).
+    CHACHA20_API void salsa20_apply_blocks (const std::array<uint32_t, 16> &state, void *out, const void *in, size_t count);
+    CHACHA20_API_END
+
+    /// @brief Block function of a state type.
+    enum class core_t {
+        CHACHA20,
+        SALSA20,
+    };
+
+    template<typename State_, typename = void>
+    struct core_of {
+        static constexpr core_t value = core_t::CHACHA20;
+    };
+
+    /// @brief States of the other block functions say so with `static constexpr core_t CORE`.
+    template<typename State_>
+    struct core_of<State_, std::void_t<decltype (State_::CORE)>> {
+        static constexpr core_t value = State_::CORE;
+    };
+
+    template<typename State_>
+    constexpr core_t core_v = core_of<State_>::value;
+
+    /// @brief Sequence (block counter) type of the state.
+    template<typename State_>
+    using sequence_t = std::decay_t<decltype (std::declval<const State_ &> ().getSequence ())>;
+
+    /// @brief `true` if the state uses 64-bit block counter.
+    template<typename State_>
+    constexpr bool has_wide_sequence_v = sizeof (sequence_t<State_>) == sizeof (uint64_t);
+
+    /// @brief Applies `count` keystream blocks and advances the sequence of `state`.
+    template<typename State_>
+    void apply_blocks (State_ &state, uint8_t *out, const uint8_t *in, size_t count) {
+        if (count == 0) {
+            return;
+        }
+        if constexpr (core_v<State_> == core_t::SALSA20) {
+            salsa20_apply_blocks (state.state (), out, in, count);
+        }
+        else {
+            apply_blocks (state.state (), has_wide_sequence_v<State_>, out, in, count);
+        }
+        state.setSequence (static_cast<sequence_t<State_>> (state.getSequence () + count));
+    }
+
+    /// @brief The keystream block at the current sequence of `state`.
+    template<typename State_, typename = decltype (std::declval<const State_ &> ().state ())>
+    mask_t create_mask (const State_ &state) {
+        if constexpr (core_v<State_> == core_t::SALSA20) {
+            return salsa20_create_mask (state.state ());
+        }
+        else {
+            return create_mask (state.state ());
+        }
+    }
+
+    /// @brief Byte types keys and nonces may be given as in constant expressions (`const void *` may not be read there).
+    template<typename T_>
+    constexpr bool is_byte_v = std::is_same_v<T_, char> || std::is_same_v<T_, signed char> || std::is_same_v<T_, unsigned char> ||
+                               std::is_same_v<T_, std::byte>;
+
+    template<typename T_>
+    using enable_if_byte_t = std::enable_if_t<is_byte_v<T_>>;
+
+    /// @brief `asUInt32` usable in constant expressions.
+    template<typename Byte_, typename = enable_if_byte_t<Byte_>>
+    constexpr uint32_t le32 (const Byte_ *p) {
+        // clang-format off
+        return ((static_cast<uint32_t> (static_cast<uint8_t> (p[0])) <<  0u) |
+                (static_cast<uint32_t> (static_cast<uint8_t> (p[1])) <<  8u) |
+                (static_cast<uint32_t> (static_cast<uint8_t> (p[2])) << 16u) |
+                (static_cast<uint32_t> (static_cast<uint8_t> (p[3])) << 24u));
+        // clang-format on
+    }
+
+    /// @brief Copies up to `N_` bytes of `src` into a zero-padded array (in constant expressions, too).
+    template<size_t N_, typename Byte_, typename = enable_if_byte_t<Byte_>>
+    constexpr std::array<uint8_t, N_> padded (const Byte_ *src, size_t size) {
+        std::array<uint8_t, N_> result {};
+        for (size_t i = 0; i < N_ && i < size; ++i) {
+            result[i] = static_cast<uint8_t> (src[i]);
+        }
+        return result;
+    }
 
     inline uint32_t asUInt32 (const void *data) {
+#ifdef CHACHA20_LITTLE_ENDIAN
+        uint32_t v;
+        ::memcpy (&v, data, sizeof (v));
+        return v;
+#else
         // clang-format off
         auto const *p = static_cast<const uint8_t *> (data);
         return ((static_cast<uint32_t> (p[0]) <<  0u) |
@@ -21,9 +177,15 @@ namespace ChaCha::detail {
                 (static_cast<uint32_t> (p[2]) << 16u) |
                 (static_cast<uint32_t> (p[3]) << 24u));
         // clang-format on
+#endif
     }
 
     inline uint64_t asUInt64 (const void *data) {
+#ifdef CHACHA20_LITTLE_ENDIAN
+        uint64_t v;
+        ::memcpy (&v, data, sizeof (v));
+        return v;
+#else
         // clang-format off
         auto const *p = static_cast<const uint8_t *> (data);
         return ((static_cast<uint64_t> (p[0]) <<  0u) |
@@ -35,5 +197,18 @@ namespace ChaCha::detail {
                 (static_cast<uint64_t> (p[6]) << 48u) |
                 (static_cast<uint64_t> (p[7]) << 56u));
         // clang-format on
+#endif
+    }
+
+    /// @brief Zeroes `size` bytes in a way the compiler may not elide.
+    inline void secure_wipe (void *data, size_t size) {
+        auto volatile *p = static_cast<volatile uint8_t *> (data);
+        for (size_t i = 0; i < size; ++i) {
+            p[i] = 0;
+        }
     }
 }  // namespace ChaCha20::detail
+
+#ifdef CHACHA20_HEADER_ONLY
+#    include "kernel/inline.hpp"
+#endif
@@ -0,0 +1,169 @@
+/*
+ * fields.hpp: Applies the keystream to selected fields of fixed-size records.
+ *
+ * The selected bytes of all the records, in address order, are encrypted as one message: byte `k` of that
+ * message takes byte `k` of the keystream, exactly as `ChaCha::apply` on the bytes gathered into a buffer.
+ * The keystream is produced a chunk of blocks at a time by the multi-block kernel and scattered into the
+ * fields, so selecting a few bytes per record costs little more than applying that many bytes in bulk
+ * (one `apply` per field would start a fresh block for each of them).
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "apply.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <vector>
+
+namespace ChaCha {
+    /// @brief Byte range of a record.
+    struct Field {
+        size_t offset;
+        size_t size;
+    };
+
+    /// @brief Record size and the fields to encrypt (sorted, overlapping and adjacent fields merged).
+    class RecordLayout {
+        size_t             stride_;
+        std::vector<Field> fields_;
+        size_t             selected_ = 0;
+
+    public:
+        /// @throws std::invalid_argument if a field does not fit in `stride` bytes
+        template<typename It_>
+        RecordLayout (size_t stride, It_ first, It_ last)
+                : stride_ {stride} {
+            std::vector<Field> fields;
+            for (auto it = first; it != last; ++it) {
+                if (stride < it->offset || stride - it->offset < it->size) {
+                    throw std::invalid_argument {"RecordLayout: the field exceeds the record"};
+                }
+                if (0 < it->size) {
+                    fields.push_back (*it);
+                }
+            }
+            std::sort (fields.begin (), fields.end (), [] (const Field &a, const Field &b) { return a.offset < b.offset; });
+            for (auto const &f : fields) {
+                if (! fields_.empty () && f.offset <= fields_.back ().offset + fields_.back ().size) {
+                    auto &last = fields_.back ();
+                    last.size  = std::max (last.offset + last.size, f.offset + f.size) - last.offset;
+                }
+                else {
+                    fields_.push_back (f);
+                }
+            }
+            for (auto const &f : fields_) {
+                selected_ += f.size;
+            }
+        }
+
+        RecordLayout (size_t stride, std::initializer_list<Field> fields)
+                : RecordLayout {stride, fields.begin (), fields.end ()} {}
+
+        [[nodiscard]] size_t                    stride () const { return stride_; }
+        [[nodiscard]] const std::vector<Field> &fields () const { return fields_; }
+        /// @brief # of selected bytes per record.
+        [[nodiscard]] size_t selected () const { return selected_; }
+        /// @brief `true` if every byte of a record is selected.
+        [[nodiscard]] bool dense () const { return selected_ == stride_; }
+    };
+
+    namespace detail {
+        inline void xor_bytes (uint8_t *out, const uint8_t *in, const uint8_t *mask, size_t size) {
+            size_t i = 0;
+            for (; i + 8 <= size; i += 8) {
+                uint64_t a;
+                uint64_t b;
+                ::memcpy (&a, in + i, 8);
+                ::memcpy (&b, mask + i, 8);
+                a ^= b;
+                ::memcpy (out + i, &a, 8);
+            }
+            for (; i < size; ++i) {
+                out[i] = in[i] ^ mask[i];
+            }
+        }
+    }  // namespace detail
+
+    /// @brief Applies the keystream to the fields of `count` records (the other bytes are copied).
+    /// @remarks On return, the sequence of `state` is as after `apply` on `count * layout.selected ()` bytes.
+    template<typename State_>
+    void apply_fields (State_ &state, void *result, const void *records, size_t count, const RecordLayout &layout) {
+        constexpr size_t BLOCK_SIZE   = std::tuple_size<detail::mask_t>::value;
+        constexpr size_t CHUNK_BLOCKS = 64;   /* keystream per refill: within L1, and a full run for the widest kernel */
+        constexpr size_t PREFETCH     = 2048; /* bytes ahead: sparse fields defeat the hardware prefetcher */
+
+        auto *      out = static_cast<uint8_t *> (result);
+        auto const *in  = static_cast<const uint8_t *> (records);
+        if (count == 0 || layout.selected () == 0) {
+            if (out != in && 0 < count) {
+                ::memmove (out, in, count * layout.stride ());
+            }
+            return;
+        }
+        if (layout.dense ()) {
+            apply (state, out, in, count * layout.stride ());
+            return;
+        }
+        if (out != in) {
+            ::memmove (out, in, count * layout.stride ());
+        }
+
+        auto const total  = count * layout.selected ();
+        size_t     blocks = 0; /* keystream blocks generated so far */
+
+        alignas (64) uint8_t keystream[CHUNK_BLOCKS * BLOCK_SIZE];
+        size_t               avail = 0;
+        size_t               pos   = 0;
+
+        [[maybe_unused]] bool const sparse = BLOCK_SIZE <= layout.stride ();
+        for (size_t r = 0; r < count; ++r) {
+            auto *rec = out + r * layout.stride ();
+#if defined(__GNUC__) || defined(__clang__)
+            if (sparse) {
+                // Address arithmetic on integers: the prefetched address may be past the end of the records.
+                auto const ahead = reinterpret_cast<uintptr_t> (rec) + layout.fields ().front ().offset + PREFETCH;
+                __builtin_prefetch (reinterpret_cast<const void *> (ahead), 1);
+            }
+#endif
+            for (auto const &f : layout.fields ()) {
+                auto * p = rec + f.offset;
+                size_t n = f.size;
+                if (n <= avail - pos) {
+                    detail::xor_bytes (p, p, keystream + pos, n);
+                    pos += n;
+                    continue;
+                }
+                while (0 < n) {
+                    if (pos == avail) {
+                        // Only the blocks the remaining bytes need: the sequence ends up where `apply` leaves it.
+                        auto const needed = (total - blocks * BLOCK_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE;
+                        auto const k      = std::min (CHUNK_BLOCKS, needed);
+                        ::memset (keystream, 0, k * BLOCK_SIZE);
+                        detail::apply_blocks (state, keystream, keystream, k);
+                        blocks += k;
+                        avail = k * BLOCK_SIZE;
+                        pos   = 0;
+                    }
+                    auto const m = std::min (n, avail - pos);
+                    detail::xor_bytes (p, p, keystream + pos, m);
+                    p += m;
+                    pos += m;
+                    n -= m;
+                }
+            }
+        }
+    }
+
+    /// @brief Applies the keystream to the fields of `count` records (in place).
+    template<typename State_>
+    void apply_fields (State_ &state, void *records, size_t count, const RecordLayout &layout) {
+        apply_fields (state, records, records, count, layout);
+    }
+}  // namespace ChaCha
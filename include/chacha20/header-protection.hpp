@@ -0,0 +1,41 @@
+/*
+ * header-protection.hpp: ChaCha20 header-protection masks of QUIC (RFC 9001, 5.4.4), single and batched.
+ *
+ * A mask is the first 5 bytes of the block whose counter and nonce are a 16-byte sample of the packet's
+ * ciphertext (counter: bytes 0 .. 3, little-endian; nonce: bytes 4 .. 15), under the header-protection key.
+ * `masks` runs a whole batch through the multi-state kernels: the key words are broadcast once per call and
+ * 16 (AVX-512F), 8 (AVX2) or 4 (SSE2) samples share each pass through the rounds.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "detail.hpp"
+#include "state-rfc7539.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ChaCha::HeaderProtection {
+    using sample_t = std::array<uint8_t, 16>;
+    using mask_t   = std::array<uint8_t, 5>;
+
+    static_assert (sizeof (sample_t) == 16 && sizeof (mask_t) == 5, "samples and masks are passed as packed arrays");
+
+    /// @brief Computes the masks of `count` samples.
+    /// @param key The header-protection key (the nonce and sequence of `key` are not used)
+    /// @param samples The samples
+    /// @param count # of samples
+    /// @param out Output (`count` masks, mask `i` belongs to `samples[i]`)
+    inline void masks (const RFC7539::State &key, const sample_t *samples, size_t count, mask_t *out) {
+        ChaCha::detail::header_protection_masks (key.state (), samples, count, out);
+    }
+
+    /// @brief Computes the mask of `sample`.
+    inline mask_t mask (const RFC7539::State &key, const sample_t &sample) {
+        mask_t result;
+        masks (key, &sample, 1, &result);
+        return result;
+    }
+}  // namespace ChaCha::HeaderProtection
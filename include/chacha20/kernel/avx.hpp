@@ -0,0 +1,374 @@
+/*
+ * avx.hpp: 8-way (AVX2) and 16-way (AVX-512F) word-sliced ChaCha20 kernel bodies.
+ *
+ * Each body is compiled only where the instruction set is enabled (`__AVX2__`, `__AVX512F__`): in the
+ * per-ISA translation units of the library, or in a header-only caller built with the matching `-m` flags.
+ * Leftover blocks fall through to the narrower kernels.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "sse.hpp"
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#    include <immintrin.h>
+#endif
+
+namespace ChaCha::detail::kernel { namespace {
+#ifdef __AVX2__
+    /// @brief Transposes 16 words x 8 lanes into 8 blocks, XORs them with input (if any) and stores.
+    /// @tparam Stream_ `true` for non-temporal stores (`out` must be 32-byte aligned)
+    template<bool Stream_ = false>
+    void store_8x16 (uint8_t *out, const uint8_t *in, const __m256i (&x)[16]) {
+        // Words `4g .. 4g+3` of the 8 lanes into rows: row `k` holds block `k` (low half) and block `k + 4` (high half).
+        auto transpose = [] (__m256i (&r)[4], __m256i a, __m256i b, __m256i c, __m256i d) {
+            __m256i t0 = _mm256_unpacklo_epi32 (a, b);
+            __m256i t1 = _mm256_unpacklo_epi32 (c, d);
+            __m256i t2 = _mm256_unpackhi_epi32 (a, b);
+            __m256i t3 = _mm256_unpackhi_epi32 (c, d);
+            r[0]       = _mm256_unpacklo_epi64 (t0, t1);
+            r[1]       = _mm256_unpackhi_epi64 (t0, t1);
+            r[2]       = _mm256_unpacklo_epi64 (t2, t3);
+            r[3]       = _mm256_unpackhi_epi64 (t2, t3);
+        };
+        auto xor_store = [out, in] (size_t off, __m256i v) {
+            if (in != nullptr) {
+                v = _mm256_xor_si256 (v, _mm256_loadu_si256 (reinterpret_cast<const __m256i *> (in + off)));
+            }
+            if constexpr (Stream_) {
+                _mm256_stream_si256 (reinterpret_cast<__m256i *> (out + off), v);
+            }
+            else {
+                _mm256_storeu_si256 (reinterpret_cast<__m256i *> (out + off), v);
+            }
+        };
+        for (size_t h = 0; h < 2; ++h) {
+            __m256i lo[4];
+            __m256i hi[4];
+            transpose (lo, x[8 * h + 0], x[8 * h + 1], x[8 * h + 2], x[8 * h + 3]);
+            transpose (hi, x[8 * h + 4], x[8 * h + 5], x[8 * h + 6], x[8 * h + 7]);
+            for (size_t k = 0; k < 4; ++k) {
+                xor_store (64 * k + 32 * h, _mm256_permute2x128_si256 (lo[k], hi[k], 0x20));
+                xor_store (64 * (k + 4) + 32 * h, _mm256_permute2x128_si256 (lo[k], hi[k], 0x31));
+            }
+        }
+    }
+
+    /// @brief `transpose_4x4` within each 128-bit lane.
+    inline void transpose_4x4 (__m256i &r0, __m256i &r1, __m256i &r2, __m256i &r3, __m256i a, __m256i b, __m256i c, __m256i d) {
+        __m256i t0 = _mm256_unpacklo_epi32 (a, b);
+        __m256i t1 = _mm256_unpacklo_epi32 (c, d);
+        __m256i t2 = _mm256_unpackhi_epi32 (a, b);
+        __m256i t3 = _mm256_unpackhi_epi32 (c, d);
+        r0         = _mm256_unpacklo_epi64 (t0, t1);
+        r1         = _mm256_unpackhi_epi64 (t0, t1);
+        r2         = _mm256_unpacklo_epi64 (t2, t3);
+        r3         = _mm256_unpackhi_epi64 (t2, t3);
+    }
+
+    /// @brief 8 blocks at once, one block per 32-bit lane.
+    class AVX2x8 {
+    public:
+        static constexpr size_t LANES            = 8;
+        static constexpr size_t STREAM_ALIGNMENT = 32;
+
+    private:
+        template<int N_>
+        static __m256i rot (__m256i v) {
+            return _mm256_or_si256 (_mm256_slli_epi32 (v, N_), _mm256_srli_epi32 (v, 32 - N_));
+        }
+        static __m256i rot16 (__m256i v) {
+            const __m256i R16 = _mm256_setr_epi8 (2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                                  2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+            return _mm256_shuffle_epi8 (v, R16);
+        }
+        static __m256i rot8 (__m256i v) {
+            const __m256i R8 = _mm256_setr_epi8 (3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                                 3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+            return _mm256_shuffle_epi8 (v, R8);
+        }
+
+        static inline void quarter_round (__m256i &a, __m256i &b, __m256i &c, __m256i &d) {
+            a = _mm256_add_epi32 (a, b);
+            d = rot16 (_mm256_xor_si256 (d, a));
+            c = _mm256_add_epi32 (c, d);
+            b = rot<12> (_mm256_xor_si256 (b, c));
+            a = _mm256_add_epi32 (a, b);
+            d = rot8 (_mm256_xor_si256 (d, a));
+            c = _mm256_add_epi32 (c, d);
+            b = rot<7> (_mm256_xor_si256 (b, c));
+        }
+
+        /// @brief The 20 rounds, in place (without the final addition).
+        static void rounds (__m256i (&x)[16]) {
+            for (int_fast32_t i = 0; i < 10; ++i) {
+                quarter_round (x[0], x[4], x[8], x[12]);
+                quarter_round (x[1], x[5], x[9], x[13]);
+                quarter_round (x[2], x[6], x[10], x[14]);
+                quarter_round (x[3], x[7], x[11], x[15]);
+                quarter_round (x[0], x[5], x[10], x[15]);
+                quarter_round (x[1], x[6], x[11], x[12]);
+                quarter_round (x[2], x[7], x[8], x[13]);
+                quarter_round (x[3], x[4], x[9], x[14]);
+            }
+        }
+
+    public:
+        /// @brief Processes `LANES` consecutive blocks starting from `state`.
+        template<bool Stream_ = false>
+        static void apply (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in) {
+            __m256i orig[16];
+            for (size_t i = 0; i < 16; ++i) {
+                orig[i] = _mm256_set1_epi32 (static_cast<int32_t> (state[i]));
+            }
+            {
+                alignas (32) uint32_t seq_lo[LANES];
+                alignas (32) uint32_t seq_hi[LANES];
+                for (size_t k = 0; k < LANES; ++k) {
+                    state_t s {state};
+                    advance (s, wide_sequence, k);
+                    seq_lo[k] = s[12];
+                    seq_hi[k] = s[13];
+                }
+                orig[12] = _mm256_load_si256 (reinterpret_cast<const __m256i *> (seq_lo));
+                orig[13] = _mm256_load_si256 (reinterpret_cast<const __m256i *> (seq_hi));
+            }
+            __m256i x[16];
+            for (size_t i = 0; i < 16; ++i) {
+                x[i] = orig[i];
+            }
+            rounds (x);
+            for (size_t i = 0; i < 16; ++i) {
+                x[i] = _mm256_add_epi32 (x[i], orig[i]);
+            }
+            store_8x16<Stream_> (out, in, x);
+        }
+
+        /// @brief Header-protection masks of `LANES` samples (see `header_masks_sse`).
+        /// @param key Words 0 .. 11 of the state, broadcast
+        static void header_masks (const __m256i (&key)[12], const uint8_t *samples, uint8_t *out) {
+            __m256i x[16];
+            for (size_t i = 0; i < 12; ++i) {
+                x[i] = key[i];
+            }
+            __m256i s[4];
+            for (size_t k = 0; k < 4; ++k) {
+                s[k] = _mm256_loadu_si256 (reinterpret_cast<const __m256i *> (samples + 32 * k));
+            }
+            transpose_4x4 (x[12], x[13], x[14], x[15], s[0], s[1], s[2], s[3]);
+            rounds (x);
+            alignas (32) uint32_t w0[LANES];
+            alignas (32) uint32_t w1[LANES];
+            _mm256_store_si256 (reinterpret_cast<__m256i *> (w0), _mm256_add_epi32 (x[0], key[0]));
+            _mm256_store_si256 (reinterpret_cast<__m256i *> (w1), _mm256_add_epi32 (x[1], key[1]));
+            store_header_masks<LANES> (w0, w1, out);
+        }
+    };
+
+    /// @brief Runs whole groups of `Kernel_::LANES` blocks (the rest is left in `count`).
+    template<typename Kernel_>
+    void apply_blocks_sliced (state_t &state, bool wide_sequence, uint8_t *&out, const uint8_t *&in, size_t &count) {
+        while (Kernel_::LANES <= count) {
+            Kernel_::apply (state, wide_sequence, out, in);
+            advance (state, wide_sequence, Kernel_::LANES);
+            out += 64 * Kernel_::LANES;
+            in += 64 * Kernel_::LANES;
+            count -= Kernel_::LANES;
+        }
+    }
+
+    inline void apply_blocks_avx2 (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count) {
+        state_t s {state};
+        apply_blocks_sliced<AVX2x8> (s, wide_sequence, out, in, count);
+        apply_blocks_sse<RotSSSE3> (s, wide_sequence, out, in, count);
+    }
+
+    /// @brief `header_masks_sse`, 8 samples at a time.
+    inline void header_masks_avx2 (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count) {
+        if (AVX2x8::LANES <= count) {
+            __m256i key[12];
+            for (size_t i = 0; i < 12; ++i) {
+                key[i] = _mm256_set1_epi32 (static_cast<int32_t> (state[i]));
+            }
+            while (AVX2x8::LANES <= count) {
+                AVX2x8::header_masks (key, samples, out);
+                samples += 16 * AVX2x8::LANES;
+                out += 5 * AVX2x8::LANES;
+                count -= AVX2x8::LANES;
+            }
+        }
+        header_masks_sse<RotSSSE3> (state, samples, out, count);
+    }
+
+    inline void apply_blocks_avx2_large (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count, size_t distance) {
+        state_t s {state};
+        apply_blocks_streaming<AVX2x8> (s, wide_sequence, out, in, count, distance);
+        apply_blocks_sse<RotSSSE3> (s, wide_sequence, out, in, count);
+    }
+#endif /* __AVX2__ */
+
+#ifdef __AVX512F__
+    /// @brief `transpose_4x4` within each 128-bit lane.
+    inline void transpose_4x4 (__m512i &r0, __m512i &r1, __m512i &r2, __m512i &r3, __m512i a, __m512i b, __m512i c, __m512i d) {
+        __m512i t0 = _mm512_unpacklo_epi32 (a, b);
+        __m512i t1 = _mm512_unpacklo_epi32 (c, d);
+        __m512i t2 = _mm512_unpackhi_epi32 (a, b);
+        __m512i t3 = _mm512_unpackhi_epi32 (c, d);
+        r0         = _mm512_unpacklo_epi64 (t0, t1);
+        r1         = _mm512_unpackhi_epi64 (t0, t1);
+        r2         = _mm512_unpacklo_epi64 (t2, t3);
+        r3         = _mm512_unpackhi_epi64 (t2, t3);
+    }
+
+    /// @brief 16 blocks at once, one block per 32-bit lane (rotations are single `vprold`s).
+    class AVX512x16 {
+    public:
+        static constexpr size_t LANES            = 16;
+        static constexpr size_t STREAM_ALIGNMENT = 64;
+
+    private:
+        static inline void quarter_round (__m512i &a, __m512i &b, __m512i &c, __m512i &d) {
+            a = _mm512_add_epi32 (a, b);
+            d = _mm512_rol_epi32 (_mm512_xor_si512 (d, a), 16);
+            c = _mm512_add_epi32 (c, d);
+            b = _mm512_rol_epi32 (_mm512_xor_si512 (b, c), 12);
+            a = _mm512_add_epi32 (a, b);
+            d = _mm512_rol_epi32 (_mm512_xor_si512 (d, a), 8);
+            c = _mm512_add_epi32 (c, d);
+            b = _mm512_rol_epi32 (_mm512_xor_si512 (b, c), 7);
+        }
+
+        /// @brief The 20 rounds, in place (without the final addition).
+        static void rounds (__m512i (&x)[16]) {
+            for (int_fast32_t i = 0; i < 10; ++i) {
+                quarter_round (x[0], x[4], x[8], x[12]);
+                quarter_round (x[1], x[5], x[9], x[13]);
+                quarter_round (x[2], x[6], x[10], x[14]);
+                quarter_round (x[3], x[7], x[11], x[15]);
+                quarter_round (x[0], x[5], x[10], x[15]);
+                quarter_round (x[1], x[6], x[11], x[12]);
+                quarter_round (x[2], x[7], x[8], x[13]);
+                quarter_round (x[3], x[4], x[9], x[14]);
+            }
+        }
+
+        /// @brief Transposes 16 words x 16 lanes into 16 blocks, XORs them with input (if any) and stores.
+        template<bool Stream_>
+        static void store (uint8_t *out, const uint8_t *in, const __m512i (&x)[16]) {
+            // r[g][k]: words `4g .. 4g+3` of blocks `k`, `k + 4`, `k + 8` and `k + 12` (one per 128-bit lane).
+            __m512i r[4][4];
+            for (size_t g = 0; g < 4; ++g) {
+                __m512i t0 = _mm512_unpacklo_epi32 (x[4 * g + 0], x[4 * g + 1]);
+                __m512i t1 = _mm512_unpacklo_epi32 (x[4 * g + 2], x[4 * g + 3]);
+                __m512i t2 = _mm512_unpackhi_epi32 (x[4 * g + 0], x[4 * g + 1]);
+                __m512i t3 = _mm512_unpackhi_epi32 (x[4 * g + 2], x[4 * g + 3]);
+                r[g][0]    = _mm512_unpacklo_epi64 (t0, t1);
+                r[g][1]    = _mm512_unpackhi_epi64 (t0, t1);
+                r[g][2]    = _mm512_unpacklo_epi64 (t2, t3);
+                r[g][3]    = _mm512_unpackhi_epi64 (t2, t3);
+            }
+            auto xor_store = [out, in] (size_t block, __m512i v) {
+                if (in != nullptr) {
+                    v = _mm512_xor_si512 (v, _mm512_loadu_si512 (in + 64 * block));
+                }
+                if constexpr (Stream_) {
+                    _mm512_stream_si512 (reinterpret_cast<__m512i *> (out + 64 * block), v);
+                }
+                else {
+                    _mm512_storeu_si512 (out + 64 * block, v);
+                }
+            };
+            for (size_t k = 0; k < 4; ++k) {
+                __m512i a = _mm512_shuffle_i32x4 (r[0][k], r[1][k], 0x44); /* g0.l0 g0.l1 g1.l0 g1.l1 */
+                __m512i b = _mm512_shuffle_i32x4 (r[2][k], r[3][k], 0x44);
+                __m512i c = _mm512_shuffle_i32x4 (r[0][k], r[1][k], 0xEE); /* g0.l2 g0.l3 g1.l2 g1.l3 */
+                __m512i d = _mm512_shuffle_i32x4 (r[2][k], r[3][k], 0xEE);
+                xor_store (k + 0, _mm512_shuffle_i32x4 (a, b, 0x88));
+                xor_store (k + 4, _mm512_shuffle_i32x4 (a, b, 0xDD));
+                xor_store (k + 8, _mm512_shuffle_i32x4 (c, d, 0x88));
+                xor_store (k + 12, _mm512_shuffle_i32x4 (c, d, 0xDD));
+            }
+        }
+
+    public:
+        template<bool Stream_ = false>
+        static void apply (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in) {
+            __m512i orig[16];
+            for (size_t i = 0; i < 16; ++i) {
+                orig[i] = _mm512_set1_epi32 (static_cast<int32_t> (state[i]));
+            }
+            {
+                alignas (64) uint32_t seq_lo[LANES];
+                alignas (64) uint32_t seq_hi[LANES];
+                for (size_t k = 0; k < LANES; ++k) {
+                    state_t s {state};
+                    advance (s, wide_sequence, k);
+                    seq_lo[k] = s[12];
+                    seq_hi[k] = s[13];
+                }
+                orig[12] = _mm512_load_si512 (seq_lo);
+                orig[13] = _mm512_load_si512 (seq_hi);
+            }
+            __m512i x[16];
+            for (size_t i = 0; i < 16; ++i) {
+                x[i] = orig[i];
+            }
+            rounds (x);
+            for (size_t i = 0; i < 16; ++i) {
+                x[i] = _mm512_add_epi32 (x[i], orig[i]);
+            }
+            store<Stream_> (out, in, x);
+        }
+
+        /// @brief Header-protection masks of `LANES` samples (see `header_masks_sse`).
+        /// @param key Words 0 .. 11 of the state, broadcast
+        static void header_masks (const __m512i (&key)[12], const uint8_t *samples, uint8_t *out) {
+            __m512i x[16];
+            for (size_t i = 0; i < 12; ++i) {
+                x[i] = key[i];
+            }
+            __m512i s[4];
+            for (size_t k = 0; k < 4; ++k) {
+                s[k] = _mm512_loadu_si512 (samples + 64 * k);
+            }
+            transpose_4x4 (x[12], x[13], x[14], x[15], s[0], s[1], s[2], s[3]);
+            rounds (x);
+            alignas (64) uint32_t w0[LANES];
+            alignas (64) uint32_t w1[LANES];
+            _mm512_store_si512 (w0, _mm512_add_epi32 (x[0], key[0]));
+            _mm512_store_si512 (w1, _mm512_add_epi32 (x[1], key[1]));
+            store_header_masks<LANES> (w0, w1, out);
+        }
+    };
+
+    inline void apply_blocks_avx512 (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count) {
+        state_t s {state};
+        apply_blocks_sliced<AVX512x16> (s, wide_sequence, out, in, count);
+        apply_blocks_avx2 (s, wide_sequence, out, in, count);
+    }
+
+    /// @brief `header_masks_sse`, 16 samples at a time.
+    inline void header_masks_avx512 (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count) {
+        if (AVX512x16::LANES <= count) {
+            __m512i key[12];
+            for (size_t i = 0; i < 12; ++i) {
+                key[i] = _mm512_set1_epi32 (static_cast<int32_t> (state[i]));
+            }
+            while (AVX512x16::LANES <= count) {
+                AVX512x16::header_masks (key, samples, out);
+                samples += 16 * AVX512x16::LANES;
+                out += 5 * AVX512x16::LANES;
+                count -= AVX512x16::LANES;
+            }
+        }
+        header_masks_avx2 (state, samples, out, count);
+    }
+
+    inline void apply_blocks_avx512_large (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count, size_t distance) {
+        state_t s {state};
+        apply_blocks_streaming<AVX512x16> (s, wide_sequence, out, in, count, distance);
+        apply_blocks_avx2 (s, wide_sequence, out, in, count);
+    }
+#endif /* __AVX512F__ */
+}}  // namespace ChaCha::detail::kernel
@@ -0,0 +1,61 @@
+/*
+ * common.hpp: Pieces shared by the kernels.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "../detail.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ChaCha::detail::kernel {
+    using state_t = std::array<uint32_t, 16>;
+}  // namespace ChaCha::detail::kernel
+
+// Compiled into every kernel translation unit with its own `-m` flags: internal linkage, like the kernel bodies.
+namespace ChaCha::detail::kernel { namespace {
+    /// @brief Computes the state of the `n`th block counted from `state`.
+    constexpr void advance (state_t &state, bool wide_sequence, uint64_t n) {
+        if (wide_sequence) {
+            uint64_t seq = (static_cast<uint64_t> (state[13]) << 32u) | state[12];
+            seq += n;
+            state[12] = static_cast<uint32_t> (seq >> 0u);
+            state[13] = static_cast<uint32_t> (seq >> 32u);
+        }
+        else {
+            state[12] += static_cast<uint32_t> (n);
+        }
+    }
+
+    /// @brief Loads a little-endian 32-bit word.
+    inline uint32_t load_le32 (const uint8_t *p) {
+#ifdef CHACHA20_LITTLE_ENDIAN
+        uint32_t v;
+        ::memcpy (&v, p, sizeof (v));
+        return v;
+#else
+        // clang-format off
+        return ((static_cast<uint32_t> (p[0]) <<  0u) |
+                (static_cast<uint32_t> (p[1]) <<  8u) |
+                (static_cast<uint32_t> (p[2]) << 16u) |
+                (static_cast<uint32_t> (p[3]) << 24u));
+        // clang-format on
+#endif
+    }
+
+    /// @brief Stores a 32-bit word in little-endian.
+    inline void store_le32 (uint8_t *p, uint32_t v) {
+#ifdef CHACHA20_LITTLE_ENDIAN
+        ::memcpy (p, &v, sizeof (v));
+#else
+        p[0] = static_cast<uint8_t> (v >> 0u);
+        p[1] = static_cast<uint8_t> (v >> 8u);
+        p[2] = static_cast<uint8_t> (v >> 16u);
+        p[3] = static_cast<uint8_t> (v >> 24u);
+#endif
+    }
+}}  // namespace ChaCha::detail::kernel
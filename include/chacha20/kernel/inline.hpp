@@ -0,0 +1,99 @@
+/*
+ * inline.hpp: Kernel definitions of the header-only configuration (`CHACHA20_HEADER_ONLY`).
+ *
+ * The instruction set is chosen at compile time from the caller's flags (AVX-512F > AVX2 > SSSE3 > SSE2 > portable)
+ * instead of the run-time dispatch of the library.  The definitions go into the inline namespace named after that
+ * choice (`CHACHA20_API_NAMESPACE`, see detail.hpp); keep the two chains in step.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "common.hpp"
+#include "salsa20.hpp"
+#include "scalar.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#    include "avx.hpp"
+#    include "salsa20-sse.hpp"
+#    include "sse.hpp"
+#    define CHACHA20_INLINE_SSE 1
+#endif
+
+namespace ChaCha::detail {
+#ifdef CHACHA20_INLINE_SSE
+    namespace kernel { namespace {
+#    ifdef __SSSE3__
+        using InlineRot = RotSSSE3;
+#    else
+        using InlineRot = RotSSE2;
+#    endif
+    }}  // namespace kernel
+#endif
+
+    CHACHA20_API_BEGIN
+    inline mask_t create_mask (const std::array<uint32_t, 16> &state) {
+        mask_t result;
+#ifdef CHACHA20_INLINE_SSE
+        kernel::create_mask_sse<kernel::InlineRot> (state, result.data ());
+#else
+        kernel::create_mask_scalar (state, result.data ());
+#endif
+        return result;
+    }
+
+    inline void apply_blocks (const std::array<uint32_t, 16> &state, bool wide_sequence, void *out, const void *in, size_t count) {
+        auto *      dst = static_cast<uint8_t *> (out);
+        auto const *src = static_cast<const uint8_t *> (in);
+#if defined(__AVX512F__)
+        kernel::apply_blocks_avx512 (state, wide_sequence, dst, src, count);
+#elif defined(__AVX2__)
+        kernel::apply_blocks_avx2 (state, wide_sequence, dst, src, count);
+#elif defined(CHACHA20_INLINE_SSE)
+        kernel::apply_blocks_sse<kernel::InlineRot> (state, wide_sequence, dst, src, count);
+#else
+        kernel::apply_blocks_scalar (state, wide_sequence, dst, src, count);
+#endif
+    }
+
+    inline void create_masks (const std::array<uint32_t, 16> *states, size_t count, void *out) {
+#ifdef CHACHA20_INLINE_SSE
+        kernel::create_masks_sse<kernel::InlineRot> (states, static_cast<uint8_t *> (out), count);
+#else
+        kernel::create_masks_scalar (states, static_cast<uint8_t *> (out), count);
+#endif
+    }
+
+    inline void header_protection_masks (const std::array<uint32_t, 16> &state, const void *samples, size_t count, void *out) {
+        auto const *src = static_cast<const uint8_t *> (samples);
+        auto *      dst = static_cast<uint8_t *> (out);
+#if defined(__AVX512F__)
+        kernel::header_masks_avx512 (state, src, dst, count);
+#elif defined(__AVX2__)
+        kernel::header_masks_avx2 (state, src, dst, count);
+#elif defined(CHACHA20_INLINE_SSE)
+        kernel::header_masks_sse<kernel::InlineRot> (state, src, dst, count);
+#else
+        kernel::header_masks_scalar (state, src, dst, count);
+#endif
+    }
+
+    inline mask_t salsa20_create_mask (const std::array<uint32_t, 16> &state) {
+        mask_t result;
+        kernel::create_mask_salsa20_scalar (state, result.data ());
+        return result;
+    }
+
+    inline void salsa20_apply_blocks (const std::array<uint32_t, 16> &state, void *out, const void *in, size_t count) {
+        auto *      dst = static_cast<uint8_t *> (out);
+        auto const *src = static_cast<const uint8_t *> (in);
+#if defined(__AVX2__)
+        kernel::apply_blocks_salsa20_avx2 (state, dst, src, count);
+#elif defined(CHACHA20_INLINE_SSE)
+        kernel::apply_blocks_salsa20_sse (state, dst, src, count);
+#else
+        kernel::apply_blocks_salsa20_scalar (state, dst, src, count);
+#endif
+    }
+    CHACHA20_API_END
+}  // namespace ChaCha::detail
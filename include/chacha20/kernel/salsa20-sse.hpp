@@ -0,0 +1,159 @@
+/*
+ * salsa20-sse.hpp: 4-way (SSE2) and 8-way (AVX2) word-sliced Salsa20 kernel bodies.
+ *
+ * Salsa20 has no byte-aligned rotation, so there is no SSSE3 variant.  The AVX2 body is compiled
+ * only where `__AVX2__` is defined (kernel-avx2.cpp, or a header-only caller built with `-mavx2`).
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "avx.hpp"
+#include "salsa20.hpp"
+#include "sse.hpp"
+
+namespace ChaCha::detail::kernel { namespace {
+
+    /// @brief 4 Salsa20 blocks at once, one block per 32-bit lane.
+    class SalsaSSEx4 {
+    public:
+        static constexpr size_t LANES = 4;
+
+    private:
+        template<int N_>
+        static __m128i rot (__m128i v) {
+            return _mm_or_si128 (_mm_slli_epi32 (v, N_), _mm_srli_epi32 (v, 32 - N_));
+        }
+
+        static inline void quarter_round (__m128i &a, __m128i &b, __m128i &c, __m128i &d) {
+            b = _mm_xor_si128 (b, rot<7> (_mm_add_epi32 (a, d)));
+            c = _mm_xor_si128 (c, rot<9> (_mm_add_epi32 (b, a)));
+            d = _mm_xor_si128 (d, rot<13> (_mm_add_epi32 (c, b)));
+            a = _mm_xor_si128 (a, rot<18> (_mm_add_epi32 (d, c)));
+        }
+
+    public:
+        /// @brief Processes `LANES` consecutive blocks starting from `state` (stores the keystream if `in` is `nullptr`).
+        static void apply (const state_t &state, uint8_t *out, const uint8_t *in) {
+            __m128i orig[16];
+            for (size_t i = 0; i < 16; ++i) {
+                orig[i] = _mm_set1_epi32 (static_cast<int32_t> (state[i]));
+            }
+            {
+                state_t s1 {state};
+                state_t s2 {state};
+                state_t s3 {state};
+                advance_salsa20 (s1, 1);
+                advance_salsa20 (s2, 2);
+                advance_salsa20 (s3, 3);
+                orig[8] = _mm_setr_epi32 (state[8], s1[8], s2[8], s3[8]);
+                orig[9] = _mm_setr_epi32 (state[9], s1[9], s2[9], s3[9]);
+            }
+            __m128i x[16];
+            for (size_t i = 0; i < 16; ++i) {
+                x[i] = orig[i];
+            }
+            for (int_fast32_t i = 0; i < 10; ++i) {
+                quarter_round (x[0], x[4], x[8], x[12]);
+                quarter_round (x[5], x[9], x[13], x[1]);
+                quarter_round (x[10], x[14], x[2], x[6]);
+                quarter_round (x[15], x[3], x[7], x[11]);
+                quarter_round (x[0], x[1], x[2], x[3]);
+                quarter_round (x[5], x[6], x[7], x[4]);
+                quarter_round (x[10], x[11], x[8], x[9]);
+                quarter_round (x[15], x[12], x[13], x[14]);
+            }
+            for (size_t i = 0; i < 16; ++i) {
+                x[i] = _mm_add_epi32 (x[i], orig[i]);
+            }
+            store_4x4 (out + 0, in == nullptr ? nullptr : in + 0, x[0], x[1], x[2], x[3]);
+            store_4x4 (out + 16, in == nullptr ? nullptr : in + 16, x[4], x[5], x[6], x[7]);
+            store_4x4 (out + 32, in == nullptr ? nullptr : in + 32, x[8], x[9], x[10], x[11]);
+            store_4x4 (out + 48, in == nullptr ? nullptr : in + 48, x[12], x[13], x[14], x[15]);
+        }
+    };
+
+    /// @brief Runs whole groups of `Kernel_::LANES` blocks (the rest is left in `count`).
+    template<typename Kernel_>
+    void apply_blocks_salsa20_sliced (state_t &state, uint8_t *&out, const uint8_t *&in, size_t &count) {
+        while (Kernel_::LANES <= count) {
+            Kernel_::apply (state, out, in);
+            advance_salsa20 (state, Kernel_::LANES);
+            out += 64 * Kernel_::LANES;
+            in += 64 * Kernel_::LANES;
+            count -= Kernel_::LANES;
+        }
+    }
+
+    inline void apply_blocks_salsa20_sse (const state_t &state, uint8_t *out, const uint8_t *in, size_t count) {
+        state_t s {state};
+        apply_blocks_salsa20_sliced<SalsaSSEx4> (s, out, in, count);
+        apply_n_salsa20_scalar<2> (s, out, in, count);
+        apply_n_salsa20_scalar<1> (s, out, in, count);
+    }
+
+#ifdef __AVX2__
+    /// @brief 8 Salsa20 blocks at once, one block per 32-bit lane.
+    class SalsaAVX2x8 {
+    public:
+        static constexpr size_t LANES = 8;
+
+    private:
+        template<int N_>
+        static __m256i rot (__m256i v) {
+            return _mm256_or_si256 (_mm256_slli_epi32 (v, N_), _mm256_srli_epi32 (v, 32 - N_));
+        }
+
+        static inline void quarter_round (__m256i &a, __m256i &b, __m256i &c, __m256i &d) {
+            b = _mm256_xor_si256 (b, rot<7> (_mm256_add_epi32 (a, d)));
+            c = _mm256_xor_si256 (c, rot<9> (_mm256_add_epi32 (b, a)));
+            d = _mm256_xor_si256 (d, rot<13> (_mm256_add_epi32 (c, b)));
+            a = _mm256_xor_si256 (a, rot<18> (_mm256_add_epi32 (d, c)));
+        }
+
+    public:
+        static void apply (const state_t &state, uint8_t *out, const uint8_t *in) {
+            __m256i orig[16];
+            for (size_t i = 0; i < 16; ++i) {
+                orig[i] = _mm256_set1_epi32 (static_cast<int32_t> (state[i]));
+            }
+            {
+                alignas (32) uint32_t seq_lo[LANES];
+                alignas (32) uint32_t seq_hi[LANES];
+                for (size_t k = 0; k < LANES; ++k) {
+                    state_t s {state};
+                    advance_salsa20 (s, k);
+                    seq_lo[k] = s[8];
+                    seq_hi[k] = s[9];
+                }
+                orig[8] = _mm256_load_si256 (reinterpret_cast<const __m256i *> (seq_lo));
+                orig[9] = _mm256_load_si256 (reinterpret_cast<const __m256i *> (seq_hi));
+            }
+            __m256i x[16];
+            for (size_t i = 0; i < 16; ++i) {
+                x[i] = orig[i];
+            }
+            for (int_fast32_t i = 0; i < 10; ++i) {
+                quarter_round (x[0], x[4], x[8], x[12]);
+                quarter_round (x[5], x[9], x[13], x[1]);
+                quarter_round (x[10], x[14], x[2], x[6]);
+                quarter_round (x[15], x[3], x[7], x[11]);
+                quarter_round (x[0], x[1], x[2], x[3]);
+                quarter_round (x[5], x[6], x[7], x[4]);
+                quarter_round (x[10], x[11], x[8], x[9]);
+                quarter_round (x[15], x[12], x[13], x[14]);
+            }
+            for (size_t i = 0; i < 16; ++i) {
+                x[i] = _mm256_add_epi32 (x[i], orig[i]);
+            }
+            store_8x16 (out, in, x);
+        }
+    };
+
+    inline void apply_blocks_salsa20_avx2 (const state_t &state, uint8_t *out, const uint8_t *in, size_t count) {
+        state_t s {state};
+        apply_blocks_salsa20_sliced<SalsaAVX2x8> (s, out, in, count);
+        apply_blocks_salsa20_sse (s, out, in, count);
+    }
+#endif /* __AVX2__ */
+}}  // namespace ChaCha::detail::kernel
@@ -0,0 +1,129 @@
+/*
+ * salsa20.hpp: Portable Salsa20 kernel body (and HSalsa20).
+ *
+ * Same layout as scalar.hpp: words are stored as `x[word][block]` so that the quarter rounds of the
+ * (independent) blocks are issued back to back.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "scalar.hpp"
+
+namespace ChaCha::detail::kernel { namespace {
+    /// @brief Computes the Salsa20 state of the `n`th block counted from `state` (the counter is `state[8..9]`).
+    constexpr void advance_salsa20 (state_t &state, uint64_t n) {
+        uint64_t seq = (static_cast<uint64_t> (state[9]) << 32u) | state[8];
+        seq += n;
+        state[8] = static_cast<uint32_t> (seq >> 0u);
+        state[9] = static_cast<uint32_t> (seq >> 32u);
+    }
+
+    /// @brief Computes `N_` consecutive Salsa20 blocks at once.
+    template<size_t N_>
+    class SalsaBlocks {
+    private:
+        uint32_t x_[16][N_] {};
+
+        constexpr void quarter_round (size_t a, size_t b, size_t c, size_t d) {
+            // clang-format off
+            for (size_t k = 0; k < N_; ++k) { x_[b][k] ^= rot32<7> (x_[a][k] + x_[d][k]); }
+            for (size_t k = 0; k < N_; ++k) { x_[c][k] ^= rot32<9> (x_[b][k] + x_[a][k]); }
+            for (size_t k = 0; k < N_; ++k) { x_[d][k] ^= rot32<13> (x_[c][k] + x_[b][k]); }
+            for (size_t k = 0; k < N_; ++k) { x_[a][k] ^= rot32<18> (x_[d][k] + x_[c][k]); }
+            // clang-format on
+        }
+
+    public:
+        /// @param feed_forward `false` for HSalsa20 (the rounds only)
+        constexpr explicit SalsaBlocks (const state_t &state, bool feed_forward = true) {
+            uint32_t orig[16][N_] {};
+            for (size_t k = 0; k < N_; ++k) {
+                state_t s {state};
+                advance_salsa20 (s, k);
+                for (size_t i = 0; i < 16; ++i) {
+                    orig[i][k] = s[i];
+                    x_[i][k]   = s[i];
+                }
+            }
+            for (int_fast32_t i = 0; i < 10; ++i) {
+                quarter_round (0, 4, 8, 12);
+                quarter_round (5, 9, 13, 1);
+                quarter_round (10, 14, 2, 6);
+                quarter_round (15, 3, 7, 11);
+                quarter_round (0, 1, 2, 3);
+                quarter_round (5, 6, 7, 4);
+                quarter_round (10, 11, 8, 9);
+                quarter_round (15, 12, 13, 14);
+            }
+            if (feed_forward) {
+                for (size_t i = 0; i < 16; ++i) {
+                    for (size_t k = 0; k < N_; ++k) {
+                        x_[i][k] += orig[i][k];
+                    }
+                }
+            }
+        }
+
+        [[nodiscard]] constexpr uint32_t word (size_t i) const { return x_[i][0]; }
+
+        void apply (uint8_t *out, const uint8_t *in) const {
+            for (size_t k = 0; k < N_; ++k) {
+                for (size_t i = 0; i < 16; ++i) {
+                    auto off = 64 * k + 4 * i;
+                    store_le32 (out + off, load_le32 (in + off) ^ x_[i][k]);
+                }
+            }
+        }
+
+        void store (uint8_t *out) const {
+            for (size_t k = 0; k < N_; ++k) {
+                for (size_t i = 0; i < 16; ++i) {
+                    store_le32 (out + 64 * k + 4 * i, x_[i][k]);
+                }
+            }
+        }
+    };
+
+    template<size_t N_>
+    void apply_n_salsa20_scalar (state_t &state, uint8_t *&out, const uint8_t *&in, size_t &count) {
+        while (N_ <= count) {
+            SalsaBlocks<N_> {state}.apply (out, in);
+            advance_salsa20 (state, N_);
+            out += 64 * N_;
+            in += 64 * N_;
+            count -= N_;
+        }
+    }
+
+    /// @brief Portable Salsa20 kernel, interleaving up to 4 independent blocks.
+    inline void apply_blocks_salsa20_scalar (const state_t &state, uint8_t *out, const uint8_t *in, size_t count) {
+        state_t s {state};
+        apply_n_salsa20_scalar<4> (s, out, in, count);
+        apply_n_salsa20_scalar<2> (s, out, in, count);
+        apply_n_salsa20_scalar<1> (s, out, in, count);
+    }
+
+    inline void create_mask_salsa20_scalar (const state_t &state, uint8_t *out) { SalsaBlocks<1> {state}.store (out); }
+
+    /// @brief HSalsa20: the Salsa20 rounds without the feed-forward, keeping the diagonal and the nonce words.
+    constexpr void hsalsa20_scalar (const uint8_t *key, const uint8_t *nonce, uint8_t *out) {
+        state_t s {};
+        s[0]  = 0x61707865u;
+        s[5]  = 0x3320646eu;
+        s[10] = 0x79622d32u;
+        s[15] = 0x6b206574u;
+        for (size_t i = 0; i < 4; ++i) {
+            s[1 + i]  = le32 (key + 4 * i);
+            s[11 + i] = le32 (key + 16 + 4 * i);
+            s[6 + i]  = le32 (nonce + 4 * i);
+        }
+        SalsaBlocks<1> const x {s, false};
+        const size_t         words[] = {0, 5, 10, 15, 6, 7, 8, 9};
+        for (size_t i = 0; i < 8; ++i) {
+            for (size_t j = 0; j < 4; ++j) {
+                out[4 * i + j] = static_cast<uint8_t> (x.word (words[i]) >> (8 * j));
+            }
+        }
+    }
+}}  // namespace ChaCha::detail::kernel
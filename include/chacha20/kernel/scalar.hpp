@@ -0,0 +1,128 @@
+/*
+ * scalar.hpp: Portable kernel body.
+ *
+ * Shared by the library and the header-only configuration; lives in an unnamed namespace like the
+ * SIMD kernel bodies.  The blocks are computed by `constexpr` constructors, so compile-time.hpp runs
+ * the very same core in constant expressions.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "common.hpp"
+
+namespace ChaCha::detail::kernel { namespace {
+    template<size_t N_>
+    constexpr uint32_t rot32 (uint32_t v) {
+        return (v << N_) | (v >> (32u - N_));
+    }
+
+    /// @brief Computes `N_` consecutive blocks at once.
+    ///        Words are stored as `x[word][block]` so that every step of the quarter round is issued
+    ///        for all of the (independent) blocks back to back.
+    template<size_t N_>
+    class Blocks {
+    private:
+        uint32_t x_[16][N_] {};
+
+        constexpr void quarter_round (size_t a, size_t b, size_t c, size_t d) {
+            // clang-format off
+            for (size_t k = 0; k < N_; ++k) { x_[a][k] += x_[b][k]; }
+            for (size_t k = 0; k < N_; ++k) { x_[d][k] = rot32<16> (x_[d][k] ^ x_[a][k]); }
+            for (size_t k = 0; k < N_; ++k) { x_[c][k] += x_[d][k]; }
+            for (size_t k = 0; k < N_; ++k) { x_[b][k] = rot32<12> (x_[b][k] ^ x_[c][k]); }
+            for (size_t k = 0; k < N_; ++k) { x_[a][k] += x_[b][k]; }
+            for (size_t k = 0; k < N_; ++k) { x_[d][k] = rot32<8> (x_[d][k] ^ x_[a][k]); }
+            for (size_t k = 0; k < N_; ++k) { x_[c][k] += x_[d][k]; }
+            for (size_t k = 0; k < N_; ++k) { x_[b][k] = rot32<7> (x_[b][k] ^ x_[c][k]); }
+            // clang-format on
+        }
+
+    public:
+        constexpr Blocks (const state_t &state, bool wide_sequence) {
+            uint32_t orig[16][N_] {};
+            for (size_t k = 0; k < N_; ++k) {
+                state_t s {state};
+                advance (s, wide_sequence, k);
+                for (size_t i = 0; i < 16; ++i) {
+                    orig[i][k] = s[i];
+                    x_[i][k]   = s[i];
+                }
+            }
+            for (int_fast32_t i = 0; i < 10; ++i) {
+                quarter_round (0, 4, 8, 12);
+                quarter_round (1, 5, 9, 13);
+                quarter_round (2, 6, 10, 14);
+                quarter_round (3, 7, 11, 15);
+                quarter_round (0, 5, 10, 15);
+                quarter_round (1, 6, 11, 12);
+                quarter_round (2, 7, 8, 13);
+                quarter_round (3, 4, 9, 14);
+            }
+            for (size_t i = 0; i < 16; ++i) {
+                for (size_t k = 0; k < N_; ++k) {
+                    x_[i][k] += orig[i][k];
+                }
+            }
+        }
+
+        [[nodiscard]] constexpr uint32_t word (size_t i) const { return x_[i][0]; }
+
+        void apply (uint8_t *out, const uint8_t *in) const {
+            for (size_t k = 0; k < N_; ++k) {
+                for (size_t i = 0; i < 16; ++i) {
+                    auto off = 64 * k + 4 * i;
+                    store_le32 (out + off, load_le32 (in + off) ^ x_[i][k]);
+                }
+            }
+        }
+
+        void store (uint8_t *out) const {
+            for (size_t k = 0; k < N_; ++k) {
+                for (size_t i = 0; i < 16; ++i) {
+                    store_le32 (out + 64 * k + 4 * i, x_[i][k]);
+                }
+            }
+        }
+    };
+
+    template<size_t N_>
+    void apply_n_scalar (state_t &state, bool wide_sequence, uint8_t *&out, const uint8_t *&in, size_t &count) {
+        while (N_ <= count) {
+            Blocks<N_> {state, wide_sequence}.apply (out, in);
+            advance (state, wide_sequence, N_);
+            out += 64 * N_;
+            in += 64 * N_;
+            count -= N_;
+        }
+    }
+
+    /// @brief Portable kernel, interleaving up to 4 independent blocks.
+    inline void apply_blocks_scalar (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count) {
+        state_t s {state};
+        apply_n_scalar<4> (s, wide_sequence, out, in, count);
+        apply_n_scalar<2> (s, wide_sequence, out, in, count);
+        apply_n_scalar<1> (s, wide_sequence, out, in, count);
+    }
+
+    inline void create_mask_scalar (const state_t &state, uint8_t *out) { Blocks<1> {state, false}.store (out); }
+
+    inline void create_masks_scalar (const state_t *states, uint8_t *out, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            Blocks<1> {states[i], false}.store (out + 64 * i);
+        }
+    }
+
+    /// @brief Header-protection masks (see `header_masks_sse`), one block at a time.
+    inline void header_masks_scalar (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count) {
+        state_t s {state};
+        uint8_t block[64];
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t k = 0; k < 4; ++k) {
+                s[12 + k] = load_le32 (samples + 16 * i + 4 * k);
+            }
+            Blocks<1> {s, false}.store (block);
+            ::memcpy (out + 5 * i, block, 5);
+        }
+    }
+}}  // namespace ChaCha::detail::kernel
@@ -0,0 +1,380 @@
+/*
+ * sse.hpp: 4-way word-sliced ChaCha20 kernel body.
+ *
+ * Included from the per-ISA translation units (and from the header-only
+ * configuration); everything lives in an unnamed namespace so that copies
+ * compiled with different `-m` flags never get merged by the linker.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "common.hpp"
+
+#include <cstdint>
+
+#include <emmintrin.h>
+#ifdef __SSSE3__
+#    include <tmmintrin.h>
+#endif
+
+namespace ChaCha::detail::kernel { namespace {
+
+    /// @brief Rotations with SSE2 only (shifts, plus word shuffles for 16).
+    struct RotSSE2 {
+        template<int N_>
+        static __m128i rot (__m128i v) {
+            return _mm_or_si128 (_mm_slli_epi32 (v, N_), _mm_srli_epi32 (v, 32 - N_));
+        }
+        static __m128i rot16 (__m128i v) {
+            return _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (v, _MM_SHUFFLE (2, 3, 0, 1)), _MM_SHUFFLE (2, 3, 0, 1));
+        }
+        static __m128i rot12 (__m128i v) { return rot<12> (v); }
+        static __m128i rot8 (__m128i v) { return rot<8> (v); }
+        static __m128i rot7 (__m128i v) { return rot<7> (v); }
+    };
+
+#ifdef __SSSE3__
+    /// @brief Rotations using `pshufb` for the byte-aligned ones.
+    struct RotSSSE3 {
+        template<int N_>
+        static __m128i rot (__m128i v) {
+            return _mm_or_si128 (_mm_slli_epi32 (v, N_), _mm_srli_epi32 (v, 32 - N_));
+        }
+        static __m128i rot16 (__m128i v) {
+            const __m128i R16 = _mm_setr_epi8 (2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+            return _mm_shuffle_epi8 (v, R16);
+        }
+        static __m128i rot12 (__m128i v) { return rot<12> (v); }
+        static __m128i rot8 (__m128i v) {
+            const __m128i R8 = _mm_setr_epi8 (3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+            return _mm_shuffle_epi8 (v, R8);
+        }
+        static __m128i rot7 (__m128i v) { return rot<7> (v); }
+    };
+#endif
+
+    /// @brief Transposes 4 rows (one per word) into 4 columns (one per block), XORs them with input (if any) and stores.
+    /// @tparam Stream_ `true` for non-temporal stores (`out` must be 16-byte aligned)
+    template<bool Stream_ = false>
+    void store_4x4 (uint8_t *out, const uint8_t *in, __m128i a, __m128i b, __m128i c, __m128i d) {
+        __m128i t0 = _mm_unpacklo_epi32 (a, b);
+        __m128i t1 = _mm_unpacklo_epi32 (c, d);
+        __m128i t2 = _mm_unpackhi_epi32 (a, b);
+        __m128i t3 = _mm_unpackhi_epi32 (c, d);
+
+        __m128i r0 = _mm_unpacklo_epi64 (t0, t1);
+        __m128i r1 = _mm_unpackhi_epi64 (t0, t1);
+        __m128i r2 = _mm_unpacklo_epi64 (t2, t3);
+        __m128i r3 = _mm_unpackhi_epi64 (t2, t3);
+
+        auto xor_store = [out, in] (size_t block, __m128i v) {
+            auto *dst = reinterpret_cast<__m128i *> (out + 64 * block);
+            if (in != nullptr) {
+                v = _mm_xor_si128 (v, _mm_loadu_si128 (reinterpret_cast<const __m128i *> (in + 64 * block)));
+            }
+            if constexpr (Stream_) {
+                _mm_stream_si128 (dst, v);
+            }
+            else {
+                _mm_storeu_si128 (dst, v);
+            }
+        };
+        xor_store (0, r0);
+        xor_store (1, r1);
+        xor_store (2, r2);
+        xor_store (3, r3);
+    }
+
+    /// @brief 4x4 transposition of 32-bit words: `r0 .. r3` are the columns of the rows `a .. d`.
+    inline void transpose_4x4 (__m128i &r0, __m128i &r1, __m128i &r2, __m128i &r3, __m128i a, __m128i b, __m128i c, __m128i d) {
+        __m128i t0 = _mm_unpacklo_epi32 (a, b);
+        __m128i t1 = _mm_unpacklo_epi32 (c, d);
+        __m128i t2 = _mm_unpackhi_epi32 (a, b);
+        __m128i t3 = _mm_unpackhi_epi32 (c, d);
+        r0         = _mm_unpacklo_epi64 (t0, t1);
+        r1         = _mm_unpackhi_epi64 (t0, t1);
+        r2         = _mm_unpacklo_epi64 (t2, t3);
+        r3         = _mm_unpackhi_epi64 (t2, t3);
+    }
+
+    /// @brief Stores the 5-byte masks of the words 0 and 1 of `Lanes_` blocks.
+    /// @remarks The samples were loaded 16 bytes per 128-bit lane, `Lanes_ / 4` samples per vector and transposed
+    ///          within the lanes, so the word `e` belongs to sample `(e % 4) * (Lanes_ / 4) + e / 4`.
+    template<size_t Lanes_>
+    void store_header_masks (const uint32_t *w0, const uint32_t *w1, uint8_t *out) {
+        for (size_t e = 0; e < Lanes_; ++e) {
+            uint8_t *dst = out + 5 * ((e % 4) * (Lanes_ / 4) + e / 4);
+            store_le32 (dst, w0[e]);
+            dst[4] = static_cast<uint8_t> (w1[e]);
+        }
+    }
+
+    /// @brief 4 blocks are computed at once, one block per 32-bit lane.
+    ///        `Rot_` supplies `rot16`, `rot12`, `rot8` and `rot7`.
+    template<typename Rot_>
+    class SSEx4 {
+    public:
+        static constexpr size_t LANES           = 4;
+        static constexpr size_t STREAM_ALIGNMENT = 16; /* of `out` for the non-temporal stores */
+
+    private:
+        static inline void quarter_round (__m128i &a, __m128i &b, __m128i &c, __m128i &d) {
+            a = _mm_add_epi32 (a, b);
+            d = Rot_::rot16 (_mm_xor_si128 (d, a));
+            c = _mm_add_epi32 (c, d);
+            b = Rot_::rot12 (_mm_xor_si128 (b, c));
+            a = _mm_add_epi32 (a, b);
+            d = Rot_::rot8 (_mm_xor_si128 (d, a));
+            c = _mm_add_epi32 (c, d);
+            b = Rot_::rot7 (_mm_xor_si128 (b, c));
+        }
+
+        /// @brief The 20 rounds, in place (without the final addition).
+        static void rounds (__m128i (&x)[16]) {
+            for (int_fast32_t i = 0; i < 10; ++i) {
+                quarter_round (x[0], x[4], x[8], x[12]);
+                quarter_round (x[1], x[5], x[9], x[13]);
+                quarter_round (x[2], x[6], x[10], x[14]);
+                quarter_round (x[3], x[7], x[11], x[15]);
+                quarter_round (x[0], x[5], x[10], x[15]);
+                quarter_round (x[1], x[6], x[11], x[12]);
+                quarter_round (x[2], x[7], x[8], x[13]);
+                quarter_round (x[3], x[4], x[9], x[14]);
+            }
+        }
+
+        /// @brief Runs the 20 rounds on `orig` and stores the blocks.
+        template<bool Stream_ = false>
+        static void finish (const __m128i (&orig)[16], uint8_t *out, const uint8_t *in) {
+            __m128i x[16];
+            for (size_t i = 0; i < 16; ++i) {
+                x[i] = orig[i];
+            }
+            rounds (x);
+            for (size_t i = 0; i < 16; ++i) {
+                x[i] = _mm_add_epi32 (x[i], orig[i]);
+            }
+            store_4x4<Stream_> (out + 0, in == nullptr ? nullptr : in + 0, x[0], x[1], x[2], x[3]);
+            store_4x4<Stream_> (out + 16, in == nullptr ? nullptr : in + 16, x[4], x[5], x[6], x[7]);
+            store_4x4<Stream_> (out + 32, in == nullptr ? nullptr : in + 32, x[8], x[9], x[10], x[11]);
+            store_4x4<Stream_> (out + 48, in == nullptr ? nullptr : in + 48, x[12], x[13], x[14], x[15]);
+        }
+
+    public:
+        /// @brief Processes `LANES` consecutive blocks starting from `state`.
+        template<bool Stream_ = false>
+        static void apply (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in) {
+            __m128i orig[16];
+            for (size_t i = 0; i < 16; ++i) {
+                orig[i] = _mm_set1_epi32 (static_cast<int32_t> (state[i]));
+            }
+            {
+                state_t s1 {state};
+                state_t s2 {state};
+                state_t s3 {state};
+                advance (s1, wide_sequence, 1);
+                advance (s2, wide_sequence, 2);
+                advance (s3, wide_sequence, 3);
+                orig[12] = _mm_setr_epi32 (state[12], s1[12], s2[12], s3[12]);
+                orig[13] = _mm_setr_epi32 (state[13], s1[13], s2[13], s3[13]);
+            }
+            finish<Stream_> (orig, out, in);
+        }
+
+        /// @brief Computes one block for each of `LANES` independent states.
+        static void generate (const state_t *states, uint8_t *out) {
+            __m128i orig[16];
+            for (size_t i = 0; i < 16; ++i) {
+                orig[i] = _mm_setr_epi32 (states[0][i], states[1][i], states[2][i], states[3][i]);
+            }
+            finish (orig, out, nullptr);
+        }
+
+        /// @brief Header-protection masks of `LANES` samples (see `header_masks_sse`).
+        /// @param key Words 0 .. 11 of the state, broadcast
+        static void header_masks (const __m128i (&key)[12], const uint8_t *samples, uint8_t *out) {
+            __m128i x[16];
+            for (size_t i = 0; i < 12; ++i) {
+                x[i] = key[i];
+            }
+            __m128i s[4];
+            for (size_t k = 0; k < 4; ++k) {
+                s[k] = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (samples + 16 * k));
+            }
+            transpose_4x4 (x[12], x[13], x[14], x[15], s[0], s[1], s[2], s[3]);
+            rounds (x);
+            alignas (16) uint32_t w0[LANES];
+            alignas (16) uint32_t w1[LANES];
+            _mm_store_si128 (reinterpret_cast<__m128i *> (w0), _mm_add_epi32 (x[0], key[0]));
+            _mm_store_si128 (reinterpret_cast<__m128i *> (w1), _mm_add_epi32 (x[1], key[1]));
+            store_header_masks<LANES> (w0, w1, out);
+        }
+    };
+
+    /// @brief Single block, rows in registers (used for the leftover blocks).
+    ///        Stores the bare keystream when `in` is `nullptr`.
+    template<typename Rot_>
+    void apply_block (const state_t &state, uint8_t *out, const uint8_t *in) {
+        __m128i v0orig = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (&state[0]));
+        __m128i v1orig = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (&state[4]));
+        __m128i v2orig = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (&state[8]));
+        __m128i v3orig = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (&state[12]));
+
+        __m128i v0 = v0orig;
+        __m128i v1 = v1orig;
+        __m128i v2 = v2orig;
+        __m128i v3 = v3orig;
+
+        for (int_fast32_t i = 0; i < 10; ++i) {
+            v0 = _mm_add_epi32 (v0, v1);
+            v3 = Rot_::rot16 (_mm_xor_si128 (v3, v0));
+            v2 = _mm_add_epi32 (v2, v3);
+            v1 = Rot_::rot12 (_mm_xor_si128 (v1, v2));
+            v0 = _mm_add_epi32 (v0, v1);
+            v3 = Rot_::rot8 (_mm_xor_si128 (v3, v0));
+            v2 = _mm_add_epi32 (v2, v3);
+            v1 = Rot_::rot7 (_mm_xor_si128 (v1, v2));
+
+            v1 = _mm_shuffle_epi32 (v1, _MM_SHUFFLE (0, 3, 2, 1));
+            v2 = _mm_shuffle_epi32 (v2, _MM_SHUFFLE (1, 0, 3, 2));
+            v3 = _mm_shuffle_epi32 (v3, _MM_SHUFFLE (2, 1, 0, 3));
+
+            v0 = _mm_add_epi32 (v0, v1);
+            v3 = Rot_::rot16 (_mm_xor_si128 (v3, v0));
+            v2 = _mm_add_epi32 (v2, v3);
+            v1 = Rot_::rot12 (_mm_xor_si128 (v1, v2));
+            v0 = _mm_add_epi32 (v0, v1);
+            v3 = Rot_::rot8 (_mm_xor_si128 (v3, v0));
+            v2 = _mm_add_epi32 (v2, v3);
+            v1 = Rot_::rot7 (_mm_xor_si128 (v1, v2));
+
+            v1 = _mm_shuffle_epi32 (v1, _MM_SHUFFLE (2, 1, 0, 3));
+            v2 = _mm_shuffle_epi32 (v2, _MM_SHUFFLE (1, 0, 3, 2));
+            v3 = _mm_shuffle_epi32 (v3, _MM_SHUFFLE (0, 3, 2, 1));
+        }
+        auto xor_store = [out, in] (size_t off, __m128i v) {
+            if (in != nullptr) {
+                v = _mm_xor_si128 (v, _mm_loadu_si128 (reinterpret_cast<const __m128i *> (in + off)));
+            }
+            _mm_storeu_si128 (reinterpret_cast<__m128i *> (out + off), v);
+        };
+        xor_store (0, _mm_add_epi32 (v0, v0orig));
+        xor_store (16, _mm_add_epi32 (v1, v1orig));
+        xor_store (32, _mm_add_epi32 (v2, v2orig));
+        xor_store (48, _mm_add_epi32 (v3, v3orig));
+    }
+
+    template<typename Rot_>
+    void create_mask_sse (const state_t &state, uint8_t *out) {
+        apply_block<Rot_> (state, out, nullptr);
+    }
+
+    /// @brief One block per state, 4 states at a time (a short tail goes through a scratch buffer).
+    template<typename Rot_>
+    void create_masks_sse (const state_t *states, uint8_t *out, size_t count) {
+        using K = SSEx4<Rot_>;
+        while (K::LANES <= count) {
+            K::generate (states, out);
+            states += K::LANES;
+            out += 64 * K::LANES;
+            count -= K::LANES;
+        }
+        if (0 < count) {
+            state_t tmp[K::LANES] {};
+            uint8_t result[64 * K::LANES];
+            for (size_t i = 0; i < count; ++i) {
+                tmp[i] = states[i];
+            }
+            K::generate (tmp, result);
+            ::memcpy (out, result, 64 * count);
+        }
+    }
+
+    /// @brief Header-protection masks: for each 16-byte sample, the first 5 bytes of the block of `state`
+    ///        (words 0 .. 11: constants and key) with the sample as words 12 .. 15.  Writes `5 * count` bytes.
+    template<typename Rot_>
+    void header_masks_sse (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count) {
+        using K = SSEx4<Rot_>;
+        if (K::LANES <= count) {
+            __m128i key[12];
+            for (size_t i = 0; i < 12; ++i) {
+                key[i] = _mm_set1_epi32 (static_cast<int32_t> (state[i]));
+            }
+            while (K::LANES <= count) {
+                K::header_masks (key, samples, out);
+                samples += 16 * K::LANES;
+                out += 5 * K::LANES;
+                count -= K::LANES;
+            }
+        }
+        // A short tail (or a single packet): one block each, rows in registers.
+        state_t s {state};
+        uint8_t block[64];
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t k = 0; k < 4; ++k) {
+                s[12 + k] = load_le32 (samples + 16 * i + 4 * k);
+            }
+            apply_block<Rot_> (s, block, nullptr);
+            ::memcpy (out + 5 * i, block, 5);
+        }
+    }
+
+    template<typename Rot_>
+    void apply_blocks_sse (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count) {
+        using K = SSEx4<Rot_>;
+        state_t s {state};
+        while (K::LANES <= count) {
+            K::apply (s, wide_sequence, out, in);
+            advance (s, wide_sequence, K::LANES);
+            out += 64 * K::LANES;
+            in += 64 * K::LANES;
+            count -= K::LANES;
+        }
+        while (0 < count) {
+            apply_block<Rot_> (s, out, in);
+            advance (s, wide_sequence, 1);
+            out += 64;
+            in += 64;
+            count -= 1;
+        }
+    }
+
+    /// @brief Large-buffer loop: runs whole groups of `Kernel_::LANES` blocks (the rest is left in `count`),
+    ///        prefetching `in` `distance` bytes ahead.  Unless working in place, `out` is written with
+    ///        non-temporal stores (fenced before returning) so that it does not evict the working set.
+    /// @remarks Falls back to the ordinary stores when `out` is not aligned for `Kernel_`.
+    template<typename Kernel_>
+    void apply_blocks_streaming (state_t &state, bool wide_sequence, uint8_t *&out, const uint8_t *&in, size_t &count, size_t distance) {
+        bool const stream = out != in && reinterpret_cast<uintptr_t> (out) % Kernel_::STREAM_ALIGNMENT == 0;
+        while (Kernel_::LANES <= count) {
+            if (in != nullptr && 0 < distance) {
+                // `in + distance` may lie past the buffer: prefetches never fault, but the pointer arithmetic must not be UB.
+                auto const ahead = reinterpret_cast<uintptr_t> (in) + distance;
+                for (size_t k = 0; k < Kernel_::LANES; ++k) {
+                    _mm_prefetch (reinterpret_cast<const char *> (ahead + 64 * k), _MM_HINT_T0);
+                }
+            }
+            if (stream) {
+                Kernel_::template apply<true> (state, wide_sequence, out, in);
+            }
+            else {
+                Kernel_::template apply<false> (state, wide_sequence, out, in);
+            }
+            advance (state, wide_sequence, Kernel_::LANES);
+            out += 64 * Kernel_::LANES;
+            in += 64 * Kernel_::LANES;
+            count -= Kernel_::LANES;
+        }
+        if (stream) {
+            _mm_sfence ();
+        }
+    }
+
+    template<typename Rot_>
+    void apply_blocks_sse_large (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count, size_t distance) {
+        state_t s {state};
+        apply_blocks_streaming<SSEx4<Rot_>> (s, wide_sequence, out, in, count, distance);
+        apply_blocks_sse<Rot_> (s, wide_sequence, out, in, count);
+    }
+}}  // namespace ChaCha::detail::kernel
@@ -0,0 +1,91 @@
+/*
+ * lazy-mapping.hpp: Maps an encrypted file as a plaintext region, decrypting pages on first touch.
+ *
+ * The constructor only maps the ciphertext and reserves the plaintext region (O(1) in the file size); a page
+ * of the region is decrypted when it is first read, by a handler thread woken through `userfaultfd`.  Byte
+ * `i` of the file is decrypted with the keystream at offset `i`, as `ChaCha::apply (state, ..., offset)` does,
+ * so a page maps to a fixed run of block counters.
+ *
+ * - A fault also decrypts up to `readahead` following pages that are not resident yet.
+ * - At most `resident_pages` pages are kept; the oldest ones are dropped (`MADV_DONTNEED`) and are decrypted
+ *   again if touched later.  There is no reference information for plaintext pages, so the order is FIFO.
+ *
+ * Faults from system calls (`write (fd, m.data (), ...)`, `send`, `splice`...) are served as well when the process
+ * may handle kernel-mode faults (`CAP_SYS_PTRACE` or `vm.unprivileged_userfaultfd = 1`).  Otherwise the mapping
+ * falls back to `UFFD_USER_MODE_ONLY` (see `user_mode_only ()`): a system call reading a page that is not
+ * resident then fails with `EFAULT`, and such ranges have to be touched (or copied) from user space first.
+ *
+ * Linux only, and `userfaultfd` may be disabled (`vm.unprivileged_userfaultfd`, seccomp filters of containers):
+ * see `supported ()`.  Not available with `CHACHA20_HEADER_ONLY`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "detail.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace ChaCha {
+    /// @brief Read-only plaintext view of an encrypted file, decrypted page by page on demand.
+    class LazyMapping {
+    public:
+        struct Options {
+            size_t resident_pages = 4096; /* plaintext page budget (raised to `readahead + 1` at least, 0: unlimited) */
+            size_t readahead      = 7;    /* pages decrypted after the faulting one */
+        };
+
+        struct Statistics {
+            uint64_t faults    = 0; /* page faults handled */
+            uint64_t decrypted = 0; /* pages decrypted (faults and readahead) */
+            uint64_t evictions = 0; /* pages dropped to keep within the budget */
+            uint64_t resident  = 0; /* plaintext pages currently mapped */
+        };
+
+        /// @brief Maps the file at `path`, encrypted with `state` (the sequence of `state` is not used).
+        /// @throws std::system_error if the file cannot be mapped or `userfaultfd` is not available
+        template<typename State_>
+        LazyMapping (const std::string &path, const State_ &state, const Options &options)
+                : LazyMapping {path, initial_state (state), detail::core_v<State_>, detail::has_wide_sequence_v<State_>, options} {}
+
+        template<typename State_>
+        LazyMapping (const std::string &path, const State_ &state)
+                : LazyMapping {path, state, Options {}} {}
+
+        ~LazyMapping ();
+        LazyMapping (LazyMapping &&) noexcept;
+        LazyMapping &operator= (LazyMapping &&) noexcept;
+        LazyMapping (const LazyMapping &) = delete;
+        LazyMapping &operator= (const LazyMapping &) = delete;
+
+        /// @brief The plaintext (valid while `*this` is alive; the bytes past `size ()` up to the page end are zero).
+        [[nodiscard]] const uint8_t *data () const;
+
+        [[nodiscard]] size_t size () const;
+
+        [[nodiscard]] Statistics statistics () const;
+
+        /// @brief `true` if only faults from user space are served (system calls fail with `EFAULT` on pages not resident).
+        [[nodiscard]] bool user_mode_only () const;
+
+        /// @brief `true` if `userfaultfd` can be used by this process.
+        [[nodiscard]] static bool supported ();
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl_;
+
+        LazyMapping (const std::string &path, const std::array<uint32_t, 16> &state, detail::core_t core, bool wide_sequence, const Options &options);
+
+        template<typename State_>
+        static std::array<uint32_t, 16> initial_state (const State_ &state) {
+            State_ s {state};
+            s.setSequence (0);
+            return s.state ();
+        }
+    };
+}  // namespace ChaCha
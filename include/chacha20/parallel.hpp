@@ -0,0 +1,58 @@
+/*
+ * parallel.hpp: Applies the keystream to a large message on several threads.
+ *
+ * The message is cut into chunks of whole blocks; each thread seeks its own copy of the state to the first
+ * block of a chunk, so the output is identical to `ChaCha::apply`.  Messages shorter than the tuned threshold
+ * (see `ChaCha::Tuning::Plan::parallel_min_size`) run on the calling thread.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "apply.hpp"
+#include "detail.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ChaCha {
+    namespace detail {
+        /// @brief `apply_blocks` split into chunks over `threads` threads.
+        /// @param core Block function of `state`
+        /// @param threads # of threads (`0`: hardware concurrency)
+        void parallel_apply_blocks (const std::array<uint32_t, 16> &state,
+                                    core_t                          core,
+                                    bool                            wide_sequence,
+                                    void *                          out,
+                                    const void *                    in,
+                                    size_t                          count,
+                                    size_t                          threads);
+    }  // namespace detail
+
+    /// @brief Applies the keystream like `ChaCha::apply (state, result, msg, msg_size)`, on up to `threads` threads.
+    /// @param threads # of threads (`0`: hardware concurrency)
+    template<typename State_>
+    void parallel_apply (State_ &state, void *result, const void *msg, size_t msg_size, size_t threads = 0) {
+        constexpr size_t BLOCK_SIZE = std::tuple_size<detail::mask_t>::value;
+
+        if (msg == nullptr || msg_size == 0) {
+            return;
+        }
+        auto *out = static_cast<uint8_t *> (result);
+        auto *in  = static_cast<const uint8_t *> (msg);
+
+        size_t cnt = msg_size / BLOCK_SIZE;
+        if (0 < cnt) {
+            detail::parallel_apply_blocks (state.state (), detail::core_v<State_>, detail::has_wide_sequence_v<State_>, out, in, cnt, threads);
+            state.setSequence (static_cast<detail::sequence_t<State_>> (state.getSequence () + cnt));
+        }
+        apply (state, out + cnt * BLOCK_SIZE, in + cnt * BLOCK_SIZE, msg_size - cnt * BLOCK_SIZE);
+    }
+
+    /// @brief Applies the keystream (in place) on up to `threads` threads.
+    template<typename State_>
+    void parallel_apply (State_ &state, void *msg, size_t msg_size, size_t threads = 0) {
+        parallel_apply (state, msg, msg, msg_size, threads);
+    }
+}  // namespace ChaCha
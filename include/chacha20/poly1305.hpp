@@ -0,0 +1,199 @@
+/*
+ * poly1305.hpp: Poly1305 one-time authenticator (RFC 8439).
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "detail.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ChaCha {
+    namespace detail {
+        /// @brief Poly1305 accumulator (radix 2^26).
+        struct poly1305_state_t {
+            std::array<uint32_t, 5> r;
+            std::array<uint32_t, 5> h;
+            std::array<uint32_t, 4> pad;
+        };
+
+        void poly1305_init (poly1305_state_t &st, const uint8_t *key);
+        /// @brief Absorbs `count` 16-byte blocks.
+        /// @param final_block `true` if the (single) block is an already padded final partial block
+        void poly1305_blocks (poly1305_state_t &st, const uint8_t *data, size_t count, bool final_block = false);
+        void poly1305_finish (poly1305_state_t &st, uint8_t *tag);
+
+        /// @brief `poly1305_blocks` split into segments over `threads` threads.
+        ///
+        /// Each segment is evaluated on its own (the first one from `st.h`, the others from 0) and the results are
+        /// combined with powers of r: `h = (...(h_1 r^n_2 + h_2) r^n_3 + ...) r^n_T + h_T`.
+        /// @param threads # of threads (`0`: hardware concurrency)
+        /// @param min_blocks Segments are at least this many blocks long (fewer threads otherwise)
+        void poly1305_blocks_parallel (poly1305_state_t &st, const uint8_t *data, size_t count, size_t threads, size_t min_blocks = 4096);
+
+        /// @brief A message for the multi-buffer authenticator.
+        ///
+        /// The message is the concatenation of the segments.  When `pad` is set every segment is zero-padded to
+        /// a multiple of 16 bytes (the AEAD construction), otherwise all segments but the last one should be
+        /// multiples of 16 bytes long.
+        struct poly1305_job_t {
+            struct segment_t {
+                const uint8_t *data;
+                size_t         size;
+            };
+            const uint8_t *          key;
+            std::array<segment_t, 3> segments;
+            size_t                   num_segments;
+            bool                     pad;
+            uint8_t *                tag;
+        };
+
+        /// @brief Authenticates `count` independent messages, several at once (one per SIMD lane) when possible.
+        void poly1305_many (const poly1305_job_t *jobs, size_t count);
+    }  // namespace detail
+
+    /// @brief Poly1305 one-time authenticator.
+    class Poly1305 final {
+    public:
+        static constexpr size_t KEY_SIZE   = 32;
+        static constexpr size_t TAG_SIZE   = 16;
+        static constexpr size_t BLOCK_SIZE = 16;
+
+        using key_t = std::array<uint8_t, KEY_SIZE>;
+        using tag_t = std::array<uint8_t, TAG_SIZE>;
+
+        /// @brief A message of the batch interface.
+        struct Message {
+            const void *key; /* 32 bytes, never reused */
+            const void *data;
+            size_t      size;
+            tag_t *     tag; /* output */
+        };
+
+    private:
+        detail::poly1305_state_t        st_;
+        std::array<uint8_t, BLOCK_SIZE> buffer_;
+        size_t                          buffered_;
+
+    public:
+        explicit Poly1305 (const void *key)
+                : buffered_ {0} {
+            detail::poly1305_init (st_, static_cast<const uint8_t *> (key));
+        }
+
+        Poly1305 &update (const void *data, size_t size) {
+            if (size == 0) {
+                // `data` may be `nullptr` (no AAD).
+                return *this;
+            }
+            auto const *p = static_cast<const uint8_t *> (data);
+            if (0 < buffered_) {
+                auto n = std::min (size, BLOCK_SIZE - buffered_);
+                ::memcpy (&buffer_[buffered_], p, n);
+                buffered_ += n;
+                p += n;
+                size -= n;
+                if (buffered_ < BLOCK_SIZE) {
+                    return *this;
+                }
+                detail::poly1305_blocks (st_, buffer_.data (), 1);
+                buffered_ = 0;
+            }
+            detail::poly1305_blocks (st_, p, size / BLOCK_SIZE);
+            p += size / BLOCK_SIZE * BLOCK_SIZE;
+            size %= BLOCK_SIZE;
+            if (0 < size) {
+                ::memcpy (buffer_.data (), p, size);
+                buffered_ = size;
+            }
+            return *this;
+        }
+
+        /// @brief `update` with the whole 16-byte blocks split over up to `threads` threads (`0`: hardware concurrency).
+        /// @remarks Worth it for messages of megabytes; shorter ones run on the calling thread.
+        Poly1305 &update_parallel (const void *data, size_t size, size_t threads = 0) {
+            if (size == 0) {
+                return *this;
+            }
+            auto const *p = static_cast<const uint8_t *> (data);
+            if (0 < buffered_) {
+                auto n = std::min (size, BLOCK_SIZE - buffered_);
+                update (p, n);
+                p += n;
+                size -= n;
+            }
+            detail::poly1305_blocks_parallel (st_, p, size / BLOCK_SIZE, threads);
+            p += size / BLOCK_SIZE * BLOCK_SIZE;
+            return update (p, size % BLOCK_SIZE);
+        }
+
+        /// @brief Zero-pads the message absorbed so far to a multiple of 16 bytes (as the AEAD construction does).
+        Poly1305 &pad () {
+            if (0 < buffered_) {
+                std::fill (buffer_.begin () + buffered_, buffer_.end (), 0);
+                detail::poly1305_blocks (st_, buffer_.data (), 1);
+                buffered_ = 0;
+            }
+            return *this;
+        }
+
+        [[nodiscard]] tag_t finish () {
+            if (0 < buffered_) {
+                buffer_[buffered_] = 1;
+                std::fill (buffer_.begin () + buffered_ + 1, buffer_.end (), 0);
+                detail::poly1305_blocks (st_, buffer_.data (), 1, true);
+                buffered_ = 0;
+            }
+            tag_t result;
+            detail::poly1305_finish (st_, result.data ());
+            return result;
+        }
+
+        [[nodiscard]] static tag_t authenticate (const void *key, const void *data, size_t size) {
+            return Poly1305 {key}.update (data, size).finish ();
+        }
+
+        /// @brief `authenticate` on up to `threads` threads (`0`: hardware concurrency).
+        [[nodiscard]] static tag_t authenticate_parallel (const void *key, const void *data, size_t size, size_t threads = 0) {
+            return Poly1305 {key}.update_parallel (data, size, threads).finish ();
+        }
+
+        /// @brief Authenticates `count` independent messages at once.
+        static void authenticate (const Message *messages, size_t count) {
+            constexpr size_t BATCH = 16;
+            std::array<detail::poly1305_job_t, BATCH> jobs;
+            while (0 < count) {
+                auto n = std::min (count, BATCH);
+                for (size_t i = 0; i < n; ++i) {
+                    auto const &m        = messages[i];
+                    auto &      job      = jobs[i];
+                    job.key              = static_cast<const uint8_t *> (m.key);
+                    job.segments[0].data = static_cast<const uint8_t *> (m.data);
+                    job.segments[0].size = m.size;
+                    job.num_segments     = 1;
+                    job.pad              = false;
+                    job.tag              = m.tag->data ();
+                }
+                detail::poly1305_many (jobs.data (), n);
+                messages += n;
+                count -= n;
+            }
+        }
+
+        /// @brief Compares two tags in constant time.
+        [[nodiscard]] static bool verify (const void *expected, const void *actual) {
+            auto const *     a    = static_cast<const uint8_t *> (expected);
+            auto const *     b    = static_cast<const uint8_t *> (actual);
+            volatile uint8_t diff = 0;
+            for (size_t i = 0; i < TAG_SIZE; ++i) {
+                diff = diff | (a[i] ^ b[i]);
+            }
+            return diff == 0;
+        }
+    };
+}  // namespace ChaCha
@@ -0,0 +1,239 @@
+/*
+ * rng.hpp: Counter-based random number generator on top of `DJB::State`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "apply.hpp"
+#include "state-djb.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#    define CHACHA20_RNG_SSE2 1
+#endif
+
+namespace ChaCha {
+    namespace detail {
+        /// @brief Converts 64-bit words into uniform doubles in [0, 1) (53 bits each), in place.
+        inline void words_to_double (void *data, size_t count) {
+            auto * p = static_cast<uint8_t *> (data);
+            size_t i = 0;
+#ifdef CHACHA20_RNG_SSE2
+            // (x >> 11) is turned into a double exactly by planting its halves in the mantissas of 2^84 and 2^52.
+            const __m128i LO_MASK = _mm_set1_epi64x (0xFFFFFFFF);
+            const __m128i EXP_HI  = _mm_set1_epi64x (0x4530000000000000); /* 2^84 */
+            const __m128i EXP_LO  = _mm_set1_epi64x (0x4330000000000000); /* 2^52 */
+            const __m128d BIAS    = _mm_set1_pd (19342813118337666422669312.0); /* 2^84 + 2^52 */
+            const __m128d SCALE   = _mm_set1_pd (1.0 / 9007199254740992.0);     /* 2^-53 */
+            for (; i + 2 <= count; i += 2) {
+                __m128i x  = _mm_srli_epi64 (_mm_loadu_si128 (reinterpret_cast<const __m128i *> (p + 8 * i)), 11);
+                __m128d hi = _mm_castsi128_pd (_mm_or_si128 (_mm_srli_epi64 (x, 32), EXP_HI));
+                __m128d lo = _mm_castsi128_pd (_mm_or_si128 (_mm_and_si128 (x, LO_MASK), EXP_LO));
+                __m128d d  = _mm_add_pd (_mm_sub_pd (hi, BIAS), lo);
+                _mm_storeu_pd (reinterpret_cast<double *> (p + 8 * i), _mm_mul_pd (d, SCALE));
+            }
+#endif
+            for (; i < count; ++i) {
+                double d = static_cast<double> (asUInt64 (p + 8 * i) >> 11u) * (1.0 / 9007199254740992.0);
+                ::memcpy (p + 8 * i, &d, sizeof (d));
+            }
+        }
+
+        /// @brief Converts 32-bit words into uniform floats in [0, 1) (24 bits each), in place.
+        inline void words_to_float (void *data, size_t count) {
+            auto * p = static_cast<uint8_t *> (data);
+            size_t i = 0;
+#ifdef CHACHA20_RNG_SSE2
+            const __m128 SCALE = _mm_set1_ps (1.0f / 16777216.0f); /* 2^-24 */
+            for (; i + 4 <= count; i += 4) {
+                __m128i x = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (p + 4 * i));
+                _mm_storeu_ps (reinterpret_cast<float *> (p + 4 * i), _mm_mul_ps (_mm_cvtepi32_ps (_mm_srli_epi32 (x, 8)), SCALE));
+            }
+#endif
+            for (; i < count; ++i) {
+                float f = static_cast<float> (asUInt32 (p + 4 * i) >> 8u) * (1.0f / 16777216.0f);
+                ::memcpy (p + 4 * i, &f, sizeof (f));
+            }
+        }
+
+        /// @brief Maps 32-bit words into [0, `bound`) with Lemire's multiply-shift, in place.
+        /// @return Index of the first word that has to be rejected (`count` if none)
+        inline size_t words_to_bounded (uint32_t *data, size_t count, uint32_t bound) {
+            const uint32_t threshold = (0u - bound) % bound;
+            size_t         i         = 0;
+#ifdef CHACHA20_RNG_SSE2
+            const __m128i B    = _mm_set1_epi32 (static_cast<int32_t> (bound));
+            const __m128i T    = _mm_set1_epi32 (static_cast<int32_t> (threshold ^ 0x80000000u));
+            const __m128i SIGN = _mm_set1_epi32 (static_cast<int32_t> (0x80000000u));
+            for (; i + 4 <= count; i += 4) {
+                __m128i x    = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (data + i));
+                __m128i even = _mm_mul_epu32 (x, B);                     /* lanes 0, 2 (64-bit products) */
+                __m128i odd  = _mm_mul_epu32 (_mm_srli_epi64 (x, 32), B); /* lanes 1, 3 */
+                __m128i e    = _mm_shuffle_epi32 (even, _MM_SHUFFLE (3, 1, 2, 0)); /* lo0 lo2 hi0 hi2 */
+                __m128i o    = _mm_shuffle_epi32 (odd, _MM_SHUFFLE (3, 1, 2, 0));  /* lo1 lo3 hi1 hi3 */
+                __m128i lo   = _mm_unpacklo_epi32 (e, o);
+                __m128i hi   = _mm_unpackhi_epi32 (e, o);
+                // Unsigned `lo < threshold`.
+                if (_mm_movemask_epi8 (_mm_cmplt_epi32 (_mm_xor_si128 (lo, SIGN), T)) != 0) {
+                    break;
+                }
+                _mm_storeu_si128 (reinterpret_cast<__m128i *> (data + i), hi);
+            }
+#endif
+            for (; i < count; ++i) {
+                uint64_t m = static_cast<uint64_t> (data[i]) * bound;
+                if (static_cast<uint32_t> (m) < threshold) {
+                    return i;
+                }
+                data[i] = static_cast<uint32_t> (m >> 32u);
+            }
+            return count;
+        }
+    }  // namespace detail
+
+    /// @brief Counter-based random number generator (a `UniformRandomBitGenerator`).
+    ///
+    /// The output is the ChaCha20 keystream of a `DJB::State`: the key is the seed, the nonce selects one of
+    /// 2^64 independent streams and the block counter is the position, so `jump`, `seek` and `split` are
+    /// O(1) and every (seed, stream, position) is reproducible on any thread.
+    class CounterRNG {
+    public:
+        using result_type = uint64_t;
+
+        static constexpr size_t BLOCK_SIZE = 64;
+        /// @brief Blocks generated at a time for `operator()` (enough for the multi-block kernels).
+        static constexpr size_t BUFFERED_BLOCKS = 8;
+        static constexpr size_t BUFFER_SIZE     = BUFFERED_BLOCKS * BLOCK_SIZE;
+
+    private:
+        DJB::State                       state_; /* sequence: the block after `buffer_` */
+        std::array<uint8_t, BUFFER_SIZE> buffer_;
+        size_t                           used_; /* bytes of `buffer_` consumed (BUFFER_SIZE: empty) */
+
+    public:
+        /// @param key Up to 32 bytes
+        /// @param stream Stream number (the nonce)
+        CounterRNG (const void *key, size_t key_size, uint64_t stream = 0)
+                : state_ {key, key_size, stream}
+                , buffer_ {}
+                , used_ {BUFFER_SIZE} {}
+
+        explicit CounterRNG (uint64_t seed, uint64_t stream = 0)
+                : buffer_ {}
+                , used_ {BUFFER_SIZE} {
+            std::array<uint8_t, 32> key {};
+            for (size_t i = 0; i < 8; ++i) {
+                key[i] = static_cast<uint8_t> (seed >> (8 * i));
+            }
+            state_ = DJB::State {key.data (), key.size (), stream};
+        }
+
+        static constexpr result_type min () { return std::numeric_limits<result_type>::min (); }
+        static constexpr result_type max () { return std::numeric_limits<result_type>::max (); }
+
+        result_type operator() () {
+            if (BUFFER_SIZE - used_ < sizeof (result_type)) {
+                result_type v;
+                generate (&v, sizeof (v)); /* straddles the refill after an odd-sized `generate` */
+                return v;
+            }
+            auto v = detail::asUInt64 (&buffer_[used_]);
+            used_ += sizeof (result_type);
+            return v;
+        }
+
+        /// @brief Another stream of the same seed (does not touch this one).
+        [[nodiscard]] CounterRNG split (uint64_t stream) const {
+            CounterRNG result {*this};
+            result.state_.setInitialVector (stream); /* also rewinds to block 0 */
+            result.used_ = BUFFER_SIZE;
+            return result;
+        }
+
+        /// @brief Position in the stream (in bytes).
+        [[nodiscard]] uint64_t position () const { return state_.getSequence () * BLOCK_SIZE - (BUFFER_SIZE - used_); }
+
+        /// @brief Moves to the `pos`th byte of the stream.
+        void seek (uint64_t pos) {
+            state_.setSequence (pos / BLOCK_SIZE);
+            used_ = BUFFER_SIZE;
+            if (pos % BLOCK_SIZE != 0) {
+                refill ();
+                used_ = pos % BLOCK_SIZE;
+            }
+        }
+
+        /// @brief Skips `n` 64-bit outputs.
+        void jump (uint64_t n) { seek (position () + n * sizeof (result_type)); }
+
+        void discard (uint64_t n) { jump (n); }
+
+        /// @brief Fills `out` with the next `size` bytes of the stream.
+        void generate (void *out, size_t size) {
+            auto *dst = static_cast<uint8_t *> (out);
+            if (used_ < BUFFER_SIZE) {
+                auto n = std::min (size, BUFFER_SIZE - used_);
+                ::memcpy (dst, &buffer_[used_], n);
+                used_ += n;
+                dst += n;
+                size -= n;
+            }
+            auto blocks = size / BLOCK_SIZE;
+            if (0 < blocks) {
+                ::memset (dst, 0, blocks * BLOCK_SIZE);
+                detail::apply_blocks (state_, dst, dst, blocks);
+                dst += blocks * BLOCK_SIZE;
+                size -= blocks * BLOCK_SIZE;
+            }
+            if (0 < size) {
+                refill ();
+                ::memcpy (dst, buffer_.data (), size);
+                used_ = size;
+            }
+        }
+
+        /// @brief Uniform doubles in [0, 1), 53 bits of the stream each.
+        void uniform (double *out, size_t count) {
+            generate (out, count * sizeof (double));
+            detail::words_to_double (out, count);
+        }
+
+        /// @brief Uniform floats in [0, 1), 24 bits of the stream each.
+        void uniform (float *out, size_t count) {
+            generate (out, count * sizeof (float));
+            detail::words_to_float (out, count);
+        }
+
+        /// @brief Uniform integers in [0, `bound`) (unbiased, `bound` > 0).
+        void bounded (uint32_t *out, size_t count, uint32_t bound) {
+            generate (out, count * sizeof (uint32_t));
+            size_t i = 0;
+            while ((i += detail::words_to_bounded (out + i, count - i, bound)) < count) {
+                // Rare rejection: redraw this one, then carry on in bulk.
+                const uint32_t threshold = (0u - bound) % bound;
+                uint64_t       m;
+                do {
+                    uint32_t w;
+                    generate (&w, sizeof (w));
+                    m = static_cast<uint64_t> (w) * bound;
+                } while (static_cast<uint32_t> (m) < threshold);
+                out[i++] = static_cast<uint32_t> (m >> 32u);
+            }
+        }
+
+    private:
+        void refill () {
+            buffer_.fill (0);
+            detail::apply_blocks (state_, buffer_.data (), buffer_.data (), BUFFERED_BLOCKS);
+            used_ = 0;
+        }
+    };
+}  // namespace ChaCha
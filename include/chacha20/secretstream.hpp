@@ -0,0 +1,224 @@
+/*
+ * secretstream.hpp: Online chunked ChaCha20-Poly1305 for unbounded streams.
+ *
+ * A stream is a sequence of chunks, each of them an RFC 8439 AEAD record of its own:
+ *
+ *   chunk = flags (1 byte) || ciphertext || tag (16 bytes)
+ *
+ * - The nonce of the `i`th chunk is the stream nonce with `i` (64-bit, little-endian) XORed into its
+ *   last 8 bytes, so chunks cannot be reordered, dropped or replayed.
+ * - The flags byte travels in clear but is authenticated (it is prepended to the associated data).
+ *   `FINAL` marks the last chunk; a stream that ends without it has been truncated.
+ * - `REKEY` (or an explicit `rekey ()` on both ends) replaces the key with the otherwise unused second
+ *   half of the chunk's block 0 and restarts the chunk counter.
+ *
+ * Memory use is constant: chunks are sealed from / opened into the caller's buffers, and the keystream
+ * and the MAC are run tile by tile so that the ciphertext is still in L1 when Poly1305 reads it.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "aead.hpp"
+#include "apply.hpp"
+#include "poly1305.hpp"
+#include "state-rfc7539.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace ChaCha::AEAD {
+    /// @brief Chunk flags.
+    enum StreamFlags : uint8_t {
+        STREAM_MESSAGE = 0x00,
+        STREAM_FINAL   = 0x01, /* last chunk of the stream */
+        STREAM_REKEY   = 0x02, /* rekey after this chunk */
+    };
+
+    namespace detail {
+        /// @brief Key schedule shared by both ends of a stream.
+        class StreamState {
+        public:
+            static constexpr size_t KEY_SIZE   = 32;
+            static constexpr size_t NONCE_SIZE = 12;
+            /// @brief Bytes of tiles run through the keystream and the MAC back to back.
+            static constexpr size_t TILE_SIZE = 4096;
+
+        private:
+            RFC7539::State                  key_; /* current key */
+            std::array<uint8_t, NONCE_SIZE> nonce_;
+            uint64_t                        counter_;
+            bool                            finished_;
+
+        public:
+            StreamState (const void *key, size_t key_size, const void *nonce, size_t nonce_size)
+                    : key_ {key, key_size}
+                    , nonce_ {}
+                    , counter_ {0}
+                    , finished_ {false} {
+                ::memcpy (nonce_.data (), nonce, std::min (nonce_size, NONCE_SIZE));
+            }
+
+            [[nodiscard]] bool     finished () const { return finished_; }
+            [[nodiscard]] uint64_t counter () const { return counter_; }
+
+            /// @brief The state (sequence 0) of the current chunk.
+            [[nodiscard]] RFC7539::State chunkState () const {
+                auto nonce {nonce_};
+                for (size_t i = 0; i < 8; ++i) {
+                    nonce[4 + i] ^= static_cast<uint8_t> (counter_ >> (8 * i));
+                }
+                RFC7539::State s {key_};
+                s.setNonce (nonce.data (), nonce.size ());
+                return s;
+            }
+
+            /// @brief Moves on to the next chunk.
+            /// @param block0 Block 0 of the chunk just processed
+            void advance (uint8_t flags, const ChaCha::detail::mask_t &block0) {
+                if ((flags & STREAM_FINAL) != 0) {
+                    finished_ = true;
+                }
+                else if ((flags & STREAM_REKEY) != 0) {
+                    rekey (block0);
+                }
+                else {
+                    ++counter_;
+                }
+            }
+
+            /// @brief Replaces the key with the second half of `block0` (Poly1305 uses the first half only).
+            void rekey (const ChaCha::detail::mask_t &block0) {
+                key_.setKey (&block0[32], KEY_SIZE);
+                counter_ = 0;
+            }
+
+            /// @brief Explicit rekeying (both ends have to call it at the same point of the stream).
+            void rekey () {
+                auto block0 = ChaCha::detail::create_mask (chunkState ().state ());
+                rekey (block0);
+                block0.fill (0);
+            }
+
+            /// @brief Runs one chunk: block 0 keys Poly1305, the payload uses blocks 1 and later.
+            /// @param encrypt `true` to seal (MAC the output), `false` to open (MAC the input)
+            /// @return Tag
+            [[nodiscard]] tag_t process (uint8_t                 flags,
+                                         void *                  out,
+                                         const void *            in,
+                                         size_t                  size,
+                                         const void *            aad,
+                                         size_t                  aad_size,
+                                         ChaCha::detail::mask_t &block0,
+                                         bool                    encrypt) const {
+                auto state = chunkState ();
+                block0     = ChaCha::detail::create_mask (state.state ());
+                Poly1305 mac {block0.data ()};
+                mac.update (&flags, 1).update (aad, aad_size).pad ();
+
+                state.setSequence (1);
+                auto *      dst = static_cast<uint8_t *> (out);
+                auto const *src = static_cast<const uint8_t *> (in);
+                for (size_t off = 0; off < size; off += TILE_SIZE) {
+                    auto n = std::min (TILE_SIZE, size - off);
+                    if (encrypt) {
+                        apply (state, dst + off, src + off, n);
+                        mac.update (dst + off, n);
+                    }
+                    else {
+                        mac.update (src + off, n);
+                        apply (state, dst + off, src + off, n);
+                    }
+                }
+                auto len = lengths (aad_size + 1, size);
+                return mac.pad ().update (len.data (), len.size ()).finish ();
+            }
+        };
+    }  // namespace detail
+
+    /// @brief Bytes added to every chunk (flags and tag).
+    constexpr size_t STREAM_OVERHEAD = 1 + Poly1305::TAG_SIZE;
+
+    /// @brief Sending end of a chunked stream.
+    class StreamSealer {
+    private:
+        detail::StreamState st_;
+
+    public:
+        /// @param key 32 bytes (shorter keys are zero-padded, as `RFC7539::State` does)
+        /// @param nonce 12 bytes, never reused with the same key
+        StreamSealer (const void *key, size_t key_size, const void *nonce, size_t nonce_size)
+                : st_ {key, key_size, nonce, nonce_size} {}
+
+        [[nodiscard]] bool finished () const { return st_.finished (); }
+
+        /// @brief Seals a chunk.
+        /// @param out Output (`size + STREAM_OVERHEAD` bytes)
+        /// @param in Payload
+        /// @param flags `STREAM_MESSAGE`, `STREAM_FINAL` or `STREAM_REKEY`
+        /// @return # of bytes written to `out`
+        size_t seal (void *out, const void *in, size_t size, uint8_t flags = STREAM_MESSAGE, const void *aad = nullptr, size_t aad_size = 0) {
+            if (st_.finished ()) {
+                throw std::logic_error {"StreamSealer::seal: the stream is already finished"};
+            }
+            auto *                 dst = static_cast<uint8_t *> (out);
+            ChaCha::detail::mask_t block0;
+            dst[0]   = flags;
+            auto tag = st_.process (flags, dst + 1, in, size, aad, aad_size, block0, true);
+            ::memcpy (dst + 1 + size, tag.data (), tag.size ());
+            st_.advance (flags, block0);
+            block0.fill (0);
+            return size + STREAM_OVERHEAD;
+        }
+
+        void rekey () { st_.rekey (); }
+    };
+
+    /// @brief Receiving end of a chunked stream.
+    class StreamOpener {
+    private:
+        detail::StreamState st_;
+        uint8_t             flags_;
+
+    public:
+        StreamOpener (const void *key, size_t key_size, const void *nonce, size_t nonce_size)
+                : st_ {key, key_size, nonce, nonce_size}
+                , flags_ {0} {}
+
+        /// @brief `true` once the final chunk is opened (a stream ending before that has been truncated).
+        [[nodiscard]] bool finished () const { return st_.finished (); }
+
+        /// @brief Flags of the last chunk opened.
+        [[nodiscard]] uint8_t flags () const { return flags_; }
+
+        /// @brief Verifies and decrypts a chunk.
+        /// @param out Output (`size - STREAM_OVERHEAD` bytes, zeroed when the chunk is not authentic)
+        /// @param in The chunk
+        /// @param size Size of the chunk (including `STREAM_OVERHEAD`)
+        /// @return `false` if the chunk is not authentic (or out of place); the stream state is left as is
+        [[nodiscard]] bool open (void *out, const void *in, size_t size, const void *aad = nullptr, size_t aad_size = 0) {
+            if (st_.finished () || size < STREAM_OVERHEAD) {
+                return false;
+            }
+            auto const *           src   = static_cast<const uint8_t *> (in);
+            auto const             n     = size - STREAM_OVERHEAD;
+            uint8_t                flags = src[0];
+            ChaCha::detail::mask_t block0;
+            auto tag = st_.process (flags, out, src + 1, n, aad, aad_size, block0, false);
+            if (! Poly1305::verify (tag.data (), src + 1 + n)) {
+                ::memset (out, 0, n);
+                return false;
+            }
+            flags_ = flags;
+            st_.advance (flags, block0);
+            block0.fill (0);
+            return true;
+        }
+
+        void rekey () { st_.rekey (); }
+    };
+}  // namespace ChaCha::AEAD
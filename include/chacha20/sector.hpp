@@ -0,0 +1,80 @@
+/*
+ * sector.hpp: Length-preserving encryption of fixed-size sectors, addressed by sector number.
+ *
+ * Sector `n` takes the keystream at offset `n * sector_size`, as `ChaCha::apply (state, ..., offset)` does, so
+ * every sector is encrypted (and decrypted, the same operation) on its own, and an encrypted volume is one
+ * stream: `LazyMapping` can map it.  A batch of sectors is split over threads, each sector going through the
+ * multi-block kernel as one run of `sector_size / 64` blocks.
+ *
+ * As with any length-preserving mode there is no integrity, and rewriting a sector reuses its keystream:
+ * an observer of both versions learns their XOR.
+ *
+ * Not available with `CHACHA20_HEADER_ONLY`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "detail.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ChaCha {
+    /// @brief A sector of a batch (`data` holds `sector_size` bytes).
+    struct SectorBuffer {
+        uint64_t number;
+        void *   data;
+    };
+
+    /// @brief A sector of a batch, read only.
+    struct ConstSectorBuffer {
+        uint64_t    number;
+        const void *data;
+    };
+
+    /// @brief Encrypts / decrypts sectors of `sector_size` bytes under the key and nonce of a state.
+    class SectorCipher {
+        std::array<uint32_t, 16> state_;
+        detail::core_t           core_;
+        bool                     wide_;
+        size_t                   sector_size_;
+
+    public:
+        /// @param state Key and nonce (the sequence of `state` is not used)
+        /// @param sector_size A multiple of 64
+        /// @throws std::invalid_argument if `sector_size` is not a positive multiple of 64
+        template<typename State_>
+        explicit SectorCipher (const State_ &state, size_t sector_size = 4096)
+                : SectorCipher {initial_state (state), detail::core_v<State_>, detail::has_wide_sequence_v<State_>, sector_size} {}
+
+        ~SectorCipher ();
+        SectorCipher (const SectorCipher &)     = default;
+        SectorCipher &operator= (const SectorCipher &) = default;
+
+        [[nodiscard]] size_t sector_size () const { return sector_size_; }
+
+        /// @brief # of sectors the block counter can address (2^26 4 KiB sectors with a 32-bit counter).
+        [[nodiscard]] uint64_t max_sectors () const;
+
+        /// @brief Encrypts / decrypts sector `number` from `in` into `out` (may be equal to `in`).
+        /// @throws std::out_of_range if `max_sectors () <= number`
+        void apply (uint64_t number, void *out, const void *in) const;
+
+        /// @brief Encrypts / decrypts `count` sectors in place, on up to `threads` threads.
+        /// @param threads # of threads (`0`: hardware concurrency); small batches run on the calling thread
+        /// @throws std::out_of_range if a sector number is out of range (no sector is modified then)
+        void apply (const SectorBuffer *sectors, size_t count, size_t threads = 0) const;
+
+    private:
+        SectorCipher (const std::array<uint32_t, 16> &state, detail::core_t core, bool wide_sequence, size_t sector_size);
+
+        template<typename State_>
+        static std::array<uint32_t, 16> initial_state (const State_ &state) {
+            State_ s {state};
+            s.setSequence (0);
+            return s.state ();
+        }
+    };
+}  // namespace ChaCha
@@ -0,0 +1,57 @@
+/*
+ * shared-stream.hpp: One keystream shared by concurrent writers without a lock.
+ *
+ * A writer reserves the byte range of its record with an atomic add on the stream position, then encrypts
+ * it from the key / nonce and the reserved offset alone (`ChaCha::apply (state, ..., offset)` on a private copy
+ * of the state).  Writers never touch a shared block counter, so they run in parallel; two records sharing
+ * a 64-byte block both compute that block, each XORing its own part of it.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "apply.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ChaCha {
+    /// @brief Keystream of `State_` shared by any number of threads (lock-free).
+    template<typename State_>
+    class SharedStream {
+        State_                base_;     /* immutable after construction */
+        std::atomic<uint64_t> position_; /* next byte to reserve */
+
+    public:
+        /// @param state Key and nonce of the stream (the sequence of `state` is not used)
+        /// @param position Offset of the first byte to reserve
+        explicit SharedStream (const State_ &state, uint64_t position = 0)
+                : base_ {state}
+                , position_ {position} {}
+
+        SharedStream (const SharedStream &) = delete;
+        SharedStream &operator= (const SharedStream &) = delete;
+
+        /// @brief Reserves the next `size` bytes of the stream.
+        /// @return The offset of the reserved range
+        uint64_t reserve (size_t size) { return position_.fetch_add (size, std::memory_order_relaxed); }
+
+        /// @brief Applies the keystream at `offset` (a range obtained from `reserve`) to `msg`.
+        void apply (uint64_t offset, void *result, const void *msg, size_t msg_size) const {
+            State_ state {base_};
+            ChaCha::apply (state, result, msg, msg_size, static_cast<size_t> (offset));
+        }
+
+        /// @brief Reserves `msg_size` bytes and applies the keystream there.
+        /// @return The offset of the record in the stream
+        uint64_t append (void *result, const void *msg, size_t msg_size) {
+            auto const offset = reserve (msg_size);
+            apply (offset, result, msg, msg_size);
+            return offset;
+        }
+
+        /// @brief The offset the next reservation starts at.
+        [[nodiscard]] uint64_t position () const { return position_.load (std::memory_order_relaxed); }
+    };
+}  // namespace ChaCha
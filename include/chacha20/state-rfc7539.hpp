@@ -5,8 +5,11 @@
 
 #include "detail.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 namespace ChaCha { inline namespace RFC7539 {
 
@@ -22,69 +25,74 @@ namespace ChaCha { inline namespace RFC7539 {
         State (State &&) noexcept = default;
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "cppcoreguidelines-pro-type-member-init"
-        State () { state_.fill (0); }
+        constexpr State ()
+                : state_ {} {}
 
-        State (const void *key, size_t size, const void *nonce, size_t nonce_size) {
-            state_.fill (0);
+        template<typename Key_, typename Nonce_, typename = detail::enable_if_byte_t<Key_>, typename = detail::enable_if_byte_t<Nonce_>>
+        constexpr State (const Key_ *key, size_t size, const Nonce_ *nonce, size_t nonce_size)
+                : state_ {} {
             this->setKey (key, size);
             this->setNonce (nonce, nonce_size);
         }
 
-        State (const void *key, size_t size) {
-            state_.fill (0);
+        State (const void *key, size_t size, const void *nonce, size_t nonce_size)
+                : State {static_cast<const uint8_t *> (key), size, static_cast<const uint8_t *> (nonce), nonce_size} {}
+
+        template<typename Byte_, typename = detail::enable_if_byte_t<Byte_>>
+        constexpr State (const Byte_ *key, size_t size)
+                : state_ {} {
             this->setKey (key, size);
         }
+
+        State (const void *key, size_t size)
+                : State {static_cast<const uint8_t *> (key), size} {}
 #pragma clang diagnostic pop
 
-        State &setKey (const void *key, size_t size) {
+        template<typename Byte_, typename = detail::enable_if_byte_t<Byte_>>
+        constexpr State &setKey (const Byte_ *key, size_t size) {
             using namespace ChaCha::detail;
-            // NOLINTNEXTLINE: cppcoreguidelines-pro-member-init
-            std::array<uint8_t, 32> K;
-            K.fill (0);
-            if (K.size () < size) {
-                size = K.size ();
-            }
-            ::memcpy (K.data (), key, size);
-            auto const *k = K.data ();
+            auto const K = padded<32> (key, size);
+            auto const k = K.data ();
 
             state_[0]  = 0x61707865u;
             state_[1]  = 0x3320646eu;
             state_[2]  = 0x79622d32u;
             state_[3]  = 0x6b206574u;
-            state_[4]  = asUInt32 (k + 0u);
-            state_[5]  = asUInt32 (k + 4u);
-            state_[6]  = asUInt32 (k + 8u);
-            state_[7]  = asUInt32 (k + 12u);
-            state_[8]  = asUInt32 (k + 16u);
-            state_[9]  = asUInt32 (k + 20u);
-            state_[10] = asUInt32 (k + 24u);
-            state_[11] = asUInt32 (k + 28u);
+            state_[4]  = le32 (k + 0u);
+            state_[5]  = le32 (k + 4u);
+            state_[6]  = le32 (k + 8u);
+            state_[7]  = le32 (k + 12u);
+            state_[8]  = le32 (k + 16u);
+            state_[9]  = le32 (k + 20u);
+            state_[10] = le32 (k + 24u);
+            state_[11] = le32 (k + 28u);
 
             return *this;
         }
 
-        State &setNonce (const void *nonce, size_t size) {
+        State &setKey (const void *key, size_t size) { return setKey (static_cast<const uint8_t *> (key), size); }
+
+        template<typename Byte_, typename = detail::enable_if_byte_t<Byte_>>
+        constexpr State &setNonce (const Byte_ *nonce, size_t size) {
             using namespace ChaCha::detail;
-            // NOLINTNEXTLINE: cppcoreguidelines-pro-member-init
-            std::array<uint8_t, 4 * 3> N;
-            N.fill (0);
-            // NOLINTNEXTLINE: bugprone-sizeof-container
-            ::memcpy (N.data (), nonce, std::min<size_t> (size, sizeof (N)));
-            state_[12] = 0;
-            state_[13] = asUInt32 (&N[0]);
-            state_[14] = asUInt32 (&N[4]);
-            state_[15] = asUInt32 (&N[8]);
+            auto const N = padded<4 * 3> (nonce, size);
+            state_[12]   = 0;
+            state_[13]   = le32 (&N[0]);
+            state_[14]   = le32 (&N[4]);
+            state_[15]   = le32 (&N[8]);
             return *this;
         }
 
-        [[nodiscard]] uint32_t getSequence () const { return state_[12]; }
+        State &setNonce (const void *nonce, size_t size) { return setNonce (static_cast<const uint8_t *> (nonce), size); }
+
+        [[nodiscard]] constexpr uint32_t getSequence () const { return state_[12]; }
 
-        State &setSequence (uint32_t value) {
+        constexpr State &setSequence (uint32_t value) {
             state_[12] = value;
             return *this;
         }
 
-        State &incrementSequence () {
+        constexpr State &incrementSequence () {
             state_[12] += 1;
             /* stopping at 2^(32 + 6) bytes per (key, nonce) pair is user's responsibility */
             return *this;
@@ -97,6 +105,6 @@ namespace ChaCha { inline namespace RFC7539 {
         State &operator= (const State &) = default;
         State &operator= (State &&) = default;
 
-        [[nodiscard]] auto const &state () const { return state_; }
+        [[nodiscard]] constexpr auto const &state () const { return state_; }
     };
 }}  // namespace ChaCha::RFC7539
@@ -0,0 +1,167 @@
+/*
+ * state-salsa20.hpp: Salsa20 and XSalsa20 states for `ChaCha::apply`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "compile-time.hpp"
+#include "detail.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ChaCha {
+    namespace Salsa20 {
+        /// @brief [Salsa20](https://cr.yp.to/snuffle/spec.pdf) with a 64-bit nonce and a 64-bit block counter.
+        class State final {
+        public:
+            static constexpr detail::core_t CORE = detail::core_t::SALSA20;
+
+        private:
+            // NOLINTNEXTLINE: cppcoreguidelines-avoid-magic-numbers
+            std::array<uint32_t, 16> state_;
+
+        public:
+            ~State ()                 = default;
+            State (const State &)     = default;
+            State (State &&) noexcept = default;
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "cppcoreguidelines-pro-type-member-init"
+            constexpr State ()
+                    : state_ {} {}
+
+            /// @param key 16 or 32 bytes
+            /// @param nonce 8 bytes
+            template<typename Key_, typename Nonce_, typename = detail::enable_if_byte_t<Key_>, typename = detail::enable_if_byte_t<Nonce_>>
+            constexpr State (const Key_ *key, size_t size, const Nonce_ *nonce, size_t nonce_size)
+                    : state_ {} {
+                this->setKey (key, size);
+                this->setNonce (nonce, nonce_size);
+            }
+
+            State (const void *key, size_t size, const void *nonce, size_t nonce_size)
+                    : State {static_cast<const uint8_t *> (key), size, static_cast<const uint8_t *> (nonce), nonce_size} {}
+
+            template<typename Byte_, typename = detail::enable_if_byte_t<Byte_>>
+            constexpr State (const Byte_ *key, size_t size)
+                    : state_ {} {
+                this->setKey (key, size);
+            }
+
+            State (const void *key, size_t size)
+                    : State {static_cast<const uint8_t *> (key), size} {}
+#pragma clang diagnostic pop
+
+            template<typename Byte_, typename = detail::enable_if_byte_t<Byte_>>
+            constexpr State &setKey (const Byte_ *key, size_t size) {
+                using namespace detail;
+
+                const char sigma[] = "expand 32-byte k";
+                const char tau[]   = "expand 16-byte k";
+
+                auto const  K  = padded<32> (key, size);
+                auto const *k  = K.data ();
+                auto const *k2 = size <= 16 ? k : k + 16;
+                auto const *c  = size <= 16 ? tau : sigma;
+
+                state_[0]  = le32 (&c[0]);
+                state_[1]  = le32 (k + 0);
+                state_[2]  = le32 (k + 4);
+                state_[3]  = le32 (k + 8);
+                state_[4]  = le32 (k + 12);
+                state_[5]  = le32 (&c[4]);
+                state_[10] = le32 (&c[8]);
+                state_[11] = le32 (k2 + 0);
+                state_[12] = le32 (k2 + 4);
+                state_[13] = le32 (k2 + 8);
+                state_[14] = le32 (k2 + 12);
+                state_[15] = le32 (&c[12]);
+                return *this;
+            }
+
+            State &setKey (const void *key, size_t size) { return setKey (static_cast<const uint8_t *> (key), size); }
+
+            /// @brief Sets the nonce (and rewinds to block 0).
+            template<typename Byte_, typename = detail::enable_if_byte_t<Byte_>>
+            constexpr State &setNonce (const Byte_ *nonce, size_t size) {
+                using namespace detail;
+                auto const N = padded<8> (nonce, size);
+                state_[6]    = le32 (&N[0]);
+                state_[7]    = le32 (&N[4]);
+                state_[8]    = 0;
+                state_[9]    = 0;
+                return *this;
+            }
+
+            State &setNonce (const void *nonce, size_t size) { return setNonce (static_cast<const uint8_t *> (nonce), size); }
+
+            [[nodiscard]] constexpr uint64_t getSequence () const {
+                return ((static_cast<uint64_t> (state_[8]) << 0u) | (static_cast<uint64_t> (state_[9]) << 32u));
+            }
+
+            constexpr State &setSequence (uint64_t value) {
+                state_[8] = static_cast<uint32_t> (value >> 0u);
+                state_[9] = static_cast<uint32_t> (value >> 32u);
+                return *this;
+            }
+
+            constexpr State &incrementSequence () {
+                if ((state_[8] += 1) == 0) {
+                    state_[9] += 1;
+                }
+                return *this;
+            }
+
+            State &operator= (const State &) = default;
+            State &operator= (State &&) = default;
+
+            [[nodiscard]] constexpr auto const &state () const { return state_; }
+        };
+    }  // namespace Salsa20
+
+    namespace XSalsa20 {
+        /// @brief XSalsa20: Salsa20 keyed with HSalsa20 (key, nonce[0..16]) and the last 8 bytes of the 24-byte nonce.
+        class State final {
+        public:
+            static constexpr detail::core_t CORE = detail::core_t::SALSA20;
+
+        private:
+            Salsa20::State salsa_;
+
+        public:
+            constexpr State () = default;
+
+            /// @param key 32 bytes (shorter keys are zero-padded)
+            /// @param nonce 24 bytes (shorter nonces are zero-padded)
+            template<typename Key_, typename Nonce_, typename = detail::enable_if_byte_t<Key_>, typename = detail::enable_if_byte_t<Nonce_>>
+            constexpr State (const Key_ *key, size_t size, const Nonce_ *nonce, size_t nonce_size)
+                    : salsa_ {} {
+                auto const K      = detail::padded<32> (key, size);
+                auto const N      = detail::padded<24> (nonce, nonce_size);
+                auto const subkey = detail::hsalsa20_constexpr (K, N);
+                salsa_            = Salsa20::State {subkey.data (), subkey.size (), &N[16], 8};
+            }
+
+            State (const void *key, size_t size, const void *nonce, size_t nonce_size)
+                    : State {static_cast<const uint8_t *> (key), size, static_cast<const uint8_t *> (nonce), nonce_size} {}
+
+            [[nodiscard]] constexpr uint64_t getSequence () const { return salsa_.getSequence (); }
+
+            constexpr State &setSequence (uint64_t value) {
+                salsa_.setSequence (value);
+                return *this;
+            }
+
+            constexpr State &incrementSequence () {
+                salsa_.incrementSequence ();
+                return *this;
+            }
+
+            [[nodiscard]] constexpr auto const &state () const { return salsa_.state (); }
+        };
+    }  // namespace XSalsa20
+}  // namespace ChaCha
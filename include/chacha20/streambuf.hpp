@@ -0,0 +1,293 @@
+/*
+ * streambuf.hpp: Encrypting/decrypting `std::streambuf` adaptor.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "apply.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+namespace ChaCha {
+
+    /// @brief `std::streambuf` that applies ChaCha20 to everything passing through to (or from) another stream buffer.
+    ///
+    /// Writes are collected into an internal buffer and encrypted a whole buffer at a time; reads fill the
+    /// buffer from the underlying stream buffer and decrypt it in one go.  The keystream offset follows the
+    /// stream position, so seeking (when the underlying buffer supports it) works with random access.
+    /// Like `std::basic_filebuf`, the destructor writes out the pending output and syncs the underlying buffer;
+    /// errors are not reported there, so flush explicitly when they matter.
+    /// @tparam State_ The state type
+    template<typename State_>
+    class CipherStreamBuf : public std::streambuf {
+    public:
+        static constexpr size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+
+    private:
+        std::streambuf *  sink_;
+        State_            state_;
+        std::vector<char> buffer_;
+        std::streamoff    base_;      /* position of the sink corresponding to the keystream offset 0 */
+        uint64_t          offset_;    /* keystream offset of the sink's current position */
+        size_t            encrypted_; /* leading bytes of the put area already encrypted (left over from a short write) */
+
+    public:
+        /// @brief Constructs an adaptor.
+        /// @param sink The underlying stream buffer (not owned)
+        /// @param state ChaCha20 state (the sequence is ignored, the keystream offset follows the stream position)
+        /// @param buffer_size Internal buffer size (rounded up to a multiple of the block size)
+        CipherStreamBuf (std::streambuf *sink, const State_ &state, size_t buffer_size = DEFAULT_BUFFER_SIZE)
+                : sink_ {sink}
+                , state_ {state}
+                , base_ {0}
+                , offset_ {0}
+                , encrypted_ {0} {
+            constexpr size_t BLOCK_SIZE = std::tuple_size<detail::mask_t>::value;
+            buffer_.resize (std::max (BLOCK_SIZE, (buffer_size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE));
+            if (sink_ != nullptr) {
+                auto pos = sink_->pubseekoff (0, std::ios_base::cur, std::ios_base::in | std::ios_base::out);
+                if (pos != std::streampos (std::streamoff (-1))) {
+                    base_ = pos;
+                }
+            }
+        }
+
+        CipherStreamBuf (const CipherStreamBuf &) = delete;
+        CipherStreamBuf &operator= (const CipherStreamBuf &) = delete;
+
+        ~CipherStreamBuf () override {
+            if (sink_ == nullptr) {
+                return;
+            }
+            try {
+                flush_output ();
+                sink_->pubsync ();
+            }
+            catch (...) {
+                // Destructors don't throw.
+            }
+        }
+
+        [[nodiscard]] std::streambuf *sink () const { return sink_; }
+
+    protected:
+        int_type overflow (int_type ch) override {
+            if (! leave_get_area () || ! flush_output ()) {
+                return traits_type::eof ();
+            }
+            setp (buffer_.data (), buffer_.data () + buffer_.size ());
+            if (! traits_type::eq_int_type (ch, traits_type::eof ())) {
+                *pptr () = traits_type::to_char_type (ch);
+                pbump (1);
+            }
+            return traits_type::not_eof (ch);
+        }
+
+        int sync () override {
+            if (! flush_output ()) {
+                return -1;
+            }
+            if (! leave_get_area ()) {
+                return -1;
+            }
+            return sink_->pubsync ();
+        }
+
+        int_type underflow () override {
+            if (! flush_output ()) {
+                return traits_type::eof ();
+            }
+            if (gptr () < egptr ()) {
+                return traits_type::to_int_type (*gptr ());
+            }
+            auto n = sink_->sgetn (buffer_.data (), static_cast<std::streamsize> (buffer_.size ()));
+            if (n <= 0) {
+                setg (nullptr, nullptr, nullptr);
+                return traits_type::eof ();
+            }
+            apply (state_, buffer_.data (), static_cast<size_t> (n), static_cast<size_t> (offset_));
+            offset_ += static_cast<uint64_t> (n);
+            setg (buffer_.data (), buffer_.data (), buffer_.data () + n);
+            return traits_type::to_int_type (*gptr ());
+        }
+
+        std::streamsize xsgetn (char *s, std::streamsize count) override {
+            std::streamsize done = 0;
+            // Drain what is already decrypted.
+            if (gptr () < egptr ()) {
+                auto n = std::min<std::streamsize> (count, egptr () - gptr ());
+                traits_type::copy (s, gptr (), static_cast<size_t> (n));
+                gbump (static_cast<int> (n));
+                done += n;
+            }
+            // Large reads bypass the internal buffer and get decrypted in place.
+            if (static_cast<std::streamsize> (buffer_.size ()) <= count - done) {
+                if (! flush_output ()) {
+                    return done;
+                }
+                auto n = sink_->sgetn (s + done, count - done);
+                if (0 < n) {
+                    apply (state_, s + done, static_cast<size_t> (n), static_cast<size_t> (offset_));
+                    offset_ += static_cast<uint64_t> (n);
+                    done += n;
+                }
+                return done;
+            }
+            if (done < count) {
+                done += std::streambuf::xsgetn (s + done, count - done);
+            }
+            return done;
+        }
+
+        pos_type seekoff (off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+            if (dir == std::ios_base::cur && off == 0) {
+                // `tellg ()` / `tellp ()`: at most one of the areas is active.
+                return pos_type (static_cast<off_type> (offset_) + (pptr () - pbase ()) - (egptr () - gptr ()));
+            }
+            if (! flush_output ()) {
+                return pos_type (off_type (-1));
+            }
+            auto     current = static_cast<off_type> (offset_) - (egptr () - gptr ());
+            off_type target;
+            switch (dir) {
+            case std::ios_base::beg:
+                target = off;
+                break;
+            case std::ios_base::cur:
+                target = current + off;
+                break;
+            default: {
+                auto end = sink_->pubseekoff (0, std::ios_base::end, which);
+                if (end == pos_type (off_type (-1))) {
+                    return end;
+                }
+                target = static_cast<off_type> (end) - base_ + off;
+                break;
+            }
+            }
+            return seek_to (target, which);
+        }
+
+        pos_type seekpos (pos_type pos, std::ios_base::openmode which) override {
+            if (! flush_output ()) {
+                return pos_type (off_type (-1));
+            }
+            return seek_to (static_cast<off_type> (pos), which);
+        }
+
+    private:
+        pos_type seek_to (off_type target, std::ios_base::openmode which) {
+            if (target < 0) {
+                return pos_type (off_type (-1));
+            }
+            // Both of the sink's positions follow the single keystream offset.
+            auto pos = sink_->pubseekpos (pos_type (base_ + target), std::ios_base::in | std::ios_base::out);
+            if (pos == pos_type (off_type (-1))) {
+                pos = sink_->pubseekpos (pos_type (base_ + target), which);
+            }
+            if (pos == pos_type (off_type (-1))) {
+                return pos;
+            }
+            setg (nullptr, nullptr, nullptr);
+            offset_ = static_cast<uint64_t> (target);
+            return pos_type (target);
+        }
+
+        /// @brief Encrypts and writes the pending output.
+        ///
+        /// On a short write the unwritten ciphertext is kept at the start of the put area (and retried by the next flush);
+        /// the pending output is dropped only when the sink takes nothing at all.
+        bool flush_output () {
+            if (pbase () == nullptr || pptr () == pbase ()) {
+                return true;
+            }
+            auto n = static_cast<size_t> (pptr () - pbase ());
+            apply (state_, pbase () + encrypted_, n - encrypted_, static_cast<size_t> (offset_ + encrypted_));
+            encrypted_   = n;
+            auto written = sink_->sputn (pbase (), static_cast<std::streamsize> (n));
+            if (written <= 0) {
+                setp (nullptr, nullptr);
+                encrypted_ = 0;
+                return false;
+            }
+            offset_ += static_cast<uint64_t> (written);
+            auto rest = n - static_cast<size_t> (written);
+            if (rest == 0) {
+                setp (nullptr, nullptr);
+                encrypted_ = 0;
+                return true;
+            }
+            traits_type::move (buffer_.data (), pbase () + written, rest);
+            setp (buffer_.data (), buffer_.data () + buffer_.size ());
+            pbump (static_cast<int> (rest));
+            encrypted_ = rest;
+            return false;
+        }
+
+        /// @brief Gives back the read-ahead bytes to the sink before switching to writing.
+        bool leave_get_area () {
+            if (gptr () == egptr ()) {
+                setg (nullptr, nullptr, nullptr);
+                return true;
+            }
+            auto target = static_cast<off_type> (offset_) - (egptr () - gptr ());
+            setg (nullptr, nullptr, nullptr);
+            return seek_to (target, std::ios_base::in | std::ios_base::out) != pos_type (off_type (-1));
+        }
+    };
+
+    /// @brief Output stream encrypting into another stream buffer.
+    template<typename State_>
+    class CipherOStream : public std::ostream {
+    private:
+        CipherStreamBuf<State_> buf_;
+
+    public:
+        CipherOStream (std::ostream &sink, const State_ &state, size_t buffer_size = CipherStreamBuf<State_>::DEFAULT_BUFFER_SIZE)
+                : std::ostream {nullptr}
+                , buf_ {sink.rdbuf (), state, buffer_size} {
+            this->init (&buf_);
+        }
+
+        [[nodiscard]] CipherStreamBuf<State_> *rdbuf () { return &buf_; }
+    };
+
+    /// @brief Input stream decrypting from another stream buffer.
+    template<typename State_>
+    class CipherIStream : public std::istream {
+    private:
+        CipherStreamBuf<State_> buf_;
+
+    public:
+        CipherIStream (std::istream &source, const State_ &state, size_t buffer_size = CipherStreamBuf<State_>::DEFAULT_BUFFER_SIZE)
+                : std::istream {nullptr}
+                , buf_ {source.rdbuf (), state, buffer_size} {
+            this->init (&buf_);
+        }
+
+        [[nodiscard]] CipherStreamBuf<State_> *rdbuf () { return &buf_; }
+    };
+
+    /// @brief Bidirectional stream over another stream buffer.
+    template<typename State_>
+    class CipherIOStream : public std::iostream {
+    private:
+        CipherStreamBuf<State_> buf_;
+
+    public:
+        CipherIOStream (std::iostream &stream, const State_ &state, size_t buffer_size = CipherStreamBuf<State_>::DEFAULT_BUFFER_SIZE)
+                : std::iostream {nullptr}
+                , buf_ {stream.rdbuf (), state, buffer_size} {
+            this->init (&buf_);
+        }
+
+        [[nodiscard]] CipherStreamBuf<State_> *rdbuf () { return &buf_; }
+    };
+}  // namespace ChaCha
@@ -0,0 +1,135 @@
+/*
+ * tuning.hpp: Kernel selection plan of the library, and the autotuner that calibrates it per host.
+ *
+ * `ChaCha::apply` runs whole blocks through one of the compiled kernels; which one depends on the length
+ * of the run.  The crossover points (and the split of `parallel_apply`) depend on the microarchitecture,
+ * so they can be measured at startup (`autotune`), saved to a file and loaded at later startups.
+ *
+ * Runs larger than the last-level cache take a large-buffer path instead: the input is prefetched ahead of
+ * the keystream and the output bypasses the caches (non-temporal stores) unless the message is applied in place.
+ *
+ * AVX-512 is only worth its frequency licence and warm-up on sustained bulk work, so besides the run length it
+ * requires the calling thread to be "hot": each thread keeps a leaky bucket of the bytes it ran through the wide
+ * kernels (`BulkMeter`), and switches to AVX-512 above one level and back below a lower one.
+ * `ThreadOverride` pins the kernel of a thread regardless of the plan.
+ *
+ * Not available with `CHACHA20_HEADER_ONLY` (the header-only kernels are chosen at compile time).
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <string>
+
+namespace ChaCha::Tuning {
+    /// @brief Multi-block kernels.
+    enum class Backend {
+        SCALAR, /* portable, up to 4 interleaved blocks */
+        SSE2,   /* 4-way */
+        SSSE3,  /* 4-way, byte-shuffle rotations */
+        AVX2,   /* 8-way */
+        AVX512, /* 16-way (AVX-512F) */
+    };
+
+    /// @brief Threshold value meaning "never".
+    constexpr size_t NEVER = std::numeric_limits<size_t>::max ();
+
+    /// @brief Kernel selection plan.
+    struct Plan {
+        Backend baseline          = Backend::SCALAR; /* kernel for the short runs */
+        size_t  avx2_min_blocks   = NEVER;           /* runs of at least this many blocks use AVX2 */
+        size_t  avx512_min_blocks = NEVER;           /* runs of at least this many blocks use AVX-512 ... */
+        size_t  avx512_engage     = 256 * 1024;      /* ... once the thread's bulk level reaches this many bytes (0: always) */
+        size_t  avx512_release    = 64 * 1024;       /* ... and until it decays below this many bytes */
+        size_t  bulk_half_life_us = 1000;            /* half-life of the bulk level */
+        size_t  large_min_size    = NEVER;           /* runs of at least this many bytes take the large-buffer path */
+        size_t  prefetch_distance = 1024;            /* bytes the large-buffer path prefetches ahead (0: none) */
+        size_t  parallel_min_size = NEVER;           /* `parallel_apply` splits messages of at least this many bytes */
+        size_t  parallel_chunk    = 256 * 1024;      /* bytes per `parallel_apply` task */
+        bool    calibrated        = false;           /* `false`: built-in defaults */
+    };
+
+    /// @brief Leaky bucket of the bytes a thread ran through the wide kernels, with hysteresis.
+    class BulkMeter {
+        double   level_    = 0;
+        uint64_t stamp_ns_ = 0;
+        bool     engaged_  = false;
+
+    public:
+        /// @brief Accounts `bytes` at `now_ns` (monotonic).
+        /// @return `true` while engaged: from when the level reaches `engage` until it decays below `release`
+        bool account (size_t bytes, uint64_t now_ns, size_t engage, size_t release, uint64_t half_life_ns) {
+            if (stamp_ns_ < now_ns && 0 < level_) {
+                level_ *= half_life_ns == 0 ? 0.0 : std::exp2 (-static_cast<double> (now_ns - stamp_ns_) / static_cast<double> (half_life_ns));
+            }
+            stamp_ns_ = now_ns;
+            level_ += static_cast<double> (bytes);
+            if (engaged_) {
+                engaged_ = static_cast<double> (release) <= level_;
+            }
+            else {
+                engaged_ = static_cast<double> (engage) <= level_;
+            }
+            return engaged_;
+        }
+
+        [[nodiscard]] bool   engaged () const { return engaged_; }
+        [[nodiscard]] double level () const { return level_; }
+    };
+
+    /// @brief Pins the kernel of the calling thread while alive (nests).
+    /// @remarks Pinning a backend that is not available leaves the thread on the plan.
+    class ThreadOverride {
+        std::optional<Backend> previous_;
+
+    public:
+        explicit ThreadOverride (Backend backend);
+        ~ThreadOverride ();
+        ThreadOverride (const ThreadOverride &) = delete;
+        ThreadOverride &operator= (const ThreadOverride &) = delete;
+    };
+
+    /// @brief The kernel pinned on the calling thread, if any.
+    [[nodiscard]] std::optional<Backend> thread_override ();
+
+    [[nodiscard]] const char *to_string (Backend backend);
+
+    /// @brief `true` if `backend` is compiled in and supported by this CPU.
+    [[nodiscard]] bool available (Backend backend);
+
+    /// @brief Identifies the CPU (and the kernels compiled in); plans are only valid on the same signature.
+    [[nodiscard]] std::string host_signature ();
+
+    /// @brief The plan used without calibration (natural kernel widths, large-buffer path above the LLC size).
+    [[nodiscard]] Plan default_plan ();
+
+    /// @brief The plan in use.
+    [[nodiscard]] Plan current_plan ();
+
+    /// @brief Installs `plan` (thresholds of unavailable backends are treated as `NEVER`).
+    void install (const Plan &plan);
+
+    /// @brief Micro-benchmarks the available kernels (and `parallel_apply`) and derives a plan (takes ~0.1 s).
+    /// @remarks The large-buffer settings are kept from `default_plan` (measuring them takes DRAM-sized buffers).
+    /// @param install_plan `true` to install the result
+    Plan autotune (bool install_plan = true);
+
+    /// @brief Saves `plan` (with the host signature) to `path`.
+    /// @return `false` on I/O errors
+    bool save (const Plan &plan, const std::string &path);
+
+    /// @brief Loads a plan saved by `save`.
+    /// @return `false` if the file is missing or malformed, or it was saved on another host
+    bool load (const std::string &path, Plan &plan);
+
+    /// @brief Loads and installs the plan in `path`, or autotunes and saves one there.
+    Plan load_or_autotune (const std::string &path);
+
+    /// @brief Human readable summary of `plan`.
+    [[nodiscard]] std::string describe (const Plan &plan);
+}  // namespace ChaCha::Tuning
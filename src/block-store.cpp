@@ -0,0 +1,184 @@
+/*
+ * block-store.cpp: Batched, coalesced `preadv` / `pwritev` of `BlockStore`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include <chacha20/block-store.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#ifdef __linux__
+#    include <fcntl.h>
+#    include <limits.h>
+#    include <sys/stat.h>
+#    include <sys/uio.h>
+#    include <unistd.h>
+#endif
+
+namespace ChaCha {
+    namespace {
+        [[noreturn]] void fail (const char *what, int err = errno) { throw std::system_error {err, std::generic_category (), what}; }
+
+        template<typename Buffer_>
+        void check_numbers (const Buffer_ *sectors, size_t count, uint64_t limit) {
+            for (size_t i = 0; i < count; ++i) {
+                if (limit <= sectors[i].number) {
+                    throw std::out_of_range {"BlockStore: sector " + std::to_string (sectors[i].number) + " is beyond the store"};
+                }
+            }
+        }
+
+        /// @brief Indices of `sectors` in ascending order of their numbers (ties in the given order).
+        template<typename Buffer_>
+        std::vector<size_t> sorted_order (const Buffer_ *sectors, size_t count) {
+            std::vector<size_t> order (count);
+            std::iota (order.begin (), order.end (), size_t {0});
+            std::stable_sort (order.begin (), order.end (), [sectors] (size_t a, size_t b) { return sectors[a].number < sectors[b].number; });
+            return order;
+        }
+    }  // namespace
+
+#ifdef __linux__
+    namespace {
+        /// @brief `preadv` / `pwritev` of all of `iov`, resumed after short transfers.
+        void transfer (int fd, iovec *iov, size_t iovcnt, off_t offset, bool write) {
+            while (0 < iovcnt) {
+                auto const cnt = static_cast<int> (std::min<size_t> (iovcnt, IOV_MAX));
+                auto const n   = write ? ::pwritev (fd, iov, cnt, offset) : ::preadv (fd, iov, cnt, offset);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    fail (write ? "BlockStore: pwritev" : "BlockStore: preadv");
+                }
+                if (n == 0) {
+                    fail ("BlockStore: short transfer", EIO);
+                }
+                offset += n;
+                for (auto left = static_cast<size_t> (n); 0 < left;) {
+                    if (left < iov->iov_len) {
+                        iov->iov_base = static_cast<uint8_t *> (iov->iov_base) + left;
+                        iov->iov_len -= left;
+                        break;
+                    }
+                    left -= iov->iov_len;
+                    ++iov;
+                    --iovcnt;
+                }
+            }
+        }
+
+        /// @brief Transfers the sectors of `order` (ascending), one system call per run of adjacent sectors.
+        /// @remarks A sector read twice starts a run of its own.
+        template<typename Buffer_>
+        void transfer_runs (int fd, const Buffer_ *sectors, const std::vector<size_t> &order, size_t sector_size, bool write) {
+            std::vector<iovec> iov;
+            iov.reserve (order.size ());
+            for (size_t i = 0; i < order.size ();) {
+                auto const first = sectors[order[i]].number;
+                iov.clear ();
+                for (; i < order.size () && sectors[order[i]].number == first + iov.size (); ++i) {
+                    iov.push_back (iovec {const_cast<void *> (static_cast<const void *> (sectors[order[i]].data)), sector_size});
+                }
+                transfer (fd, iov.data (), iov.size (), static_cast<off_t> (first * sector_size), write);
+            }
+        }
+    }  // namespace
+
+    BlockStore::BlockStore (const std::string &path, const SectorCipher &cipher, uint64_t sectors)
+            : cipher_ {cipher}
+            , fd_ {-1}
+            , sectors_ {sectors} {
+        if (cipher.max_sectors () < sectors) {
+            throw std::invalid_argument {"BlockStore: more sectors than the cipher can address"};
+        }
+        fd_ = ::open (path.c_str (), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd_ < 0) {
+            fail ("BlockStore: open");
+        }
+        struct stat st {};
+        auto const  size = static_cast<off_t> (sectors * cipher.sector_size ());
+        if (::fstat (fd_, &st) != 0 || (st.st_size < size && ::ftruncate (fd_, size) != 0)) {
+            auto const err = errno;
+            ::close (fd_);
+            fail ("BlockStore: sizing the file", err);
+        }
+    }
+
+    BlockStore::~BlockStore () {
+        if (0 <= fd_) {
+            ::close (fd_);
+        }
+    }
+
+    void BlockStore::read (const SectorBuffer *sectors, size_t count, size_t threads) {
+        check_numbers (sectors, count, sectors_);
+        transfer_runs (fd_, sectors, sorted_order (sectors, count), sector_size (), false);
+        cipher_.apply (sectors, count, threads);
+    }
+
+    void BlockStore::write (const ConstSectorBuffer *sectors, size_t count, size_t threads) {
+        check_numbers (sectors, count, sectors_);
+        auto order = sorted_order (sectors, count);
+        // Of a repeated sector, keep the last one given.
+        auto last = std::unique (order.rbegin (), order.rend (), [sectors] (size_t a, size_t b) { return sectors[a].number == sectors[b].number; });
+        order.erase (order.begin (), last.base ());
+
+        auto const size = sector_size ();
+        scratch_.resize (order.size () * size);
+        std::vector<SectorBuffer> cipher (order.size ());
+        for (size_t i = 0; i < order.size (); ++i) {
+            cipher[i] = SectorBuffer {sectors[order[i]].number, &scratch_[i * size]};
+            std::memcpy (cipher[i].data, sectors[order[i]].data, size);
+        }
+        cipher_.apply (cipher.data (), cipher.size (), threads);
+
+        std::vector<size_t> ascending (cipher.size ());
+        std::iota (ascending.begin (), ascending.end (), size_t {0});
+        transfer_runs (fd_, cipher.data (), ascending, size, true);
+    }
+
+    void BlockStore::sync () {
+        if (::fdatasync (fd_) != 0) {
+            fail ("BlockStore: fdatasync");
+        }
+    }
+#else
+    BlockStore::BlockStore (const std::string &, const SectorCipher &cipher, uint64_t sectors)
+            : cipher_ {cipher}
+            , fd_ {-1}
+            , sectors_ {sectors} {
+        fail ("BlockStore", ENOSYS);
+    }
+
+    BlockStore::~BlockStore () = default;
+
+    void BlockStore::read (const SectorBuffer *, size_t, size_t) { fail ("BlockStore", ENOSYS); }
+
+    void BlockStore::write (const ConstSectorBuffer *, size_t, size_t) { fail ("BlockStore", ENOSYS); }
+
+    void BlockStore::sync () { fail ("BlockStore", ENOSYS); }
+#endif
+
+    BlockStore::BlockStore (BlockStore &&other) noexcept
+            : cipher_ {other.cipher_}
+            , fd_ {std::exchange (other.fd_, -1)}
+            , sectors_ {std::exchange (other.sectors_, 0)}
+            , scratch_ {std::move (other.scratch_)} {}
+
+    BlockStore &BlockStore::operator= (BlockStore &&other) noexcept {
+        BlockStore tmp {std::move (other)};
+        std::swap (cipher_, tmp.cipher_);
+        std::swap (fd_, tmp.fd_);
+        std::swap (sectors_, tmp.sectors_);
+        std::swap (scratch_, tmp.scratch_);
+        return *this;
+    }
+}  // namespace ChaCha
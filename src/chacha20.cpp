@@ -12,139 +12,350 @@
 #    include "config.hpp"
 #endif
 
-#ifdef HAVE_SSE3
-#    include <emmintrin.h>
-#    include <xmmintrin.h>
-#endif
+#include "dispatch.hpp"
+#include "kernel.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <optional>
 
 namespace ChaCha::detail {
 
-    template<size_t N_>
-    uint32_t rot (uint32_t v) {
-        return (v << N_) | (v >> (32u - N_));
+    mask_t create_mask (const std::array<uint32_t, 16> &state) {
+        mask_t result;
+#ifdef HAVE_SSE3
+        kernel::sse2::create_mask (state, result.data ());
+#else
+        kernel::scalar::create_mask (state, result.data ());
+#endif
+        return result;
     }
 
+    namespace {
+        kernel::apply_blocks_t select_apply_blocks () {
+#if defined(HAVE_SSSE3) && (defined(__GNUC__) || defined(__clang__))
+            if (__builtin_cpu_supports ("ssse3")) {
+                return kernel::ssse3::apply_blocks;
+            }
+#endif
 #ifdef HAVE_SSE3
+            return kernel::sse2::apply_blocks;
+#else
+            return kernel::scalar::apply_blocks;
+#endif
+        }
 
-    template<size_t N_>
-    __m128i vrot (__m128i v) {
-        __m128i t0 = _mm_slli_epi32 (v, N_);
-        __m128i t1 = _mm_srli_epi32 (v, 32 - N_);
-        return _mm_or_si128 (t0, t1);
-    }
+        /// @brief Kernel selection by run length (see `ChaCha::Tuning::Plan`).
+        struct Route {
+            std::atomic<kernel::apply_blocks_t> baseline {select_apply_blocks ()};
+            std::atomic<size_t>                 avx2_min_blocks {Tuning::NEVER};
+            std::atomic<size_t>                 avx512_min_blocks {Tuning::NEVER};
+            const kernel::apply_blocks_t        avx2 {dispatch::kernel_of (Tuning::Backend::AVX2)};
+            const kernel::apply_blocks_t        avx512 {dispatch::kernel_of (Tuning::Backend::AVX512)};
+            /* Never `nullptr` once `large_min_blocks` is set, so that the two can be updated independently. */
+            std::atomic<kernel::apply_blocks_large_t> large {nullptr};
+            std::atomic<size_t>                       large_min_blocks {Tuning::NEVER};
+            std::atomic<size_t>                       prefetch_distance {0};
+            /* AVX-512 engagement (see `ChaCha::Tuning::BulkMeter`) */
+            std::atomic<size_t>   avx512_engage {0};
+            std::atomic<size_t>   avx512_release {0};
+            std::atomic<uint64_t> bulk_half_life_ns {0};
 
-    template<>
-    __m128i vrot<16> (__m128i v) {
-        return _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (v, _MM_SHUFFLE (2, 3, 0, 1)), _MM_SHUFFLE (2, 3, 0, 1));
-    }
+            Route () {
+                auto const &plan = Tuning::default_plan ();
+                avx2_min_blocks.store (plan.avx2_min_blocks, std::memory_order_relaxed);
+                avx512_min_blocks.store (plan.avx512_min_blocks, std::memory_order_relaxed);
+                avx512_engage.store (plan.avx512_engage, std::memory_order_relaxed);
+                avx512_release.store (plan.avx512_release, std::memory_order_relaxed);
+                bulk_half_life_ns.store (1000u * plan.bulk_half_life_us, std::memory_order_relaxed);
+                for (auto b : {Tuning::Backend::AVX512, Tuning::Backend::AVX2, Tuning::Backend::SSSE3, Tuning::Backend::SSE2}) {
+                    if (auto fn = dispatch::large_kernel_of (b); fn != nullptr) {
+                        large.store (fn, std::memory_order_relaxed);
+                        large_min_blocks.store (plan.large_min_size == Tuning::NEVER ? Tuning::NEVER : plan.large_min_size / 64,
+                                                std::memory_order_relaxed);
+                        prefetch_distance.store (plan.prefetch_distance, std::memory_order_relaxed);
+                        break;
+                    }
+                }
+            }
+        };
+
+        Route &route () {
+            static Route route;
+            return route;
+        }
+
+        /// @brief Per-thread part of the routing.
+        struct ThreadRoute {
+            kernel::apply_blocks_t         pinned       = nullptr;
+            kernel::apply_blocks_large_t   pinned_large = nullptr;
+            std::optional<Tuning::Backend> pinned_backend;
+            Tuning::BulkMeter              meter;
+        };
+
+        thread_local ThreadRoute thread_route;
+
+        /// @brief `true` if the calling thread is doing bulk work (after accounting `count` blocks).
+        bool bulk (const Route &r, size_t count) {
+            auto const engage = r.avx512_engage.load (std::memory_order_relaxed);
+            if (engage == 0) {
+                return true;
+            }
+            auto const now = std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now ().time_since_epoch ());
+            return thread_route.meter.account (64 * count,
+                                               static_cast<uint64_t> (now.count ()),
+                                               engage,
+                                               r.avx512_release.load (std::memory_order_relaxed),
+                                               r.bulk_half_life_ns.load (std::memory_order_relaxed));
+        }
+
+        /// @brief The kernel for a run of `count` blocks on the calling thread.
+        kernel::apply_blocks_t by_length (const Route &r, size_t count) {
+            if (r.avx512_min_blocks.load (std::memory_order_relaxed) <= count && bulk (r, count)) {
+                return r.avx512;
+            }
+            if (r.avx2_min_blocks.load (std::memory_order_relaxed) <= count) {
+                return r.avx2;
+            }
+            return r.baseline.load (std::memory_order_relaxed);
+        }
+
+        kernel::salsa20_apply_blocks_t select_salsa20_apply_blocks () {
+#if defined(HAVE_AVX2) && (defined(__GNUC__) || defined(__clang__))
+            if (__builtin_cpu_supports ("avx2")) {
+                return kernel::avx2::salsa20_apply_blocks;
+            }
+#endif
+#ifdef HAVE_SSE3
+            return kernel::sse2::salsa20_apply_blocks;
+#else
+            return kernel::scalar::salsa20_apply_blocks;
 #endif
+        }
 
-    mask_t create_mask (const std::array<uint32_t, 16> &state) {
-        std::array<uint32_t, 16> x {state};
-        const int32_t            NUM_ROUNDS = 20;
-        static_assert ((NUM_ROUNDS % 2) == 0, "# of ROUNDS should be a multiple of 2.");
+        kernel::create_masks_t select_create_masks () {
+#if defined(HAVE_SSSE3) && (defined(__GNUC__) || defined(__clang__))
+            if (__builtin_cpu_supports ("ssse3")) {
+                return kernel::ssse3::create_masks;
+            }
+#endif
+#ifdef HAVE_SSE3
+            return kernel::sse2::create_masks;
+#else
+            return kernel::scalar::create_masks;
+#endif
+        }
+
+        kernel::header_masks_t select_header_masks () {
+#if defined(__GNUC__) || defined(__clang__)
+#    ifdef HAVE_AVX512F
+            if (__builtin_cpu_supports ("avx512f")) {
+                return kernel::avx512::header_masks;
+            }
+#    endif
+#    ifdef HAVE_AVX2
+            if (__builtin_cpu_supports ("avx2")) {
+                return kernel::avx2::header_masks;
+            }
+#    endif
+#    ifdef HAVE_SSSE3
+            if (__builtin_cpu_supports ("ssse3")) {
+                return kernel::ssse3::header_masks;
+            }
+#    endif
+#endif
+#ifdef HAVE_SSE3
+            return kernel::sse2::header_masks;
+#else
+            return kernel::scalar::header_masks;
+#endif
+        }
+    }  // namespace
+
+    namespace dispatch {
+        bool supported (Tuning::Backend backend) {
+#if defined(__GNUC__) || defined(__clang__)
+            switch (backend) {
+            case Tuning::Backend::SCALAR:
+                return true;
+            case Tuning::Backend::SSE2:
+#    ifdef HAVE_SSE3
+                return true;
+#    else
+                return false;
+#    endif
+            case Tuning::Backend::SSSE3:
+#    ifdef HAVE_SSSE3
+                return __builtin_cpu_supports ("ssse3");
+#    else
+                return false;
+#    endif
+            case Tuning::Backend::AVX2:
+#    ifdef HAVE_AVX2
+                return __builtin_cpu_supports ("avx2");
+#    else
+                return false;
+#    endif
+            case Tuning::Backend::AVX512:
+#    ifdef HAVE_AVX512F
+                return __builtin_cpu_supports ("avx512f");
+#    else
+                return false;
+#    endif
+            }
+            return false;
+#else
+            return backend == Tuning::Backend::SCALAR;
+#endif
+        }
 
+        kernel::apply_blocks_t kernel_of (Tuning::Backend backend) {
+            if (! supported (backend)) {
+                return nullptr;
+            }
+            switch (backend) {
+            case Tuning::Backend::SCALAR:
+                return kernel::scalar::apply_blocks;
 #ifdef HAVE_SSE3
-        __m128i v0orig = _mm_loadu_si128 ((const __m128i *)&state[0]);
-        __m128i v1orig = _mm_loadu_si128 ((const __m128i *)&state[4]);
-        __m128i v2orig = _mm_loadu_si128 ((const __m128i *)&state[8]);
-        __m128i v3orig = _mm_loadu_si128 ((const __m128i *)&state[12]);
-
-        __m128i v0 = v0orig;
-        __m128i v1 = v1orig;
-        __m128i v2 = v2orig;
-        __m128i v3 = v3orig;
-
-        for (int_fast32_t i = 0; i < (NUM_ROUNDS / 2); ++i) {
-            //  3  2  1  0
-            //  7  6  5  4
-            // 11 10  9  8
-            // 15 14 13 12
-            v0 = _mm_add_epi32 (v0, v1);
-            v3 = vrot<16> (_mm_xor_si128 (v3, v0));
-            v2 = _mm_add_epi32 (v2, v3);
-            v1 = vrot<12> (_mm_xor_si128 (v1, v2));
-            v0 = _mm_add_epi32 (v0, v1);
-            v3 = vrot<8> (_mm_xor_si128 (v3, v0));
-            v2 = _mm_add_epi32 (v2, v3);
-            v1 = vrot<7> (_mm_xor_si128 (v1, v2));
-
-            v1 = _mm_shuffle_epi32 (v1, _MM_SHUFFLE (0, 3, 2, 1));
-            v2 = _mm_shuffle_epi32 (v2, _MM_SHUFFLE (1, 0, 3, 2));
-            v3 = _mm_shuffle_epi32 (v3, _MM_SHUFFLE (2, 1, 0, 3));
-            //  3  2  1  0
-            //  4  7  6  5
-            //  9  8 11 10
-            // 14 13 12 15
-
-            v0 = _mm_add_epi32 (v0, v1);
-            v3 = vrot<16> (_mm_xor_si128 (v3, v0));
-            v2 = _mm_add_epi32 (v2, v3);
-            v1 = vrot<12> (_mm_xor_si128 (v1, v2));
-            v0 = _mm_add_epi32 (v0, v1);
-            v3 = vrot<8> (_mm_xor_si128 (v3, v0));
-            v2 = _mm_add_epi32 (v2, v3);
-            v1 = vrot<7> (_mm_xor_si128 (v1, v2));
-
-            v1 = _mm_shuffle_epi32 (v1, _MM_SHUFFLE (2, 1, 0, 3));
-            v2 = _mm_shuffle_epi32 (v2, _MM_SHUFFLE (1, 0, 3, 2));
-            v3 = _mm_shuffle_epi32 (v3, _MM_SHUFFLE (0, 3, 2, 1));
-            //  3  2  1  0
-            //  7  6  5  4
-            // 11 10  9  8
-            // 15 14 13 12
-        }
-        v0 = _mm_add_epi32 (v0, v0orig);
-        v1 = _mm_add_epi32 (v1, v1orig);
-        v2 = _mm_add_epi32 (v2, v2orig);
-        v3 = _mm_add_epi32 (v3, v3orig);
+            case Tuning::Backend::SSE2:
+                return kernel::sse2::apply_blocks;
+#endif
+#ifdef HAVE_SSSE3
+            case Tuning::Backend::SSSE3:
+                return kernel::ssse3::apply_blocks;
+#endif
+#ifdef HAVE_AVX2
+            case Tuning::Backend::AVX2:
+                return kernel::avx2::apply_blocks;
+#endif
+#ifdef HAVE_AVX512F
+            case Tuning::Backend::AVX512:
+                return kernel::avx512::apply_blocks;
+#endif
+            default:
+                return nullptr;
+            }
+        }
 
-        mask_t result;
-        {
-            _mm_storeu_si128 ((__m128i *)&result[0], v0);
-            _mm_storeu_si128 ((__m128i *)&result[16], v1);
-            _mm_storeu_si128 ((__m128i *)&result[32], v2);
-            _mm_storeu_si128 ((__m128i *)&result[48], v3);
+        kernel::apply_blocks_large_t large_kernel_of (Tuning::Backend backend) {
+            if (! supported (backend)) {
+                return nullptr;
+            }
+            switch (backend) {
+#ifdef HAVE_SSE3
+            case Tuning::Backend::SSE2:
+                return kernel::sse2::apply_blocks_large;
+#endif
+#ifdef HAVE_SSSE3
+            case Tuning::Backend::SSSE3:
+                return kernel::ssse3::apply_blocks_large;
+#endif
+#ifdef HAVE_AVX2
+            case Tuning::Backend::AVX2:
+                return kernel::avx2::apply_blocks_large;
+#endif
+#ifdef HAVE_AVX512F
+            case Tuning::Backend::AVX512:
+                return kernel::avx512::apply_blocks_large;
+#endif
+            default:
+                return nullptr;
+            }
         }
-        return result;
 
-#else /* not HAVE_SSE3 */
-        auto quarter_round = [&x] (uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
-            x[a] += x[b];
-            x[d] = rot<16> (x[d] ^ x[a]);
-            x[c] += x[d];
-            x[b] = rot<12> (x[b] ^ x[c]);
-            x[a] += x[b];
-            x[d] = rot<8> (x[d] ^ x[a]);
-            x[c] += x[d];
-            x[b] = rot<7> (x[b] ^ x[c]);
-        };
+        void install (const Tuning::Plan &plan) {
+            auto &r  = route ();
+            auto  fn = kernel_of (plan.baseline);
+            r.baseline.store (fn != nullptr ? fn : select_apply_blocks (), std::memory_order_relaxed);
+            r.avx2_min_blocks.store (supported (Tuning::Backend::AVX2) ? plan.avx2_min_blocks : Tuning::NEVER, std::memory_order_relaxed);
+            r.avx512_min_blocks.store (supported (Tuning::Backend::AVX512) ? plan.avx512_min_blocks : Tuning::NEVER, std::memory_order_relaxed);
+            r.avx512_engage.store (plan.avx512_engage, std::memory_order_relaxed);
+            r.avx512_release.store (plan.avx512_release, std::memory_order_relaxed);
+            r.bulk_half_life_ns.store (1000u * plan.bulk_half_life_us, std::memory_order_relaxed);
 
-        for (int_fast32_t i = 0; i < (NUM_ROUNDS / 2); ++i) {
-            quarter_round (0, 4, 8, 12);
-            quarter_round (1, 5, 9, 13);
-            quarter_round (2, 6, 10, 14);
-            quarter_round (3, 7, 11, 15);
-            quarter_round (0, 5, 10, 15);
-            quarter_round (1, 6, 11, 12);
-            quarter_round (2, 7, 8, 13);
-            quarter_round (3, 4, 9, 14);
+            // The large-buffer path uses the widest kernel the plan routes to at all.
+            kernel::apply_blocks_large_t large = nullptr;
+            if (plan.avx512_min_blocks != Tuning::NEVER) {
+                large = large_kernel_of (Tuning::Backend::AVX512);
+            }
+            if (large == nullptr && plan.avx2_min_blocks != Tuning::NEVER) {
+                large = large_kernel_of (Tuning::Backend::AVX2);
+            }
+            if (large == nullptr) {
+                large = large_kernel_of (plan.baseline);
+            }
+            if (large == nullptr) {
+                r.large_min_blocks.store (Tuning::NEVER, std::memory_order_relaxed);
+                return;
+            }
+            r.large.store (large, std::memory_order_relaxed);
+            r.prefetch_distance.store (plan.prefetch_distance, std::memory_order_relaxed);
+            r.large_min_blocks.store (plan.large_min_size == Tuning::NEVER ? Tuning::NEVER : plan.large_min_size / 64, std::memory_order_relaxed);
         }
-        for (int_fast32_t i = 0; i < x.size (); ++i) {
-            x[i] += state[i];
+
+        void set_thread_override (std::optional<Tuning::Backend> backend) {
+            auto &t = thread_route;
+            if (backend && kernel_of (*backend) != nullptr) {
+                t.pinned         = kernel_of (*backend);
+                t.pinned_large   = large_kernel_of (*backend);
+                t.pinned_backend = backend;
+            }
+            else {
+                t.pinned       = nullptr;
+                t.pinned_large = nullptr;
+                t.pinned_backend.reset ();
+            }
         }
 
-        mask_t result;
-        for (int_fast32_t i = 0; i < x.size (); ++i) {
-            auto v            = x[i];
-            result[4 * i + 0] = static_cast<uint8_t> (v >> 0);
-            result[4 * i + 1] = static_cast<uint8_t> (v >> 8);
-            result[4 * i + 2] = static_cast<uint8_t> (v >> 16);
-            result[4 * i + 3] = static_cast<uint8_t> (v >> 24);
+        std::optional<Tuning::Backend> thread_override () { return thread_route.pinned_backend; }
+    }  // namespace dispatch
+
+    void apply_blocks (const std::array<uint32_t, 16> &state, bool wide_sequence, void *out, const void *in, size_t count) {
+        if (count == 0) {
+            return;
         }
+        auto &r = route ();
+        auto &t = thread_route;
+        if (r.large_min_blocks.load (std::memory_order_relaxed) <= count) {
+            // A single run this large is bulk work by itself.
+            auto large    = t.pinned != nullptr ? t.pinned_large : r.large.load (std::memory_order_relaxed);
+            auto distance = r.prefetch_distance.load (std::memory_order_relaxed);
+            if (large != nullptr) {
+                large (state, wide_sequence, static_cast<uint8_t *> (out), static_cast<const uint8_t *> (in), count, distance);
+                return;
+            }
+        }
+        auto fn = t.pinned != nullptr ? t.pinned : by_length (r, count);
+        fn (state, wide_sequence, static_cast<uint8_t *> (out), static_cast<const uint8_t *> (in), count);
+    }
+
+    void create_masks (const std::array<uint32_t, 16> *states, size_t count, void *out) {
+        static const kernel::create_masks_t fn = select_create_masks ();
+        if (count == 0) {
+            return;
+        }
+        fn (states, static_cast<uint8_t *> (out), count);
+    }
+
+    void header_protection_masks (const std::array<uint32_t, 16> &state, const void *samples, size_t count, void *out) {
+        static const kernel::header_masks_t fn = select_header_masks ();
+        if (count == 0) {
+            return;
+        }
+        fn (state, static_cast<const uint8_t *> (samples), static_cast<uint8_t *> (out), count);
+    }
+
+    mask_t salsa20_create_mask (const std::array<uint32_t, 16> &state) {
+        mask_t result;
+        kernel::scalar::salsa20_create_mask (state, result.data ());
         return result;
-#endif /* not HAVE_SSE3 */
     }
-}  // namespace ChaCha::detail
 
-  // namespace ChaCha
+    void salsa20_apply_blocks (const std::array<uint32_t, 16> &state, void *out, const void *in, size_t count) {
+        static const kernel::salsa20_apply_blocks_t fn = select_salsa20_apply_blocks ();
+        if (count == 0) {
+            return;
+        }
+        fn (state, static_cast<uint8_t *> (out), static_cast<const uint8_t *> (in), count);
+    }
+}  // namespace ChaCha::detail
@@ -0,0 +1,49 @@
+/*
+ * dispatch.hpp: Run-time kernel selection (internal).
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include "kernel.hpp"
+
+#include <chacha20/tuning.hpp>
+
+namespace ChaCha::detail::dispatch {
+    /// @brief `true` if `backend` is compiled in and supported by this CPU.
+    bool supported (Tuning::Backend backend);
+
+    /// @brief The ChaCha20 kernel of `backend` (`nullptr` if not supported).
+    kernel::apply_blocks_t kernel_of (Tuning::Backend backend);
+
+    /// @brief The large-buffer variant of the ChaCha20 kernel of `backend` (`nullptr` if not supported or none).
+    kernel::apply_blocks_large_t large_kernel_of (Tuning::Backend backend);
+
+    /// @brief Routes `apply_blocks` as `plan` says (`plan` must be sanitized).
+    void install (const Tuning::Plan &plan);
+
+    /// @brief Pins (or with `std::nullopt`, unpins) the kernel of the calling thread.
+    void set_thread_override (std::optional<Tuning::Backend> backend);
+
+    /// @brief The kernel pinned on the calling thread.
+    std::optional<Tuning::Backend> thread_override ();
+
+    /// @brief Split of `parallel_apply` (in bytes).
+    struct ParallelLimits {
+        size_t min_size;
+        size_t chunk;
+    };
+
+    /// @brief The installed split of `parallel_apply`.
+    ParallelLimits parallel_limits ();
+
+    /// @brief Runs `count` blocks in chunks of `chunk_blocks` on `threads` threads (the caller is one of them).
+    void parallel_apply_blocks (const kernel::state_t &state,
+                                core_t                 core,
+                                bool                   wide_sequence,
+                                uint8_t *              out,
+                                const uint8_t *        in,
+                                size_t                 count,
+                                size_t                 threads,
+                                size_t                 chunk_blocks);
+}  // namespace ChaCha::detail::dispatch
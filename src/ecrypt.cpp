@@ -0,0 +1,76 @@
+/*
+ * ecrypt.cpp: The ECRYPT stream cipher API (`reference/ecrypt-sync.h`) on top of the library.
+ *
+ * Drop-in replacement of the reference implementation (`chacha20-ref`): same symbols, same `ECRYPT_ctx`
+ * layout and the same outputs, but messages run through `ChaCha::apply` (the multi-block kernels).
+ * `ECRYPT_ctx::input` has the word layout of `ChaCha::DJB::State`, so a context is copied into a state
+ * and back on every call (64 bytes).
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include <chacha20.hpp>
+
+#include <cstring>
+#include <type_traits>
+
+extern "C" {
+#include "ecrypt-sync.h"
+}
+
+namespace {
+    using ChaCha::DJB::State;
+
+    static_assert (std::is_trivially_copyable_v<State>);
+    static_assert (sizeof (State) == sizeof (ECRYPT_ctx));
+
+    State load (const ECRYPT_ctx *ctx) {
+        State result;
+        ::memcpy (static_cast<void *> (&result), ctx, sizeof (result));
+        return result;
+    }
+
+    void store (ECRYPT_ctx *ctx, const State &state) { ::memcpy (ctx, &state, sizeof (*ctx)); }
+}  // namespace
+
+extern "C" {
+void ECRYPT_init () {}
+
+void ECRYPT_keysetup (ECRYPT_ctx *ctx, const u8 *key, u32 keysize, u32 /* ivsize */) {
+    auto state = load (ctx);
+    // As the reference: anything but 256 bits is a 128-bit key.
+    state.setKey (key, keysize == 256 ? 32 : 16);
+    store (ctx, state);
+}
+
+void ECRYPT_ivsetup (ECRYPT_ctx *ctx, const u8 *iv) {
+    auto state = load (ctx);
+    state.setInitialVector ((static_cast<uint64_t> (ChaCha::detail::asUInt32 (iv + 4)) << 32u) | ChaCha::detail::asUInt32 (iv + 0));
+    store (ctx, state);
+}
+
+void ECRYPT_encrypt_bytes (ECRYPT_ctx *ctx, const u8 *plaintext, u8 *ciphertext, u32 msglen) {
+    // As the reference, a trailing partial block consumes the whole block.
+    auto state = load (ctx);
+    ChaCha::apply (state, ciphertext, plaintext, msglen);
+    store (ctx, state);
+}
+
+void ECRYPT_decrypt_bytes (ECRYPT_ctx *ctx, const u8 *ciphertext, u8 *plaintext, u32 msglen) {
+    ECRYPT_encrypt_bytes (ctx, ciphertext, plaintext, msglen);
+}
+
+void ECRYPT_keystream_bytes (ECRYPT_ctx *ctx, u8 *keystream, u32 length) {
+    ::memset (keystream, 0, length);
+    ECRYPT_encrypt_bytes (ctx, keystream, keystream, length);
+}
+
+void ECRYPT_encrypt_packet (ECRYPT_ctx *ctx, const u8 *iv, const u8 *plaintext, u8 *ciphertext, u32 msglen) {
+    ECRYPT_ivsetup (ctx, iv);
+    ECRYPT_encrypt_bytes (ctx, plaintext, ciphertext, msglen);
+}
+
+void ECRYPT_decrypt_packet (ECRYPT_ctx *ctx, const u8 *iv, const u8 *ciphertext, u8 *plaintext, u32 msglen) {
+    ECRYPT_ivsetup (ctx, iv);
+    ECRYPT_decrypt_bytes (ctx, ciphertext, plaintext, msglen);
+}
+}
@@ -0,0 +1,33 @@
+/*
+ * kernel-avx2.cpp: 8-way kernels (AVX2).
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#ifdef HAVE_CONFIG_HPP
+#    include "config.hpp"
+#endif
+
+#ifdef HAVE_AVX2
+#    include "kernel.hpp"
+
+#    include <chacha20/kernel/avx.hpp>
+#    include <chacha20/kernel/salsa20-sse.hpp>
+
+namespace ChaCha::detail::kernel::avx2 {
+    void apply_blocks (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count) {
+        apply_blocks_avx2 (state, wide_sequence, out, in, count);
+    }
+
+    void apply_blocks_large (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count, size_t distance) {
+        apply_blocks_avx2_large (state, wide_sequence, out, in, count, distance);
+    }
+
+    void salsa20_apply_blocks (const state_t &state, uint8_t *out, const uint8_t *in, size_t count) {
+        apply_blocks_salsa20_avx2 (state, out, in, count);
+    }
+
+    void header_masks (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count) {
+        header_masks_avx2 (state, samples, out, count);
+    }
+}  // namespace ChaCha::detail::kernel::avx2
+#endif /* HAVE_AVX2 */
@@ -0,0 +1,28 @@
+/*
+ * kernel-avx512.cpp: 16-way kernel (AVX-512F).
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#ifdef HAVE_CONFIG_HPP
+#    include "config.hpp"
+#endif
+
+#ifdef HAVE_AVX512F
+#    include "kernel.hpp"
+
+#    include <chacha20/kernel/avx.hpp>
+
+namespace ChaCha::detail::kernel::avx512 {
+    void apply_blocks (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count) {
+        apply_blocks_avx512 (state, wide_sequence, out, in, count);
+    }
+
+    void apply_blocks_large (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count, size_t distance) {
+        apply_blocks_avx512_large (state, wide_sequence, out, in, count, distance);
+    }
+
+    void header_masks (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count) {
+        header_masks_avx512 (state, samples, out, count);
+    }
+}  // namespace ChaCha::detail::kernel::avx512
+#endif /* HAVE_AVX512F */
@@ -0,0 +1,29 @@
+/*
+ * kernel-scalar.cpp: Portable kernel.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "kernel.hpp"
+
+#include <chacha20/kernel/salsa20.hpp>
+#include <chacha20/kernel/scalar.hpp>
+
+namespace ChaCha::detail::kernel::scalar {
+    void apply_blocks (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count) {
+        apply_blocks_scalar (state, wide_sequence, out, in, count);
+    }
+
+    void create_mask (const state_t &state, uint8_t *out) { create_mask_scalar (state, out); }
+
+    void create_masks (const state_t *states, uint8_t *out, size_t count) { create_masks_scalar (states, out, count); }
+
+    void header_masks (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count) {
+        header_masks_scalar (state, samples, out, count);
+    }
+
+    void salsa20_apply_blocks (const state_t &state, uint8_t *out, const uint8_t *in, size_t count) {
+        apply_blocks_salsa20_scalar (state, out, in, count);
+    }
+
+    void salsa20_create_mask (const state_t &state, uint8_t *out) { create_mask_salsa20_scalar (state, out); }
+}  // namespace ChaCha::detail::kernel::scalar
@@ -0,0 +1,39 @@
+/*
+ * kernel-sse2.cpp: 4-way kernel for the x86-64 baseline.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#ifdef HAVE_CONFIG_HPP
+#    include "config.hpp"
+#endif
+
+#ifdef HAVE_SSE3
+#    include "kernel.hpp"
+
+#    include <chacha20/kernel/salsa20-sse.hpp>
+#    include <chacha20/kernel/sse.hpp>
+
+namespace ChaCha::detail::kernel::sse2 {
+    using Rot = RotSSE2;
+
+    void apply_blocks (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count) {
+        apply_blocks_sse<Rot> (state, wide_sequence, out, in, count);
+    }
+
+    void apply_blocks_large (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count, size_t distance) {
+        apply_blocks_sse_large<Rot> (state, wide_sequence, out, in, count, distance);
+    }
+
+    void create_mask (const state_t &state, uint8_t *out) { create_mask_sse<Rot> (state, out); }
+
+    void create_masks (const state_t *states, uint8_t *out, size_t count) { create_masks_sse<Rot> (states, out, count); }
+
+    void header_masks (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count) {
+        header_masks_sse<Rot> (state, samples, out, count);
+    }
+
+    void salsa20_apply_blocks (const state_t &state, uint8_t *out, const uint8_t *in, size_t count) {
+        apply_blocks_salsa20_sse (state, out, in, count);
+    }
+}  // namespace ChaCha::detail::kernel::sse2
+#endif /* HAVE_SSE3 */
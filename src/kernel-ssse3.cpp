@@ -0,0 +1,32 @@
+/*
+ * kernel-ssse3.cpp: 4-way kernel using `pshufb` for the byte-aligned rotations.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#ifdef HAVE_CONFIG_HPP
+#    include "config.hpp"
+#endif
+
+#ifdef HAVE_SSSE3
+#    include "kernel.hpp"
+
+#    include <chacha20/kernel/sse.hpp>
+
+namespace ChaCha::detail::kernel::ssse3 {
+    using Rot = RotSSSE3;
+
+    void apply_blocks (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count) {
+        apply_blocks_sse<Rot> (state, wide_sequence, out, in, count);
+    }
+
+    void apply_blocks_large (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count, size_t distance) {
+        apply_blocks_sse_large<Rot> (state, wide_sequence, out, in, count, distance);
+    }
+
+    void create_masks (const state_t *states, uint8_t *out, size_t count) { create_masks_sse<Rot> (states, out, count); }
+
+    void header_masks (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count) {
+        header_masks_sse<Rot> (state, samples, out, count);
+    }
+}  // namespace ChaCha::detail::kernel::ssse3
+#endif /* HAVE_SSSE3 */
@@ -0,0 +1,105 @@
+/*
+ * kernel.hpp: Multi-block kernels (internal).
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#ifdef HAVE_CONFIG_HPP
+#    include "config.hpp"
+#endif
+
+#include <chacha20/kernel/common.hpp>
+
+namespace ChaCha::detail::kernel {
+    /// @brief Signature of the multi-block kernels.
+    /// @remarks Same contract as `ChaCha::detail::apply_blocks`.
+    using apply_blocks_t = void (*) (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count);
+
+    /// @brief Signature of the large-buffer kernels: `apply_blocks_t` prefetching `in` `distance` bytes ahead,
+    ///        with non-temporal stores to `out` (unless in place).
+    using apply_blocks_large_t = void (*) (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count, size_t distance);
+
+    /// @brief Signature of the multi-state kernels.
+    /// @remarks Same contract as `ChaCha::detail::create_masks`.
+    using create_masks_t = void (*) (const state_t *states, uint8_t *out, size_t count);
+
+    /// @brief Signature of the header-protection mask kernels.
+    /// @remarks Same contract as `ChaCha::detail::header_protection_masks`.
+    using header_masks_t = void (*) (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count);
+
+    /// @brief Signature of the Salsa20 multi-block kernels.
+    /// @remarks Same contract as `ChaCha::detail::salsa20_apply_blocks`.
+    using salsa20_apply_blocks_t = void (*) (const state_t &state, uint8_t *out, const uint8_t *in, size_t count);
+
+    namespace scalar {
+        /// @brief Portable kernel, interleaving up to 4 independent blocks.
+        void apply_blocks (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count);
+
+        /// @brief Portable single block keystream.
+        void create_mask (const state_t &state, uint8_t *out);
+
+        /// @brief One block for each of the `count` states.
+        void create_masks (const state_t *states, uint8_t *out, size_t count);
+
+        void header_masks (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count);
+
+        void salsa20_apply_blocks (const state_t &state, uint8_t *out, const uint8_t *in, size_t count);
+
+        void salsa20_create_mask (const state_t &state, uint8_t *out);
+    }  // namespace scalar
+
+    namespace sse2 {
+        /// @brief 4-way word-sliced kernel (SSE2).
+        void apply_blocks (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count);
+
+        /// @brief Large-buffer variant of `apply_blocks`.
+        void apply_blocks_large (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count, size_t distance);
+
+        void create_mask (const state_t &state, uint8_t *out);
+
+        void create_masks (const state_t *states, uint8_t *out, size_t count);
+
+        void header_masks (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count);
+
+        /// @brief 4-way word-sliced Salsa20 kernel (SSE2).
+        void salsa20_apply_blocks (const state_t &state, uint8_t *out, const uint8_t *in, size_t count);
+    }  // namespace sse2
+
+    namespace ssse3 {
+        /// @brief 4-way word-sliced kernel (SSSE3, byte-shuffle rotations).
+        void apply_blocks (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count);
+
+        /// @brief Large-buffer variant of `apply_blocks`.
+        void apply_blocks_large (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count, size_t distance);
+
+        void create_masks (const state_t *states, uint8_t *out, size_t count);
+
+        void header_masks (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count);
+    }  // namespace ssse3
+
+    namespace avx2 {
+        /// @brief 8-way word-sliced kernel (AVX2).
+        void apply_blocks (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count);
+
+        /// @brief Large-buffer variant of `apply_blocks`.
+        void apply_blocks_large (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count, size_t distance);
+
+        /// @brief 8-way word-sliced Salsa20 kernel (AVX2).
+        void salsa20_apply_blocks (const state_t &state, uint8_t *out, const uint8_t *in, size_t count);
+
+        /// @brief 8 header-protection masks per round trip through the rounds.
+        void header_masks (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count);
+    }  // namespace avx2
+
+    namespace avx512 {
+        /// @brief 16-way word-sliced kernel (AVX-512F).
+        void apply_blocks (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count);
+
+        /// @brief Large-buffer variant of `apply_blocks`.
+        void apply_blocks_large (const state_t &state, bool wide_sequence, uint8_t *out, const uint8_t *in, size_t count, size_t distance);
+
+        /// @brief 16 header-protection masks per round trip through the rounds.
+        void header_masks (const state_t &state, const uint8_t *samples, uint8_t *out, size_t count);
+    }  // namespace avx512
+}  // namespace ChaCha::detail::kernel
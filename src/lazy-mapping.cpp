@@ -0,0 +1,341 @@
+/*
+ * lazy-mapping.cpp: `userfaultfd` handler of `LazyMapping`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include <chacha20/lazy-mapping.hpp>
+
+#include <chacha20/detail.hpp>
+#include <chacha20/kernel/salsa20.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#    include <fcntl.h>
+#    include <linux/userfaultfd.h>
+#    include <poll.h>
+#    include <sys/eventfd.h>
+#    include <sys/ioctl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
+
+namespace ChaCha {
+    namespace {
+        [[noreturn]] void fail (const char *what, int err = errno) { throw std::system_error {err, std::generic_category (), what}; }
+    }  // namespace
+
+#ifdef __linux__
+    namespace {
+        constexpr size_t BLOCK_SIZE = std::tuple_size<detail::mask_t>::value;
+
+        /// @brief Opens a `userfaultfd`, handling kernel-mode faults if permitted.
+        /// @param user_mode_only Set to `true` if only faults from user space are handled
+        int open_userfaultfd (bool &user_mode_only) {
+            int flags      = O_CLOEXEC | O_NONBLOCK;
+            user_mode_only = false;
+            int fd         = static_cast<int> (::syscall (SYS_userfaultfd, flags));
+#    ifdef UFFD_USER_MODE_ONLY
+            if (fd < 0 && errno == EPERM) {
+                // Only faults from user space: allowed without privileges since Linux 5.11.
+                fd = static_cast<int> (::syscall (SYS_userfaultfd, flags | UFFD_USER_MODE_ONLY));
+                user_mode_only = 0 <= fd;
+            }
+#    endif
+            return fd;
+        }
+    }  // namespace
+
+    struct LazyMapping::Impl {
+        std::array<uint32_t, 16> state_;
+        detail::core_t           core_;
+        bool                     wide_sequence_;
+        size_t                   page_size_;
+        size_t                   size_      = 0;
+        size_t                   num_pages_ = 0;
+        size_t                   budget_;
+        size_t                   readahead_;
+
+        int            file_           = -1;
+        const uint8_t *cipher_         = nullptr; /* the file, mapped */
+        uint8_t *      plain_          = nullptr; /* the plaintext region, registered to `uffd_` */
+        int            uffd_           = -1;
+        bool           user_mode_only_ = false; /* `uffd_` only handles faults from user space */
+        int            stop_           = -1;    /* eventfd waking the handler for shutdown */
+
+        // Owned by the handler thread.
+        std::vector<uint8_t> resident_;
+        std::deque<size_t>   order_; /* resident pages, oldest first */
+        std::vector<uint8_t> buffer_;
+
+        std::atomic<uint64_t> faults_ {0};
+        std::atomic<uint64_t> decrypted_ {0};
+        std::atomic<uint64_t> evictions_ {0};
+        std::atomic<uint64_t> resident_count_ {0};
+
+        std::thread handler_;
+
+        Impl (const std::string &path, const std::array<uint32_t, 16> &state, detail::core_t core, bool wide_sequence, const Options &options)
+                : state_ {state}
+                , core_ {core}
+                , wide_sequence_ {wide_sequence}
+                , page_size_ {static_cast<size_t> (::sysconf (_SC_PAGESIZE))}
+                , budget_ {options.resident_pages == 0 ? SIZE_MAX : std::max (options.resident_pages, options.readahead + 1)}
+                , readahead_ {options.readahead} {
+            try {
+                open (path);
+            }
+            catch (...) {
+                close ();
+                throw;
+            }
+        }
+
+        ~Impl () { close (); }
+
+        Impl (const Impl &) = delete;
+        Impl &operator= (const Impl &) = delete;
+
+        void open (const std::string &path) {
+            file_ = ::open (path.c_str (), O_RDONLY | O_CLOEXEC);
+            if (file_ < 0) {
+                fail ("LazyMapping: open");
+            }
+            struct stat st {};
+            if (::fstat (file_, &st) != 0) {
+                fail ("LazyMapping: fstat");
+            }
+            size_      = static_cast<size_t> (st.st_size);
+            num_pages_ = (size_ + page_size_ - 1) / page_size_;
+            if (num_pages_ == 0) {
+                return;
+            }
+            auto const length = num_pages_ * page_size_;
+            void *     p      = ::mmap (nullptr, size_, PROT_READ, MAP_PRIVATE, file_, 0);
+            if (p == MAP_FAILED) {
+                fail ("LazyMapping: mmap (file)");
+            }
+            cipher_ = static_cast<const uint8_t *> (p);
+            // Pages are read once each, in no particular order.
+            ::madvise (p, size_, MADV_RANDOM);
+
+            p = ::mmap (nullptr, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (p == MAP_FAILED) {
+                fail ("LazyMapping: mmap (plaintext)");
+            }
+            plain_ = static_cast<uint8_t *> (p);
+
+            uffd_ = open_userfaultfd (user_mode_only_);
+            if (uffd_ < 0) {
+                fail ("LazyMapping: userfaultfd");
+            }
+            uffdio_api api {};
+            api.api = UFFD_API;
+            if (::ioctl (uffd_, UFFDIO_API, &api) != 0) {
+                fail ("LazyMapping: UFFDIO_API");
+            }
+            uffdio_register reg {};
+            reg.range.start = reinterpret_cast<uintptr_t> (plain_);
+            reg.range.len   = length;
+            reg.mode        = UFFDIO_REGISTER_MODE_MISSING;
+            if (::ioctl (uffd_, UFFDIO_REGISTER, &reg) != 0) {
+                fail ("LazyMapping: UFFDIO_REGISTER");
+            }
+            stop_ = ::eventfd (0, EFD_CLOEXEC);
+            if (stop_ < 0) {
+                fail ("LazyMapping: eventfd");
+            }
+            resident_.assign (num_pages_, 0);
+            buffer_.resize ((readahead_ + 1) * page_size_);
+            handler_ = std::thread {[this] () { run (); }};
+        }
+
+        void close () {
+            if (handler_.joinable ()) {
+                uint64_t one = 1;
+                [[maybe_unused]] auto n = ::write (stop_, &one, sizeof (one));
+                handler_.join ();
+            }
+            if (stop_ >= 0) {
+                ::close (stop_);
+            }
+            if (uffd_ >= 0) {
+                ::close (uffd_);
+            }
+            if (plain_ != nullptr) {
+                ::munmap (plain_, num_pages_ * page_size_);
+            }
+            if (cipher_ != nullptr) {
+                ::munmap (const_cast<uint8_t *> (cipher_), size_);
+            }
+            if (file_ >= 0) {
+                ::close (file_);
+            }
+            detail::secure_wipe (state_.data (), sizeof (state_));
+            detail::secure_wipe (buffer_.data (), buffer_.size ());
+        }
+
+        void run () {
+            std::array<uffd_msg, 16> msgs {};
+            std::array<pollfd, 2>    fds {pollfd {uffd_, POLLIN, 0}, pollfd {stop_, POLLIN, 0}};
+            for (;;) {
+                if (::poll (fds.data (), fds.size (), -1) < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return;
+                }
+                if (fds[1].revents != 0) {
+                    return;
+                }
+                for (;;) {
+                    auto n = ::read (uffd_, msgs.data (), sizeof (msgs));
+                    if (n <= 0) {
+                        break;
+                    }
+                    for (size_t i = 0; i < static_cast<size_t> (n) / sizeof (uffd_msg); ++i) {
+                        if (msgs[i].event == UFFD_EVENT_PAGEFAULT) {
+                            fault ((static_cast<uintptr_t> (msgs[i].arg.pagefault.address) - reinterpret_cast<uintptr_t> (plain_)) / page_size_);
+                        }
+                    }
+                }
+            }
+        }
+
+        void fault (size_t page) {
+            faults_.fetch_add (1, std::memory_order_relaxed);
+            if (resident_[page] != 0) {
+                // Another thread faulted on the page before it was filled.
+                wake (page, 1);
+                return;
+            }
+            size_t n = 1;
+            while (n <= readahead_ && page + n < num_pages_ && resident_[page + n] == 0) {
+                ++n;
+            }
+            decrypt (page, n);
+            while (budget_ < resident_count_.load (std::memory_order_relaxed) + n) {
+                evict ();
+            }
+
+            // The faulting threads are woken once the bookkeeping is done, so that they see it.
+            uffdio_copy copy {};
+            copy.dst  = reinterpret_cast<uintptr_t> (plain_ + page * page_size_);
+            copy.src  = reinterpret_cast<uintptr_t> (buffer_.data ());
+            copy.len  = n * page_size_;
+            copy.mode = UFFDIO_COPY_MODE_DONTWAKE;
+            ::ioctl (uffd_, UFFDIO_COPY, &copy);
+            auto const filled = 0 < copy.copy ? static_cast<size_t> (copy.copy) / page_size_ : 0;
+            for (size_t i = 0; i < filled; ++i) {
+                resident_[page + i] = 1;
+                order_.push_back (page + i);
+            }
+            resident_count_.fetch_add (filled, std::memory_order_relaxed);
+            decrypted_.fetch_add (filled, std::memory_order_relaxed);
+            wake (page, std::max<size_t> (filled, 1));
+        }
+
+        /// @brief Decrypts `count` pages from `page` into `buffer_`.
+        void decrypt (size_t page, size_t count) {
+            auto const offset = page * page_size_;
+            auto const length = std::min (count * page_size_, size_ - offset);
+            auto const blocks = length / BLOCK_SIZE;
+
+            auto s = state_;
+            if (core_ == detail::core_t::SALSA20) {
+                detail::kernel::advance_salsa20 (s, offset / BLOCK_SIZE);
+                detail::salsa20_apply_blocks (s, buffer_.data (), cipher_ + offset, blocks);
+                detail::kernel::advance_salsa20 (s, blocks);
+            }
+            else {
+                detail::kernel::advance (s, wide_sequence_, offset / BLOCK_SIZE);
+                detail::apply_blocks (s, wide_sequence_, buffer_.data (), cipher_ + offset, blocks);
+                detail::kernel::advance (s, wide_sequence_, blocks);
+            }
+            auto const done = blocks * BLOCK_SIZE;
+            if (done < length) {
+                auto const &mask = core_ == detail::core_t::SALSA20 ? detail::salsa20_create_mask (s) : detail::create_mask (s);
+                for (size_t i = done; i < length; ++i) {
+                    buffer_[i] = cipher_[offset + i] ^ mask[i - done];
+                }
+            }
+            // The tail of the last page is zero, not keystream.
+            std::fill (buffer_.begin () + static_cast<ptrdiff_t> (length), buffer_.begin () + static_cast<ptrdiff_t> (count * page_size_), 0);
+        }
+
+        void evict () {
+            auto const page = order_.front ();
+            order_.pop_front ();
+            ::madvise (plain_ + page * page_size_, page_size_, MADV_DONTNEED);
+            resident_[page] = 0;
+            resident_count_.fetch_sub (1, std::memory_order_relaxed);
+            evictions_.fetch_add (1, std::memory_order_relaxed);
+        }
+
+        void wake (size_t page, size_t count) {
+            uffdio_range range {};
+            range.start = reinterpret_cast<uintptr_t> (plain_ + page * page_size_);
+            range.len   = count * page_size_;
+            ::ioctl (uffd_, UFFDIO_WAKE, &range);
+        }
+    };
+
+    LazyMapping::LazyMapping (const std::string &path, const std::array<uint32_t, 16> &state, detail::core_t core, bool wide_sequence, const Options &options)
+            : impl_ {std::make_unique<Impl> (path, state, core, wide_sequence, options)} {}
+
+    const uint8_t *LazyMapping::data () const { return impl_->plain_; }
+
+    size_t LazyMapping::size () const { return impl_->size_; }
+
+    bool LazyMapping::user_mode_only () const { return impl_->user_mode_only_; }
+
+    LazyMapping::Statistics LazyMapping::statistics () const {
+        Statistics result;
+        result.faults    = impl_->faults_.load (std::memory_order_relaxed);
+        result.decrypted = impl_->decrypted_.load (std::memory_order_relaxed);
+        result.evictions = impl_->evictions_.load (std::memory_order_relaxed);
+        result.resident  = impl_->resident_count_.load (std::memory_order_relaxed);
+        return result;
+    }
+
+    bool LazyMapping::supported () {
+        bool user_mode_only;
+        int  fd = open_userfaultfd (user_mode_only);
+        if (fd < 0) {
+            return false;
+        }
+        ::close (fd);
+        return true;
+    }
+#else
+    struct LazyMapping::Impl {};
+
+    LazyMapping::LazyMapping (const std::string &, const std::array<uint32_t, 16> &, detail::core_t, bool, const Options &) {
+        fail ("LazyMapping", ENOSYS);
+    }
+
+    const uint8_t *LazyMapping::data () const { return nullptr; }
+
+    size_t LazyMapping::size () const { return 0; }
+
+    bool LazyMapping::user_mode_only () const { return false; }
+
+    LazyMapping::Statistics LazyMapping::statistics () const { return {}; }
+
+    bool LazyMapping::supported () { return false; }
+#endif
+
+    LazyMapping::~LazyMapping ()                  = default;
+    LazyMapping::LazyMapping (LazyMapping &&) noexcept = default;
+    LazyMapping &LazyMapping::operator= (LazyMapping &&) noexcept = default;
+}  // namespace ChaCha
@@ -0,0 +1,84 @@
+/*
+ * parallel.cpp: Multi-threaded `apply_blocks`.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include <chacha20/parallel.hpp>
+
+#include "dispatch.hpp"
+
+#include <chacha20/kernel/salsa20.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace ChaCha::detail {
+    namespace dispatch {
+        void parallel_apply_blocks (const kernel::state_t &state,
+                                    core_t                 core,
+                                    bool                   wide_sequence,
+                                    uint8_t *              out,
+                                    const uint8_t *        in,
+                                    size_t                 count,
+                                    size_t                 threads,
+                                    size_t                 chunk_blocks) {
+            chunk_blocks      = std::max<size_t> (chunk_blocks, 1);
+            size_t const jobs = (count + chunk_blocks - 1) / chunk_blocks;
+            threads           = std::min (threads, jobs);
+
+            std::atomic<size_t> next {0};
+            auto                worker = [&] () {
+                for (size_t j = next.fetch_add (1, std::memory_order_relaxed); j < jobs; j = next.fetch_add (1, std::memory_order_relaxed)) {
+                    size_t const   first = j * chunk_blocks;
+                    size_t const   n     = std::min (chunk_blocks, count - first);
+                    kernel::state_t s {state};
+                    if (core == core_t::SALSA20) {
+                        kernel::advance_salsa20 (s, first);
+                        salsa20_apply_blocks (s, out + 64 * first, in + 64 * first, n);
+                    }
+                    else {
+                        kernel::advance (s, wide_sequence, first);
+                        apply_blocks (s, wide_sequence, out + 64 * first, in + 64 * first, n);
+                    }
+                }
+            };
+            std::vector<std::thread> helpers;
+            helpers.reserve (threads);
+            for (size_t i = 1; i < threads; ++i) {
+                helpers.emplace_back (worker);
+            }
+            worker ();
+            for (auto &t : helpers) {
+                t.join ();
+            }
+        }
+    }  // namespace dispatch
+
+    void parallel_apply_blocks (const std::array<uint32_t, 16> &state,
+                                core_t                          core,
+                                bool                            wide_sequence,
+                                void *                          out,
+                                const void *                    in,
+                                size_t                          count,
+                                size_t                          threads) {
+        if (threads == 0) {
+            threads = std::max<size_t> (std::thread::hardware_concurrency (), 1);
+        }
+        auto const &limits       = dispatch::parallel_limits ();
+        size_t      chunk_blocks = limits.chunk / 64;
+        if (threads < 2 || count < limits.min_size / 64) {
+            threads      = 1;
+            chunk_blocks = count;
+        }
+        dispatch::parallel_apply_blocks (state,
+                                         core,
+                                         wide_sequence,
+                                         static_cast<uint8_t *> (out),
+                                         static_cast<const uint8_t *> (in),
+                                         count,
+                                         threads,
+                                         chunk_blocks);
+    }
+}  // namespace ChaCha::detail
@@ -0,0 +1,188 @@
+/*
+ * poly1305-avx2.cpp: Multi-buffer Poly1305, 4 independent messages per call (one per 64-bit lane).
+ *
+ * Each lane carries its own r and accumulator in radix 2^26.  A lane whose message ends is finalized
+ * and refilled with the next message right away, so a batch of mixed lengths keeps all lanes busy
+ * until the batch runs dry; lanes without a message absorb zero blocks and their results are dropped.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#ifdef HAVE_CONFIG_HPP
+#    include "config.hpp"
+#endif
+
+#ifdef HAVE_AVX2
+#    include "poly1305-kernel.hpp"
+
+#    include <immintrin.h>
+
+namespace ChaCha::detail::poly1305::avx2 {
+    namespace {
+        constexpr size_t LANES = 4;
+
+        const std::array<uint8_t, 16> ZERO_BLOCK {};
+
+        /// @brief Per-lane bookkeeping (the vectors hold the arithmetic state).
+        struct Lanes {
+            alignas (32) uint64_t r[5][LANES];
+            alignas (32) uint64_t h[5][LANES];
+            poly1305_state_t      st[LANES];
+            Cursor                cursor[LANES];
+            const poly1305_job_t *job[LANES];
+        };
+
+        struct Vectors {
+            __m256i r[5];
+            __m256i s[5]; /* s[i] = 5 * r[i] (s[0] is unused) */
+            __m256i h[5];
+
+            void load (const Lanes &lanes) {
+                for (size_t i = 0; i < 5; ++i) {
+                    r[i] = _mm256_load_si256 (reinterpret_cast<const __m256i *> (lanes.r[i]));
+                    h[i] = _mm256_load_si256 (reinterpret_cast<const __m256i *> (lanes.h[i]));
+                    s[i] = _mm256_add_epi64 (r[i], _mm256_slli_epi64 (r[i], 2));
+                }
+            }
+
+            void store_h (Lanes &lanes) const {
+                for (size_t i = 0; i < 5; ++i) {
+                    _mm256_store_si256 (reinterpret_cast<__m256i *> (lanes.h[i]), h[i]);
+                }
+            }
+
+            /// @brief h = (h + m) * r (partially reduced).
+            void absorb (const uint8_t *const (&blocks)[LANES], const uint32_t (&hibits)[LANES]) {
+                const __m256i M26 = _mm256_set1_epi64x (MASK26);
+
+                __m256i lo = _mm256_set_epi64x (static_cast<int64_t> (asUInt64 (blocks[3])),
+                                                static_cast<int64_t> (asUInt64 (blocks[2])),
+                                                static_cast<int64_t> (asUInt64 (blocks[1])),
+                                                static_cast<int64_t> (asUInt64 (blocks[0])));
+                __m256i hi = _mm256_set_epi64x (static_cast<int64_t> (asUInt64 (blocks[3] + 8)),
+                                                static_cast<int64_t> (asUInt64 (blocks[2] + 8)),
+                                                static_cast<int64_t> (asUInt64 (blocks[1] + 8)),
+                                                static_cast<int64_t> (asUInt64 (blocks[0] + 8)));
+                __m256i hb = _mm256_set_epi64x (hibits[3], hibits[2], hibits[1], hibits[0]);
+
+                __m256i h0 = _mm256_add_epi64 (h[0], _mm256_and_si256 (lo, M26));
+                __m256i h1 = _mm256_add_epi64 (h[1], _mm256_and_si256 (_mm256_srli_epi64 (lo, 26), M26));
+                __m256i m2 = _mm256_or_si256 (_mm256_srli_epi64 (lo, 52), _mm256_slli_epi64 (hi, 12));
+                __m256i h2 = _mm256_add_epi64 (h[2], _mm256_and_si256 (m2, M26));
+                __m256i h3 = _mm256_add_epi64 (h[3], _mm256_and_si256 (_mm256_srli_epi64 (hi, 14), M26));
+                __m256i h4 = _mm256_add_epi64 (h[4], _mm256_or_si256 (_mm256_srli_epi64 (hi, 40), hb));
+
+                auto mul = [] (__m256i a, __m256i b) { return _mm256_mul_epu32 (a, b); };
+                auto add = [] (__m256i a, __m256i b) { return _mm256_add_epi64 (a, b); };
+
+                // clang-format off
+                __m256i d0 = add (add (add (add (mul (h0, r[0]), mul (h1, s[4])), mul (h2, s[3])), mul (h3, s[2])), mul (h4, s[1]));
+                __m256i d1 = add (add (add (add (mul (h0, r[1]), mul (h1, r[0])), mul (h2, s[4])), mul (h3, s[3])), mul (h4, s[2]));
+                __m256i d2 = add (add (add (add (mul (h0, r[2]), mul (h1, r[1])), mul (h2, r[0])), mul (h3, s[4])), mul (h4, s[3]));
+                __m256i d3 = add (add (add (add (mul (h0, r[3]), mul (h1, r[2])), mul (h2, r[1])), mul (h3, r[0])), mul (h4, s[4]));
+                __m256i d4 = add (add (add (add (mul (h0, r[4]), mul (h1, r[3])), mul (h2, r[2])), mul (h3, r[1])), mul (h4, r[0]));
+                // clang-format on
+
+                __m256i c;
+                c    = _mm256_srli_epi64 (d0, 26);
+                h[0] = _mm256_and_si256 (d0, M26);
+                d1   = add (d1, c);
+                c    = _mm256_srli_epi64 (d1, 26);
+                h[1] = _mm256_and_si256 (d1, M26);
+                d2   = add (d2, c);
+                c    = _mm256_srli_epi64 (d2, 26);
+                h[2] = _mm256_and_si256 (d2, M26);
+                d3   = add (d3, c);
+                c    = _mm256_srli_epi64 (d3, 26);
+                h[3] = _mm256_and_si256 (d3, M26);
+                d4   = add (d4, c);
+                c    = _mm256_srli_epi64 (d4, 26);
+                h[4] = _mm256_and_si256 (d4, M26);
+                h[0] = add (h[0], add (c, _mm256_slli_epi64 (c, 2)));
+                c    = _mm256_srli_epi64 (h[0], 26);
+                h[0] = _mm256_and_si256 (h[0], M26);
+                h[1] = add (h[1], c);
+            }
+        };
+    }  // namespace
+
+    void many (const poly1305_job_t *jobs, size_t count) {
+        Lanes   lanes {};
+        Vectors v;
+        size_t  next = 0;
+
+        const uint8_t *blocks[LANES];
+        uint32_t       hibits[LANES];
+
+        // Finalizes the lane's message and starts the next one (if any).  Returns `true` if the lane is busy.
+        auto refill = [&] (size_t lane) -> bool {
+            while (true) {
+                if (lanes.job[lane] != nullptr) {
+                    auto &st = lanes.st[lane];
+                    for (size_t i = 0; i < 5; ++i) {
+                        st.h[i] = static_cast<uint32_t> (lanes.h[i][lane]);
+                    }
+                    poly1305_finish (st, lanes.job[lane]->tag);
+                    lanes.job[lane] = nullptr;
+                }
+                if (count <= next) {
+                    blocks[lane] = ZERO_BLOCK.data ();
+                    hibits[lane] = 0;
+                    return false;
+                }
+                auto const &job = jobs[next++];
+                auto &      st  = lanes.st[lane];
+                poly1305_init (st, job.key);
+                lanes.job[lane]    = &job;
+                lanes.cursor[lane] = Cursor {job};
+                for (size_t i = 0; i < 5; ++i) {
+                    lanes.r[i][lane] = st.r[i];
+                    lanes.h[i][lane] = 0;
+                }
+                if ((blocks[lane] = lanes.cursor[lane].next (hibits[lane])) != nullptr) {
+                    return true;
+                }
+            }
+        };
+
+        size_t busy = 0;
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            busy += refill (lane) ? 1 : 0;
+        }
+        v.load (lanes);
+        while (1 < busy || (busy == 1 && next < count)) {
+            v.absorb (blocks, hibits);
+            bool reload = false;
+            for (size_t lane = 0; lane < LANES; ++lane) {
+                if (lanes.job[lane] == nullptr) {
+                    continue;
+                }
+                if ((blocks[lane] = lanes.cursor[lane].next (hibits[lane])) == nullptr) {
+                    if (! reload) {
+                        v.store_h (lanes);
+                        reload = true;
+                    }
+                    busy -= refill (lane) ? 0 : 1;
+                }
+            }
+            if (reload) {
+                v.load (lanes);
+            }
+        }
+        // A single long message is left: the scalar code has a shorter dependency chain per block.
+        v.store_h (lanes);
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            if (lanes.job[lane] == nullptr) {
+                continue;
+            }
+            auto &st = lanes.st[lane];
+            for (size_t i = 0; i < 5; ++i) {
+                st.h[i] = static_cast<uint32_t> (lanes.h[i][lane]);
+            }
+            do {
+                poly1305_blocks (st, blocks[lane], 1, hibits[lane] == 0);
+            } while ((blocks[lane] = lanes.cursor[lane].next (hibits[lane])) != nullptr);
+            poly1305_finish (st, lanes.job[lane]->tag);
+        }
+    }
+}  // namespace ChaCha::detail::poly1305::avx2
+#endif /* HAVE_AVX2 */
@@ -0,0 +1,86 @@
+/*
+ * poly1305-kernel.hpp: Internal interface of the Poly1305 kernels.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include <chacha20/poly1305.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ChaCha::detail::poly1305 {
+    constexpr uint32_t MASK26 = 0x3FFFFFFu;
+    constexpr uint32_t HIBIT  = 1u << 24u;
+
+    /// @brief Walks the 16-byte blocks of a job, padding the segment tails.
+    class Cursor {
+    private:
+        const poly1305_job_t *   job_;
+        size_t                   segment_;
+        size_t                   offset_;
+        std::array<uint8_t, 16> tmp_;
+
+    public:
+        Cursor ()
+                : job_ {nullptr}
+                , segment_ {0}
+                , offset_ {0}
+                , tmp_ {} {}
+
+        explicit Cursor (const poly1305_job_t &job)
+                : job_ {&job}
+                , segment_ {0}
+                , offset_ {0}
+                , tmp_ {} {}
+
+        /// @brief Returns the next block (or `nullptr` at the end).
+        /// @param hibit Receives the bit 128 of the block (in the radix 2^26 top limb)
+        /// @remarks The returned pointer stays valid until the next call.
+        const uint8_t *next (uint32_t &hibit) {
+            if (job_ == nullptr) {
+                return nullptr;
+            }
+            while (segment_ < job_->num_segments) {
+                auto const &seg = job_->segments[segment_];
+                if (offset_ + 16 <= seg.size) {
+                    auto const *p = seg.data + offset_;
+                    offset_ += 16;
+                    hibit = HIBIT;
+                    return p;
+                }
+                if (offset_ < seg.size) {
+                    auto n = seg.size - offset_;
+                    tmp_.fill (0);
+                    ::memcpy (tmp_.data (), seg.data + offset_, n);
+                    offset_ = seg.size;
+                    if (job_->pad) {
+                        hibit = HIBIT;
+                    }
+                    else {
+                        tmp_[n] = 1;
+                        hibit   = 0;
+                    }
+                    return tmp_.data ();
+                }
+                ++segment_;
+                offset_ = 0;
+            }
+            return nullptr;
+        }
+    };
+
+    using many_t = void (*) (const poly1305_job_t *jobs, size_t count);
+
+    namespace scalar {
+        void many (const poly1305_job_t *jobs, size_t count);
+    }
+
+    namespace avx2 {
+        /// @brief 4 messages at once, one per 64-bit lane.
+        void many (const poly1305_job_t *jobs, size_t count);
+    }  // namespace avx2
+}  // namespace ChaCha::detail::poly1305
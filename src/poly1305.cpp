@@ -0,0 +1,326 @@
+/*
+ * poly1305.cpp: Portable Poly1305 (radix 2^26, 32x32->64 multiplications) and the kernel dispatch.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#ifdef HAVE_CONFIG_HPP
+#    include "config.hpp"
+#endif
+
+#include "poly1305-kernel.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace ChaCha::detail {
+    using poly1305::HIBIT;
+    using poly1305::MASK26;
+
+    void poly1305_init (poly1305_state_t &st, const uint8_t *key) {
+        // r &= 0xffffffc0ffffffc0ffffffc0fffffff
+        st.r[0] = (asUInt32 (key + 0) >> 0u) & 0x3FFFFFFu;
+        st.r[1] = (asUInt32 (key + 3) >> 2u) & 0x3FFFF03u;
+        st.r[2] = (asUInt32 (key + 6) >> 4u) & 0x3FFC0FFu;
+        st.r[3] = (asUInt32 (key + 9) >> 6u) & 0x3F03FFFu;
+        st.r[4] = (asUInt32 (key + 12) >> 8u) & 0x00FFFFFu;
+        st.h.fill (0);
+        st.pad[0] = asUInt32 (key + 16);
+        st.pad[1] = asUInt32 (key + 20);
+        st.pad[2] = asUInt32 (key + 24);
+        st.pad[3] = asUInt32 (key + 28);
+    }
+
+    void poly1305_blocks (poly1305_state_t &st, const uint8_t *data, size_t count, bool final_block) {
+        const uint32_t hibit = final_block ? 0 : HIBIT;
+
+        const uint64_t r0 = st.r[0];
+        const uint64_t r1 = st.r[1];
+        const uint64_t r2 = st.r[2];
+        const uint64_t r3 = st.r[3];
+        const uint64_t r4 = st.r[4];
+        const uint64_t s1 = r1 * 5;
+        const uint64_t s2 = r2 * 5;
+        const uint64_t s3 = r3 * 5;
+        const uint64_t s4 = r4 * 5;
+
+        uint32_t h0 = st.h[0];
+        uint32_t h1 = st.h[1];
+        uint32_t h2 = st.h[2];
+        uint32_t h3 = st.h[3];
+        uint32_t h4 = st.h[4];
+
+        for (size_t i = 0; i < count; ++i, data += 16) {
+            h0 += (asUInt32 (data + 0) >> 0u) & MASK26;
+            h1 += (asUInt32 (data + 3) >> 2u) & MASK26;
+            h2 += (asUInt32 (data + 6) >> 4u) & MASK26;
+            h3 += (asUInt32 (data + 9) >> 6u) & MASK26;
+            h4 += (asUInt32 (data + 12) >> 8u) | hibit;
+
+            uint64_t d0 = h0 * r0 + h1 * s4 + h2 * s3 + h3 * s2 + h4 * s1;
+            uint64_t d1 = h0 * r1 + h1 * r0 + h2 * s4 + h3 * s3 + h4 * s2;
+            uint64_t d2 = h0 * r2 + h1 * r1 + h2 * r0 + h3 * s4 + h4 * s3;
+            uint64_t d3 = h0 * r3 + h1 * r2 + h2 * r1 + h3 * r0 + h4 * s4;
+            uint64_t d4 = h0 * r4 + h1 * r3 + h2 * r2 + h3 * r1 + h4 * r0;
+
+            uint32_t c;
+            c  = static_cast<uint32_t> (d0 >> 26u);
+            h0 = static_cast<uint32_t> (d0) & MASK26;
+            d1 += c;
+            c  = static_cast<uint32_t> (d1 >> 26u);
+            h1 = static_cast<uint32_t> (d1) & MASK26;
+            d2 += c;
+            c  = static_cast<uint32_t> (d2 >> 26u);
+            h2 = static_cast<uint32_t> (d2) & MASK26;
+            d3 += c;
+            c  = static_cast<uint32_t> (d3 >> 26u);
+            h3 = static_cast<uint32_t> (d3) & MASK26;
+            d4 += c;
+            c  = static_cast<uint32_t> (d4 >> 26u);
+            h4 = static_cast<uint32_t> (d4) & MASK26;
+            h0 += c * 5;
+            c  = h0 >> 26u;
+            h0 = h0 & MASK26;
+            h1 += c;
+        }
+        st.h = {h0, h1, h2, h3, h4};
+    }
+
+    void poly1305_finish (poly1305_state_t &st, uint8_t *tag) {
+        uint32_t h0 = st.h[0];
+        uint32_t h1 = st.h[1];
+        uint32_t h2 = st.h[2];
+        uint32_t h3 = st.h[3];
+        uint32_t h4 = st.h[4];
+
+        // Fully carries h.
+        uint32_t c;
+        c  = h1 >> 26u;
+        h1 = h1 & MASK26;
+        h2 += c;
+        c  = h2 >> 26u;
+        h2 = h2 & MASK26;
+        h3 += c;
+        c  = h3 >> 26u;
+        h3 = h3 & MASK26;
+        h4 += c;
+        c  = h4 >> 26u;
+        h4 = h4 & MASK26;
+        h0 += c * 5;
+        c  = h0 >> 26u;
+        h0 = h0 & MASK26;
+        h1 += c;
+
+        // Computes h + -p and selects h if it is negative (in constant time).
+        uint32_t g0 = h0 + 5;
+        c           = g0 >> 26u;
+        g0 &= MASK26;
+        uint32_t g1 = h1 + c;
+        c           = g1 >> 26u;
+        g1 &= MASK26;
+        uint32_t g2 = h2 + c;
+        c           = g2 >> 26u;
+        g2 &= MASK26;
+        uint32_t g3 = h3 + c;
+        c           = g3 >> 26u;
+        g3 &= MASK26;
+        uint32_t g4 = h4 + c - (1u << 26u);
+
+        uint32_t mask = (g4 >> 31u) - 1u;
+        h0            = (h0 & ~mask) | (g0 & mask);
+        h1            = (h1 & ~mask) | (g1 & mask);
+        h2            = (h2 & ~mask) | (g2 & mask);
+        h3            = (h3 & ~mask) | (g3 & mask);
+        h4            = (h4 & ~mask) | (g4 & mask);
+
+        // h = (h + pad) % 2^128
+        uint64_t f0 = static_cast<uint32_t> (h0 | (h1 << 26u));
+        uint64_t f1 = static_cast<uint32_t> ((h1 >> 6u) | (h2 << 20u));
+        uint64_t f2 = static_cast<uint32_t> ((h2 >> 12u) | (h3 << 14u));
+        uint64_t f3 = static_cast<uint32_t> ((h3 >> 18u) | (h4 << 8u));
+
+        f0 += st.pad[0];
+        f1 += st.pad[1] + (f0 >> 32u);
+        f2 += st.pad[2] + (f1 >> 32u);
+        f3 += st.pad[3] + (f2 >> 32u);
+
+        for (auto [off, v] : {std::pair {0, f0}, std::pair {4, f1}, std::pair {8, f2}, std::pair {12, f3}}) {
+            tag[off + 0] = static_cast<uint8_t> (v >> 0u);
+            tag[off + 1] = static_cast<uint8_t> (v >> 8u);
+            tag[off + 2] = static_cast<uint8_t> (v >> 16u);
+            tag[off + 3] = static_cast<uint8_t> (v >> 24u);
+        }
+        st.h.fill (0);
+        st.r.fill (0);
+        st.pad.fill (0);
+    }
+
+    namespace {
+        using limbs_t = std::array<uint32_t, 5>;
+
+        /// @brief Carries `h` as `poly1305_blocks` leaves it (limbs below 2^26, but `h1` may exceed it slightly).
+        void carry (limbs_t &h) {
+            uint32_t c;
+            c    = h[0] >> 26u;
+            h[0] = h[0] & MASK26;
+            h[1] += c;
+            c    = h[1] >> 26u;
+            h[1] = h[1] & MASK26;
+            h[2] += c;
+            c    = h[2] >> 26u;
+            h[2] = h[2] & MASK26;
+            h[3] += c;
+            c    = h[3] >> 26u;
+            h[3] = h[3] & MASK26;
+            h[4] += c;
+            c    = h[4] >> 26u;
+            h[4] = h[4] & MASK26;
+            h[0] += c * 5;
+            c    = h[0] >> 26u;
+            h[0] = h[0] & MASK26;
+            h[1] += c;
+        }
+
+        /// @brief `a * b` mod 2^130 - 5 (the multiplication of `poly1305_blocks` with any `b`).
+        limbs_t multiply (const limbs_t &a, const limbs_t &b) {
+            const uint64_t b0 = b[0];
+            const uint64_t b1 = b[1];
+            const uint64_t b2 = b[2];
+            const uint64_t b3 = b[3];
+            const uint64_t b4 = b[4];
+            const uint64_t s1 = b1 * 5;
+            const uint64_t s2 = b2 * 5;
+            const uint64_t s3 = b3 * 5;
+            const uint64_t s4 = b4 * 5;
+            const uint64_t a0 = a[0];
+            const uint64_t a1 = a[1];
+            const uint64_t a2 = a[2];
+            const uint64_t a3 = a[3];
+            const uint64_t a4 = a[4];
+
+            uint64_t d0 = a0 * b0 + a1 * s4 + a2 * s3 + a3 * s2 + a4 * s1;
+            uint64_t d1 = a0 * b1 + a1 * b0 + a2 * s4 + a3 * s3 + a4 * s2;
+            uint64_t d2 = a0 * b2 + a1 * b1 + a2 * b0 + a3 * s4 + a4 * s3;
+            uint64_t d3 = a0 * b3 + a1 * b2 + a2 * b1 + a3 * b0 + a4 * s4;
+            uint64_t d4 = a0 * b4 + a1 * b3 + a2 * b2 + a3 * b1 + a4 * b0;
+
+            limbs_t  h;
+            uint32_t c;
+            c    = static_cast<uint32_t> (d0 >> 26u);
+            h[0] = static_cast<uint32_t> (d0) & MASK26;
+            d1 += c;
+            c    = static_cast<uint32_t> (d1 >> 26u);
+            h[1] = static_cast<uint32_t> (d1) & MASK26;
+            d2 += c;
+            c    = static_cast<uint32_t> (d2 >> 26u);
+            h[2] = static_cast<uint32_t> (d2) & MASK26;
+            d3 += c;
+            c    = static_cast<uint32_t> (d3 >> 26u);
+            h[3] = static_cast<uint32_t> (d3) & MASK26;
+            d4 += c;
+            c    = static_cast<uint32_t> (d4 >> 26u);
+            h[4] = static_cast<uint32_t> (d4) & MASK26;
+            h[0] += c * 5;
+            c    = h[0] >> 26u;
+            h[0] = h[0] & MASK26;
+            h[1] += c;
+            return h;
+        }
+
+        /// @brief `r^n` (`n >= 1`).
+        limbs_t power (const limbs_t &r, uint64_t n) {
+            limbs_t result = r;
+            int     bit    = 63;
+            while (((n >> static_cast<unsigned> (bit)) & 1u) == 0) {
+                --bit;
+            }
+            while (0 < bit--) {
+                result = multiply (result, result);
+                if (((n >> static_cast<unsigned> (bit)) & 1u) != 0) {
+                    result = multiply (result, r);
+                }
+            }
+            return result;
+        }
+    }  // namespace
+
+    void poly1305_blocks_parallel (poly1305_state_t &st, const uint8_t *data, size_t count, size_t threads, size_t min_blocks) {
+        if (threads == 0) {
+            threads = std::max<size_t> (std::thread::hardware_concurrency (), 1);
+        }
+        size_t const segments = std::min (threads, count / std::max<size_t> (min_blocks, 1));
+        if (segments < 2) {
+            poly1305_blocks (st, data, count);
+            return;
+        }
+        // Segments of `length` blocks, the last one takes the remainder as well.
+        size_t const length = count / segments;
+        size_t const last   = count - length * (segments - 1);
+
+        std::vector<poly1305_state_t> partial (segments, st);
+        for (size_t j = 1; j < segments; ++j) {
+            partial[j].h.fill (0);
+        }
+        auto worker = [&] (size_t j) { poly1305_blocks (partial[j], data + 16 * length * j, j + 1 < segments ? length : last); };
+        std::vector<std::thread> helpers;
+        helpers.reserve (segments - 1);
+        for (size_t j = 1; j < segments; ++j) {
+            helpers.emplace_back (worker, j);
+        }
+        worker (0);
+        for (auto &t : helpers) {
+            t.join ();
+        }
+
+        auto const r_length = power (st.r, length);
+        auto const r_last   = power (st.r, last);
+        limbs_t    h        = partial[0].h;
+        for (size_t j = 1; j < segments; ++j) {
+            h = multiply (h, j + 1 < segments ? r_length : r_last);
+            for (size_t i = 0; i < h.size (); ++i) {
+                h[i] += partial[j].h[i];
+            }
+            carry (h);
+        }
+        st.h = h;
+        for (auto &p : partial) {
+            p.r.fill (0);
+            p.pad.fill (0);
+            p.h.fill (0);
+        }
+    }
+
+    namespace poly1305::scalar {
+        void many (const poly1305_job_t *jobs, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                poly1305_state_t st;
+                poly1305_init (st, jobs[i].key);
+                Cursor   cursor {jobs[i]};
+                uint32_t hibit;
+                while (auto const *p = cursor.next (hibit)) {
+                    poly1305_blocks (st, p, 1, hibit == 0);
+                }
+                poly1305_finish (st, jobs[i].tag);
+            }
+        }
+    }  // namespace poly1305::scalar
+
+    namespace {
+        poly1305::many_t select_poly1305_many () {
+#if defined(HAVE_AVX2) && (defined(__GNUC__) || defined(__clang__))
+            if (__builtin_cpu_supports ("avx2")) {
+                return poly1305::avx2::many;
+            }
+#endif
+            return poly1305::scalar::many;
+        }
+    }  // namespace
+
+    void poly1305_many (const poly1305_job_t *jobs, size_t count) {
+        static const poly1305::many_t fn = select_poly1305_many ();
+        if (count == 0) {
+            return;
+        }
+        fn (jobs, count);
+    }
+}  // namespace ChaCha::detail
@@ -0,0 +1,105 @@
+/*
+ * sector.cpp: Sector-addressed `apply_blocks`, single and batched.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include <chacha20/sector.hpp>
+
+#include "dispatch.hpp"
+
+#include <chacha20/detail.hpp>
+#include <chacha20/kernel/salsa20.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ChaCha {
+    namespace {
+        constexpr size_t BLOCK_SIZE = std::tuple_size<detail::mask_t>::value;
+
+        [[noreturn]] void out_of_range (uint64_t number) {
+            throw std::out_of_range {"SectorCipher: sector " + std::to_string (number) + " is beyond the block counter"};
+        }
+    }  // namespace
+
+    SectorCipher::SectorCipher (const std::array<uint32_t, 16> &state, detail::core_t core, bool wide_sequence, size_t sector_size)
+            : state_ {state}
+            , core_ {core}
+            , wide_ {wide_sequence || core == detail::core_t::SALSA20}
+            , sector_size_ {sector_size} {
+        if (sector_size == 0 || sector_size % BLOCK_SIZE != 0) {
+            throw std::invalid_argument {"SectorCipher: sector size must be a positive multiple of 64"};
+        }
+    }
+
+    SectorCipher::~SectorCipher () { detail::secure_wipe (state_.data (), sizeof (state_)); }
+
+    uint64_t SectorCipher::max_sectors () const {
+        uint64_t const blocks = sector_size_ / BLOCK_SIZE;
+        if (! wide_) {
+            return (uint64_t {1} << 32u) / blocks;
+        }
+        // 2^64 / blocks, saturated for one-block sectors.
+        return blocks == 1 ? UINT64_MAX : UINT64_MAX / blocks + (UINT64_MAX % blocks == blocks - 1 ? 1 : 0);
+    }
+
+    void SectorCipher::apply (uint64_t number, void *out, const void *in) const {
+        if (max_sectors () <= number) {
+            out_of_range (number);
+        }
+        uint64_t const  blocks = sector_size_ / BLOCK_SIZE;
+        detail::kernel::state_t s {state_};
+        if (core_ == detail::core_t::SALSA20) {
+            detail::kernel::advance_salsa20 (s, number * blocks);
+            detail::salsa20_apply_blocks (s, out, in, blocks);
+        }
+        else {
+            detail::kernel::advance (s, wide_, number * blocks);
+            detail::apply_blocks (s, wide_, out, in, blocks);
+        }
+    }
+
+    void SectorCipher::apply (const SectorBuffer *sectors, size_t count, size_t threads) const {
+        auto const limit = max_sectors ();
+        for (size_t i = 0; i < count; ++i) {
+            if (limit <= sectors[i].number) {
+                out_of_range (sectors[i].number);
+            }
+        }
+        if (threads == 0) {
+            threads = std::max<size_t> (std::thread::hardware_concurrency (), 1);
+        }
+        // Jobs are runs of sectors about as large as the chunks of `parallel_apply`.
+        auto const &limits = detail::dispatch::parallel_limits ();
+        size_t      run    = std::max<size_t> (limits.chunk / sector_size_, 1);
+        if (threads < 2 || count * sector_size_ < limits.min_size) {
+            threads = 1;
+            run     = std::max<size_t> (count, 1);
+        }
+        size_t const jobs = (count + run - 1) / run;
+        threads           = std::min (threads, jobs);
+
+        std::atomic<size_t> next {0};
+        auto                worker = [&] () {
+            for (size_t j = next.fetch_add (1, std::memory_order_relaxed); j < jobs; j = next.fetch_add (1, std::memory_order_relaxed)) {
+                size_t const last = std::min (count, (j + 1) * run);
+                for (size_t i = j * run; i < last; ++i) {
+                    apply (sectors[i].number, sectors[i].data, sectors[i].data);
+                }
+            }
+        };
+        std::vector<std::thread> helpers;
+        helpers.reserve (threads);
+        for (size_t i = 1; i < threads; ++i) {
+            helpers.emplace_back (worker);
+        }
+        worker ();
+        for (auto &t : helpers) {
+            t.join ();
+        }
+    }
+}  // namespace ChaCha
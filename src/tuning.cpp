@@ -0,0 +1,454 @@
+/*
+ * tuning.cpp: Kernel selection plan and the autotuner.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include <chacha20/tuning.hpp>
+
+#include "dispatch.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#    include <unistd.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#    include <cpuid.h>
+#    define CHACHA20_HAVE_CPUID 1
+#endif
+
+namespace ChaCha::Tuning {
+    namespace {
+        constexpr int PLAN_VERSION = 3;
+
+        constexpr std::array<Backend, 5> ALL_BACKENDS {Backend::SCALAR, Backend::SSE2, Backend::SSSE3, Backend::AVX2, Backend::AVX512};
+
+        /// @brief Block counts measured by the autotuner.
+        constexpr std::array<size_t, 9> COUNTS {1, 2, 4, 8, 16, 32, 64, 128, 256};
+
+        struct Installed {
+            std::mutex          mutex;
+            Plan                plan {default_plan ()};
+            std::atomic<size_t> parallel_min_size {plan.parallel_min_size};
+            std::atomic<size_t> parallel_chunk {plan.parallel_chunk};
+        };
+
+        Installed &installed () {
+            static Installed v;
+            return v;
+        }
+
+        size_t hardware_threads () { return std::max<size_t> (std::thread::hardware_concurrency (), 1); }
+
+        /// @brief Size of the last-level cache (a guess if the system does not tell).
+        size_t llc_size () {
+            long size = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+            size = ::sysconf (_SC_LEVEL3_CACHE_SIZE);
+#endif
+#ifdef _SC_LEVEL2_CACHE_SIZE
+            if (size <= 0) {
+                size = ::sysconf (_SC_LEVEL2_CACHE_SIZE);
+            }
+#endif
+            return 0 < size ? static_cast<size_t> (size) : 8 * 1024 * 1024;
+        }
+
+        Backend best_baseline () {
+            for (auto b : {Backend::SSSE3, Backend::SSE2}) {
+                if (available (b)) {
+                    return b;
+                }
+            }
+            return Backend::SCALAR;
+        }
+
+        /// @brief Drops what this host cannot run.
+        Plan sanitize (Plan plan) {
+            if (! available (plan.baseline) || plan.baseline == Backend::AVX2 || plan.baseline == Backend::AVX512) {
+                plan.baseline = best_baseline ();
+            }
+            if (! available (Backend::AVX2) || plan.avx2_min_blocks == 0) {
+                plan.avx2_min_blocks = available (Backend::AVX2) ? 1 : NEVER;
+            }
+            if (! available (Backend::AVX512) || plan.avx512_min_blocks == 0) {
+                plan.avx512_min_blocks = available (Backend::AVX512) ? 1 : NEVER;
+            }
+            plan.avx512_release = std::min (plan.avx512_release, plan.avx512_engage);
+            plan.parallel_chunk = std::max<size_t> (plan.parallel_chunk / 64, 1) * 64;
+            return plan;
+        }
+
+        using clock_t = std::chrono::steady_clock;
+
+        /// @brief Best of 3 per-call times (in ns) of `fn`.
+        template<typename Fn_>
+        double time_per_call (Fn_ &&fn, std::chrono::microseconds min_duration) {
+            double best = 0;
+            for (int trial = 0; trial < 3; ++trial) {
+                size_t calls = 0;
+                auto   start = clock_t::now ();
+                auto   now   = start;
+                do {
+                    fn ();
+                    ++calls;
+                    now = clock_t::now ();
+                } while (now - start < min_duration);
+                double t = std::chrono::duration<double, std::nano> (now - start).count () / static_cast<double> (calls);
+                if (trial == 0 || t < best) {
+                    best = t;
+                }
+            }
+            return best;
+        }
+
+        /// @brief Smallest measured count from which `candidate` beats `rival` at every larger count (`NEVER` if none).
+        size_t crossover (const std::vector<double> &candidate, const std::vector<double> &rival) {
+            constexpr double MARGIN = 0.97;
+            size_t           result = NEVER;
+            for (size_t i = COUNTS.size (); 0 < i; --i) {
+                if (MARGIN * rival[i - 1] < candidate[i - 1]) {
+                    break;
+                }
+                result = COUNTS[i - 1];
+            }
+            return result;
+        }
+
+        std::string threshold_to_string (size_t v) { return v == NEVER ? std::string {"never"} : std::to_string (v); }
+
+        bool threshold_from_string (const std::string &s, size_t &v) {
+            if (s == "never") {
+                v = NEVER;
+                return true;
+            }
+            if (s.empty () || s.find_first_not_of ("0123456789") != std::string::npos) {
+                return false;
+            }
+            v = static_cast<size_t> (std::stoull (s));
+            return true;
+        }
+    }  // namespace
+
+    ThreadOverride::ThreadOverride (Backend backend) : previous_ {thread_override ()} {
+        detail::dispatch::set_thread_override (backend);
+    }
+
+    ThreadOverride::~ThreadOverride () { detail::dispatch::set_thread_override (previous_); }
+
+    std::optional<Backend> thread_override () { return detail::dispatch::thread_override (); }
+
+    const char *to_string (Backend backend) {
+        switch (backend) {
+        case Backend::SCALAR:
+            return "scalar";
+        case Backend::SSE2:
+            return "sse2";
+        case Backend::SSSE3:
+            return "ssse3";
+        case Backend::AVX2:
+            return "avx2";
+        case Backend::AVX512:
+            return "avx512";
+        }
+        return "unknown";
+    }
+
+    bool available (Backend backend) { return detail::dispatch::supported (backend); }
+
+    std::string host_signature () {
+        std::string result;
+#ifdef CHACHA20_HAVE_CPUID
+        unsigned int eax = 0;
+        unsigned int ebx = 0;
+        unsigned int ecx = 0;
+        unsigned int edx = 0;
+        if (__get_cpuid (0, &eax, &ebx, &ecx, &edx) != 0) {
+            char vendor[13] {};
+            ::memcpy (&vendor[0], &ebx, 4);
+            ::memcpy (&vendor[4], &edx, 4);
+            ::memcpy (&vendor[8], &ecx, 4);
+            result += vendor;
+        }
+        if (__get_cpuid (1, &eax, &ebx, &ecx, &edx) != 0) {
+            std::ostringstream out;
+            out << " " << std::hex << eax;
+            result += out.str ();
+        }
+        if (__get_cpuid (0x80000000u, &eax, &ebx, &ecx, &edx) != 0 && 0x80000004u <= eax) {
+            std::array<unsigned int, 12> brand {};
+            for (unsigned int i = 0; i < 3; ++i) {
+                __get_cpuid (0x80000002u + i, &brand[4 * i + 0], &brand[4 * i + 1], &brand[4 * i + 2], &brand[4 * i + 3]);
+            }
+            std::string name (reinterpret_cast<const char *> (brand.data ()), sizeof (brand));
+            name.erase (std::find (name.begin (), name.end (), '\0'), name.end ());
+            auto const first = name.find_first_not_of (' ');
+            auto const last  = name.find_last_not_of (' ');
+            if (first != std::string::npos) {
+                result += " " + name.substr (first, last - first + 1);
+            }
+        }
+#else
+        result += "generic";
+#endif
+        result += " threads:" + std::to_string (hardware_threads ());
+        result += " kernels:";
+        for (auto b : ALL_BACKENDS) {
+            if (available (b)) {
+                result += std::string {" "} + to_string (b);
+            }
+        }
+        return result;
+    }
+
+    Plan default_plan () {
+        Plan result;
+        result.baseline          = best_baseline ();
+        result.avx2_min_blocks   = available (Backend::AVX2) ? 8 : NEVER;
+        result.avx512_min_blocks = available (Backend::AVX512) ? 16 : NEVER;
+        result.large_min_size    = llc_size ();
+        result.prefetch_distance = 1024;
+        result.parallel_min_size = 1 < hardware_threads () ? 1024 * 1024 : NEVER;
+        result.parallel_chunk    = 256 * 1024;
+        result.calibrated        = false;
+        return result;
+    }
+
+    Plan current_plan () {
+        auto &                      v = installed ();
+        std::lock_guard<std::mutex> lock {v.mutex};
+        return v.plan;
+    }
+
+    void install (const Plan &plan) {
+        auto const &                p = sanitize (plan);
+        auto &                      v = installed ();
+        std::lock_guard<std::mutex> lock {v.mutex};
+        v.plan = p;
+        v.parallel_min_size.store (p.parallel_min_size, std::memory_order_relaxed);
+        v.parallel_chunk.store (p.parallel_chunk, std::memory_order_relaxed);
+        detail::dispatch::install (p);
+    }
+
+    Plan autotune (bool install_plan) {
+        using namespace std::chrono_literals;
+
+        Plan                    result = default_plan ();
+        detail::kernel::state_t state {};
+        for (size_t i = 0; i < state.size (); ++i) {
+            state[i] = static_cast<uint32_t> (0x9E3779B9u * (i + 1));
+        }
+        std::vector<uint8_t> buffer (64 * COUNTS.back (), 0x5A);
+
+        // Per-call times of every kernel at every count.
+        std::map<Backend, std::vector<double>> times;
+        for (auto b : ALL_BACKENDS) {
+            auto fn = detail::dispatch::kernel_of (b);
+            if (fn == nullptr) {
+                continue;
+            }
+            auto &t = times[b];
+            for (auto n : COUNTS) {
+                t.push_back (time_per_call ([&] () { fn (state, true, buffer.data (), buffer.data (), n); }, 200us));
+            }
+        }
+
+        // Baseline: the narrow kernel with the least total per-block time.
+        double best_cost = 0;
+        for (auto b : {Backend::SCALAR, Backend::SSE2, Backend::SSSE3}) {
+            auto it = times.find (b);
+            if (it == times.end ()) {
+                continue;
+            }
+            double cost = 0;
+            for (size_t i = 0; i < COUNTS.size (); ++i) {
+                cost += it->second[i] / static_cast<double> (COUNTS[i]);
+            }
+            if (b == Backend::SCALAR || cost < best_cost) {
+                result.baseline = b;
+                best_cost       = cost;
+            }
+        }
+        std::vector<double> routed {times[result.baseline]};
+        if (times.count (Backend::AVX2) != 0) {
+            result.avx2_min_blocks = crossover (times[Backend::AVX2], routed);
+            for (size_t i = 0; i < COUNTS.size (); ++i) {
+                if (result.avx2_min_blocks <= COUNTS[i]) {
+                    routed[i] = times[Backend::AVX2][i];
+                }
+            }
+        }
+        if (times.count (Backend::AVX512) != 0) {
+            result.avx512_min_blocks = crossover (times[Backend::AVX512], routed);
+        }
+
+        // Splitting a message only pays off once the work outweighs starting the threads.
+        size_t const threads = hardware_threads ();
+        if (threads < 2) {
+            result.parallel_min_size = NEVER;
+        }
+        else {
+            detail::dispatch::install (sanitize (result));
+            constexpr size_t     MAX_SIZE = 4 * 1024 * 1024;
+            std::vector<uint8_t> large (MAX_SIZE, 0x5A);
+            auto                 run = [&] (size_t size, size_t t, size_t chunk) {
+                return time_per_call (
+                        [&] () {
+                            detail::dispatch::parallel_apply_blocks (
+                                    state, detail::core_t::CHACHA20, true, large.data (), large.data (), size / 64, t, chunk / 64);
+                        },
+                        2ms);
+            };
+            double best_time = 0;
+            for (size_t chunk : {64 * 1024, 256 * 1024, 1024 * 1024}) {
+                double t = run (MAX_SIZE, threads, chunk);
+                if (chunk == 64 * 1024 || t < best_time) {
+                    result.parallel_chunk = chunk;
+                    best_time             = t;
+                }
+            }
+            result.parallel_min_size = NEVER;
+            for (size_t size = MAX_SIZE; 16 * 1024 <= size; size /= 2) {
+                if (0.9 * run (size, 1, size) < run (size, threads, std::min (result.parallel_chunk, size / 2))) {
+                    break;
+                }
+                result.parallel_min_size = size;
+            }
+        }
+        result.calibrated = true;
+
+        // Leave the routing as it was unless asked otherwise.
+        install (install_plan ? result : current_plan ());
+        return result;
+    }
+
+    bool save (const Plan &plan, const std::string &path) {
+        std::ofstream out {path, std::ios::out | std::ios::trunc};
+        if (! out) {
+            return false;
+        }
+        out << "# ChaCha kernel selection plan" << '\n'
+            << "version=" << PLAN_VERSION << '\n'
+            << "host=" << host_signature () << '\n'
+            << "baseline=" << to_string (plan.baseline) << '\n'
+            << "avx2_min_blocks=" << threshold_to_string (plan.avx2_min_blocks) << '\n'
+            << "avx512_min_blocks=" << threshold_to_string (plan.avx512_min_blocks) << '\n'
+            << "avx512_engage=" << plan.avx512_engage << '\n'
+            << "avx512_release=" << plan.avx512_release << '\n'
+            << "bulk_half_life_us=" << plan.bulk_half_life_us << '\n'
+            << "large_min_size=" << threshold_to_string (plan.large_min_size) << '\n'
+            << "prefetch_distance=" << plan.prefetch_distance << '\n'
+            << "parallel_min_size=" << threshold_to_string (plan.parallel_min_size) << '\n'
+            << "parallel_chunk=" << plan.parallel_chunk << '\n'
+            << "calibrated=" << (plan.calibrated ? 1 : 0) << '\n';
+        out.flush ();
+        return static_cast<bool> (out);
+    }
+
+    bool load (const std::string &path, Plan &plan) {
+        std::ifstream in {path};
+        if (! in) {
+            return false;
+        }
+        std::map<std::string, std::string> values;
+        std::string                        line;
+        while (std::getline (in, line)) {
+            if (line.empty () || line[0] == '#') {
+                continue;
+            }
+            auto const pos = line.find ('=');
+            if (pos == std::string::npos) {
+                return false;
+            }
+            values[line.substr (0, pos)] = line.substr (pos + 1);
+        }
+        if (values["version"] != std::to_string (PLAN_VERSION) || values["host"] != host_signature ()) {
+            return false;
+        }
+        Plan result;
+        auto it = std::find_if (ALL_BACKENDS.begin (), ALL_BACKENDS.end (), [&] (Backend b) { return values["baseline"] == to_string (b); });
+        if (it == ALL_BACKENDS.end ()) {
+            return false;
+        }
+        result.baseline = *it;
+        if (! threshold_from_string (values["avx2_min_blocks"], result.avx2_min_blocks) ||
+            ! threshold_from_string (values["avx512_min_blocks"], result.avx512_min_blocks) ||
+            ! threshold_from_string (values["avx512_engage"], result.avx512_engage) ||
+            ! threshold_from_string (values["avx512_release"], result.avx512_release) ||
+            ! threshold_from_string (values["bulk_half_life_us"], result.bulk_half_life_us) ||
+            ! threshold_from_string (values["large_min_size"], result.large_min_size) ||
+            ! threshold_from_string (values["prefetch_distance"], result.prefetch_distance) || result.prefetch_distance == NEVER ||
+            ! threshold_from_string (values["parallel_min_size"], result.parallel_min_size) ||
+            ! threshold_from_string (values["parallel_chunk"], result.parallel_chunk) || result.parallel_chunk == NEVER) {
+            return false;
+        }
+        result.calibrated = values["calibrated"] == "1";
+        plan              = result;
+        return true;
+    }
+
+    Plan load_or_autotune (const std::string &path) {
+        Plan plan;
+        if (load (path, plan)) {
+            install (plan);
+            return current_plan ();
+        }
+        plan = autotune (true);
+        save (plan, path);
+        return plan;
+    }
+
+    std::string describe (const Plan &plan) {
+        std::ostringstream out;
+        out << "baseline:       " << to_string (plan.baseline) << '\n';
+        auto runs = [&out] (const char *name, size_t n) {
+            out << name;
+            if (n == NEVER) {
+                out << "never" << '\n';
+            }
+            else {
+                out << "runs of " << n << " blocks or more" << '\n';
+            }
+        };
+        runs ("avx2:           ", plan.avx2_min_blocks);
+        runs ("avx512:         ", plan.avx512_min_blocks);
+        if (plan.avx512_min_blocks != NEVER && 0 < plan.avx512_engage) {
+            out << "                  on threads above " << plan.avx512_engage << " bytes of bulk work (until below " << plan.avx512_release
+                << ", half-life " << plan.bulk_half_life_us << " us)" << '\n';
+        }
+        out << "large buffers:  ";
+        if (plan.large_min_size == NEVER) {
+            out << "never" << '\n';
+        }
+        else {
+            out << plan.large_min_size << " bytes or more, prefetching " << plan.prefetch_distance << " bytes ahead" << '\n';
+        }
+        out << "parallel_apply: ";
+        if (plan.parallel_min_size == NEVER) {
+            out << "never" << '\n';
+        }
+        else {
+            out << plan.parallel_min_size << " bytes or more, in chunks of " << plan.parallel_chunk << " bytes" << '\n';
+        }
+        out << "source:         " << (plan.calibrated ? "autotuned" : "defaults") << '\n';
+        return out.str ();
+    }
+}  // namespace ChaCha::Tuning
+
+namespace ChaCha::detail::dispatch {
+    ParallelLimits parallel_limits () {
+        auto &v = Tuning::installed ();
+        return {v.parallel_min_size.load (std::memory_order_relaxed), v.parallel_chunk.load (std::memory_order_relaxed)};
+    }
+}  // namespace ChaCha::detail::dispatch
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20/block-cache.hpp>
+#include <chacha20/state-djb.hpp>
+#include <chacha20/state-rfc7539.hpp>
+
+#include "doctest-rapidcheck.hpp"
+#include "fixtures.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+namespace {
+    using fixtures::KEY;
+    using fixtures::NONCE;
+    using fixtures::pattern;
+}  // namespace
+
+TEST_CASE ("Test ChaCha::BlockCache") {
+    auto const &plain = pattern (4096);
+
+    SUBCASE ("same as the uncached apply") {
+        ChaCha::BlockCache     cache {64, 4};
+        ChaCha::RFC7539::State S {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()};
+        ChaCha::DJB::State     D {KEY.data (), KEY.size (), 0};
+        rc::prop ("random reads", [&] () {
+            auto const           offset = *rc::gen::inRange<size_t> (0, plain.size ());
+            auto const           size   = *rc::gen::inRange<size_t> (0, std::min<size_t> (plain.size () - offset, 400));
+            std::vector<uint8_t> expected (size);
+            std::vector<uint8_t> actual (size);
+
+            auto S0 = S;
+            ChaCha::apply (S0, expected.data (), plain.data () + offset, size, offset);
+            ChaCha::apply (cache, S, actual.data (), plain.data () + offset, size, offset);
+            RC_ASSERT (expected == actual);
+            RC_ASSERT (S0.getSequence () == S.getSequence ());
+
+            auto D0 = D;
+            ChaCha::apply (D0, expected.data (), plain.data () + offset, size, offset);
+            ChaCha::apply (cache, D, actual.data (), plain.data () + offset, size, offset);
+            RC_ASSERT (expected == actual);
+            RC_ASSERT (D0.getSequence () == D.getSequence ());
+        });
+    }
+    SUBCASE ("hits, misses and evictions") {
+        ChaCha::BlockCache     cache {8, 1};
+        ChaCha::RFC7539::State S {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()};
+        REQUIRE_EQ (cache.capacity (), 8);
+        std::vector<uint8_t> buf (16);
+        for (size_t i = 0; i < 10; ++i) {
+            ChaCha::apply (cache, S, buf.data (), plain.data () + 100, buf.size (), 100);
+        }
+        auto stats = cache.statistics ();
+        REQUIRE_EQ (stats.misses, 1);
+        REQUIRE_EQ (stats.hits, 9);
+        REQUIRE_EQ (stats.evictions, 0);
+
+        // Another key never hits the blocks of the first one.
+        ChaCha::RFC7539::State T {NONCE.data (), NONCE.size (), NONCE.data (), NONCE.size ()};
+        ChaCha::apply (cache, T, buf.data (), plain.data () + 100, buf.size (), 100);
+        REQUIRE_EQ (cache.statistics ().misses, 2);
+
+        for (size_t i = 0; i < 64; ++i) {
+            ChaCha::apply (cache, S, buf.data (), plain.data () + 64 * i, buf.size (), 64 * i);
+        }
+        stats = cache.statistics ();
+        REQUIRE_EQ (stats.misses + stats.hits, 10 + 1 + 64);
+        REQUIRE (56 <= stats.evictions);
+
+        // Large reads bypass the cache.
+        std::vector<uint8_t> large (1000);
+        ChaCha::apply (cache, S, large.data (), plain.data (), large.size (), 0);
+        REQUIRE_EQ (cache.statistics ().misses + cache.statistics ().hits, stats.misses + stats.hits);
+    }
+    SUBCASE ("shared by threads") {
+        ChaCha::BlockCache       cache {256, 8};
+        std::vector<std::thread> threads;
+        std::vector<char>        ok (4, 0);
+        for (size_t t = 0; t < ok.size (); ++t) {
+            threads.emplace_back ([&, t] () {
+                ChaCha::RFC7539::State S {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()};
+                bool                   result = true;
+                for (size_t i = 0; i < 2000; ++i) {
+                    size_t               offset = (i * 37 + t * 11) % (plain.size () - 40);
+                    std::vector<uint8_t> expected (40);
+                    std::vector<uint8_t> actual (40);
+                    auto                 S0 = S;
+                    ChaCha::apply (S0, expected.data (), plain.data () + offset, 40, offset);
+                    ChaCha::apply (cache, S, actual.data (), plain.data () + offset, 40, offset);
+                    result = result && expected == actual;
+                }
+                ok[t] = result;
+            });
+        }
+        for (auto &th : threads) {
+            th.join ();
+        }
+        for (size_t t = 0; t < ok.size (); ++t) {
+            CAPTURE (t);
+            REQUIRE (ok[t]);
+        }
+        REQUIRE (0 < cache.statistics ().hits);
+    }
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20.hpp>
+#include <chacha20/compile-time.hpp>
+#include <chacha20/state-rfc7539.hpp>
+#include <chacha20/state-salsa20.hpp>
+
+#include "doctest-rapidcheck.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+namespace {
+    constexpr uint8_t hex_digit (char ch) {
+        return static_cast<uint8_t> ('a' <= ch ? ch - 'a' + 10 : ch - '0');
+    }
+
+    template<size_t N_>
+    constexpr std::array<uint8_t, (N_ - 1) / 2> from_hex (const char (&s)[N_]) {
+        std::array<uint8_t, (N_ - 1) / 2> result {};
+        for (size_t i = 0; i < result.size (); ++i) {
+            result[i] = static_cast<uint8_t> (hex_digit (s[2 * i]) << 4u | hex_digit (s[2 * i + 1]));
+        }
+        return result;
+    }
+
+    constexpr auto RFC7539_KEY = [] () {
+        std::array<uint8_t, 32> result {};
+        for (size_t i = 0; i < result.size (); ++i) {
+            result[i] = static_cast<uint8_t> (i);
+        }
+        return result;
+    }();
+    constexpr std::array<uint8_t, 12> RFC7539_NONCE {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4A, 0x00, 0x00, 0x00, 0x00};
+    constexpr auto                    RFC7539_PLAIN = ChaCha::literal_bytes (
+            "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.");
+
+    /// @brief RFC7539 2.4.2, encrypted by the compiler.
+    constexpr auto RFC7539_CIPHER = [] () {
+        ChaCha::RFC7539::State S {RFC7539_KEY.data (), RFC7539_KEY.size (), RFC7539_NONCE.data (), RFC7539_NONCE.size ()};
+        S.setSequence (1);
+        return ChaCha::apply_constexpr (S, RFC7539_PLAIN);
+    }();
+    static_assert (RFC7539_CIPHER.size () == 114);
+    static_assert (RFC7539_CIPHER[0] == 0x6E && RFC7539_CIPHER[1] == 0x2E && RFC7539_CIPHER[63] == 0xD8);
+    static_assert (RFC7539_CIPHER[64] == 0x07 && RFC7539_CIPHER[112] == 0x87 && RFC7539_CIPHER[113] == 0x4D);
+
+    /// @brief ECRYPT Salsa20 set 1, vector 0.
+    constexpr std::array<uint8_t, 16> SALSA20_KEY {0x80};
+    constexpr std::array<uint8_t, 8>  SALSA20_NONCE {};
+    constexpr auto                    SALSA20_STREAM =
+            ChaCha::keystream<64> (ChaCha::Salsa20::State {SALSA20_KEY.data (), SALSA20_KEY.size (), SALSA20_NONCE.data (), SALSA20_NONCE.size ()});
+    static_assert (SALSA20_STREAM == from_hex ("4dfa5e481da23ea09a31022050859936da52fcee218005164f267cb65f5cfd7f"
+                                               "2b4f97e0ff16924a52df269515110a07f9e460bc65ef95da58f740b7d1dbb0aa"));
+
+    /// @brief NaCl's XSalsa20 stream (HSalsa20 included).
+    constexpr auto XSALSA20_KEY    = from_hex ("1b27556473e985d462cd51197a9a46c76009549eac6474f206c4ee0844f68389");
+    constexpr auto XSALSA20_NONCE  = from_hex ("69696ee955b62b73cd62bda875fc73d68219e0036b7a0b37");
+    constexpr auto XSALSA20_STREAM = ChaCha::keystream<64> (
+            ChaCha::XSalsa20::State {XSALSA20_KEY.data (), XSALSA20_KEY.size (), XSALSA20_NONCE.data (), XSALSA20_NONCE.size ()});
+    static_assert (XSALSA20_STREAM == from_hex ("eea6a7251c1e72916d11c2cb214d3c252539121d8e234e652d651fa4c8cff880"
+                                                "309e645a74e9e0a60d8243acd9177ab51a1beb8d5a2f5d700c093c5e55855796"));
+
+    /// @brief `apply_constexpr` (run at run time) against `apply` from random sequences.
+    template<typename State_>
+    void check_same_as_apply (const State_ &state) {
+        rc::prop ("same output and sequence", [&state] () {
+            auto const  size  = *rc::gen::inRange<size_t> (0, 300);
+            auto const &plain = *rc::gen::container<std::vector<uint8_t>> (size, rc::gen::arbitrary<uint8_t> ());
+            auto const  seq   = *rc::gen::inRange<uint32_t> (0, 1000);
+            State_      S0 {state};
+            State_      S1 {state};
+            S0.setSequence (seq);
+            S1.setSequence (seq);
+            std::vector<uint8_t> expected (plain.size ());
+            std::vector<uint8_t> actual (plain.size ());
+            ChaCha::apply (S0, expected.data (), plain.data (), plain.size ());
+            ChaCha::apply_constexpr (S1, actual.data (), plain.data (), plain.size ());
+            RC_ASSERT (actual == expected);
+            RC_ASSERT (S1.getSequence () == S0.getSequence ());
+        });
+    }
+}  // namespace
+
+TEST_CASE ("Test ChaCha::apply_constexpr") {
+    SUBCASE ("encrypted at compile time, decrypted at run time") {
+        ChaCha::RFC7539::State S {RFC7539_KEY.data (), RFC7539_KEY.size (), RFC7539_NONCE.data (), RFC7539_NONCE.size ()};
+        S.setSequence (1);
+        std::array<uint8_t, RFC7539_CIPHER.size ()> plain {};
+        ChaCha::apply (S, plain.data (), RFC7539_CIPHER.data (), RFC7539_CIPHER.size ());
+        REQUIRE_EQ (plain, RFC7539_PLAIN);
+    }
+    SUBCASE ("byte pointers and `const void *` make the same state") {
+        const std::string key {"0123456789abcdef0123456789abcdef"};
+        const std::string nonce {"0123456789abcdef01234567"};
+        auto const *      k = static_cast<const void *> (key.data ());
+        auto const *      n = static_cast<const void *> (nonce.data ());
+        for (size_t key_size : {10u, 16u, 32u}) {
+            auto const djb      = ChaCha::DJB::State {key.data (), key_size, 7}.state ();
+            auto const rfc      = ChaCha::RFC7539::State {key.data (), key_size, nonce.data (), 12}.state ();
+            auto const sal      = ChaCha::Salsa20::State {key.data (), key_size, nonce.data (), 8}.state ();
+            auto const djb_void = ChaCha::DJB::State {k, key_size, 7}.state ();
+            auto const rfc_void = ChaCha::RFC7539::State {k, key_size, n, 12}.state ();
+            auto const sal_void = ChaCha::Salsa20::State {k, key_size, n, 8}.state ();
+            REQUIRE_EQ (djb, djb_void);
+            REQUIRE_EQ (rfc, rfc_void);
+            REQUIRE_EQ (sal, sal_void);
+        }
+        auto const subkey   = ChaCha::detail::hsalsa20_constexpr (ChaCha::detail::padded<32> (key.data (), 32),
+                                                                    ChaCha::detail::padded<24> (nonce.data (), 24));
+        auto const xsalsa   = ChaCha::XSalsa20::State {key.data (), 32, nonce.data (), 24}.state ();
+        auto const expected = ChaCha::Salsa20::State {subkey.data (), subkey.size (), nonce.data () + 16, 8}.state ();
+        REQUIRE_EQ (xsalsa, expected);
+    }
+    SUBCASE ("same as apply") {
+        const std::string key {"0123456789abcdef0123456789abcdef"};
+        const std::string nonce {"0123456789abcdef01234567"};
+        check_same_as_apply (ChaCha::DJB::State {key.data (), key.size (), 7});
+        check_same_as_apply (ChaCha::RFC7539::State {key.data (), key.size (), nonce.data (), 12});
+        check_same_as_apply (ChaCha::Salsa20::State {key.data (), key.size (), nonce.data (), 8});
+        check_same_as_apply (ChaCha::XSalsa20::State {key.data (), key.size (), nonce.data (), 24});
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20/cooperative.hpp>
+#include <chacha20/state-djb.hpp>
+#include <chacha20/state-rfc7539.hpp>
+
+#include "fixtures.hpp"
+
+#include <coroutine>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+namespace {
+    using fixtures::pattern;
+    /// @brief Minimal run queue: `co_await loop.yield ()` reschedules the awaiting coroutine.
+    class Loop {
+    private:
+        std::deque<std::coroutine_handle<>> queue_;
+
+    public:
+        auto yield () {
+            struct Awaiter {
+                Loop *loop;
+                bool  await_ready () const noexcept { return false; }
+                void  await_suspend (std::coroutine_handle<> h) const { loop->queue_.push_back (h); }
+                void  await_resume () const noexcept {}
+            };
+            return Awaiter {this};
+        }
+
+        size_t run () {
+            size_t cnt = 0;
+            while (! queue_.empty ()) {
+                auto h = queue_.front ();
+                queue_.pop_front ();
+                h.resume ();
+                ++cnt;
+            }
+            return cnt;
+        }
+    };
+
+    /// @brief Fire-and-forget coroutine used to await a task from the loop.
+    struct Detached {
+        struct promise_type {
+            Detached            get_return_object () { return {}; }
+            std::suspend_never  initial_suspend () noexcept { return {}; }
+            std::suspend_never  final_suspend () noexcept { return {}; }
+            void                return_void () {}
+            void                unhandled_exception () { std::terminate (); }
+        };
+    };
+}  // namespace
+
+TEST_CASE ("Test ChaCha::apply_cooperatively") {
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+    auto const &      plain = pattern (64 * 37 + 13);
+
+    ChaCha::DJB::State S0 {key.data (), key.size (), 0x0123456789ABCDEFu};
+    std::vector<uint8_t> expected (plain.size ());
+    ChaCha::apply (S0, expected.data (), plain.data (), plain.size ());
+
+    SUBCASE ("resumed step by step") {
+        ChaCha::DJB::State   S {key.data (), key.size (), 0x0123456789ABCDEFu};
+        std::vector<uint8_t> actual (plain.size ());
+        auto                 task  = ChaCha::apply_cooperatively (S, actual.data (), plain.data (), plain.size (), 256);
+        size_t               steps = 0;
+        REQUIRE_FALSE (task.done ());
+        while (task.resume ()) {
+            ++steps;
+            // Suspended at a slice boundary: the state points the next block.
+            REQUIRE_EQ (S.getSequence (), 4 * steps);
+        }
+        REQUIRE (task.done ());
+        REQUIRE_EQ (steps, (plain.size () + 255) / 256 - 1);
+        REQUIRE (expected == actual);
+        REQUIRE_EQ (S.getSequence (), S0.getSequence ());
+    }
+    SUBCASE ("budget is rounded to whole blocks") {
+        ChaCha::DJB::State   S {key.data (), key.size (), 0x0123456789ABCDEFu};
+        std::vector<uint8_t> actual {plain};
+        auto                 task = ChaCha::apply_cooperatively (S, actual.data (), actual.size (), 100);
+        task.resume ();
+        REQUIRE_EQ (S.getSequence (), 1u);
+        task.run ();
+        REQUIRE (expected == actual);
+    }
+    SUBCASE ("awaited from a coroutine") {
+        Loop                 loop;
+        ChaCha::DJB::State   S {key.data (), key.size (), 0x0123456789ABCDEFu};
+        std::vector<uint8_t> actual (plain.size ());
+        bool                 finished = false;
+        auto                 job      = [&] () -> Detached {
+            co_await ChaCha::apply_cooperatively (S, actual.data (), plain.data (), plain.size (), 512, [&loop] () { return loop.yield (); });
+            finished = true;
+        };
+        job ();
+        REQUIRE_FALSE (finished);
+        REQUIRE_EQ (loop.run (), (plain.size () + 511) / 512 - 1);
+        REQUIRE (finished);
+        REQUIRE (expected == actual);
+    }
+    SUBCASE ("RFC7539 state") {
+        ChaCha::RFC7539::State S1 {key.data (), key.size ()};
+        ChaCha::RFC7539::State S2 {key.data (), key.size ()};
+        std::vector<uint8_t>   e (plain.size ());
+        std::vector<uint8_t>   a (plain.size ());
+        ChaCha::apply (S1, e.data (), plain.data (), plain.size ());
+        ChaCha::apply_cooperatively (S2, a.data (), plain.data (), plain.size (), 4096).run ();
+        REQUIRE (e == a);
+    }
+}
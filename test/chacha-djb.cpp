@@ -148,6 +148,47 @@ TEST_CASE ("Test ChaCha::DJB with large key") {
     }
 }
 
+TEST_CASE ("Test ChaCha::DJB multi-block path") {
+    ECRYPT_ctx ctx;
+    memset (&ctx, 0, sizeof (ctx));
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+    ECRYPT_keysetup (&ctx, reinterpret_cast<const u8 *> (key.data ()), 256, 0);
+    std::array<uint8_t, 8> iv {1, 2, 3, 4, 5, 6, 7, 8};
+    ECRYPT_ivsetup (&ctx, static_cast<const u8 *> (iv.data ()));
+    ChaCha::DJB::State S {key.data (), key.size (), ChaCha::detail::asUInt64 (iv.data ())};
+
+    std::string src;
+    for (size_t i = 0; i < 64 * 19 + 7; ++i) {
+        src.push_back (static_cast<char> (i * 7));
+    }
+    SUBCASE ("various lengths") {
+        for (size_t sz : {64u, 128u, 192u, 255u, 256u, 257u, 320u, 512u, 575u, 1024u, 64u * 19u + 7u}) {
+            CAPTURE (sz);
+            ECRYPT_ivsetup (&ctx, static_cast<const u8 *> (iv.data ()));
+            S.setSequence (0);
+            auto const &plain    = src.substr (0, sz);
+            auto const &expected = encode (ctx, plain);
+            auto const &actual   = encode (S, plain);
+            REQUIRE (expected == actual);
+            REQUIRE_EQ (S.getSequence (), (sz + 63) / 64);
+        }
+    }
+    SUBCASE ("sequence carries into the upper word") {
+        ctx.input[12] = 0xFFFFFFFEu;
+        S.setSequence (0xFFFFFFFEu);
+        auto const &expected = encode (ctx, src);
+        auto const &actual   = encode (S, src);
+        REQUIRE (expected == actual);
+        REQUIRE_EQ (S.getSequence (), UINT64_C (0xFFFFFFFE) + 20u);
+    }
+    SUBCASE ("in place") {
+        auto const &expected = encode (ctx, src);
+        std::vector<uint8_t> actual {src.begin (), src.end ()};
+        ChaCha::apply (S, actual.data (), actual.size ());
+        REQUIRE (expected == actual);
+    }
+}
+
 TEST_CASE ("ChaCha::DJB property") {
     rc::prop ("roundtrip", [] () {
         auto const  key_size = *rc::gen::element (16, 32);
@@ -0,0 +1,113 @@
+/*
+ * chacha-ecrypt.cpp: `chacha20-ecrypt` against the reference implementation.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#include "doctest-rapidcheck.hpp"
+#include "fixtures.hpp"
+
+#include <cstring>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+extern "C" {
+#include "ecrypt-sync.h"
+
+// `chacha20-ref-renamed`: the reference implementation with renamed entry points.
+void REF_ECRYPT_keysetup (ECRYPT_ctx *ctx, const u8 *key, u32 keysize, u32 ivsize);
+void REF_ECRYPT_ivsetup (ECRYPT_ctx *ctx, const u8 *iv);
+void REF_ECRYPT_encrypt_bytes (ECRYPT_ctx *ctx, const u8 *plaintext, u8 *ciphertext, u32 msglen);
+void REF_ECRYPT_keystream_bytes (ECRYPT_ctx *ctx, u8 *keystream, u32 length);
+}
+
+namespace {
+    using fixtures::pattern;
+    struct Contexts {
+        ECRYPT_ctx ref;
+        ECRYPT_ctx ctx;
+
+        Contexts (const std::vector<uint8_t> &key, u32 keysize, const std::vector<uint8_t> &iv) {
+            ::memset (&ref, 0, sizeof (ref));
+            ::memset (&ctx, 0, sizeof (ctx));
+            REF_ECRYPT_keysetup (&ref, key.data (), keysize, 64);
+            ECRYPT_keysetup (&ctx, key.data (), keysize, 64);
+            REF_ECRYPT_ivsetup (&ref, iv.data ());
+            ECRYPT_ivsetup (&ctx, iv.data ());
+        }
+
+        [[nodiscard]] bool same () const { return ::memcmp (&ref, &ctx, sizeof (ctx)) == 0; }
+    };
+}  // namespace
+
+TEST_CASE ("ECRYPT compatibility") {
+    rc::prop ("key and IV setup", [] () {
+        auto const  wide = *rc::gen::arbitrary<bool> ();
+        auto const &key  = *rc::gen::container<std::vector<uint8_t>> (32, rc::gen::arbitrary<uint8_t> ());
+        auto const &iv   = *rc::gen::container<std::vector<uint8_t>> (8, rc::gen::arbitrary<uint8_t> ());
+        Contexts    c {key, wide ? 256u : 128u, iv};
+        RC_ASSERT (c.same ());
+    });
+    rc::prop ("split messages", [] () {
+        auto const  wide  = *rc::gen::arbitrary<bool> ();
+        auto const &key   = *rc::gen::container<std::vector<uint8_t>> (32, rc::gen::arbitrary<uint8_t> ());
+        auto const &iv    = *rc::gen::container<std::vector<uint8_t>> (8, rc::gen::arbitrary<uint8_t> ());
+        auto const &sizes = *rc::gen::container<std::vector<size_t>> (rc::gen::inRange<size_t> (0, 2000));
+        Contexts    c {key, wide ? 256u : 128u, iv};
+        for (auto size : sizes) {
+            auto const &msg = pattern (size);
+            std::vector<uint8_t> expected (size);
+            std::vector<uint8_t> actual (size);
+            REF_ECRYPT_encrypt_bytes (&c.ref, msg.data (), expected.data (), static_cast<u32> (size));
+            ECRYPT_encrypt_bytes (&c.ctx, msg.data (), actual.data (), static_cast<u32> (size));
+            RC_ASSERT (actual == expected);
+            RC_ASSERT (c.same ());
+        }
+    });
+    rc::prop ("keystream", [] () {
+        auto const &key  = *rc::gen::container<std::vector<uint8_t>> (32, rc::gen::arbitrary<uint8_t> ());
+        auto const &iv   = *rc::gen::container<std::vector<uint8_t>> (8, rc::gen::arbitrary<uint8_t> ());
+        auto const  size = *rc::gen::inRange<size_t> (0, 5000);
+        Contexts    c {key, 256, iv};
+        std::vector<uint8_t> expected (size);
+        std::vector<uint8_t> actual (size);
+        REF_ECRYPT_keystream_bytes (&c.ref, expected.data (), static_cast<u32> (size));
+        ECRYPT_keystream_bytes (&c.ctx, actual.data (), static_cast<u32> (size));
+        RC_ASSERT (actual == expected);
+        RC_ASSERT (c.same ());
+    });
+    SUBCASE ("counter carry") {
+        std::vector<uint8_t> key (32, 0x42);
+        std::vector<uint8_t> iv (8, 0x24);
+        Contexts             c {key, 256, iv};
+        c.ref.input[12] = c.ctx.input[12] = 0xFFFFFFF0u;
+
+        auto const &msg = pattern (64 * 40 + 5);
+        std::vector<uint8_t> expected (msg.size ());
+        std::vector<uint8_t> actual (msg.size ());
+        REF_ECRYPT_encrypt_bytes (&c.ref, msg.data (), expected.data (), static_cast<u32> (msg.size ()));
+        ECRYPT_encrypt_bytes (&c.ctx, msg.data (), actual.data (), static_cast<u32> (msg.size ()));
+        REQUIRE (actual == expected);
+        REQUIRE (c.same ());
+        REQUIRE (c.ctx.input[13] == 1);
+    }
+    SUBCASE ("packets") {
+        std::vector<uint8_t> key (16, 0x42);
+        std::vector<uint8_t> iv (8, 0x24);
+        Contexts             c {key, 128, iv};
+
+        auto const &msg = pattern (1000);
+        std::vector<uint8_t> expected (msg.size ());
+        std::vector<uint8_t> actual (msg.size ());
+        REF_ECRYPT_encrypt_bytes (&c.ref, msg.data (), expected.data (), static_cast<u32> (msg.size ()));
+        ECRYPT_encrypt_bytes (&c.ctx, msg.data (), actual.data (), static_cast<u32> (msg.size ()));
+        // A packet resets the counter.
+        ECRYPT_encrypt_packet (&c.ctx, iv.data (), msg.data (), actual.data (), static_cast<u32> (msg.size ()));
+        REQUIRE (actual == expected);
+
+        std::vector<uint8_t> plain (msg.size ());
+        ECRYPT_decrypt_packet (&c.ctx, iv.data (), actual.data (), plain.data (), static_cast<u32> (plain.size ()));
+        REQUIRE (plain == msg);
+        REQUIRE (c.same ());
+    }
+}
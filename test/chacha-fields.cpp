@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20.hpp>
+#include <chacha20/fields.hpp>
+#include <chacha20/state-rfc7539.hpp>
+
+#include "doctest-rapidcheck.hpp"
+#include "fixtures.hpp"
+
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+namespace {
+    using fixtures::KEY;
+    using fixtures::NONCE;
+    using fixtures::pattern;
+
+    /// @brief `apply_fields` by hand: gathers the fields, applies and scatters them back.
+    template<typename State_>
+    std::vector<uint8_t> gathered (State_ &state, const std::vector<uint8_t> &records, size_t count, const ChaCha::RecordLayout &layout) {
+        std::vector<uint8_t> tmp;
+        for (size_t r = 0; r < count; ++r) {
+            for (auto const &f : layout.fields ()) {
+                auto const *p = records.data () + r * layout.stride () + f.offset;
+                tmp.insert (tmp.end (), p, p + f.size);
+            }
+        }
+        ChaCha::apply (state, tmp.data (), tmp.size ());
+        auto   result = records;
+        size_t k      = 0;
+        for (size_t r = 0; r < count; ++r) {
+            for (auto const &f : layout.fields ()) {
+                std::copy (tmp.begin () + k, tmp.begin () + k + f.size, result.begin () + r * layout.stride () + f.offset);
+                k += f.size;
+            }
+        }
+        return result;
+    }
+}  // namespace
+
+TEST_CASE ("Test ChaCha::apply_fields") {
+    SUBCASE ("layouts") {
+        ChaCha::RecordLayout layout {128, {{64, 8}, {16, 16}, {20, 4}, {32, 8}, {72, 0}}};
+        REQUIRE_EQ (layout.fields ().size (), 2);
+        REQUIRE_EQ (layout.fields ()[0].offset, 16);
+        REQUIRE_EQ (layout.fields ()[0].size, 24);
+        REQUIRE_EQ (layout.fields ()[1].offset, 64);
+        REQUIRE_EQ (layout.selected (), 32);
+        REQUIRE_FALSE (layout.dense ());
+        REQUIRE (ChaCha::RecordLayout {16, {{0, 10}, {10, 6}}}.dense ());
+        REQUIRE_THROWS_AS ((ChaCha::RecordLayout {16, {{8, 9}}}), std::invalid_argument);
+    }
+    SUBCASE ("same as gathered fields") {
+        ChaCha::DJB::State     D {KEY.data (), KEY.size (), 3};
+        ChaCha::RFC7539::State S {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()};
+        rc::prop ("random layouts", [&] () {
+            auto const stride = *rc::gen::inRange<size_t> (1, 300);
+            auto const count  = *rc::gen::inRange<size_t> (0, 100);
+            auto const nf     = *rc::gen::inRange<size_t> (0, 4);
+            std::vector<ChaCha::Field> fields;
+            for (size_t i = 0; i < nf; ++i) {
+                auto const offset = *rc::gen::inRange<size_t> (0, stride);
+                auto const size   = *rc::gen::inRange<size_t> (0, stride - offset + 1);
+                fields.push_back ({offset, size});
+            }
+            ChaCha::RecordLayout layout {stride, fields.begin (), fields.end ()};
+            auto const &         records = pattern (stride * count);
+
+            auto D0       = D;
+            auto expected = gathered (D0, records, count, layout);
+            auto D1       = D;
+            std::vector<uint8_t> actual (records.size ());
+            ChaCha::apply_fields (D1, actual.data (), records.data (), count, layout);
+            RC_ASSERT (actual == expected);
+            RC_ASSERT (D0.getSequence () == D1.getSequence ());
+
+            auto S0 = S;
+            expected = gathered (S0, records, count, layout);
+            auto S1  = S;
+            actual   = records;
+            ChaCha::apply_fields (S1, actual.data (), count, layout);
+            RC_ASSERT (actual == expected);
+            RC_ASSERT (S0.getSequence () == S1.getSequence ());
+        });
+    }
+    SUBCASE ("large table") {
+        ChaCha::RecordLayout layout {128, {{16, 16}}};
+        auto const &         records = pattern (128 * 10000);
+        ChaCha::DJB::State   D0 {KEY.data (), KEY.size (), 3};
+        ChaCha::DJB::State   D1 {D0};
+        auto const &         expected = gathered (D0, records, 10000, layout);
+        auto                 actual   = records;
+        ChaCha::apply_fields (D1, actual.data (), 10000, layout);
+        REQUIRE (actual == expected);
+        REQUIRE_EQ (D1.getSequence (), 10000 * 16 / 64);
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ *
+ * Built without the library (`CHACHA20_HEADER_ONLY`), against the reference implementation.
+ */
+
+#include <chacha20.hpp>
+#include <chacha20/header-protection.hpp>
+#include <chacha20/state-rfc7539.hpp>
+#include <chacha20/state-salsa20.hpp>
+
+#include "doctest-rapidcheck.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+extern "C" {
+#include "ecrypt-sync.h"
+}
+
+#ifndef CHACHA20_HEADER_ONLY
+#    error "This test should be built with CHACHA20_HEADER_ONLY."
+#endif
+
+TEST_CASE ("Test header-only ChaCha::DJB") {
+    rc::prop ("matches the reference", [] () {
+        auto const &key    = *rc::gen::container<std::vector<char>> (32, rc::gen::arbitrary<char> ());
+        auto const &plain  = *rc::gen::scale (16, rc::gen::arbitrary<std::string> ());
+        auto const  offset = *rc::gen::inRange<size_t> (0, 200);
+
+        ECRYPT_ctx ctx;
+        memset (&ctx, 0, sizeof (ctx));
+        ECRYPT_keysetup (&ctx, reinterpret_cast<const u8 *> (key.data ()), 256, 0);
+        std::array<uint8_t, 8> iv;
+        iv.fill (0);
+        ECRYPT_ivsetup (&ctx, static_cast<const u8 *> (iv.data ()));
+
+        std::string expected (offset + plain.size (), '\0');
+        {
+            std::string src (offset, '\0');
+            src += plain;
+            ECRYPT_encrypt_bytes (&ctx, reinterpret_cast<const u8 *> (src.data ()), reinterpret_cast<u8 *> (expected.data ()), src.size ());
+        }
+        ChaCha::DJB::State S {key.data (), key.size (), 0};
+        std::string        actual (plain.size (), '\0');
+        ChaCha::apply (S, actual.data (), plain.data (), plain.size (), offset);
+        RC_ASSERT (expected.substr (offset) == actual);
+    });
+}
+
+TEST_CASE ("Test header-only multi-state keystream") {
+    std::array<std::array<uint32_t, 16>, 7> states;
+    for (size_t i = 0; i < states.size (); ++i) {
+        std::string            key (32, static_cast<char> ('a' + i));
+        ChaCha::RFC7539::State S {key.data (), key.size ()};
+        S.setSequence (static_cast<uint32_t> (i * 11));
+        states[i] = S.state ();
+    }
+    std::vector<uint8_t> masks (64 * states.size ());
+    ChaCha::detail::create_masks (states.data (), states.size (), masks.data ());
+    for (size_t i = 0; i < states.size (); ++i) {
+        CAPTURE (i);
+        auto const &expected = ChaCha::detail::create_mask (states[i]);
+        REQUIRE (std::equal (expected.begin (), expected.end (), masks.begin () + 64 * i));
+    }
+}
+
+TEST_CASE ("Test header-only header-protection masks") {
+    const std::string                                  key {"0123456789abcdef0123456789abcdef"};
+    const ChaCha::RFC7539::State                       K {key.data (), key.size ()};
+    std::array<ChaCha::HeaderProtection::sample_t, 37> samples;
+    for (size_t i = 0; i < samples.size (); ++i) {
+        for (size_t k = 0; k < 16; ++k) {
+            samples[i][k] = static_cast<uint8_t> (i * 31 + k);
+        }
+    }
+    std::array<ChaCha::HeaderProtection::mask_t, samples.size ()> masks;
+    ChaCha::HeaderProtection::masks (K, samples.data (), samples.size (), masks.data ());
+    for (size_t i = 0; i < samples.size (); ++i) {
+        CAPTURE (i);
+        ChaCha::RFC7539::State S {key.data (), key.size (), samples[i].data () + 4, 12};
+        S.setSequence (ChaCha::detail::le32 (samples[i].data ()));
+        auto const &expected = ChaCha::detail::create_mask (S.state ());
+        REQUIRE (std::equal (masks[i].begin (), masks[i].end (), expected.begin ()));
+    }
+}
+
+TEST_CASE ("Test header-only ChaCha::XSalsa20") {
+    const std::string       key {"0123456789abcdef0123456789abcdef"};
+    const std::string       nonce {"0123456789abcdef01234567"};
+    ChaCha::XSalsa20::State S {key.data (), key.size (), nonce.data (), nonce.size ()};
+    std::vector<uint8_t>    stream (64 * 11, 0);
+    ChaCha::apply (S, stream.data (), stream.size ());
+    S.setSequence (0);
+    for (size_t i = 0; i < 11; ++i) {
+        CAPTURE (i);
+        auto const &expected = ChaCha::detail::create_mask (S);
+        REQUIRE (std::equal (expected.begin (), expected.end (), stream.begin () + 64 * i));
+        S.incrementSequence ();
+    }
+}
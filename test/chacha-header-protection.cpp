@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20.hpp>
+#include <chacha20/header-protection.hpp>
+#include <chacha20/state-rfc7539.hpp>
+
+#include "doctest-rapidcheck.hpp"
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+namespace {
+    /// @brief The mask of `sample` from a state of its own (the per-packet way).
+    ChaCha::HeaderProtection::mask_t reference_mask (const std::string &key, const ChaCha::HeaderProtection::sample_t &sample) {
+        ChaCha::RFC7539::State S {key.data (), key.size (), sample.data () + 4, 12};
+        S.setSequence (ChaCha::detail::le32 (sample.data ()));
+        auto const &                     block = ChaCha::detail::create_mask (S.state ());
+        ChaCha::HeaderProtection::mask_t result;
+        std::copy_n (block.begin (), result.size (), result.begin ());
+        return result;
+    }
+}  // namespace
+
+TEST_CASE ("Test ChaCha::HeaderProtection") {
+    SUBCASE ("RFC 9001, A.5") {
+        const std::array<uint8_t, 32> key {0x25, 0xa2, 0x82, 0xb9, 0xe8, 0x2f, 0x06, 0xf2, 0x1f, 0x48, 0x89, 0x17, 0xa4, 0xfc, 0x8f, 0x1b,
+                                           0x73, 0x57, 0x36, 0x85, 0x60, 0x85, 0x97, 0xd0, 0xef, 0xcb, 0x07, 0x6b, 0x0a, 0xb7, 0xa7, 0xa4};
+        const ChaCha::HeaderProtection::sample_t sample {
+                0x5e, 0x5c, 0xd5, 0x5c, 0x41, 0xf6, 0x90, 0x80, 0x57, 0x5d, 0x79, 0x99, 0xc2, 0x5a, 0x5b, 0xfb};
+        const ChaCha::HeaderProtection::mask_t expected {0xae, 0xfe, 0xfe, 0x7d, 0x03};
+
+        auto const actual = ChaCha::HeaderProtection::mask (ChaCha::RFC7539::State {key.data (), key.size ()}, sample);
+        REQUIRE_EQ (actual, expected);
+    }
+    SUBCASE ("batches match one state per sample") {
+        const std::string key {"0123456789abcdef0123456789abcdef"};
+        rc::prop ("same masks", [&key] () {
+            auto const count = *rc::gen::inRange<size_t> (0, 70);
+            auto const bytes = *rc::gen::container<std::vector<uint8_t>> (16 * count, rc::gen::arbitrary<uint8_t> ());
+
+            std::vector<ChaCha::HeaderProtection::sample_t> samples (count);
+            for (size_t i = 0; i < count; ++i) {
+                std::copy_n (&bytes[16 * i], 16, samples[i].begin ());
+            }
+            // The nonce and sequence of the key state are ignored.
+            ChaCha::RFC7539::State K {key.data (), key.size (), "nonce-ignored", 12};
+            K.setSequence (12345);
+            std::vector<ChaCha::HeaderProtection::mask_t> masks (count + 1, {0xEE, 0xEE, 0xEE, 0xEE, 0xEE});
+            ChaCha::HeaderProtection::masks (K, samples.data (), count, masks.data ());
+            for (size_t i = 0; i < count; ++i) {
+                RC_ASSERT (masks[i] == reference_mask (key, samples[i]));
+            }
+            // Nothing is written past the last mask.
+            RC_ASSERT (masks[count] == (ChaCha::HeaderProtection::mask_t {0xEE, 0xEE, 0xEE, 0xEE, 0xEE}));
+        });
+    }
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20.hpp>
+#include <chacha20/lazy-mapping.hpp>
+#include <chacha20/state-rfc7539.hpp>
+#include <chacha20/state-salsa20.hpp>
+
+#include "doctest-rapidcheck.hpp"
+#include "fixtures.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <doctest/doctest.h>
+
+namespace {
+    using fixtures::KEY;
+    using fixtures::NONCE;
+    using fixtures::pattern;
+
+    /// @brief Writes `plain` encrypted with `state` to a temporary file (removed on destruction).
+    struct EncryptedFile {
+        std::string path;
+
+        template<typename State_>
+        EncryptedFile (const std::vector<uint8_t> &plain, State_ state)
+                : path {std::string {"chacha20-lazy-mapping-"} + std::to_string (reinterpret_cast<uintptr_t> (this)) + ".bin"} {
+            std::vector<uint8_t> cipher (plain.size ());
+            ChaCha::apply (state, cipher.data (), plain.data (), plain.size ());
+            std::ofstream out {path, std::ios::binary};
+            out.write (reinterpret_cast<const char *> (cipher.data ()), static_cast<std::streamsize> (cipher.size ()));
+        }
+
+        ~EncryptedFile () { std::remove (path.c_str ()); }
+    };
+
+    template<typename State_>
+    void check_all (const std::vector<uint8_t> &plain, const State_ &state) {
+        EncryptedFile        file {plain, state};
+        ChaCha::LazyMapping  m {file.path, state};
+        REQUIRE_EQ (m.size (), plain.size ());
+        REQUIRE (std::equal (plain.begin (), plain.end (), m.data ()));
+    }
+}  // namespace
+
+TEST_CASE ("Test ChaCha::LazyMapping") {
+    if (! ChaCha::LazyMapping::supported ()) {
+        MESSAGE ("userfaultfd is not available, skipped");
+        return;
+    }
+    auto const  PAGE  = static_cast<size_t> (::sysconf (_SC_PAGESIZE));
+    auto const &plain = pattern (37 * PAGE + 100);
+
+    SUBCASE ("decrypts as ChaCha::apply") {
+        check_all (plain, ChaCha::DJB::State {KEY.data (), KEY.size (), 1234});
+        check_all (plain, ChaCha::RFC7539::State {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()});
+        check_all (plain, ChaCha::Salsa20::State {KEY.data (), KEY.size (), NONCE.data (), 8});
+        check_all (pattern (PAGE), ChaCha::DJB::State {KEY.data (), KEY.size (), 1});
+        check_all (pattern (10), ChaCha::DJB::State {KEY.data (), KEY.size (), 1});
+        check_all (pattern (0), ChaCha::DJB::State {KEY.data (), KEY.size (), 1});
+    }
+    SUBCASE ("random reads") {
+        ChaCha::DJB::State  S {KEY.data (), KEY.size (), 1};
+        EncryptedFile       file {plain, S};
+        ChaCha::LazyMapping m {file.path, S, {4, 1}};
+        rc::prop ("matches the plaintext", [&] () {
+            auto const offset = *rc::gen::inRange<size_t> (0, plain.size ());
+            auto const size   = *rc::gen::inRange<size_t> (0, std::min<size_t> (plain.size () - offset, 3 * PAGE));
+            RC_ASSERT (std::equal (plain.begin () + offset, plain.begin () + offset + size, m.data () + offset));
+        });
+        REQUIRE (m.statistics ().resident <= 4);
+    }
+    SUBCASE ("readahead, budget and the tail of the last page") {
+        ChaCha::DJB::State  S {KEY.data (), KEY.size (), 1};
+        EncryptedFile       file {plain, S};
+        ChaCha::LazyMapping m {file.path, S, {8, 3}};
+        REQUIRE_EQ (m.statistics ().decrypted, 0);
+
+        REQUIRE_EQ (m.data ()[5], plain[5]);
+        auto s = m.statistics ();
+        REQUIRE_EQ (s.faults, 1);
+        REQUIRE_EQ (s.decrypted, 4);
+        REQUIRE_EQ (m.data ()[3 * PAGE + 1], plain[3 * PAGE + 1]);
+        REQUIRE_EQ (m.statistics ().faults, 1);
+
+        for (size_t off = 0; off < plain.size (); off += PAGE) {
+            REQUIRE_EQ (m.data ()[off], plain[off]);
+        }
+        s = m.statistics ();
+        REQUIRE_EQ (s.decrypted, 38);
+        REQUIRE_EQ (s.resident, 8);
+        REQUIRE_EQ (s.evictions, 30);
+        // Evicted pages are decrypted again.
+        REQUIRE_EQ (m.data ()[7], plain[7]);
+        REQUIRE_EQ (m.statistics ().decrypted, 42);
+
+        for (size_t i = plain.size (); i < 38 * PAGE; ++i) {
+            REQUIRE_EQ (m.data ()[i], 0);
+        }
+    }
+    SUBCASE ("system calls on pages not resident") {
+        ChaCha::DJB::State  S {KEY.data (), KEY.size (), 1};
+        EncryptedFile       file {plain, S};
+        ChaCha::LazyMapping m {file.path, S, {0, 0}};
+        int                 fds[2];
+        REQUIRE_EQ (::pipe (fds), 0);
+        auto const           offset = 16 * PAGE + 5;
+        std::vector<uint8_t> got (2 * PAGE);
+        if (m.user_mode_only ()) {
+            MESSAGE ("userfaultfd in user-mode only");
+            REQUIRE_EQ (::write (fds[1], m.data () + offset, got.size ()), -1);
+            REQUIRE_EQ (errno, EFAULT);
+            // Touched from user space first.
+            volatile uint8_t sink = 0;
+            for (size_t off = offset; off < offset + got.size (); off += PAGE) {
+                sink = sink + m.data ()[off];
+            }
+            sink = sink + m.data ()[offset + got.size () - 1];
+        }
+        REQUIRE_EQ (m.statistics ().faults, m.user_mode_only () ? 3u : 0u);
+        REQUIRE_EQ (::write (fds[1], m.data () + offset, got.size ()), static_cast<ssize_t> (got.size ()));
+        REQUIRE_EQ (::read (fds[0], got.data (), got.size ()), static_cast<ssize_t> (got.size ()));
+        REQUIRE (std::equal (got.begin (), got.end (), plain.begin () + static_cast<ptrdiff_t> (offset)));
+        ::close (fds[0]);
+        ::close (fds[1]);
+    }
+    SUBCASE ("concurrent readers") {
+        ChaCha::RFC7539::State S {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()};
+        EncryptedFile          file {plain, S};
+        ChaCha::LazyMapping    m {file.path, S, {16, 2}};
+        std::vector<std::thread> readers;
+        std::vector<int>         ok (4, 0);
+        for (size_t t = 0; t < ok.size (); ++t) {
+            readers.emplace_back ([&, t] () {
+                bool same = true;
+                for (size_t round = 0; round < 4; ++round) {
+                    for (size_t off = (t * 997) % plain.size (); off < plain.size (); off += 1021) {
+                        same = same && m.data ()[off] == plain[off];
+                    }
+                }
+                ok[t] = same ? 1 : 0;
+            });
+        }
+        for (auto &r : readers) {
+            r.join ();
+        }
+        REQUIRE_EQ (ok, std::vector<int> (4, 1));
+    }
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20/aead.hpp>
+#include <chacha20/poly1305.hpp>
+
+#include "doctest-rapidcheck.hpp"
+#include "fixtures.hpp"
+
+#include <array>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+namespace {
+    using fixtures::pattern;
+    std::vector<uint8_t> from_hex (const std::string &s) {
+        std::vector<uint8_t> result;
+        for (size_t i = 0; i + 1 < s.size (); i += 2) {
+            result.push_back (static_cast<uint8_t> (std::stoul (s.substr (i, 2), nullptr, 16)));
+        }
+        return result;
+    }
+
+    template<typename T_>
+    std::string to_hex (const T_ &v) {
+        std::string result;
+        for (auto ch : v) {
+            result += fmt::format ("{:02x}", static_cast<uint8_t> (ch));
+        }
+        return result;
+    }
+}  // namespace
+
+TEST_CASE ("Test ChaCha::Poly1305 with test vector") {
+    // RFC 8439 2.5.2
+    auto const        key = from_hex ("85d6be7857556d337f4452fe42d506a80103808afb0db2fd4abff6af4149f51b");
+    const std::string msg {"Cryptographic Forum Research Group"};
+    SUBCASE ("one shot") {
+        auto const &tag = ChaCha::Poly1305::authenticate (key.data (), msg.data (), msg.size ());
+        REQUIRE_EQ (to_hex (tag), "a8061dc1305136c6c22b8baf0c0127a9");
+    }
+    SUBCASE ("byte by byte") {
+        ChaCha::Poly1305 mac {key.data ()};
+        for (auto ch : msg) {
+            mac.update (&ch, 1);
+            // Empty updates (no AAD) in the middle of a partial block.
+            mac.update (nullptr, 0);
+        }
+        REQUIRE_EQ (to_hex (mac.finish ()), "a8061dc1305136c6c22b8baf0c0127a9");
+    }
+}
+
+TEST_CASE ("Test ChaCha::Poly1305 multi-buffer") {
+    std::vector<std::vector<uint8_t>>      keys;
+    std::vector<std::vector<uint8_t>>      messages;
+    std::vector<ChaCha::Poly1305::Message> batch;
+    for (size_t i = 0; i < 37; ++i) {
+        keys.push_back (pattern (32, static_cast<uint8_t> (i)));
+        // Mixed lengths, including empty ones and the exact multiples of 16.
+        messages.push_back (pattern ((i * 53) % 300 + (i % 5 == 0 ? 0 : 1), static_cast<uint8_t> (3 * i)));
+    }
+    keys.push_back (std::vector<uint8_t> (32, 0xFF)); // r and s at their maximum
+    messages.push_back (std::vector<uint8_t> (1000, 0xFF));
+    messages[7].clear ();
+
+    std::vector<ChaCha::Poly1305::tag_t> tags (messages.size ());
+    for (size_t i = 0; i < messages.size (); ++i) {
+        batch.push_back ({keys[i].data (), messages[i].data (), messages[i].size (), &tags[i]});
+    }
+    ChaCha::Poly1305::authenticate (batch.data (), batch.size ());
+    for (size_t i = 0; i < messages.size (); ++i) {
+        CAPTURE (i);
+        REQUIRE_EQ (to_hex (tags[i]), to_hex (ChaCha::Poly1305::authenticate (keys[i].data (), messages[i].data (), messages[i].size ())));
+    }
+}
+
+TEST_CASE ("Test ChaCha::Poly1305 split over threads") {
+    auto const &message = pattern (16 * 5000 + 7, 11);
+    SUBCASE ("segments") {
+        for (auto const &key : {pattern (32, 1), std::vector<uint8_t> (32, 0xFF)}) {
+            auto const &expected = ChaCha::Poly1305::authenticate (key.data (), message.data (), message.size ());
+            for (size_t threads : {1u, 2u, 3u, 4u, 7u}) {
+                for (size_t min_blocks : {1u, 100u, 4096u}) {
+                    CAPTURE (threads);
+                    CAPTURE (min_blocks);
+                    // Starts from a non-zero accumulator.
+                    ChaCha::detail::poly1305_state_t st;
+                    ChaCha::detail::poly1305_init (st, key.data ());
+                    ChaCha::detail::poly1305_blocks (st, message.data (), 3);
+                    ChaCha::detail::poly1305_blocks_parallel (st, message.data () + 48, message.size () / 16 - 3, threads, min_blocks);
+                    std::array<uint8_t, 16> last {};
+                    ::memcpy (last.data (), message.data () + message.size () / 16 * 16, 7);
+                    last[7] = 1;
+                    ChaCha::detail::poly1305_blocks (st, last.data (), 1, true);
+                    ChaCha::Poly1305::tag_t tag;
+                    ChaCha::detail::poly1305_finish (st, tag.data ());
+                    REQUIRE_EQ (to_hex (tag), to_hex (expected));
+                }
+            }
+        }
+    }
+    SUBCASE ("update_parallel") {
+        auto const &key = pattern (32, 5);
+        rc::prop ("same tag", [&] () {
+            auto const head    = *rc::gen::inRange<size_t> (0, 40);
+            auto const size    = *rc::gen::inRange<size_t> (0, message.size () - head);
+            auto const threads = *rc::gen::inRange<size_t> (1, 6);
+            auto const &expected = ChaCha::Poly1305::authenticate (key.data (), message.data (), head + size);
+            auto const &actual   = ChaCha::Poly1305 {key.data ()}.update (message.data (), head).update_parallel (message.data () + head, size, threads).finish ();
+            RC_ASSERT (actual == expected);
+        });
+    }
+}
+
+TEST_CASE ("Test ChaCha::AEAD") {
+    // RFC 8439 2.8.2
+    std::vector<uint8_t> key;
+    for (size_t i = 0; i < 32; ++i) {
+        key.push_back (static_cast<uint8_t> (0x80 + i));
+    }
+    auto const        nonce = from_hex ("070000004041424344454647");
+    auto const        aad   = from_hex ("50515253c0c1c2c3c4c5c6c7");
+    const std::string plain {"Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it."};
+    const std::string expected_cipher {
+        "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d63dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b3692ddbd7f2d"
+        "778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc3ff4def08e4b7a9de576d26586cec64b6116"};
+    const std::string expected_tag {"1ae10b594f09e26a7e902ecbd0600691"};
+
+    ChaCha::RFC7539::State S {key.data (), key.size (), nonce.data (), nonce.size ()};
+
+    SUBCASE ("seal and open") {
+        std::vector<uint8_t> cipher (plain.size ());
+        auto const &         tag = ChaCha::AEAD::seal (S, cipher.data (), plain.data (), plain.size (), aad.data (), aad.size ());
+        REQUIRE_EQ (to_hex (cipher), expected_cipher);
+        REQUIRE_EQ (to_hex (tag), expected_tag);
+
+        std::string decrypted (cipher.size (), '\0');
+        REQUIRE (ChaCha::AEAD::open (S, decrypted.data (), cipher.data (), cipher.size (), aad.data (), aad.size (), tag.data ()));
+        REQUIRE_EQ (decrypted, plain);
+
+        cipher[17] ^= 1u;
+        std::string untouched (cipher.size (), '\0');
+        REQUIRE_FALSE (ChaCha::AEAD::open (S, untouched.data (), cipher.data (), cipher.size (), aad.data (), aad.size (), tag.data ()));
+        REQUIRE_EQ (untouched, std::string (cipher.size (), '\0'));
+    }
+    SUBCASE ("parallel seal and open") {
+        auto const &big = pattern (3 * 1024 * 1024 + 5, 9);
+        std::vector<uint8_t> expected_cipher (big.size ());
+        std::vector<uint8_t> cipher (big.size ());
+        auto const &expected_tag = ChaCha::AEAD::seal (S, expected_cipher.data (), big.data (), big.size (), aad.data (), aad.size ());
+        auto const &tag          = ChaCha::AEAD::parallel_seal (S, cipher.data (), big.data (), big.size (), aad.data (), aad.size (), 4);
+        REQUIRE (cipher == expected_cipher);
+        REQUIRE_EQ (to_hex (tag), to_hex (expected_tag));
+
+        std::vector<uint8_t> decrypted (cipher.size ());
+        REQUIRE (ChaCha::AEAD::parallel_open (S, decrypted.data (), cipher.data (), cipher.size (), aad.data (), aad.size (), tag.data (), 4));
+        REQUIRE (decrypted == big);
+        cipher[1234567] ^= 1u;
+        REQUIRE_FALSE (ChaCha::AEAD::parallel_open (S, decrypted.data (), cipher.data (), cipher.size (), aad.data (), aad.size (), tag.data (), 4));
+    }
+    SUBCASE ("batch") {
+        constexpr size_t                  N = 21;
+        std::vector<std::vector<uint8_t>> plains;
+        std::vector<std::vector<uint8_t>> ciphers (N);
+        std::vector<ChaCha::AEAD::Record> records (N);
+        for (size_t i = 0; i < N; ++i) {
+            plains.push_back (pattern ((i * 97) % 1100, static_cast<uint8_t> (i)));
+            ciphers[i].resize (plains[i].size ());
+            auto nonce_i = nonce;
+            nonce_i[4]   = static_cast<uint8_t> (i);
+            auto &r      = records[i];
+            r.state      = ChaCha::RFC7539::State {key.data (), key.size (), nonce_i.data (), nonce_i.size ()};
+            r.state.setSequence (static_cast<uint32_t> (i * 1000)); // ignored
+            r.aad      = aad.data ();
+            r.aad_size = i % 3 == 0 ? 0 : aad.size ();
+            r.in       = plains[i].data ();
+            r.out      = ciphers[i].data ();
+            r.size     = plains[i].size ();
+        }
+        ciphers[0].resize (plain.size ());
+        records[0].state    = S;
+        records[0].aad_size = aad.size ();
+        records[0].in       = plain.data ();
+        records[0].out      = ciphers[0].data ();
+        records[0].size     = plain.size ();
+
+        ChaCha::AEAD::seal (records.data (), records.size ());
+        REQUIRE_EQ (to_hex (ciphers[0]), expected_cipher);
+        REQUIRE_EQ (to_hex (records[0].tag), expected_tag);
+        for (size_t i = 0; i < N; ++i) {
+            CAPTURE (i);
+            auto const &         r = records[i];
+            std::vector<uint8_t> cipher (r.size);
+            auto const &         tag = ChaCha::AEAD::seal (r.state, cipher.data (), r.in, r.size, r.aad, r.aad_size);
+            REQUIRE_EQ (to_hex (cipher), to_hex (ciphers[i]));
+            REQUIRE_EQ (to_hex (tag), to_hex (r.tag));
+        }
+
+        // Open in place, with a couple of forgeries.
+        ciphers[3][0] ^= 0x80u;
+        records[5].tag[15] ^= 1u;
+        for (size_t i = 0; i < N; ++i) {
+            records[i].in  = ciphers[i].data ();
+            records[i].out = ciphers[i].data ();
+        }
+        REQUIRE_EQ (ChaCha::AEAD::open (records.data (), records.size ()), N - 2);
+        for (size_t i = 0; i < N; ++i) {
+            CAPTURE (i);
+            REQUIRE_EQ (records[i].authentic, i != 3 && i != 5);
+            if (records[i].authentic) {
+                REQUIRE_EQ (to_hex (ciphers[i]), i == 0 ? to_hex (plain) : to_hex (plains[i]));
+            }
+        }
+    }
+}
@@ -114,6 +114,58 @@ TEST_CASE ("Test ChaCha::RFC7539 with test vector") {
 }
 #pragma clang diagnostic pop
 
+TEST_CASE ("Test ChaCha::RFC7539 multi-block path") {
+    std::string key;
+    for (size_t i = 0; i < 32; ++i) {
+        key.push_back (static_cast<char> (i));
+    }
+    const std::array<uint8_t, 12> nonce {0, 0, 0, 9, 0, 0, 0, 0x4A, 0, 0, 0, 0};
+    ChaCha::RFC7539::State        S {key.data (), key.size (), nonce.data (), nonce.size ()};
+
+    // Reference: one `create_mask` per block.
+    auto encode_by_block = [] (ChaCha::RFC7539::State state, const std::string &plain) {
+        std::vector<uint8_t> result;
+        for (size_t i = 0; i < plain.size (); ++i) {
+            if (i % 64 == 0) {
+                auto const &mask = ChaCha::detail::create_mask (state.state ());
+                state.incrementSequence ();
+                result.insert (result.end (), mask.begin (), mask.end ());
+            }
+            result[i] ^= static_cast<uint8_t> (plain[i]);
+        }
+        result.resize (plain.size ());
+        return result;
+    };
+    std::string src;
+    for (size_t i = 0; i < 64 * 13 + 5; ++i) {
+        src.push_back (static_cast<char> (i * 3));
+    }
+    SUBCASE ("from sequence 1") {
+        S.setSequence (1);
+        auto const &expected = encode_by_block (S, src);
+        auto const &actual   = encode (S, src);
+        REQUIRE (expected == actual);
+        REQUIRE_EQ (S.getSequence (), 1u + 14u);
+    }
+    SUBCASE ("sequence wraps around without touching the nonce") {
+        S.setSequence (0xFFFFFFFDu);
+        auto const &expected = encode_by_block (S, src);
+        auto const &actual   = encode (S, src);
+        REQUIRE (expected == actual);
+        REQUIRE_EQ (S.getSequence (), 0xFFFFFFFDu + 14u);
+        REQUIRE_EQ (S.state ()[13], 0x09000000u);
+    }
+    SUBCASE ("with offset") {
+        auto const &expected = encode_by_block (S, src);
+        for (size_t off : {0u, 1u, 63u, 64u, 100u, 300u}) {
+            CAPTURE (off);
+            auto const &actual = encode (S, src.substr (off), off);
+            REQUIRE (std::equal (actual.begin (), actual.end (), expected.begin () + off));
+            REQUIRE_EQ (S.getSequence (), src.size () / 64);
+        }
+    }
+}
+
 TEST_CASE ("Test ChaCha::RFC7539 properties") {
     rc::prop ("splitted inputs", [] () {
         auto const  key_size = *rc::gen::element (16, 32).as ("key_size");
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20.hpp>
+#include <chacha20/rng.hpp>
+
+#include "doctest-rapidcheck.hpp"
+#include "fixtures.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+namespace {
+    using fixtures::KEY;
+}  // namespace
+
+TEST_CASE ("Test ChaCha::CounterRNG") {
+    ChaCha::CounterRNG rng {KEY.data (), KEY.size (), 7};
+
+    SUBCASE ("output is the DJB keystream") {
+        std::vector<uint8_t> expected (1000, 0);
+        ChaCha::DJB::State   S {KEY.data (), KEY.size (), 7};
+        ChaCha::apply (S, expected.data (), expected.size ());
+        for (size_t i = 0; i < 40; ++i) {
+            CAPTURE (i);
+            REQUIRE_EQ (rng (), ChaCha::detail::asUInt64 (&expected[8 * i]));
+        }
+        std::vector<uint8_t> rest (expected.size () - 320);
+        rng.generate (rest.data (), 3);
+        rng.generate (rest.data () + 3, rest.size () - 3);
+        REQUIRE (std::equal (rest.begin (), rest.end (), expected.begin () + 320));
+        REQUIRE_EQ (rng.position (), expected.size ());
+    }
+    SUBCASE ("operator () after an odd-sized generate") {
+        auto                 ref = rng;
+        std::vector<uint8_t> expected (ChaCha::CounterRNG::BUFFER_SIZE + 3);
+        std::vector<uint8_t> actual (expected.size ());
+        ref.generate (expected.data (), expected.size ());
+        // Leaves 5 bytes in the buffer, so the last output straddles a refill.
+        for (size_t i = 0; i + 8 < ChaCha::CounterRNG::BUFFER_SIZE; i += 8) {
+            auto v = rng ();
+            ::memcpy (&actual[i], &v, sizeof (v));
+        }
+        rng.generate (&actual[ChaCha::CounterRNG::BUFFER_SIZE - 8], 3);
+        auto v = rng ();
+        ::memcpy (&actual[ChaCha::CounterRNG::BUFFER_SIZE - 5], &v, sizeof (v));
+        REQUIRE (expected == actual);
+        REQUIRE_EQ (rng.position (), ref.position ());
+    }
+    SUBCASE ("jump and seek are draw-and-discard") {
+        auto other = rng;
+        rc::prop ("jump", [&] () {
+            auto const n = *rc::gen::inRange<uint64_t> (0, 300);
+            auto const m = *rc::gen::inRange<uint64_t> (0, 20);
+            rng.seek (m * 8);
+            other.seek (m * 8);
+            for (uint64_t i = 0; i < n; ++i) {
+                rng ();
+            }
+            other.jump (n);
+            RC_ASSERT (rng.position () == other.position ());
+            RC_ASSERT (rng () == other ());
+        });
+    }
+    SUBCASE ("split streams") {
+        auto s0 = rng.split (0);
+        auto s1 = rng.split (1);
+        REQUIRE_NE (s0 (), s1 ());
+        REQUIRE_EQ (rng.split (7) (), ChaCha::CounterRNG (KEY.data (), KEY.size (), 7) ());
+        ChaCha::CounterRNG seeded {12345, 1};
+        REQUIRE_EQ (seeded.split (3) (), ChaCha::CounterRNG (12345, 3) ());
+    }
+    SUBCASE ("uniform") {
+        constexpr size_t    N   = 1001;
+        auto                ref = rng;
+        std::vector<double> d (N);
+        rng.uniform (d.data (), d.size ());
+        for (size_t i = 0; i < N; ++i) {
+            CAPTURE (i);
+            REQUIRE_EQ (d[i], static_cast<double> (ref () >> 11u) * 0x1.0p-53);
+            REQUIRE (0.0 <= d[i]);
+            REQUIRE (d[i] < 1.0);
+        }
+        std::vector<float>    f (N);
+        std::vector<uint32_t> w (N);
+        ref.generate (w.data (), w.size () * sizeof (uint32_t));
+        rng.uniform (f.data (), f.size ());
+        for (size_t i = 0; i < N; ++i) {
+            CAPTURE (i);
+            REQUIRE_EQ (f[i], static_cast<float> (w[i] >> 8u) * 0x1.0p-24f);
+            REQUIRE (f[i] < 1.0f);
+        }
+    }
+    SUBCASE ("bounded") {
+        for (uint32_t bound : {1u, 6u, 1000u, 0x80000001u, 0xFFFFFFFFu}) {
+            CAPTURE (bound);
+            constexpr size_t      N   = 4099;
+            auto                  ref = rng;
+            std::vector<uint32_t> v (N);
+            rng.bounded (v.data (), v.size (), bound);
+            // Same as drawing one word at a time with Lemire's method.
+            const uint32_t        threshold = (0u - bound) % bound;
+            std::vector<uint32_t> words (N);
+            ref.generate (words.data (), words.size () * sizeof (uint32_t));
+            size_t k = 0;
+            for (size_t i = 0; i < N; ++i) {
+                CAPTURE (i);
+                uint64_t m = static_cast<uint64_t> (words[i]) * bound;
+                if (static_cast<uint32_t> (m) < threshold) {
+                    continue; /* redrawn after the bulk words */
+                }
+                REQUIRE (v[i] < bound);
+                REQUIRE_EQ (v[i], static_cast<uint32_t> (m >> 32u));
+                ++k;
+            }
+            if (bound == 0x80000001u) {
+                REQUIRE (k < N); /* rejection rate is about 1/2 here */
+            }
+            for (auto x : v) {
+                REQUIRE (x < bound);
+            }
+        }
+    }
+}
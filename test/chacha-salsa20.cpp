@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20/apply.hpp>
+#include <chacha20/state-salsa20.hpp>
+
+#include "doctest-rapidcheck.hpp"
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+namespace {
+    std::vector<uint8_t> from_hex (const std::string &s) {
+        std::vector<uint8_t> result;
+        for (size_t i = 0; i + 1 < s.size (); i += 2) {
+            result.push_back (static_cast<uint8_t> (std::stoul (s.substr (i, 2), nullptr, 16)));
+        }
+        return result;
+    }
+
+    template<typename T_>
+    std::string to_hex (const T_ &v) {
+        std::string result;
+        for (auto ch : v) {
+            result += fmt::format ("{:02x}", static_cast<uint8_t> (ch));
+        }
+        return result;
+    }
+
+    template<typename State_>
+    std::string keystream (State_ &state, size_t size) {
+        std::vector<uint8_t> result (size, 0);
+        ChaCha::apply (state, result.data (), result.size ());
+        return to_hex (result);
+    }
+}  // namespace
+
+TEST_CASE ("Test ChaCha::Salsa20 with test vectors") {
+    SUBCASE ("ECRYPT set 1, vector 0 (128-bit key)") {
+        std::array<uint8_t, 16> key {0x80};
+        std::array<uint8_t, 8>  nonce {};
+        ChaCha::Salsa20::State  S {key.data (), key.size (), nonce.data (), nonce.size ()};
+        REQUIRE_EQ (keystream (S, 64),
+                    "4dfa5e481da23ea09a31022050859936da52fcee218005164f267cb65f5cfd7f"
+                    "2b4f97e0ff16924a52df269515110a07f9e460bc65ef95da58f740b7d1dbb0aa");
+    }
+    SUBCASE ("256-bit key") {
+        const std::string      key {"0123456789abcdef0123456789abcdef"};
+        const std::string      nonce {"01234567"};
+        ChaCha::Salsa20::State S {key.data (), key.size (), nonce.data (), nonce.size ()};
+        auto const &           stream = keystream (S, 640);
+        REQUIRE_EQ (stream.substr (0, 128),
+                    "af168ea2ebd275e35b40eb2763ad5ed064c2249032daaf2d34e34b357f13e91d"
+                    "d4ebcf5fadb6541953b2dd4457c253a89e4301c33f6ede3800b267fefc884ca3");
+        REQUIRE_EQ (stream.substr (2 * 576, 128),
+                    "a7b4b06254185d39bebd5a7976e2598c64033ec4f2262bd31a48dfe7facb9138"
+                    "18e9788dc844e9b599dcf52bcca13d6b59c607e7cfa453e97d88206721f18d26");
+        REQUIRE_EQ (S.getSequence (), 10);
+
+        // The block counter carries into the high word.
+        S.setSequence (0xFFFFFFFEu);
+        auto const &carry = keystream (S, 8 * 64);
+        REQUIRE_EQ (carry.substr (2 * 128, 128),
+                    "89caa376922af367f38d75aa6f9322af083602202a9e900b5aad868e6f25fcc0"
+                    "95364b7406c9ef3194247a2c51f6d59aa0835d79153457b123b68c45fa7aacb2");
+        S.setSequence (0xFFFFFFFEu);
+        for (size_t i = 0; i < 8; ++i) {
+            CAPTURE (i);
+            REQUIRE_EQ (to_hex (ChaCha::detail::create_mask (S)), carry.substr (128 * i, 128));
+            S.incrementSequence ();
+        }
+    }
+}
+
+TEST_CASE ("Test ChaCha::XSalsa20 with test vectors") {
+    // NaCl: HSalsa20 (the "firstkey" of crypto_box) and the XSalsa20 stream keyed with it.
+    SUBCASE ("HSalsa20") {
+        auto const              shared = from_hex ("4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742");
+        std::array<uint8_t, 32> key {};
+        std::array<uint8_t, 24> nonce {};
+        std::copy (shared.begin (), shared.end (), key.begin ());
+        auto const out = ChaCha::detail::hsalsa20_constexpr (key, nonce);
+        REQUIRE_EQ (to_hex (out), "1b27556473e985d462cd51197a9a46c76009549eac6474f206c4ee0844f68389");
+    }
+    SUBCASE ("stream") {
+        auto const              key   = from_hex ("1b27556473e985d462cd51197a9a46c76009549eac6474f206c4ee0844f68389");
+        auto const              nonce = from_hex ("69696ee955b62b73cd62bda875fc73d68219e0036b7a0b37");
+        ChaCha::XSalsa20::State S {key.data (), key.size (), nonce.data (), nonce.size ()};
+        auto const &            stream = keystream (S, 6 * 64);
+        REQUIRE_EQ (stream.substr (0, 128),
+                    "eea6a7251c1e72916d11c2cb214d3c252539121d8e234e652d651fa4c8cff880"
+                    "309e645a74e9e0a60d8243acd9177ab51a1beb8d5a2f5d700c093c5e55855796");
+        REQUIRE_EQ (stream.substr (2 * 320, 128),
+                    "f57e75ab588e475aaf06f17859dffa799891c4288f6635b5c5a45eee9017fd72"
+                    "feac9d54fc8c115ae247d9a7e919dd76cfcbc72d32cae4944860817cbdfb8c04");
+    }
+}
+
+TEST_CASE ("Test ChaCha::Salsa20 properties") {
+    const std::string key {"0123456789abcdef0123456789abcdef"};
+    const std::string nonce {"01234567"};
+    rc::prop ("split application", [&] () {
+        auto const           size  = *rc::gen::inRange<size_t> (0, 2000);
+        auto const           split = *rc::gen::inRange<size_t> (0, size + 1);
+        std::vector<uint8_t> plain (size);
+        for (size_t i = 0; i < size; ++i) {
+            plain[i] = static_cast<uint8_t> (i * 13);
+        }
+        ChaCha::Salsa20::State S0 {key.data (), key.size (), nonce.data (), nonce.size ()};
+        ChaCha::Salsa20::State S1 {S0};
+        std::vector<uint8_t>   expected (size);
+        std::vector<uint8_t>   actual (size);
+        ChaCha::apply (S0, expected.data (), plain.data (), size);
+        ChaCha::apply (S1, actual.data (), plain.data (), split, 0);
+        ChaCha::apply (S1, actual.data () + split, plain.data () + split, size - split, split);
+        RC_ASSERT (expected == actual);
+    });
+}
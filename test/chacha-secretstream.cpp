@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20/secretstream.hpp>
+
+#include "doctest-rapidcheck.hpp"
+#include "fixtures.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+namespace {
+    using fixtures::KEY;
+    const std::string NONCE {"nonce-012345"};
+
+    std::vector<uint8_t> seal (ChaCha::AEAD::StreamSealer &sealer, const std::string &payload, uint8_t flags, const std::string &aad = {}) {
+        std::vector<uint8_t> chunk (payload.size () + ChaCha::AEAD::STREAM_OVERHEAD);
+        auto n = sealer.seal (chunk.data (), payload.data (), payload.size (), flags, aad.data (), aad.size ());
+        REQUIRE_EQ (n, chunk.size ());
+        return chunk;
+    }
+
+    bool open (ChaCha::AEAD::StreamOpener &opener, const std::vector<uint8_t> &chunk, std::string &payload, const std::string &aad = {}) {
+        payload.assign (chunk.size () - ChaCha::AEAD::STREAM_OVERHEAD, '\0');
+        return opener.open (payload.data (), chunk.data (), chunk.size (), aad.data (), aad.size ());
+    }
+
+    std::string text (size_t size, char seed) {
+        std::string result;
+        for (size_t i = 0; i < size; ++i) {
+            result.push_back (static_cast<char> (seed + i * 13));
+        }
+        return result;
+    }
+}  // namespace
+
+TEST_CASE ("Test ChaCha::AEAD stream") {
+    using namespace ChaCha::AEAD;
+    StreamSealer sealer {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()};
+    StreamOpener opener {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()};
+
+    SUBCASE ("chunk 0 is an RFC 8439 record with the flags prepended to the AAD") {
+        auto const &payload = text (300, 'a');
+        auto const &chunk   = seal (sealer, payload, STREAM_MESSAGE, "header");
+
+        ChaCha::RFC7539::State S {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()};
+        const std::string      aad {std::string (1, '\0') + "header"};
+        std::vector<uint8_t>   cipher (payload.size ());
+        auto const &tag = ChaCha::AEAD::seal (S, cipher.data (), payload.data (), payload.size (), aad.data (), aad.size ());
+        REQUIRE_EQ (chunk[0], STREAM_MESSAGE);
+        REQUIRE (std::equal (cipher.begin (), cipher.end (), chunk.begin () + 1));
+        REQUIRE (std::equal (tag.begin (), tag.end (), chunk.end () - 16));
+    }
+    SUBCASE ("roundtrip with rekeying") {
+        std::vector<std::string>          payloads;
+        std::vector<std::vector<uint8_t>> chunks;
+        for (size_t i = 0; i < 12; ++i) {
+            payloads.push_back (text (i * 1531 % 9000, static_cast<char> (i)));
+            uint8_t flags = i == 11 ? STREAM_FINAL : i % 4 == 3 ? STREAM_REKEY : STREAM_MESSAGE;
+            chunks.push_back (seal (sealer, payloads.back (), flags));
+            if (i == 5) {
+                sealer.rekey ();
+            }
+        }
+        REQUIRE (sealer.finished ());
+        REQUIRE_THROWS_AS (seal (sealer, "more", STREAM_MESSAGE), std::logic_error);
+
+        for (size_t i = 0; i < chunks.size (); ++i) {
+            CAPTURE (i);
+            REQUIRE_FALSE (opener.finished ());
+            std::string payload;
+            REQUIRE (open (opener, chunks[i], payload));
+            REQUIRE_EQ (payload, payloads[i]);
+            if (i == 5) {
+                opener.rekey ();
+            }
+        }
+        REQUIRE (opener.finished ());
+        REQUIRE_EQ (opener.flags (), STREAM_FINAL);
+        std::string payload;
+        REQUIRE_FALSE (open (opener, chunks[0], payload));
+    }
+    SUBCASE ("tampering, reordering and truncation") {
+        auto c0 = seal (sealer, text (100, 'x'), STREAM_MESSAGE);
+        auto c1 = seal (sealer, text (200, 'y'), STREAM_MESSAGE);
+        auto c2 = seal (sealer, text (50, 'z'), STREAM_FINAL);
+
+        std::string payload;
+        REQUIRE_FALSE (open (opener, c1, payload)); // out of order
+        REQUIRE_EQ (payload, std::string (payload.size (), '\0'));
+
+        auto bad = c0;
+        bad[0]   = STREAM_FINAL; // promoting a chunk to the final one
+        REQUIRE_FALSE (open (opener, bad, payload));
+        bad = c0;
+        bad[50] ^= 4u;
+        REQUIRE_FALSE (open (opener, bad, payload));
+        REQUIRE_FALSE (open (opener, c0, payload, "unexpected aad"));
+
+        REQUIRE (open (opener, c0, payload));
+        REQUIRE_EQ (payload, text (100, 'x'));
+        REQUIRE_FALSE (open (opener, c0, payload)); // replay
+        REQUIRE (open (opener, c1, payload));
+        REQUIRE_FALSE (opener.finished ()); // stream cut here would be detected
+        REQUIRE (open (opener, c2, payload));
+        REQUIRE (opener.finished ());
+    }
+}
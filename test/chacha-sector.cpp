@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20.hpp>
+#include <chacha20/block-store.hpp>
+#include <chacha20/lazy-mapping.hpp>
+#include <chacha20/sector.hpp>
+#include <chacha20/state-rfc7539.hpp>
+#include <chacha20/state-salsa20.hpp>
+
+#include "doctest-rapidcheck.hpp"
+#include "fixtures.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+namespace {
+    using fixtures::KEY;
+    using fixtures::NONCE;
+    using fixtures::pattern;
+
+    constexpr size_t SECTOR_SIZE = 512;
+
+    /// @brief Sector `n` is the stream at `n * sector_size`, singly and in (multi-threaded) batches.
+    template<typename State_>
+    void check_stream_offsets (const State_ &state) {
+        ChaCha::SectorCipher cipher {state, SECTOR_SIZE};
+        rc::prop ("same as apply at the sector offset", [&] () {
+            auto const count   = *rc::gen::inRange<size_t> (1, 40);
+            auto const numbers = *rc::gen::container<std::vector<uint64_t>> (count, rc::gen::inRange<uint64_t> (0, 100000));
+            auto const threads = *rc::gen::inRange<size_t> (0, 4);
+
+            std::vector<std::vector<uint8_t>> data;
+            std::vector<ChaCha::SectorBuffer> batch;
+            for (size_t i = 0; i < count; ++i) {
+                data.emplace_back (pattern (SECTOR_SIZE, static_cast<uint8_t> (i)));
+            }
+            for (size_t i = 0; i < count; ++i) {
+                batch.push_back (ChaCha::SectorBuffer {numbers[i], data[i].data ()});
+            }
+            cipher.apply (batch.data (), batch.size (), threads);
+            for (size_t i = 0; i < count; ++i) {
+                auto                 plain = pattern (SECTOR_SIZE, static_cast<uint8_t> (i));
+                std::vector<uint8_t> expected (SECTOR_SIZE);
+                std::vector<uint8_t> single (SECTOR_SIZE);
+                State_               S {state};
+                S.setSequence (0);
+                ChaCha::apply (S, expected.data (), plain.data (), plain.size (), numbers[i] * SECTOR_SIZE);
+                cipher.apply (numbers[i], single.data (), plain.data ());
+                RC_ASSERT (data[i] == expected);
+                RC_ASSERT (single == expected);
+            }
+        });
+    }
+
+    /// @brief A temporary file name (removed on destruction).
+    struct TemporaryPath {
+        std::string path {std::string {"chacha20-sector-"} + std::to_string (reinterpret_cast<uintptr_t> (this)) + ".bin"};
+
+        ~TemporaryPath () { std::remove (path.c_str ()); }
+    };
+}  // namespace
+
+TEST_CASE ("Test ChaCha::SectorCipher") {
+    SUBCASE ("same as the stream") {
+        check_stream_offsets (ChaCha::DJB::State {KEY.data (), KEY.size (), 1234});
+        check_stream_offsets (ChaCha::RFC7539::State {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()});
+        check_stream_offsets (ChaCha::Salsa20::State {KEY.data (), KEY.size (), NONCE.data (), 8});
+    }
+    SUBCASE ("large batches go over threads") {
+        ChaCha::SectorCipher              cipher {ChaCha::DJB::State {KEY.data (), KEY.size (), 1}, 4096};
+        std::vector<uint8_t>              data (1024 * 4096, 0x5A);
+        std::vector<ChaCha::SectorBuffer> batch;
+        for (size_t i = 0; i < 1024; ++i) {
+            batch.push_back (ChaCha::SectorBuffer {1023 - i, &data[i * 4096]});
+        }
+        cipher.apply (batch.data (), batch.size (), 4);
+        cipher.apply (batch.data (), batch.size (), 1);
+        REQUIRE (std::all_of (data.begin (), data.end (), [] (uint8_t v) { return v == 0x5A; }));
+    }
+    SUBCASE ("limits") {
+        ChaCha::RFC7539::State S {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()};
+        REQUIRE_THROWS_AS (ChaCha::SectorCipher (S, 0), std::invalid_argument);
+        REQUIRE_THROWS_AS (ChaCha::SectorCipher (S, 100), std::invalid_argument);
+
+        ChaCha::SectorCipher cipher {S};
+        REQUIRE_EQ (cipher.sector_size (), 4096u);
+        REQUIRE_EQ (cipher.max_sectors (), uint64_t {1} << 26u);
+        std::vector<uint8_t> sector (4096);
+        ChaCha::SectorBuffer batch[] = {{0, sector.data ()}, {uint64_t {1} << 26u, sector.data ()}};
+        REQUIRE_THROWS_AS (cipher.apply (batch, 2), std::out_of_range);
+        REQUIRE (std::all_of (sector.begin (), sector.end (), [] (uint8_t v) { return v == 0; }));
+
+        ChaCha::SectorCipher wide {ChaCha::DJB::State {KEY.data (), KEY.size (), 1}, 64};
+        REQUIRE_EQ (wide.max_sectors (), UINT64_MAX);
+    }
+}
+
+TEST_CASE ("Test ChaCha::BlockStore") {
+    ChaCha::RFC7539::State S {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()};
+    ChaCha::SectorCipher   cipher {S, SECTOR_SIZE};
+    TemporaryPath          file;
+
+    SUBCASE ("round trip") {
+        ChaCha::BlockStore store {file.path, cipher, 64};
+        REQUIRE_EQ (store.sectors (), 64u);
+
+        // Out of order, adjacent runs and a repeated sector (the last one wins).
+        const uint64_t                         numbers[] = {9, 3, 4, 5, 63, 10, 3};
+        std::vector<std::vector<uint8_t>>      plain;
+        std::vector<ChaCha::ConstSectorBuffer> writes;
+        for (size_t i = 0; i < std::size (numbers); ++i) {
+            plain.emplace_back (pattern (SECTOR_SIZE, static_cast<uint8_t> (i)));
+        }
+        for (size_t i = 0; i < std::size (numbers); ++i) {
+            writes.push_back (ChaCha::ConstSectorBuffer {numbers[i], plain[i].data ()});
+        }
+        store.write (writes.data (), writes.size ());
+        REQUIRE (plain[0] == pattern (SECTOR_SIZE, 0));
+
+        std::vector<std::vector<uint8_t>> got (4, std::vector<uint8_t> (SECTOR_SIZE));
+        ChaCha::SectorBuffer              reads[] = {{10, got[0].data ()}, {3, got[1].data ()}, {9, got[2].data ()}, {0, got[3].data ()}};
+        store.read (reads, std::size (reads), 2);
+        REQUIRE (got[0] == plain[5]);
+        REQUIRE (got[1] == plain[6]);
+        REQUIRE (got[2] == plain[0]);
+        // Never written: zeros, decrypted.
+        std::vector<uint8_t> keystream (SECTOR_SIZE);
+        cipher.apply (0, keystream.data (), keystream.data ());
+        REQUIRE (got[3] == keystream);
+
+        ChaCha::SectorBuffer beyond[] = {{64, got[0].data ()}};
+        REQUIRE_THROWS_AS (store.read (beyond, 1), std::out_of_range);
+        store.sync ();
+    }
+    SUBCASE ("the file is one stream") {
+        auto const plain = pattern (8 * SECTOR_SIZE, 1);
+        {
+            ChaCha::BlockStore                     store {file.path, cipher, 8};
+            std::vector<ChaCha::ConstSectorBuffer> writes;
+            for (uint64_t i = 0; i < 8; ++i) {
+                writes.push_back (ChaCha::ConstSectorBuffer {i, &plain[i * SECTOR_SIZE]});
+            }
+            store.write (writes.data (), writes.size ());
+        }
+        if (ChaCha::LazyMapping::supported ()) {
+            ChaCha::LazyMapping m {file.path, S};
+            REQUIRE_EQ (m.size (), plain.size ());
+            REQUIRE (std::equal (plain.begin (), plain.end (), m.data ()));
+        }
+        {
+            // Reopened: the size is kept, and so are the sectors.
+            ChaCha::BlockStore   store {file.path, cipher, 8};
+            std::vector<uint8_t> got (SECTOR_SIZE);
+            ChaCha::SectorBuffer reads[] = {{7, got.data ()}};
+            store.read (reads, 1);
+            REQUIRE (std::equal (got.begin (), got.end (), &plain[7 * SECTOR_SIZE]));
+        }
+    }
+}
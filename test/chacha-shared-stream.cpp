@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20.hpp>
+#include <chacha20/shared-stream.hpp>
+#include <chacha20/state-rfc7539.hpp>
+
+#include "doctest-rapidcheck.hpp"
+#include "fixtures.hpp"
+
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+namespace {
+    using fixtures::KEY;
+    using fixtures::NONCE;
+    using fixtures::pattern;
+
+    /// @brief `writers` threads append records of 1 .. 300 bytes; the result must be one contiguous stream.
+    template<typename State_>
+    void check_concurrent (const State_ &state, size_t writers) {
+        constexpr size_t RECORDS = 500;
+
+        auto const &         plain = pattern (writers * RECORDS * 300);
+        std::vector<uint8_t> out (plain.size ());
+
+        ChaCha::SharedStream<State_> stream {state};
+        std::vector<std::thread>     threads;
+        for (size_t t = 0; t < writers; ++t) {
+            threads.emplace_back ([&, t] () {
+                std::mt19937                          gen {static_cast<uint32_t> (t)};
+                std::uniform_int_distribution<size_t> size {1, 300};
+                for (size_t i = 0; i < RECORDS; ++i) {
+                    auto const n   = size (gen);
+                    auto const off = stream.reserve (n);
+                    stream.apply (off, out.data () + off, plain.data () + off, n);
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join ();
+        }
+        auto const           total = static_cast<size_t> (stream.position ());
+        std::vector<uint8_t> expected (total);
+        State_               S {state};
+        ChaCha::apply (S, expected.data (), plain.data (), total);
+        REQUIRE (std::equal (expected.begin (), expected.end (), out.begin ()));
+    }
+}  // namespace
+
+TEST_CASE ("Test ChaCha::SharedStream") {
+    SUBCASE ("records sharing blocks") {
+        ChaCha::DJB::State S {KEY.data (), KEY.size (), 7};
+        auto const &       plain = pattern (1000);
+        rc::prop ("same as one apply", [&] () {
+            auto const &         sizes = *rc::gen::container<std::vector<size_t>> (rc::gen::inRange<size_t> (0, 100));
+            size_t               total = 0;
+            std::vector<uint8_t> out (plain.size ());
+            ChaCha::SharedStream<ChaCha::DJB::State> s {S, 0};
+            for (auto n : sizes) {
+                if (plain.size () < total + n) {
+                    break;
+                }
+                RC_ASSERT (s.append (out.data () + total, plain.data () + total, n) == total);
+                total += n;
+            }
+            std::vector<uint8_t> expected (total);
+            auto                 S0 = S;
+            ChaCha::apply (S0, expected.data (), plain.data (), total);
+            RC_ASSERT (std::equal (expected.begin (), expected.end (), out.begin ()));
+        });
+    }
+    SUBCASE ("starting position") {
+        ChaCha::DJB::State                       S {KEY.data (), KEY.size (), 7};
+        ChaCha::SharedStream<ChaCha::DJB::State> stream {S, 100};
+        auto const &                             plain = pattern (50);
+        std::vector<uint8_t>                     actual (plain.size ());
+        std::vector<uint8_t>                     expected (plain.size ());
+        REQUIRE_EQ (stream.append (actual.data (), plain.data (), plain.size ()), 100);
+        REQUIRE_EQ (stream.position (), 150);
+        ChaCha::apply (S, expected.data (), plain.data (), plain.size (), 100);
+        REQUIRE_EQ (actual, expected);
+    }
+    SUBCASE ("concurrent writers") {
+        check_concurrent (ChaCha::DJB::State {KEY.data (), KEY.size (), 7}, 4);
+        check_concurrent (ChaCha::RFC7539::State {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()}, 4);
+    }
+}
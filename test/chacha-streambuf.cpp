@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20/state-djb.hpp>
+#include <chacha20/state-rfc7539.hpp>
+#include <chacha20/streambuf.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+namespace {
+    std::string make_message (size_t size) {
+        std::string result;
+        result.reserve (size);
+        for (size_t i = 0; i < size; ++i) {
+            result.push_back (static_cast<char> ('A' + (i * 7) % 26));
+        }
+        return result;
+    }
+
+    template<typename State_>
+    std::string encrypt (State_ state, const std::string &plain) {
+        std::string result (plain.size (), 0);
+        ChaCha::apply (state, result.data (), plain.data (), plain.size (), 0);
+        return result;
+    }
+
+    /// @brief A sink taking at most `limit` bytes per write.
+    class ShortWriteBuf : public std::stringbuf {
+    public:
+        std::streamsize limit = 100;
+
+    protected:
+        std::streamsize xsputn (const char *s, std::streamsize count) override {
+            return std::stringbuf::xsputn (s, std::min (count, limit));
+        }
+    };
+
+    /// @brief A sink counting `pubsync ()` calls.
+    class SyncCountBuf : public std::stringbuf {
+    public:
+        int syncs = 0;
+
+    protected:
+        int sync () override {
+            ++syncs;
+            return std::stringbuf::sync ();
+        }
+    };
+}  // namespace
+
+TEST_CASE ("Test ChaCha::CipherStreamBuf") {
+    const std::string      key {"0123456789abcdef0123456789abcdef"};
+    const std::string      nonce {"0123456789ab"};
+    ChaCha::RFC7539::State S {key.data (), key.size (), nonce.data (), nonce.size ()};
+
+    auto const &plain    = make_message (10000);
+    auto const &expected = encrypt (S, plain);
+
+    SUBCASE ("write a byte at a time") {
+        std::ostringstream sink;
+        {
+            ChaCha::CipherOStream<ChaCha::RFC7539::State> os {sink, S, 256};
+            for (auto ch : plain) {
+                os.put (ch);
+            }
+            os.flush ();
+            REQUIRE_EQ (sink.str ().size (), plain.size ());
+            REQUIRE_EQ (static_cast<size_t> (os.tellp ()), plain.size ());
+        }
+        REQUIRE (sink.str () == expected);
+    }
+    SUBCASE ("keystream continues across flushes") {
+        std::ostringstream sink;
+        {
+            ChaCha::CipherOStream<ChaCha::RFC7539::State> os {sink, S};
+            os.write (plain.data (), 100);
+            os.flush ();
+            os.write (plain.data () + 100, 1);
+            os.flush ();
+            os << plain.substr (101);
+        }
+        REQUIRE (sink.str () == expected);
+    }
+    SUBCASE ("read") {
+        std::istringstream                             source {expected};
+        ChaCha::CipherIStream<ChaCha::RFC7539::State> is {source, S, 1000};
+        std::string                                    actual;
+        SUBCASE ("per character") {
+            char ch;
+            while (is.get (ch)) {
+                actual.push_back (ch);
+            }
+        }
+        SUBCASE ("in large chunks") {
+            actual.resize (plain.size ());
+            is.read (actual.data (), 10);
+            is.read (actual.data () + 10, static_cast<std::streamsize> (actual.size () - 10));
+            REQUIRE_EQ (is.gcount (), static_cast<std::streamsize> (actual.size () - 10));
+        }
+        REQUIRE (actual == plain);
+    }
+    SUBCASE ("random access") {
+        std::istringstream                             source {expected};
+        ChaCha::CipherIStream<ChaCha::RFC7539::State> is {source, S, 512};
+        for (size_t off : {5000u, 0u, 63u, 64u, 9990u, 1234u}) {
+            CAPTURE (off);
+            std::string actual (10, 0);
+            is.seekg (static_cast<std::streamoff> (off));
+            REQUIRE (is.read (actual.data (), static_cast<std::streamsize> (actual.size ())));
+            REQUIRE (actual == plain.substr (off, 10));
+            REQUIRE_EQ (static_cast<size_t> (is.tellg ()), off + 10);
+        }
+        is.seekg (-3, std::ios_base::end);
+        std::string tail (3, 0);
+        REQUIRE (is.read (tail.data (), 3));
+        REQUIRE (tail == plain.substr (plain.size () - 3));
+    }
+    SUBCASE ("overwrite in the middle") {
+        std::stringstream stream {expected};
+        {
+            ChaCha::CipherIOStream<ChaCha::RFC7539::State> io {stream, S, 128};
+            std::string                                     head (50, 0);
+            REQUIRE (io.read (head.data (), 50));
+            REQUIRE (head == plain.substr (0, 50));
+            io.seekp (1000);
+            io << "HELLO";
+            io.seekg (998);
+            std::string mid (9, 0);
+            REQUIRE (io.read (mid.data (), 9));
+            REQUIRE (mid == plain.substr (998, 2) + "HELLO" + plain.substr (1005, 2));
+        }
+        auto modified = plain;
+        modified.replace (1000, 5, "HELLO");
+        REQUIRE (stream.str () == encrypt (S, modified));
+    }
+    SUBCASE ("short writes") {
+        ShortWriteBuf sink;
+        std::ostream  out {&sink};
+        {
+            ChaCha::CipherOStream<ChaCha::RFC7539::State> os {out, S, 256};
+            // The unwritten ciphertext is kept and retried, never encrypted twice.
+            os.write (plain.data (), 250);
+            REQUIRE_FALSE (os.flush ());
+            REQUIRE_EQ (sink.str ().size (), 100u);
+            os.clear ();
+            REQUIRE_FALSE (os.flush ());
+            os.clear ();
+            REQUIRE (os.flush ());
+            REQUIRE_EQ (sink.str ().size (), 250u);
+            REQUIRE_EQ (static_cast<size_t> (os.tellp ()), 250u);
+
+            // Nothing taken at all: the pending output is dropped.
+            sink.limit = 0;
+            os.write (plain.data () + 250, 10);
+            REQUIRE_FALSE (os.flush ());
+            REQUIRE_EQ (sink.str ().size (), 250u);
+            os.clear ();
+            REQUIRE_EQ (static_cast<size_t> (os.tellp ()), 250u);
+
+            sink.limit = static_cast<std::streamsize> (plain.size ());
+            os.write (plain.data () + 250, static_cast<std::streamsize> (plain.size () - 250));
+        }
+        REQUIRE (sink.str () == expected);
+    }
+    SUBCASE ("destruction flushes") {
+        SyncCountBuf sink;
+        std::ostream out {&sink};
+        {
+            ChaCha::CipherOStream<ChaCha::RFC7539::State> os {out, S, 256};
+            os.write (plain.data (), 1000);
+            REQUIRE_EQ (sink.str ().size (), 768u);
+            REQUIRE_EQ (sink.syncs, 0);
+        }
+        REQUIRE_EQ (sink.syncs, 1);
+        REQUIRE (sink.str () == expected.substr (0, 1000));
+    }
+    SUBCASE ("DJB state") {
+        ChaCha::DJB::State D {key.data (), key.size (), 0x1234u};
+        std::ostringstream sink;
+        {
+            ChaCha::CipherOStream<ChaCha::DJB::State> os {sink, D};
+            os << plain;
+        }
+        REQUIRE (sink.str () == encrypt (D, plain));
+    }
+}
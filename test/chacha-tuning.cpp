@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2020 Masashi Fujita
+ */
+
+#include <chacha20/apply.hpp>
+#include <chacha20/parallel.hpp>
+#include <chacha20/state-djb.hpp>
+#include <chacha20/state-rfc7539.hpp>
+#include <chacha20/state-salsa20.hpp>
+#include <chacha20/tuning.hpp>
+
+#include "doctest-rapidcheck.hpp"
+#include "fixtures.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+namespace {
+    using fixtures::KEY;
+    using fixtures::NONCE;
+    using fixtures::pattern;
+
+    /// @brief Restores the installed plan on scope exit.
+    class PlanGuard {
+        ChaCha::Tuning::Plan saved_;
+
+    public:
+        PlanGuard () : saved_ {ChaCha::Tuning::current_plan ()} {}
+        ~PlanGuard () { ChaCha::Tuning::install (saved_); }
+    };
+
+    template<typename State_>
+    void apply_with (ChaCha::Tuning::Backend backend, State_ &state, void *out, const void *in, size_t size) {
+        ChaCha::Tuning::ThreadOverride pin {backend};
+        ChaCha::apply (state, out, in, size);
+    }
+}  // namespace
+
+TEST_CASE ("Test ChaCha::Tuning backends") {
+    using ChaCha::Tuning::Backend;
+    auto const &plain = pattern (64 * 80);
+
+    for (auto backend : {Backend::SSE2, Backend::SSSE3, Backend::AVX2, Backend::AVX512}) {
+        if (! ChaCha::Tuning::available (backend)) {
+            continue;
+        }
+        CAPTURE (ChaCha::Tuning::to_string (backend));
+        // Every run length (and a carry out of the low counter word) against the portable kernel.
+        for (size_t blocks = 1; blocks * 64 <= plain.size (); ++blocks) {
+            CAPTURE (blocks);
+            ChaCha::DJB::State     D {KEY.data (), KEY.size (), 0};
+            ChaCha::RFC7539::State S {KEY.data (), KEY.size (), NONCE.data (), NONCE.size ()};
+            D.setSequence (0xFFFFFFFFu - blocks / 2);
+            auto                 D1 = D;
+            auto                 S1 = S;
+            std::vector<uint8_t> expected (64 * blocks);
+            std::vector<uint8_t> actual (64 * blocks);
+
+            apply_with (Backend::SCALAR, D, expected.data (), plain.data (), expected.size ());
+            apply_with (backend, D1, actual.data (), plain.data (), actual.size ());
+            REQUIRE (expected == actual);
+            REQUIRE_EQ (D.getSequence (), D1.getSequence ());
+
+            apply_with (Backend::SCALAR, S, expected.data (), plain.data (), expected.size ());
+            apply_with (backend, S1, actual.data (), plain.data (), actual.size ());
+            REQUIRE (expected == actual);
+        }
+    }
+}
+
+TEST_CASE ("Test ChaCha::Tuning large-buffer path") {
+    using ChaCha::Tuning::Backend;
+    PlanGuard   guard;
+    auto const &plain = pattern (64 * 70 + 128);
+
+    for (auto backend : {Backend::SSE2, Backend::SSSE3, Backend::AVX2, Backend::AVX512}) {
+        if (! ChaCha::Tuning::available (backend)) {
+            continue;
+        }
+        CAPTURE (ChaCha::Tuning::to_string (backend));
+        for (size_t distance : {0, 64, 4096}) {
+            CAPTURE (distance);
+            auto large              = ChaCha::Tuning::current_plan ();
+            large.large_min_size    = 64;
+            large.prefetch_distance = distance;
+            // Aligned (non-temporal stores), misaligned and in-place outputs.
+            for (size_t skew : {0, 8, 64}) {
+                CAPTURE (skew);
+                for (size_t blocks : {1, 5, 16, 37, 64}) {
+                    CAPTURE (blocks);
+                    ChaCha::DJB::State   D {KEY.data (), KEY.size (), 0};
+                    auto                 D1 = D;
+                    std::vector<uint8_t> expected (64 * blocks);
+                    std::vector<uint8_t> buffer (64 * blocks + 128);
+                    auto const           base   = reinterpret_cast<uintptr_t> (buffer.data ());
+                    auto *               actual = buffer.data () + (64 - base % 64) % 64 + skew % 64;
+
+                    apply_with (Backend::SCALAR, D, expected.data (), plain.data (), expected.size ());
+                    ChaCha::Tuning::install (large);
+                    ChaCha::Tuning::ThreadOverride pin {backend};
+                    if (skew == 64) {
+                        ::memcpy (actual, plain.data (), expected.size ());
+                        ChaCha::apply (D1, actual, expected.size ());
+                    }
+                    else {
+                        ChaCha::apply (D1, actual, plain.data (), expected.size ());
+                    }
+                    REQUIRE (std::equal (expected.begin (), expected.end (), actual));
+                    REQUIRE_EQ (D.getSequence (), D1.getSequence ());
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE ("Test ChaCha::Tuning AVX-512 engagement") {
+    using ChaCha::Tuning::Backend;
+    constexpr uint64_t MS = 1000 * 1000;
+
+    SUBCASE ("hysteresis") {
+        ChaCha::Tuning::BulkMeter meter;
+        auto account = [&meter] (size_t bytes, uint64_t now) { return meter.account (bytes, now, 256 * 1024, 64 * 1024, MS); };
+        // Small messages at a low rate never engage.
+        for (uint64_t i = 0; i < 100; ++i) {
+            REQUIRE_FALSE (account (1024, 10 * MS * i));
+        }
+        // A sustained stream engages once the level reaches 256 KiB...
+        uint64_t now = 1000 * MS;
+        size_t   n   = 0;
+        while (! account (4096, now)) {
+            now += 1000;
+            ++n;
+        }
+        CHECK_LT (n, 100);
+        // ... and stays engaged while decaying (half-life 1 ms) down to 64 KiB, i.e. for about 2 ms.
+        REQUIRE (account (0, now + MS));
+        REQUIRE (account (0, now + 3 * MS / 2));
+        REQUIRE_FALSE (account (0, now + 3 * MS));
+        // Re-engaging needs the higher level again.
+        REQUIRE_FALSE (account (128 * 1024, now + 3 * MS));
+        REQUIRE (account (128 * 1024, now + 3 * MS));
+        // One message large enough engages at once.
+        ChaCha::Tuning::BulkMeter cold;
+        REQUIRE (cold.account (1024 * 1024, 0, 256 * 1024, 64 * 1024, MS));
+    }
+    SUBCASE ("thread override") {
+        REQUIRE_FALSE (ChaCha::Tuning::thread_override ().has_value ());
+        {
+            ChaCha::Tuning::ThreadOverride pin {Backend::SCALAR};
+            REQUIRE_EQ (ChaCha::Tuning::thread_override (), Backend::SCALAR);
+            {
+                ChaCha::Tuning::ThreadOverride inner {Backend::SSE2};
+                if (ChaCha::Tuning::available (Backend::SSE2)) {
+                    REQUIRE_EQ (ChaCha::Tuning::thread_override (), Backend::SSE2);
+                }
+            }
+            REQUIRE_EQ (ChaCha::Tuning::thread_override (), Backend::SCALAR);
+            // Other threads follow the plan.
+            std::optional<Backend> other {Backend::AVX2};
+            std::thread {[&other] () { other = ChaCha::Tuning::thread_override (); }}.join ();
+            REQUIRE_FALSE (other.has_value ());
+        }
+        REQUIRE_FALSE (ChaCha::Tuning::thread_override ().has_value ());
+    }
+}
+
+TEST_CASE ("Test ChaCha::Tuning plans") {
+    using ChaCha::Tuning::Backend;
+    PlanGuard guard;
+
+    SUBCASE ("install") {
+        auto plan = ChaCha::Tuning::default_plan ();
+        REQUIRE_FALSE (plan.calibrated);
+        plan.avx2_min_blocks   = 32;
+        plan.avx512_min_blocks = 128;
+        ChaCha::Tuning::install (plan);
+        auto const &installed = ChaCha::Tuning::current_plan ();
+        REQUIRE_EQ (installed.avx2_min_blocks, ChaCha::Tuning::available (Backend::AVX2) ? 32 : ChaCha::Tuning::NEVER);
+        REQUIRE_EQ (installed.avx512_min_blocks, ChaCha::Tuning::available (Backend::AVX512) ? 128 : ChaCha::Tuning::NEVER);
+        REQUIRE (ChaCha::Tuning::available (installed.baseline));
+    }
+    SUBCASE ("autotune") {
+        auto const &plan = ChaCha::Tuning::autotune (false);
+        REQUIRE (plan.calibrated);
+        REQUIRE (ChaCha::Tuning::available (plan.baseline));
+        REQUIRE_FALSE (ChaCha::Tuning::current_plan ().calibrated);
+        if (! ChaCha::Tuning::available (Backend::AVX2)) {
+            REQUIRE_EQ (plan.avx2_min_blocks, ChaCha::Tuning::NEVER);
+        }
+        REQUIRE_NE (ChaCha::Tuning::describe (plan).find ("autotuned"), std::string::npos);
+    }
+    SUBCASE ("save and load") {
+        auto const path = std::string {"test-chacha20-plan.txt"};
+        auto       plan = ChaCha::Tuning::default_plan ();
+        plan.avx2_min_blocks   = 24;
+        plan.avx512_engage     = 1024 * 1024;
+        plan.large_min_size    = 32 * 1024 * 1024;
+        plan.prefetch_distance = 512;
+        plan.parallel_min_size = ChaCha::Tuning::NEVER;
+        plan.parallel_chunk    = 128 * 1024;
+        plan.calibrated        = true;
+        REQUIRE (ChaCha::Tuning::save (plan, path));
+
+        ChaCha::Tuning::Plan loaded;
+        REQUIRE (ChaCha::Tuning::load (path, loaded));
+        REQUIRE_EQ (loaded.baseline, plan.baseline);
+        REQUIRE_EQ (loaded.avx2_min_blocks, 24);
+        REQUIRE_EQ (loaded.avx512_min_blocks, plan.avx512_min_blocks);
+        REQUIRE_EQ (loaded.avx512_engage, 1024 * 1024);
+        REQUIRE_EQ (loaded.avx512_release, plan.avx512_release);
+        REQUIRE_EQ (loaded.bulk_half_life_us, plan.bulk_half_life_us);
+        REQUIRE_EQ (loaded.large_min_size, 32 * 1024 * 1024);
+        REQUIRE_EQ (loaded.prefetch_distance, 512);
+        REQUIRE_EQ (loaded.parallel_min_size, ChaCha::Tuning::NEVER);
+        REQUIRE_EQ (loaded.parallel_chunk, 128 * 1024);
+        REQUIRE (loaded.calibrated);
+
+        // Plans of other hosts are ignored.
+        {
+            std::ofstream out {path, std::ios::app};
+            out << "host=some other host" << '\n';
+        }
+        REQUIRE_FALSE (ChaCha::Tuning::load (path, loaded));
+        std::remove (path.c_str ());
+        REQUIRE_FALSE (ChaCha::Tuning::load (path, loaded));
+    }
+}
+
+TEST_CASE ("Test ChaCha::parallel_apply") {
+    PlanGuard guard;
+    auto      plan         = ChaCha::Tuning::current_plan ();
+    plan.parallel_min_size = 1024;
+    plan.parallel_chunk    = 192;
+    ChaCha::Tuning::install (plan);
+
+    auto const &plain = pattern (5000);
+    rc::prop ("same as apply", [&] () {
+        auto const             size    = *rc::gen::inRange<size_t> (0, plain.size ());
+        auto const             threads = *rc::gen::inRange<size_t> (0, 5);
+        ChaCha::DJB::State     D {KEY.data (), KEY.size (), 0};
+        ChaCha::Salsa20::State X {KEY.data (), KEY.size (), NONCE.data (), 8};
+        D.setSequence (0xFFFFFFF0u);
+        auto                 D1 = D;
+        auto                 X1 = X;
+        std::vector<uint8_t> expected (size);
+        std::vector<uint8_t> actual (size);
+
+        ChaCha::apply (D, expected.data (), plain.data (), size);
+        ChaCha::parallel_apply (D1, actual.data (), plain.data (), size, threads);
+        RC_ASSERT (expected == actual);
+        RC_ASSERT (D.getSequence () == D1.getSequence ());
+
+        ChaCha::apply (X, expected.data (), plain.data (), size);
+        ChaCha::parallel_apply (X1, actual.data (), plain.data (), size, threads);
+        RC_ASSERT (expected == actual);
+        RC_ASSERT (X.getSequence () == X1.getSequence ());
+    });
+}
@@ -0,0 +1,26 @@
+/*
+ * fixtures.hpp: Keys, nonces and messages shared by the tests.
+ *
+ * Copyright (c) 2020 Masashi Fujita.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fixtures {
+    inline const std::string KEY {"0123456789abcdef0123456789abcdef"};
+    inline const std::string NONCE {"0123456789ab"};
+
+    /// @brief `size` bytes of a fixed pattern (no short period, so misplaced blocks show up).
+    /// @param seed Shifts the pattern (distinct messages of one test)
+    inline std::vector<uint8_t> pattern (size_t size, uint8_t seed = 0) {
+        std::vector<uint8_t> result (size);
+        for (size_t i = 0; i < size; ++i) {
+            result[i] = static_cast<uint8_t> (seed + i * 7 + (i >> 6u));
+        }
+        return result;
+    }
+}  // namespace fixtures